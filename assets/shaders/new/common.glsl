@@ -29,4 +29,13 @@ const float PI = 3.14159265359;
 //     float roughness;
 // } u_Material;
 
+// Inverse of `oct_encode` in mesh_processing.odin.
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 #endif // COMMON_H
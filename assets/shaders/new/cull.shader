@@ -0,0 +1,138 @@
+#version 450 core
+
+// Culling for the GPU driven opaque pass, see gpu_culling.odin. One invocation per object: if it's
+// inside the view frustum it picks a LOD, writes its instance data and appends a draw for it to the
+// bucket of its mesh.
+
+#define MAX_MESH_LODS 4
+// A LOD is used while the mesh covers at least this fraction of the screen height, see `select_lod`.
+#define LOD_SCREEN_SIZE 0.25
+
+// Must match `InstanceData` in global.glsl.
+struct InstanceData {
+    mat4 model;
+    int entity_id;
+    uint material;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+struct MeshLod {
+    uint first_index;
+    uint index_count;
+};
+
+// Must match `GpuMesh` in gpu_culling.odin.
+struct Mesh {
+    MeshLod lods[MAX_MESH_LODS];
+    int vertex_offset;
+    uint lod_count;
+    uint command_base;
+    uint bucket;
+};
+
+// Must match `GpuObject` in gpu_culling.odin.
+struct Object {
+    mat4 model;
+    vec3 bounds_min;
+    uint mesh;
+    vec3 bounds_max;
+    uint material;
+    int entity_id;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    Object data[];
+} b_Objects;
+
+layout(std430, set = 0, binding = 1) readonly buffer Meshes {
+    Mesh data[];
+} b_Meshes;
+
+layout(std430, set = 0, binding = 2) writeonly buffer Commands {
+    DrawCommand data[];
+} b_Commands;
+
+layout(std430, set = 0, binding = 3) buffer Counts {
+    uint data[];
+} b_Counts;
+
+layout(std430, set = 0, binding = 4) writeonly buffer Instances {
+    InstanceData data[];
+} b_Instances;
+
+layout(push_constant) uniform CullPushConstants {
+    // (normal, distance), pointing inwards.
+    vec4 planes[6];
+    // xyz is the view position, w the projection scale.
+    vec4 view;
+    uint object_base;
+    uint object_count;
+    uint instance_base;
+    uint count_base;
+} u_Cull;
+
+#pragma type: compute
+
+layout(local_size_x = 64) in;
+
+bool is_visible(vec3 center, vec3 extents) {
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = u_Cull.planes[i];
+        float distance = dot(plane.xyz, center) + plane.w;
+        float radius = dot(abs(plane.xyz), extents);
+        if (distance < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint select_lod(Mesh mesh, vec3 center, vec3 extents) {
+    float radius = length(extents);
+    float distance = length(center - u_Cull.view.xyz);
+
+    uint lod = 0;
+    if (distance > radius) {
+        float coverage = radius * u_Cull.view.w / distance;
+        float threshold = LOD_SCREEN_SIZE;
+        while (lod < mesh.lod_count - 1 && coverage < threshold) {
+            lod++;
+            threshold *= 0.5;
+        }
+    }
+    return lod;
+}
+
+void Compute() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= u_Cull.object_count) {
+        return;
+    }
+
+    Object object = b_Objects.data[u_Cull.object_base + index];
+    vec3 center = (object.bounds_min + object.bounds_max) * 0.5;
+    vec3 extents = object.bounds_max - center;
+    if (!is_visible(center, extents)) {
+        return;
+    }
+
+    Mesh mesh = b_Meshes.data[object.mesh];
+    MeshLod lod = mesh.lods[select_lod(mesh, center, extents)];
+
+    // Every object has its own instance slot, so only the draws need to be compacted.
+    uint instance = u_Cull.instance_base + index;
+    b_Instances.data[instance] = InstanceData(object.model, object.entity_id, object.material);
+
+    uint slot = atomicAdd(b_Counts.data[u_Cull.count_base + mesh.bucket], 1);
+    b_Commands.data[mesh.command_base + slot] = DrawCommand(lod.index_count, 1, lod.first_index, mesh.vertex_offset, instance);
+}
+
+// vim:ft=glsl
@@ -1,7 +1,7 @@
 #version 450 core
+#include "new/global.glsl"
 
 layout(push_constant) uniform DepthPassPushConstants {
-    mat4 model;
     mat4 light_space;
 } u_PerObjectData;
 
@@ -10,7 +10,8 @@ layout(push_constant) uniform DepthPassPushConstants {
 layout(location = 0) in vec3 position;
 
 void Vertex() {
-    gl_Position = u_PerObjectData.light_space * u_PerObjectData.model * vec4(position, 1.0);
+    mat4 model = b_Instances.data[gl_InstanceIndex].model;
+    gl_Position = u_PerObjectData.light_space * model * vec4(position, 1.0);
 }
 
 #pragma type: fragment
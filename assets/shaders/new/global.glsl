@@ -19,4 +19,16 @@ layout(std140, set = GLOBAL_SET, binding = 1) uniform DebugOptions {
     bool shadow_cascade_colors;
 } u_DebugOptions;
 
+struct InstanceData {
+    mat4 model;
+    int entity_id;
+    // Index into b_Materials, see object.glsl.
+    uint material;
+};
+
+// Indexed with gl_InstanceIndex, which includes the firstInstance of the draw.
+layout(std430, set = GLOBAL_SET, binding = 3) readonly buffer Instances {
+    InstanceData data[];
+} b_Instances;
+
 #endif
\ No newline at end of file
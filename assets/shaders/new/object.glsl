@@ -1,12 +1,42 @@
 #ifndef OBJECT_SET_H
 #define OBJECT_SET_H
 
+#extension GL_EXT_nonuniform_qualifier : require
+
 #define OBJECT_SET 2
 
-layout(std140, set = OBJECT_SET, binding = 0) uniform Material {
+// Must match `MaterialData` in material_table.odin.
+struct MaterialData {
     vec4 albedo_color;
     float metallic;
     float roughness;
-} u_Material;
 
-#endif
\ No newline at end of file
+    // Slots in u_Textures.
+    uint albedo_map;
+    uint normal_map;
+    uint ambient_occlusion_map;
+    uint emissive_map;
+    uint metallic_roughness_map;
+    uint _padding;
+};
+
+layout(std430, set = OBJECT_SET, binding = 0) readonly buffer Materials {
+    MaterialData data[];
+} b_Materials;
+
+layout(set = OBJECT_SET, binding = 1) uniform sampler2D u_Textures[];
+
+// The material comes with the instance, the vertex shader passes it on to a flat v_Material.
+#define u_Material b_Materials.data[v_Material]
+
+vec4 sample_material_texture(uint slot, vec2 uv) {
+    return texture(u_Textures[nonuniformEXT(slot)], uv);
+}
+
+// Cooked normal maps are BC5 and only store X and Y, so Z is always rebuilt.
+vec3 sample_material_normal(uint slot, vec2 uv) {
+    vec2 xy = sample_material_texture(slot, uv).rg * 2.0 - 1.0;
+    return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
+
+#endif
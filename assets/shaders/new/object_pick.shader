@@ -11,10 +11,9 @@ layout(push_constant) uniform PushConstants {
 
 layout(location = 0) in vec3 a_Position;
 
-layout(location = 1) in vec3 a_Normal;
-layout(location = 2) in vec3 a_Tangent;
+layout(location = 1) in vec2 a_Normal;
+layout(location = 2) in vec2 a_Tangent;
 layout(location = 3) in vec2 a_UV;
-layout(location = 4) in vec3 a_Color;
 
 void Vertex() {
     gl_Position =
@@ -5,15 +5,7 @@
 #include "new/scene.glsl"
 #include "new/object.glsl"
 
-layout(push_constant) uniform PushConstants {
-    mat4 model;
-#ifdef EDITOR
-    int local_id;
-#endif
-} u_PushConstants;
-
 struct VertexOutput {
-    vec3 frag_color;
     vec2 frag_uv;
     vec3 frag_pos;
     vec3 normal;
@@ -29,10 +21,10 @@ struct VertexOutput {
 #pragma type: vertex
 
 layout(location = 0) in vec3 a_Position;
-layout(location = 1) in vec3 a_Normal;
-layout(location = 2) in vec3 a_Tangent;
+// Octahedral encoded, see `oct_decode`.
+layout(location = 1) in vec2 a_Normal;
+layout(location = 2) in vec2 a_Tangent;
 layout(location = 3) in vec2 a_UV;
-layout(location = 4) in vec3 a_Color;
 
 const mat4 biasMat = mat4(
     0.5, 0.0, 0.0, 0.0,
@@ -41,20 +33,22 @@ const mat4 biasMat = mat4(
     0.5, 0.5, 0.0, 1.0 );
 
 layout(location = 0) out VertexOutput Out;
+layout(location = 13) flat out uint v_Material;
 void Vertex() {
-    Out.frag_color = a_Color;
     Out.frag_uv = a_UV;
+    v_Material = b_Instances.data[gl_InstanceIndex].material;
 
-    mat3 normal_matrix = transpose(inverse(mat3(u_PushConstants.model)));
-    vec3 T = normalize(normal_matrix * a_Tangent);
-    vec3 N = normalize(normal_matrix * a_Normal);
+    mat4 model = b_Instances.data[gl_InstanceIndex].model;
+    mat3 normal_matrix = transpose(inverse(mat3(model)));
+    vec3 T = normalize(normal_matrix * oct_decode(a_Tangent));
+    vec3 N = normalize(normal_matrix * oct_decode(a_Normal));
     T = normalize(T - dot(T, N) * N);
     vec3 B = cross(N, T);
     mat3 tbn = transpose(mat3(T, B, N));
     Out.TBN = tbn;
 
-    gl_Position = u_ViewData.projection * u_ViewData.view * u_PushConstants.model * vec4(a_Position, 1.0);
-    Out.frag_pos = vec3(u_PushConstants.model * vec4(a_Position, 1.0));
+    gl_Position = u_ViewData.projection * u_ViewData.view * model * vec4(a_Position, 1.0);
+    Out.frag_pos = vec3(model * vec4(a_Position, 1.0));
 
     Out.normal = N;
     Out.tangent_light_dir = tbn * u_LightData.directional.direction.xyz;
@@ -82,6 +76,7 @@ layout(location = 0) out vec4 o_Color;
 #endif */
 
 layout(location = 0) in VertexOutput In;
+layout(location = 13) flat in uint v_Material;
 
 float SampleShadow(float index, vec2 coords, float compare) {
     return step(compare, texture(shadow_map, vec3(coords, index)).r);
@@ -170,8 +165,7 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
 
 vec3 do_directional_light() {
     // vec3 N = normalize(In.normal);
-    vec3 N = texture(normal_map, In.frag_uv).rgb;
-    N = normalize(N * 2.0 - 1);
+    vec3 N = normalize(sample_material_normal(u_Material.normal_map, In.frag_uv));
     // vec3 V = normalize(u_SceneData.view_position.xyz - In.frag_pos);
     vec3 V = normalize(In.tangent_view_pos.xyz - In.tangent_frag_pos);
 
@@ -181,15 +175,15 @@ vec3 do_directional_light() {
     vec3 radiance = u_LightData.directional.color.rgb;
 
     vec3 F0 = vec3(0.04);
-    vec3 albedo = texture(albedo_map, In.frag_uv).rgb;
+    vec3 albedo = sample_material_texture(u_Material.albedo_map, In.frag_uv).rgb;
     // vec3 albedo = vec3(1, 1, 1);
 
-    float metalness = texture(metallic_roughness_map, In.frag_uv).b * u_Material.metallic;
+    float metalness = sample_material_texture(u_Material.metallic_roughness_map, In.frag_uv).b * u_Material.metallic;
     F0 = mix(F0, u_Material.albedo_color.rgb * albedo, metalness);
 
     vec3 F = FrenselSchlick(max(dot(H, V), 0.0), F0);
 
-    float roughness = texture(metallic_roughness_map, In.frag_uv).g * u_Material.roughness;
+    float roughness = sample_material_texture(u_Material.metallic_roughness_map, In.frag_uv).g * u_Material.roughness;
     float NDF = DistributionGGX(N, H, roughness);
     float G = GeometrySmith(N, V, L, roughness);
 
@@ -223,13 +217,13 @@ vec3 do_directional_light() {
     /* vec2 frag_coords = In.frag_pos.xy / In.frag_pos.w;
     vec2 screen_uv = frag_color * 0.5 + 0.5; */
     // float occlusion = texture(s_SSAO,  gl_FragCoord.xy / u_ViewData.screen_size).r;
-    float occlusion = texture(ambient_occlusion_map, In.frag_uv).r;
+    float occlusion = sample_material_texture(u_Material.ambient_occlusion_map, In.frag_uv).r;
 
     vec3 ambient = u_SceneData.ambient_color.rgb * albedo * u_Material.albedo_color.rgb * 0.1;
     ambient *= occlusion;
     vec3 ret = ambient + (kd * u_Material.albedo_color.rgb * albedo / PI + specular + reflection * metalness * ks) * radiance * NdotL * shadow * occlusion;
 
-    ret += texture(emissive_map, In.frag_uv).rgb;
+    ret += sample_material_texture(u_Material.emissive_map, In.frag_uv).rgb;
     if (u_DebugOptions.shadow_cascade_colors) {
         switch(int(index)) {
             case 0 :
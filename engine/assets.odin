@@ -145,8 +145,24 @@ when USE_EDITOR {
                     case .Shader:
                         log_debug(LC.AssetSystem, "Starting shader reload..")
                         shader := get_asset(manager, handle, Shader)
+                        // Builds both stages at the same time.
+                        shader_precompile({metadata.path})
                         shader_reload(shader, metadata.path)
                         log_debug(LC.AssetSystem, "Shader reload finished.")
+                    case:
+                        // Included files are not assets, reload every shader that uses it.
+                        dependents := shader_dependents(path, temp)
+                        if len(dependents) == 0 do break
+
+                        log_debug(LC.AssetSystem, "Reloading %v shaders that include '%v'..", len(dependents), path)
+                        shader_precompile(dependents)
+                        for dependent in dependents {
+                            dependent_handle := get_asset_handle_from_path(manager, dependent)
+                            if shader := get_asset(manager, dependent_handle, Shader); shader != nil {
+                                shader_reload(shader, dependent)
+                            }
+                        }
+                        log_debug(LC.AssetSystem, "Shader reload finished.")
                     }
                 })
         }
@@ -482,6 +498,19 @@ when USE_EDITOR {
         if asset in manager.loaded_assets {
             asset_ptr := manager.loaded_assets[asset]
 
+            #partial switch manager.registry[asset].type {
+            case .Texture2D:
+                // The texture streamer keeps a pointer to streamed textures.
+                destroy_texture2d(cast(^Texture2D)asset_ptr)
+            case .Prefab:
+                // Instances reference the template components. While playing, the edited world is kept aside.
+                prefab_detach_instances(EngineInstance.world, asset)
+                if EditorInstance.state != .Edit {
+                    prefab_detach_instances(&EditorInstance.editor_world, asset)
+                }
+                destroy_prefab(cast(^Prefab)asset_ptr)
+            }
+
             // TODO(minebill): Have some kind of clean up procedure that can be implemented by the assets.
             //                  Possibly, similar to the component system.
             free(asset_ptr)
@@ -50,7 +50,10 @@ import_texture :: proc(metadata: AssetMetadata) -> (asset: ^Asset, error: AssetI
     texture.type = .Texture2D
     path := filepath.join({EditorInstance.active_project.root, metadata.path})
     defer delete(path)
-    texture^, error = import_texture_from_path(path)
+    texture^, error = load_texture_from_file(path)
+    if texture.stream != nil {
+        texture_streamer_add(&Renderer3DInstance.texture_streamer, texture)
+    }
     return texture, error
 }
 
@@ -128,6 +131,48 @@ import_texture_from_path :: proc(path: string) -> (Texture2D, AssetImportError)
     return create_texture2d(spec, raw_image[:size]), {}
 }
 
+// Loads the cooked version of the texture when it's up to date, otherwise decodes the image and cooks it,
+// see texture_processing.odin. Unlike import_texture_from_path the texture gets mips, is compressed and
+// streams its levels from the cooked file (see texture_streamer.odin), once it's added to the streamer.
+load_texture_from_file :: proc(path: string) -> (texture: Texture2D, error: AssetImportError) {
+    tracy.Zone()
+    if !os.exists(path) {
+        return {}, AssetNotFoundError {
+            path = path,
+        }
+    }
+
+    compress := Renderer3DInstance.device.supports_bc_compression
+    if cooked, found := open_cooked_texture(path); found {
+        if compress || gpu.format_block_size(cooked.data.format) == 0 {
+            return create_streamed_texture2d(cooked), nil
+        }
+        // Cooked on a device with BC support, recook it uncompressed.
+        close_cooked_texture(&cooked)
+    }
+
+    w, h, c: i32
+    raw_image := stbi.load(cstr(path), &w, &h, &c, 4)
+    if raw_image == nil {
+        return {}, GenericMessageError {
+            message = strings.clone_from_cstring(stbi.failure_reason()),
+        }
+    }
+    defer stbi.image_free(raw_image)
+
+    texels := mem.slice_data_cast([][4]u8, raw_image[:w * h * 4])
+    data := cook_texture(texels, int(w), int(h), texture_is_normal_map(path, texels), compress)
+    defer destroy_texture_data(&data)
+
+    // Streaming works off the cooked file, without one the texture stays fully resident.
+    if write_cooked_texture(path, data) {
+        if cooked, found := open_cooked_texture(path); found {
+            return create_streamed_texture2d(cooked), nil
+        }
+    }
+    return create_texture2d_from_data(data), nil
+}
+
 @(importer=LuaScript)
 import_script :: proc(metadata: AssetMetadata) -> (asset: ^Asset, error: AssetImportError) {
     tracy.Zone()
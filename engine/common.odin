@@ -173,6 +173,8 @@ vec4i :: [4]i32
 mat3 :: matrix[3, 3]f32
 mat4 :: matrix[4, 4]f32
 
+quat :: quaternion128
+
 Engine_Error :: union #shared_nil {
     enum {
         None,
@@ -20,98 +20,6 @@ import "packages:jolt"
 // If a proc is this type and it is marked with @(constructor=C), it will be used to serialize component C.
 ComponentSerializer :: #type proc(this: rawptr, serialize: bool, s: ^SerializeContext)
 
-// Special case component, every gameobject has a Transform by default.
-@(component, LuaExport = {
-    Name = "Transform",
-    Type = {Full, Light},
-    Fields = {
-        local_position = "position",
-        local_rotation = "rotation",
-        local_scale    = "scale",
-    },
-})
-TransformComponent :: struct {
-    local_position: vec3,
-    local_rotation: vec3,
-    local_scale: vec3,
-
-    position: vec3,
-    rotation: vec3,
-    scale: vec3,
-
-    local_matrix: mat4,
-    global_matrix: mat4,
-
-    dirty: bool,
-}
-
-default_transform :: proc() -> TransformComponent {
-    return {
-        local_scale = vec3{1, 1, 1},
-        local_matrix = mat4(1.0),
-        global_matrix = mat4(1.0),
-    }
-}
-
-@(serializer=TransformComponent)
-serialize_transform :: proc(this: rawptr, serialize: bool, s: ^SerializeContext) {
-    this := cast(^TransformComponent)this
-    if serialize {
-        serialize_do_field(s, "LocalPosition", this.local_position)
-        serialize_do_field(s, "LocalRotation", this.local_rotation)
-        serialize_do_field(s, "LocalScale", this.local_scale)
-    } else {
-        if position, ok := serialize_get_field(s, "LocalPosition", vec3); ok {
-            this.local_position = position
-        }
-        if rotation, ok := serialize_get_field(s, "LocalRotation", vec3); ok {
-            this.local_rotation = rotation
-        }
-        if scale, ok := serialize_get_field(s, "LocalScale", vec3); ok {
-            this.local_scale = scale
-        }
-    }
-}
-
-// Called by the world/gameobject.
-init_transform :: proc(this: ^TransformComponent) {}
-
-// Called by the world/gameobject.
-update_transform :: proc(go: ^Entity, this: ^TransformComponent, update: f64) {
-    tracy.Zone()
-    assert(go != nil, "Entity is nil")
-    parent := get_object(go.world, go.parent)
-
-    s := linalg.matrix4_scale(go.transform.local_scale)
-    rot := go.transform.local_rotation
-    r := linalg.matrix4_from_euler_angles_yxz(
-        rot.y * math.RAD_PER_DEG,
-        rot.x * math.RAD_PER_DEG,
-        rot.z * math.RAD_PER_DEG,
-    )
-    t := linalg.matrix4_translate(go.transform.local_position)
-    go.transform.local_matrix = t * r * s
-
-    if parent == nil {
-        go.transform.global_matrix = go.transform.local_matrix
-    } else {
-        go.transform.global_matrix =  parent.transform.global_matrix * go.transform.local_matrix
-    }
-
-    m := go.transform.global_matrix
-    go.transform.position = vec3{m[0, 3], m[1, 3], m[2, 3]}
-}
-
-set_global_position :: proc(go: ^Entity, pos: vec3) {
-    parent := get_object(go.world, go.parent)
-    if parent == nil {
-        go.transform.local_position = pos
-    } else {
-        // This assumes that the parents global position is correct
-        go.transform.local_position = pos - parent.transform.position
-    }
-}
-
 Level :: log.Level
 
 @(component="Testing")
@@ -296,8 +204,7 @@ mover_update :: proc(this: rawptr, delta: f64) {
     this.timer += f32(delta)
 
     go := get_object(this.world, this.owner)
-    t := &go.transform
-    t.local_position.y = math.sin(this.timer) + this.offset
+    transform_local_position(go)^.y = math.sin(this.timer) + this.offset
 }
 
 @(component="Core/Lights")
@@ -330,17 +237,13 @@ directional_light_debug_draw :: proc(this: rawptr, ctx: ^DebugDrawContext) {
     this := cast(^DirectionalLight)this
     go := get_object(this.world, this.owner)
 
-    rot := go.transform.local_rotation
-    dir_light_quat := linalg.quaternion_from_euler_angles(
-        rot.y * math.RAD_PER_DEG,
-        rot.x * math.RAD_PER_DEG,
-        rot.z * math.RAD_PER_DEG,
-        .YXZ)
+    dir_light_quat := transform_local_rotation(go)^
     dir := linalg.quaternion_mul_vector3(dir_light_quat, vec3{0, 0, -1})
 
-    end := go.transform.position + dir
-    dbg_draw_line(g_dbg_context, go.transform.position, end)
-    dbg_draw_cube(g_dbg_context, end, {}, VEC3_ONE * 0.125)
+    position := transform_world_position(go)
+    end := position + dir
+    dbg_draw_line(g_dbg_context, position, end)
+    dbg_draw_cube(g_dbg_context, end, 1, VEC3_ONE * 0.125)
 }
 
 @(serializer=DirectionalLight)
@@ -381,6 +284,7 @@ CubemapComponent :: struct {
 make_cubemap :: proc() -> rawptr {
     cube := new(CubemapComponent)
     cube.base = default_component_constructor()
+    cube.copy = component_shallow_copy(CubemapComponent)
 
     // Hardcoded cubemap
     images :: [?]string {
@@ -459,15 +363,10 @@ camera_debug_draw :: proc(this: rawptr, ctx: ^DebugDrawContext) {
     this := cast(^Camera)this
     entity := get_object(this.world, this.owner)
 
-    euler := entity.transform.local_rotation
-    this.rotation = linalg.quaternion_from_euler_angles(
-        euler.y * math.RAD_PER_DEG,
-        euler.x * math.RAD_PER_DEG,
-        euler.z * math.RAD_PER_DEG,
-        .YXZ)
+    this.rotation = transform_local_rotation(entity)^
 
     this.view = linalg.matrix4_from_quaternion(this.rotation) *
-                    linalg.inverse(linalg.matrix4_translate(entity.transform.position))
+                    linalg.inverse(linalg.matrix4_translate(transform_world_position(entity)))
     this.projection = linalg.matrix4_perspective_f32(math.to_radians(f32(this.fov)), f32(EngineInstance.screen_size.x) / f32(EngineInstance.screen_size.y), this.near_plane, this.far_plane)
     corners := get_frustum_corners_world_space(
         this.projection,
@@ -566,6 +465,8 @@ script_copy :: proc(this: rawptr) -> rawptr {
     script.script_fields = clone(this.script_fields)
     script.scripts = clone(this.scripts)
     script.instances = clone(this.instances)
+    // The copy may be in another world, it gets an instance from that world's VM in script_init.
+    script.instance = {}
 
     return script
 }
@@ -573,9 +474,6 @@ script_copy :: proc(this: rawptr) -> rawptr {
 script_init :: proc(this: rawptr) {
     tracy.Zone()
     this := cast(^ScriptComponent)this
-    // this.script = cast(^LuaScript)load_asset(this.script.path, LuaScript, this.script.id)
-    // this.instance = create_script_instance(this.script)
-
     go := get_object(this.world, this.owner)
     this.lua_entity = LuaEntity{
         world = this.world,
@@ -584,12 +482,17 @@ script_init :: proc(this: rawptr) {
     }
 
     script := get_asset(&EngineInstance.asset_manager, this.script, LuaScript)
+    if script != nil && !is_script_instance_valid(this.instance) {
+        this.instance = create_script_instance(&this.world.scripts, this.script, script)
+    }
     if script != nil  && is_script_instance_valid(this.instance) {
         L := this.instance.state
 
         stack_before := lua.gettop(L)
 
         lua.newtable(L)
+        lua.rawgeti(L, lua.REGISTRYINDEX, this.instance.metatable)
+        lua.setmetatable(L, -2)
 
         this.instance.instance_table = i64(luaL.ref(L, lua.REGISTRYINDEX))
         lua.rawgeti(L, lua.REGISTRYINDEX, this.instance.instance_table)
@@ -614,6 +517,7 @@ script_init :: proc(this: rawptr) {
 
         if lua.gettop(L)+2 > lua.MINSTACK {
             log.error("Lua stack overflow: Insufficient space to push values.")
+            lua.settop(L, stack_before)
             return
         }
 
@@ -644,11 +548,13 @@ script_update :: proc(this: rawptr, delta: f64) {
         lua.rawgeti(L, lua.REGISTRYINDEX, this.instance.on_update)
         if !lua.isfunction(L, -1) {
             log.error("init_ref is not a function")
+            lua.settop(L, stack_before)
             return
         }
 
         if lua.gettop(L)+2 > lua.MINSTACK {
             log.error("Lua stack overflow: Insufficient space to push values.")
+            lua.settop(L, stack_before)
             return
         }
 
@@ -670,6 +576,11 @@ script_update :: proc(this: rawptr, delta: f64) {
 script_destroy :: proc(this: rawptr) {
     this := cast(^ScriptComponent)this
 
+    if is_script_instance_valid(this.instance) && this.instance.instance_table != 0 {
+        luaL.unref(this.instance.state, lua.REGISTRYINDEX, i32(this.instance.instance_table))
+    }
+    this.instance = {}
+
     for name, _ in this.script_fields {
         delete(name)
     }
@@ -813,7 +724,6 @@ serialize_script_component :: proc(this: rawptr, serialize: bool, s: ^SerializeC
 
         script := get_asset(&EngineInstance.asset_manager, this.script, LuaScript)
         if script != nil {
-            this.instance = create_script_instance(script)
             if len(this.script_fields) != len(script.properties.fields) {
                 for name, field in script.properties.fields {
                     name := strings.clone(name)
@@ -850,8 +760,8 @@ box_collider_debug_draw :: proc(this: rawptr, d: ^DebugDrawContext) {
     this := cast(^BoxColliderComponent) this
     entity := get_object(this.world, this.owner)
 
-    size := this.half_extent * 2 * entity.transform.local_scale
-    dbg_draw_cube(d, entity.transform.position, entity.transform.local_rotation, size)
+    size := this.half_extent * 2 * transform_local_scale(entity)^
+    dbg_draw_cube(d, transform_world_position(entity), transform_local_rotation(entity)^, size)
 }
 
 @(serializer = BoxColliderComponent)
@@ -891,7 +801,7 @@ sphere_collider_debug_draw :: proc(this: rawptr, d: ^DebugDrawContext) {
     this := cast(^SphereColliderComponent) this
     entity := get_object(this.world, this.owner)
 
-    dbg_draw_sphere(d, entity.transform.position, entity.transform.local_rotation, this.radius)
+    dbg_draw_sphere(d, transform_world_position(entity), transform_local_rotation(entity)^, this.radius)
 }
 
 @(serializer = SphereColliderComponent)
@@ -947,7 +857,7 @@ rigid_body_init :: proc(this: rawptr) {
     case has_component(this.world, this.owner, BoxColliderComponent):
         box_collider := get_component(this.world, this.owner, BoxColliderComponent)
 
-        extent := box_collider.half_extent * entity.transform.local_scale
+        extent := box_collider.half_extent * transform_local_scale(entity)^
         sphere_shape_settings := jolt.BoxShapeSettings_Create(&extent)
         sphere_shape = jolt.ShapeSettings_CreateShape(cast(^jolt.ShapeSettings) sphere_shape_settings)
     case has_component(this.world, this.owner, SphereColliderComponent):
@@ -960,15 +870,14 @@ rigid_body_init :: proc(this: rawptr) {
         return
     }
 
-    euler_angles := entity.transform.local_rotation
-    quat := linalg.quaternion_from_euler_angles(euler_angles.y, euler_angles.x, euler_angles.z, .YXZ)
-    quat_to_vec4 := transmute(vec4)quat
+    // Jolt takes the quaternion as x, y, z, w, the same layout as ours.
+    quat_to_vec4 := transmute(vec4)transform_local_rotation(entity)^
     sphere_body_settings: jolt.BodyCreationSettings
 
     jolt.BodyCreationSettings_Set(
         &sphere_body_settings,
         sphere_shape,
-        &entity.transform.local_position,
+        transform_local_position(entity),
         &quat_to_vec4,
         body_type_to_jolt(this.body_type),
         jolt.ObjectLayer(ObjectLayers.Moving))
@@ -1002,16 +911,11 @@ rigid_body_update :: proc(this: rawptr, delta: f64) {
     r: vec4
     jolt.BodyInterface_GetRotation(physics.body_interface, this.body_id, &r)
 
-    rotation := transmute(quaternion128)r
+    rotation := transmute(quat)r
 
     entity := get_object(this.world, this.owner)
     set_global_position(entity, position)
-
-    y, x, z := linalg.euler_angles_from_quaternion(rotation, .YXZ)
-    entity.transform.local_rotation = vec3{
-        x * math.DEG_PER_RAD,
-        y * math.DEG_PER_RAD,
-        z * math.DEG_PER_RAD}
+    transform_local_rotation(entity)^ = rotation
 }
 
 rigid_body_destroy :: proc(this: rawptr) {
@@ -0,0 +1,291 @@
+package engine
+import "core:math/linalg"
+import tracy "packages:odin-tracy"
+
+AABB :: struct {
+    min, max: vec3,
+}
+
+aabb_center :: proc(aabb: AABB) -> vec3 {
+    return (aabb.min + aabb.max) * 0.5
+}
+
+aabb_merge :: proc(a, b: AABB) -> AABB {
+    return {
+        min = {min(a.min.x, b.min.x), min(a.min.y, b.min.y), min(a.min.z, b.min.z)},
+        max = {max(a.max.x, b.max.x), max(a.max.y, b.max.y), max(a.max.z, b.max.z)},
+    }
+}
+
+aabb_add_point :: proc(aabb: ^AABB, point: vec3) {
+    aabb^ = aabb_merge(aabb^, {point, point})
+}
+
+// Returns an AABB that contains `aabb` after being transformed by `m`.
+aabb_transform :: proc(aabb: AABB, m: mat4) -> AABB {
+    center := aabb_center(aabb)
+    extents := aabb.max - center
+
+    new_center := (m * vec4{center.x, center.y, center.z, 1}).xyz
+    new_extents: vec3
+    for i in 0..<3 {
+        new_extents[i] =
+            abs(m[i, 0]) * extents.x +
+            abs(m[i, 1]) * extents.y +
+            abs(m[i, 2]) * extents.z
+    }
+
+    return {
+        min = new_center - new_extents,
+        max = new_center + new_extents,
+    }
+}
+
+EMPTY_AABB :: AABB {
+    min = {max(f32), max(f32), max(f32)},
+    max = {min(f32), min(f32), min(f32)},
+}
+
+FrustumPlane :: enum {
+    Left,
+    Right,
+    Bottom,
+    Top,
+    Near,
+    Far,
+}
+
+// Planes are stored as (normal, distance), pointing inwards.
+Frustum :: struct {
+    planes: [FrustumPlane]vec4,
+    // Planes that are not tested. Shadow cascades skip near/far so casters
+    // outside the cascade volume still cast shadows into it.
+    ignored: bit_set[FrustumPlane],
+}
+
+frustum_from_matrix :: proc(view_projection: mat4, ignored: bit_set[FrustumPlane] = {}) -> (frustum: Frustum) {
+    m := linalg.transpose(view_projection)
+    frustum.planes[.Left]   = m[3] + m[0]
+    frustum.planes[.Right]  = m[3] - m[0]
+    frustum.planes[.Bottom] = m[3] + m[1]
+    frustum.planes[.Top]    = m[3] - m[1]
+    frustum.planes[.Near]   = m[3] + m[2]
+    frustum.planes[.Far]    = m[3] - m[2]
+
+    for &plane in frustum.planes {
+        plane /= linalg.length(plane.xyz)
+    }
+    frustum.ignored = ignored
+    return
+}
+
+CullResult :: enum {
+    Outside,
+    Intersecting,
+    Inside,
+}
+
+frustum_test_aabb :: proc(frustum: Frustum, aabb: AABB) -> CullResult {
+    center := aabb_center(aabb)
+    extents := aabb.max - center
+
+    result := CullResult.Inside
+    for plane, kind in frustum.planes do if kind not_in frustum.ignored {
+        distance := linalg.dot(plane.xyz, center) + plane.w
+        radius := abs(plane.x) * extents.x + abs(plane.y) * extents.y + abs(plane.z) * extents.z
+
+        if distance < -radius {
+            return .Outside
+        }
+        if distance < radius {
+            result = .Intersecting
+        }
+    }
+    return result
+}
+
+CullItem :: struct {
+    bounds: AABB,
+    renderer: ^MeshRenderer,
+    // Not `renderer.owner`, prefab instances share the renderer of their template.
+    owner: EntityHandle,
+}
+
+BVHNode :: struct {
+    bounds: AABB,
+    // For leaves, the range of items. For internal nodes, `first` is the index of the left child
+    // and the right child immediately follows it.
+    first, count: int,
+    is_leaf: bool,
+}
+
+// A bounding volume hierarchy over the mesh renderers of a scene. It's cheap enough to rebuild every frame
+// for the entity counts we have, which avoids having to track transform changes.
+CullingBVH :: struct {
+    nodes: [dynamic]BVHNode,
+    items: [dynamic]CullItem,
+}
+
+BVH_LEAF_SIZE :: 4
+
+bvh_clear :: proc(bvh: ^CullingBVH) {
+    clear(&bvh.nodes)
+    clear(&bvh.items)
+}
+
+bvh_destroy :: proc(bvh: ^CullingBVH) {
+    delete(bvh.nodes)
+    delete(bvh.items)
+}
+
+bvh_add :: proc(bvh: ^CullingBVH, bounds: AABB, renderer: ^MeshRenderer, owner: EntityHandle) {
+    append(&bvh.items, CullItem{bounds, renderer, owner})
+}
+
+// Builds the hierarchy over the items added with bvh_add.
+bvh_build :: proc(bvh: ^CullingBVH) {
+    tracy.Zone()
+    clear(&bvh.nodes)
+    if len(bvh.items) == 0 {
+        return
+    }
+
+    build_node :: proc(bvh: ^CullingBVH, node_index, first, count: int) {
+        items := bvh.items[first:first + count]
+
+        bounds := EMPTY_AABB
+        centers := EMPTY_AABB
+        for item in items {
+            bounds = aabb_merge(bounds, item.bounds)
+            aabb_add_point(&centers, aabb_center(item.bounds))
+        }
+
+        if count <= BVH_LEAF_SIZE {
+            bvh.nodes[node_index] = {bounds = bounds, first = first, count = count, is_leaf = true}
+            return
+        }
+
+        // Split along the longest axis of the centers, at the midpoint.
+        size := centers.max - centers.min
+        axis := 0
+        if size.y > size[axis] do axis = 1
+        if size.z > size[axis] do axis = 2
+        split := (centers.min[axis] + centers.max[axis]) * 0.5
+
+        mid := 0
+        for i in 0..<len(items) {
+            if aabb_center(items[i].bounds)[axis] < split {
+                items[i], items[mid] = items[mid], items[i]
+                mid += 1
+            }
+        }
+
+        // All the centers are in the same spot, just split in half.
+        if mid == 0 || mid == count {
+            mid = count / 2
+        }
+
+        left := len(bvh.nodes)
+        append(&bvh.nodes, BVHNode{}, BVHNode{})
+        bvh.nodes[node_index] = {bounds = bounds, first = left, count = count, is_leaf = false}
+
+        build_node(bvh, left, first, mid)
+        build_node(bvh, left + 1, first + mid, count - mid)
+    }
+
+    reserve(&bvh.nodes, 2 * len(bvh.items) / BVH_LEAF_SIZE + 1)
+    append(&bvh.nodes, BVHNode{})
+    build_node(bvh, 0, 0, len(bvh.items))
+}
+
+// Appends all the items that are inside or intersect the frustum to `visible`.
+bvh_cull :: proc(bvh: ^CullingBVH, frustum: Frustum, visible: ^[dynamic]CullItem) {
+    tracy.Zone()
+    if len(bvh.nodes) == 0 {
+        return
+    }
+
+    // The whole node is visible, no need to test anything below it.
+    append_node :: proc(bvh: ^CullingBVH, node_index: int, visible: ^[dynamic]CullItem) {
+        node := bvh.nodes[node_index]
+        if node.is_leaf {
+            append(visible, ..bvh.items[node.first:node.first + node.count])
+        } else {
+            append_node(bvh, node.first, visible)
+            append_node(bvh, node.first + 1, visible)
+        }
+    }
+
+    cull_node :: proc(bvh: ^CullingBVH, node_index: int, frustum: Frustum, visible: ^[dynamic]CullItem) {
+        node := bvh.nodes[node_index]
+
+        switch frustum_test_aabb(frustum, node.bounds) {
+        case .Outside:
+            return
+        case .Inside:
+            append_node(bvh, node_index, visible)
+        case .Intersecting:
+            if node.is_leaf {
+                for item in bvh.items[node.first:node.first + node.count] {
+                    if frustum_test_aabb(frustum, item.bounds) != .Outside {
+                        append(visible, item)
+                    }
+                }
+            } else {
+                cull_node(bvh, node.first, frustum, visible)
+                cull_node(bvh, node.first + 1, frustum, visible)
+            }
+        }
+    }
+
+    cull_node(bvh, 0, frustum, visible)
+}
+
+// Distance along the ray to the AABB, 0 when the origin is inside it.
+ray_test_aabb :: proc(origin, inverse_direction: vec3, aabb: AABB) -> (distance: f32, hit: bool) {
+    t0 := (aabb.min - origin) * inverse_direction
+    t1 := (aabb.max - origin) * inverse_direction
+    near := linalg.max(linalg.min(t0, t1))
+    far := linalg.min(linalg.max(t0, t1))
+    if far < max(near, 0) {
+        return
+    }
+    return max(near, 0), true
+}
+
+// Returns the item with the closest bounds along the ray. Only the bounds are tested, not the triangles.
+bvh_raycast :: proc(bvh: ^CullingBVH, origin, direction: vec3) -> (item: CullItem, distance: f32, hit: bool) {
+    tracy.Zone()
+    if len(bvh.nodes) == 0 {
+        return
+    }
+
+    Ray :: struct {
+        origin, inverse_direction: vec3,
+    }
+
+    raycast_node :: proc(bvh: ^CullingBVH, node_index: int, ray: Ray, closest_item: ^CullItem, closest: ^f32) {
+        node := bvh.nodes[node_index]
+        t, hit := ray_test_aabb(ray.origin, ray.inverse_direction, node.bounds)
+        if !hit || t >= closest^ {
+            return
+        }
+
+        if node.is_leaf {
+            for item in bvh.items[node.first:node.first + node.count] {
+                if t, hit := ray_test_aabb(ray.origin, ray.inverse_direction, item.bounds); hit && t < closest^ {
+                    closest^ = t
+                    closest_item^ = item
+                }
+            }
+        } else {
+            raycast_node(bvh, node.first, ray, closest_item, closest)
+            raycast_node(bvh, node.first + 1, ray, closest_item, closest)
+        }
+    }
+
+    ray := Ray{origin, 1 / direction}
+    distance = max(f32)
+    raycast_node(bvh, 0, ray, &item, &distance)
+    return item, distance, item.renderer != nil
+}
@@ -103,17 +103,14 @@ dbg_draw_line :: proc(d: ^DebugDrawContext, s, e: vec3, thickness: f32 = 1.0, co
     }
 }
 
-dbg_draw_cube :: proc(d: ^DebugDrawContext, center: vec3, angles: vec3, size: vec3, thickness: f32 = 1.0, color := COLOR_GREEN, time := f32(0)) {
+dbg_draw_cube :: proc(d: ^DebugDrawContext, center: vec3, rotation: quat, size: vec3, thickness: f32 = 1.0, color := COLOR_GREEN, time := f32(0)) {
     half := size / 2
 
     AXIS_X :: vec3{1, 0, 0}
     AXIS_Y :: vec3{0, 1, 0}
     AXIS_Z :: vec3{0, 0, 1}
 
-    rot := linalg.matrix3_from_euler_angles_yxz(
-             angles.y * math.RAD_PER_DEG,
-             angles.x * math.RAD_PER_DEG,
-             angles.z * math.RAD_PER_DEG)
+    rot := linalg.matrix3_from_quaternion(rotation)
 
     dbg_draw_line(d, center + rot * (vec3{-1, -1, 1}   * half), center + rot * (vec3{1, -1, 1}   * half), thickness, color, time)
     dbg_draw_line(d, center + rot * (vec3{-1, 1,  1}   * half), center + rot * (vec3{1, 1,  1}   * half), thickness, color, time)
@@ -137,7 +134,7 @@ dbg_draw_cube :: proc(d: ^DebugDrawContext, center: vec3, angles: vec3, size: ve
 dbg_draw_sphere :: proc(
     d: ^DebugDrawContext,
     #no_broadcast center: vec3,
-    #no_broadcast euler_rotation: vec3 = {},
+    rotation: quat = 1,
     radius: f32 = 1.0,
     thickness: f32 = 1.0,
     color := COLOR_GREEN,
@@ -147,10 +144,7 @@ dbg_draw_sphere :: proc(
     LATITUDE_SEGMENTS :: SEGMENTS
     LONGITUDE_SEGMENTS :: SEGMENTS
 
-    rot := linalg.matrix3_from_euler_angles_yxz(
-             euler_rotation.y * math.RAD_PER_DEG,
-             euler_rotation.x * math.RAD_PER_DEG,
-             euler_rotation.z * math.RAD_PER_DEG)
+    rot := linalg.matrix3_from_quaternion(rotation)
 
     // Draw latitude lines
     for lat in 0..<LATITUDE_SEGMENTS {
@@ -0,0 +1,324 @@
+package engine
+import "core:math/linalg"
+import "core:sync"
+import tracy "packages:odin-tracy"
+
+// Rendering a pass happens in three stages:
+//  1. Extraction: the visible renderers are turned into draw packets. This is where all the
+//     asset lookups happen (meshes, materials and their textures).
+//  2. Sorting: the packets are radix sorted by their 64 bit key.
+//  3. Recording: the sorted packets are walked and turned into (instanced) draw calls,
+//     only touching GPU state when it changes.
+//
+// LODs are picked during extraction, from the screen size of the mesh bounds.
+//
+// Packets don't depend on each other, so extraction could be split across threads, as long as
+// every thread gets its own list. Material table updates (`material_table_material`) are not thread safe though.
+
+DrawPass :: enum u8 {
+    Opaque,
+    Shadow,
+}
+
+DrawPipeline :: enum u8 {
+    Object,
+    Depth,
+}
+
+// Layout of a sort key, from the most significant bit:
+//  | pass: 4 | pipeline: 8 | material: 16 | mesh: 16 | depth: 20 |
+// Material and mesh are dense per list ids, not asset handles.
+DRAW_KEY_DEPTH_BITS    :: 20
+DRAW_KEY_MESH_BITS     :: 16
+DRAW_KEY_MATERIAL_BITS :: 16
+DRAW_KEY_PIPELINE_BITS :: 8
+
+DRAW_KEY_MESH_SHIFT     :: DRAW_KEY_DEPTH_BITS
+DRAW_KEY_MATERIAL_SHIFT :: DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS
+DRAW_KEY_PIPELINE_SHIFT :: DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS
+DRAW_KEY_PASS_SHIFT     :: DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS
+
+make_draw_key :: proc(pass: DrawPass, pipeline: DrawPipeline, material, mesh: u32, depth: f32) -> u64 {
+    max_depth :: (1 << DRAW_KEY_DEPTH_BITS) - 1
+    quantized := u64(clamp(depth, 0, 1) * max_depth)
+
+    return u64(pass) << DRAW_KEY_PASS_SHIFT |
+        u64(pipeline) << DRAW_KEY_PIPELINE_SHIFT |
+        u64(material) << DRAW_KEY_MATERIAL_SHIFT |
+        u64(mesh) << DRAW_KEY_MESH_SHIFT |
+        quantized
+}
+
+// A LOD is used while the mesh covers at least this fraction of the screen height,
+// the threshold halves for every following LOD.
+LOD_SCREEN_SIZE :: 0.25
+
+// The view a list is extracted for.
+DrawView :: struct {
+    position: vec3,
+    far: f32,
+    // projection[1][1], the cotangent of half the vertical fov.
+    projection_scale: f32,
+    // Added to the selected LOD, shadow passes can get away with coarser meshes.
+    lod_bias: int,
+    // Set for orthographic views, like the shadow cascades, to half the height they cover. The LOD then
+    // only depends on the size of the mesh, not on where `position` is.
+    ortho_extent: f32,
+}
+
+make_draw_view :: proc(camera: RenderCamera, lod_bias := 0) -> DrawView {
+    return {
+        position = camera.position,
+        far = camera.far,
+        projection_scale = abs(camera.projection[1][1]),
+        lod_bias = lod_bias,
+    }
+}
+
+select_lod :: proc(view: DrawView, mesh: ^Mesh, world_bounds: AABB) -> int {
+    center := aabb_center(world_bounds)
+    radius := linalg.length(world_bounds.max - center)
+    distance := linalg.length(center - view.position)
+
+    lod := 0
+    if view.ortho_extent > 0 || distance > radius {
+        // Fraction of the screen height covered by the bounding sphere.
+        coverage := radius * view.projection_scale / distance
+        if view.ortho_extent > 0 {
+            coverage = radius / view.ortho_extent
+        }
+        threshold := f32(LOD_SCREEN_SIZE)
+        for lod < mesh.lod_count - 1 && coverage < threshold {
+            lod += 1
+            threshold *= 0.5
+        }
+    }
+    return clamp(lod + view.lod_bias, 0, max(mesh.lod_count - 1, 0))
+}
+
+DrawPacket :: struct {
+    mesh: ^Mesh,
+    mesh_handle: AssetHandle,
+    lod: u8,
+    // Index into `DrawList.materials`.
+    material: u32,
+    model: mat4,
+    entity_id: i32,
+}
+
+DrawListMaterial :: struct {
+    handle: AssetHandle,
+    // What the instances with this material get, see `material_table_material`.
+    index: u32,
+}
+
+DrawKey :: struct {
+    key: u64,
+    packet: u32,
+}
+
+// Every LOD of a mesh gets its own id, so they sort (and instance) separately.
+DrawMeshKey :: struct {
+    handle: AssetHandle,
+    lod: u8,
+}
+
+DrawList :: struct {
+    pass: DrawPass,
+    packets: [dynamic]DrawPacket,
+    // Sorted by draw_list_sort, the packets themselves never move.
+    keys: [dynamic]DrawKey,
+
+    materials: [dynamic]DrawListMaterial,
+    material_ids: map[AssetHandle]u32,
+    mesh_ids: map[DrawMeshKey]u32,
+}
+
+// Draw lists are rebuilt every frame, so they live in the temp allocator by default.
+make_draw_list :: proc(pass: DrawPass, capacity := 0, allocator := context.temp_allocator) -> (list: DrawList) {
+    list.pass = pass
+    list.packets = make([dynamic]DrawPacket, 0, capacity, allocator)
+    list.keys = make([dynamic]DrawKey, 0, capacity, allocator)
+    list.materials = make([dynamic]DrawListMaterial, allocator)
+    list.material_ids = make(map[AssetHandle]u32, allocator = allocator)
+    list.mesh_ids = make(map[DrawMeshKey]u32, allocator = allocator)
+    return
+}
+
+// Extraction stage. The view is used to pick the LODs and to sort opaque draws front to back.
+draw_list_extract :: proc(
+    r: ^Renderer3D,
+    list: ^DrawList,
+    scene: ^World,
+    renderers: []CullItem,
+    view: DrawView,
+) {
+    tracy.Zone()
+    manager := &EngineInstance.asset_manager
+
+    for item in renderers {
+        mr := item.renderer
+        mesh := get_asset(manager, mr.mesh, Mesh)
+        if mesh == nil do continue
+        go := get_object(scene, item.owner)
+        if go == nil do continue
+
+        lod := u8(select_lod(view, mesh, aabb_transform(mesh.bounds, transform_world_matrix(go))))
+        mesh_key := DrawMeshKey{mr.mesh, lod}
+        mesh_id, found := list.mesh_ids[mesh_key]
+        if !found {
+            mesh_id = u32(len(list.mesh_ids))
+            if mesh_id >= 1 << DRAW_KEY_MESH_BITS {
+                log_warning(LC.Renderer, "Too many unique meshes in a draw list, skipping mesh %v.", mr.mesh)
+                continue
+            }
+            list.mesh_ids[mesh_key] = mesh_id
+        }
+
+        pipeline := DrawPipeline.Depth
+        material_id := u32(0)
+        depth := f32(0)
+        if list.pass == .Opaque {
+            pipeline = .Object
+            ok: bool
+            material_id, ok = draw_list_get_material(r, list, mr.material)
+            if !ok do continue
+
+            position := transform_world_position(go)
+            depth = linalg.length(position - view.position) / view.far
+        }
+
+        append(&list.keys, DrawKey {
+            key = make_draw_key(list.pass, pipeline, material_id, mesh_id, depth),
+            packet = u32(len(list.packets)),
+        })
+        append(&list.packets, DrawPacket {
+            mesh = mesh,
+            mesh_handle = mr.mesh,
+            lod = lod,
+            material = material_id,
+            model = transform_world_matrix(go),
+            entity_id = i32(go.local_id),
+        })
+    }
+}
+
+// Resolves the material (and its material table entry) once per list.
+@(private = "file")
+draw_list_get_material :: proc(r: ^Renderer3D, list: ^DrawList, handle: AssetHandle) -> (id: u32, ok: bool) {
+    if id, found := list.material_ids[handle]; found {
+        return id, true
+    }
+
+    id = u32(len(list.materials))
+    if id >= 1 << DRAW_KEY_MATERIAL_BITS {
+        log_warning(LC.Renderer, "Too many unique materials in a draw list, skipping material %v.", handle)
+        return
+    }
+
+    material := get_asset(&EngineInstance.asset_manager, handle, PbrMaterial)
+    if material == nil {
+        log_warning(LC.Renderer, "Cannot have <nil> material. A default one should have been assigned.")
+        return
+    }
+
+    append(&list.materials, DrawListMaterial {
+        handle = handle,
+        index = material_table_material(r, handle, material),
+    })
+    list.material_ids[handle] = id
+    return id, true
+}
+
+// Sorting stage. LSD radix sort over the keys, a byte at a time. Bytes that are the same for
+// every key (e.g. the pass) are skipped.
+draw_list_sort :: proc(list: ^DrawList) {
+    tracy.Zone()
+    keys := list.keys[:]
+    if len(keys) < 2 {
+        return
+    }
+
+    scratch := make([]DrawKey, len(keys), context.temp_allocator)
+    src, dst := keys, scratch
+    for shift := u64(0); shift < 64; shift += 8 {
+        counts: [256]int
+        for k in src {
+            counts[(k.key >> shift) & 0xff] += 1
+        }
+        if counts[(src[0].key >> shift) & 0xff] == len(src) {
+            continue
+        }
+
+        offset := 0
+        for &count in counts {
+            n := count
+            count = offset
+            offset += n
+        }
+
+        for k in src {
+            bucket := (k.key >> shift) & 0xff
+            dst[counts[bucket]] = k
+            counts[bucket] += 1
+        }
+        src, dst = dst, src
+    }
+
+    if raw_data(src) != raw_data(keys) {
+        copy(keys, src)
+    }
+}
+
+// Reserves `count` consecutive instances in the current frame's region of the instance buffer. Returns
+// the index of the first one, frame region included, and how many of them fit. Thread safe.
+instance_buffer_reserve :: proc(r: ^Renderer3D, count: int) -> (base, available: int) {
+    instances := &r.global_set.instances
+    first := sync.atomic_add(&instances.count, count)
+    available = clamp(MAX_INSTANCES - first, 0, count)
+    if available < count && !sync.atomic_exchange(&instances.overflow_reported, true) {
+        log_warning(LC.Renderer, "Instance buffer is full (%v instances), skipping the remaining draws.", MAX_INSTANCES)
+    }
+    return r.swapchain.current_frame * MAX_INSTANCES + first, available
+}
+
+// Recording stage helper. Walks the sorted packets and merges runs with the same mesh and material into
+// instanced batches, writing the per-instance data to the instance buffer.
+// The instance range is reserved atomically, so lists can be recorded from multiple threads.
+draw_list_build_batches :: proc(r: ^Renderer3D, list: ^DrawList, allocator := context.temp_allocator) -> []InstanceBatch {
+    tracy.Zone()
+    data := ([^]InstanceData)(r.global_set.instances.handle.alloc_info.pMappedData)
+    base, available := instance_buffer_reserve(r, len(list.keys))
+
+    batches := make([dynamic]InstanceBatch, 0, available, allocator)
+    for key, i in list.keys[:available] {
+        packet := &list.packets[key.packet]
+        index := base + i
+        data[index] = InstanceData {
+            model = packet.model,
+            entity_id = packet.entity_id,
+        }
+        if list.pass == .Opaque {
+            data[index].material = list.materials[packet.material].index
+        }
+
+        if len(batches) > 0 {
+            last := &batches[len(batches) - 1]
+            if last.mesh_handle == packet.mesh_handle && last.lod == packet.lod && last.material == packet.material {
+                last.count += 1
+                continue
+            }
+        }
+
+        batch := InstanceBatch {
+            mesh = packet.mesh,
+            mesh_handle = packet.mesh_handle,
+            lod = packet.lod,
+            material = packet.material,
+            first_instance = u32(index),
+            count = 1,
+        }
+        append(&batches, batch)
+    }
+    return batches[:]
+}
@@ -76,6 +76,13 @@ Editor :: struct {
 
     entity_selection: map[EntityHandle]bool,
     selected_entity: Maybe(EntityHandle),
+    // The inspector's Euler view of the selected entity's rotation. Only recomputed when the
+    // rotation changes elsewhere, so edited angles don't snap to quat_to_euler's range.
+    rotation_view: struct {
+        entity: EntityHandle,
+        rotation: quat,
+        euler: vec3,
+    },
 
     viewport_size: vec2,
     delta: f64,
@@ -88,6 +95,8 @@ Editor :: struct {
     viewport_position: vec2,
     window_size: vec2,
     viewport_maximized: bool,
+    // Whether the pending pick replaces the selection or adds to it.
+    pick_resets_selection: bool,
 
     log_entries: [dynamic]LogEntry,
     clear_log_on_play: bool,
@@ -362,12 +371,9 @@ editor_update :: proc(e: ^Editor, _delta: f64) {
                     tracy.ZoneNC("Mouse Picking", 0xff0000ff)
                     mouse := g_event_ctx.mouse + g_event_ctx.window_position - e.viewport_position
                     x, y := int(mouse.x), int(mouse.y)
-                    color, ok := gpu.read_pixel(Renderer3DInstance.object_picking.framebuffer, x, y)
-                    if ok {
-                        id := color[0]
-                        handle := e.engine.world.local_id_to_uuid[int(id)]
-                        select_entity(e, handle, !is_key_pressed(.LeftShift))
-                    }
+                    // Resolved a frame or two later, see `editor_poll_picking`.
+                    object_picking_request(Renderer3DInstance, x, y)
+                    e.pick_resets_selection = !is_key_pressed(.LeftShift)
                 }
             }
         case MouseWheelEvent:
@@ -576,6 +582,8 @@ editor_update :: proc(e: ^Editor, _delta: f64) {
     }
     if e.state == .Play {
         physics_update(PhysicsInstance, _delta)
+        // Sync point for what the contact callbacks recorded.
+        world_flush_commands(e.engine.world)
     }
 
     for handle, &window in e.asset_windows {
@@ -604,6 +612,12 @@ editor_draw :: proc(e: ^Editor) {
     if !ok do return
     defer r3d_end_frame(r, cmd)
 
+    if id, picked := object_picking_poll(&r.object_picking); picked && e.engine.world != nil {
+        // Id 0 maps to the null handle, which just clears the selection.
+        handle := e.engine.world.local_id_to_uuid[id]
+        select_entity(e, handle, e.pick_resets_selection)
+    }
+
     switch e.state {
     case .Edit:
         editor_render_scene(e, cmd)
@@ -616,9 +630,11 @@ editor_draw :: proc(e: ^Editor) {
     }
 
     // This actually draws the editor. It ALWAYS happens.
-    if gpu.do_render_pass(cmd, r.imgui_renderpass, r.swapchain.framebuffers[r.image_index]) {
-        data := imgui.GetDrawData()
-        imgui_impl_vulkan.RenderDrawData(data, cmd.handle)
+    if gpu.do_zone(cmd, "ImGui") {
+        if gpu.do_render_pass(cmd, r.imgui_renderpass, r.swapchain.framebuffers[r.image_index]) {
+            data := imgui.GetDrawData()
+            imgui_impl_vulkan.RenderDrawData(data, cmd.handle)
+        }
     }
 }
 
@@ -674,14 +690,9 @@ editor_render_game_view :: proc(e: ^Editor, cmd: gpu.CommandBuffer) {
     if camera := find_first_component(e.engine.world, Camera); camera != nil {
         go := get_object(e.engine.world, camera.owner)
 
-        euler := go.transform.local_rotation
-        rotation := linalg.quaternion_from_euler_angles(
-            euler.x * math.RAD_PER_DEG,
-            euler.y * math.RAD_PER_DEG,
-            euler.z * math.RAD_PER_DEG,
-            .XYZ)
+        rotation := transform_local_rotation(go)^
 
-        camera_view       := linalg.matrix4_from_quaternion(rotation) * linalg.inverse(linalg.matrix4_translate(go.transform.position))
+        camera_view       := linalg.matrix4_from_quaternion(rotation) * linalg.inverse(linalg.matrix4_translate(transform_world_position(go)))
         camera_projection := linalg.matrix4_perspective_f32(math.to_radians(f32(camera.fov)), f32(e.engine.screen_size.x) / f32(e.engine.screen_size.y), camera.near_plane, camera.far_plane)
         camera_rotation   := rotation
 
@@ -692,7 +703,7 @@ editor_render_game_view :: proc(e: ^Editor, cmd: gpu.CommandBuffer) {
             camera = RenderCamera {
                 projection = camera_projection,
                 view       = camera_view,
-                position   = go.transform.local_position,
+                position   = transform_local_position(go)^,
                 rotation   = rotation,
                 near       = camera.near_plane,
                 far        = camera.far_plane,
@@ -707,6 +718,7 @@ editor_render_game_view :: proc(e: ^Editor, cmd: gpu.CommandBuffer) {
 editor_on_scene_play :: proc(e: ^Editor) {
     log_debug(LC.Editor, "On Scene Play")
     if e.clear_log_on_play {
+        sync.guard(category_logger_mutex(e.logger))
         clear(&e.log_entries)
     }
 
@@ -733,6 +745,11 @@ editor_on_scene_stop :: proc(e: ^Editor) {
 
     destroy_world(&e.runtime_world)
     e.engine.world = &e.editor_world
+    // The entities still point at the world editor_world was copied from, the transform
+    // accessors go through that pointer.
+    for _, &go in e.editor_world.objects {
+        go.world = &e.editor_world
+    }
     e.is_detached = false
 }
 
@@ -873,7 +890,7 @@ editor_viewport :: proc(e: ^Editor) {
         uv0 := vec2{0, 1}
         uv1 := vec2{1, 0}
 
-        imgui.Image(tex(gpu.get_color_attachment(Renderer3DInstance.world_framebuffers[0], 1)), size)
+        imgui.Image(tex(Renderer3DInstance.world_color), size)
         // white := get_asset(&EngineInstance.asset_manager, Renderer3DInstance.white_texture, Texture2D)
         // imgui.Image(tex(white.handle), size, uv0, uv1)
 
@@ -943,6 +960,62 @@ editor_viewport :: proc(e: ^Editor) {
                 previous_frame_times[len(previous_frame_times) - 1] = f32(gpu_time)
 
                 imgui.PlotLines(cstr("##gpu_time_window"), raw_data(previous_frame_times[:]), cast(i32) len(previous_frame_times), graph_size = {0, 30})
+
+                if stats.zone_count > 0 && imgui.BeginTable("gpu_zones", 2, imgui.TableFlags_SizingFixedFit) {
+                    for zone in stats.zones[:stats.zone_count] {
+                        imgui.TableNextRow()
+                        imgui.TableNextColumn()
+                        // Nested zones, Indent(0) would use the default spacing.
+                        indent := f32(zone.depth) * 10
+                        if indent > 0 do imgui.Indent(indent)
+                        imgui.TextUnformatted(fmt.ctprintf("%v", zone.name))
+                        if indent > 0 do imgui.Unindent(indent)
+                        imgui.TableNextColumn()
+                        imgui.TextUnformatted(fmt.ctprintf("%.2vms", zone.time))
+                    }
+                    imgui.EndTable()
+                }
+
+                if Renderer3DInstance.gpu_culling.supported {
+                    do_checkbox("GPU Driven Opaque Pass", &Renderer3DInstance.gpu_driven)
+                }
+                // Raycasts against the culling BVH instead of reading back the picking pass.
+                do_checkbox("CPU Object Picking", &Renderer3DInstance.object_picking.cpu_fallback)
+                shadow_cache := &Renderer3DInstance.shadow_cache
+                do_checkbox("Cached Shadows", &shadow_cache.enabled)
+                if shadow_cache.enabled {
+                    imgui.TextUnformatted(fmt.ctprintf("Shadow cache redraws: %v", shadow_cache.redraws))
+                }
+                streamer := &Renderer3DInstance.texture_streamer
+                do_checkbox("Texture Streaming", &streamer.enabled)
+                if streamer.enabled {
+                    budget := i32(streamer.budget / mem.Megabyte)
+                    if imgui.DragInt("Texture Budget (MB)", &budget, 1, 16, 16 * 1024) {
+                        streamer.budget = int(max(budget, 16)) * mem.Megabyte
+                    }
+                }
+                streamer_stats := &streamer.stats
+                imgui.TextUnformatted(fmt.ctprintf("Textures: %v, %.2vMB resident of %.2vMB",
+                    streamer_stats.textures,
+                    f32(streamer_stats.resident_bytes) / mem.Megabyte,
+                    f32(streamer_stats.full_bytes) / mem.Megabyte))
+                if streamer.enabled {
+                    imgui.TextUnformatted(fmt.ctprintf("Effective Texture Budget: %.2vMB", f32(streamer_stats.budget) / mem.Megabyte))
+                }
+                imgui.TextUnformatted(fmt.ctprintf("Texture Streaming: %v mips missing, %.2vMB uploaded, %.2vMB evicted",
+                    streamer_stats.missing_mips,
+                    f32(streamer_stats.uploaded_bytes) / mem.Megabyte,
+                    f32(streamer_stats.evicted_bytes) / mem.Megabyte))
+                graph_stats := &Renderer3DInstance.render_graph.stats
+                imgui.TextUnformatted(fmt.ctprintf("Render Graph: %v passes, %v culled, %v barriers",
+                    graph_stats.passes, graph_stats.culled_passes, graph_stats.barriers))
+                imgui.TextUnformatted(fmt.ctprintf("Transient Memory: %.2vMB (%.2vMB without aliasing)",
+                    f32(graph_stats.transient_size) / mem.Megabyte, f32(graph_stats.unaliased_size) / mem.Megabyte))
+                cull_stats := &Renderer3DInstance.cull_stats
+                imgui.TextUnformatted(fmt.ctprintf("Meshes: %v visible, %v culled", cull_stats.visible, cull_stats.total - cull_stats.visible))
+                for visible, split in cull_stats.shadow_visible {
+                    imgui.TextUnformatted(fmt.ctprintf("Cascade %v: %v visible, %v culled", split, visible, cull_stats.total - visible))
+                }
                 imgui.Separator()
                 @(static) show_camera_stats := false
                 do_checkbox("Editor Camera Stats", &show_camera_stats)
@@ -1013,9 +1086,10 @@ editor_entidor :: proc(e: ^Editor) {
                         // Push on start edit, commit on stop edit
 
                         imgui.TextUnformatted("Position")
-                        modified_position, pos_activated, pos_deactivated := imgui_vec3("position", &go.transform.local_position)
+                        local_position := transform_local_position(go)
+                        modified_position, pos_activated, pos_deactivated := imgui_vec3("position", local_position)
                         if pos_activated {
-                            undo_push_single(&e.undo, &go.transform.local_position, tag = "Position")
+                            undo_push_single(&e.undo, local_position, tag = "Position")
                         }
 
                         if pos_deactivated {
@@ -1023,9 +1097,21 @@ editor_entidor :: proc(e: ^Editor) {
                         }
 
                         imgui.TextUnformatted("Rotation")
-                        rot_modified, rot_activated, rot_deactivated := imgui_vec3("rotation", &go.transform.local_rotation)
+                        local_rotation := transform_local_rotation(go)
+                        view := &e.rotation_view
+                        if view.entity != go.handle || view.rotation != local_rotation^ {
+                            view.entity = go.handle
+                            view.rotation = local_rotation^
+                            view.euler = quat_to_euler(local_rotation^)
+                        }
+
+                        rot_modified, rot_activated, rot_deactivated := imgui_vec3("rotation", &view.euler)
                         if rot_activated {
-                            undo_push_single(&e.undo, &go.transform.local_position, tag = "LocalRotation")
+                            undo_push_single(&e.undo, local_rotation, tag = "LocalRotation")
+                        }
+                        if rot_modified {
+                            local_rotation^ = euler_to_quat(view.euler)
+                            view.rotation = local_rotation^
                         }
 
                         if rot_deactivated {
@@ -1033,9 +1119,10 @@ editor_entidor :: proc(e: ^Editor) {
                         }
 
                         imgui.TextUnformatted("Scale")
-                        scale_modified, scale_activated, scale_deactivated := imgui_vec3("scale", &go.transform.local_scale)
+                        local_scale := transform_local_scale(go)
+                        scale_modified, scale_activated, scale_deactivated := imgui_vec3("scale", local_scale)
                         if scale_activated {
-                            undo_push_single(&e.undo, &go.transform.local_scale, tag = "LocalScale")
+                            undo_push_single(&e.undo, local_scale, tag = "LocalScale")
                         }
 
                         if scale_deactivated {
@@ -1054,7 +1141,7 @@ editor_entidor :: proc(e: ^Editor) {
                 // imgui.SeparatorText("Components")
 
                 for id, component in go.components {
-                    draw_component(e, id, component)
+                    draw_component(e, id, component, shared = component_is_shared(go, component))
                     // imgui.Separator()
                 }
 
@@ -1194,6 +1281,7 @@ editor_ui_toolstrip :: proc(e: ^Editor) {
         log_debug(LC.Editor, "Stepping 1 frame")
         world_update(e.engine.world, e.delta, true)
         physics_update(PhysicsInstance, e.delta)
+        world_flush_commands(e.engine.world)
     }
 
     min_step_button := imgui.GetItemRectMin()
@@ -1748,6 +1836,7 @@ editor_log_window :: proc(e: ^Editor) {
     opened := do_window("Log")
     if opened {
         if do_button("Clear") {
+            sync.guard(category_logger_mutex(e.logger))
             clear(&e.log_entries)
         }
 
@@ -1770,6 +1859,7 @@ editor_log_window :: proc(e: ^Editor) {
         if child_opened {
             width := imgui.GetContentRegionAvail().x
 
+            sync.guard(category_logger_mutex(e.logger))
             for entry, i in e.log_entries {
                 category := cast(LC) entry.category.value
 
@@ -2179,7 +2269,8 @@ select_entity :: proc(e: ^Editor, entity: EntityHandle, should_reset_selection :
     }
 }
 
-draw_component :: proc(e: ^Editor, id: typeid, component: ^Component) {
+// Shared components belong to a prefab template, they are read only until overridden.
+draw_component :: proc(e: ^Editor, id: typeid, component: ^Component, shared := false) {
     name: cstring
     info := type_info_of(id).variant.(reflect.Type_Info_Named)
     name = cstr(COMPONENT_NAMES[id]) if id in COMPONENT_NAMES else cstr(info.name)
@@ -2226,7 +2317,19 @@ draw_component :: proc(e: ^Editor, id: typeid, component: ^Component) {
     imgui.PopID()
 
     if opened {
+        if shared {
+            if do_button("Override Prefab", alignment = 0.5) {
+                if handle, ok := e.selected_entity.(EntityHandle); ok {
+                    // Gives the entity its own copy, editable from the next frame.
+                    get_component_typeid(e.engine.world, handle, id)
+                }
+            }
+            imgui.BeginDisabled()
+        }
         imgui_draw_component(e, any{component, id})
+        if shared {
+            imgui.EndDisabled()
+        }
         imgui.TreePop()
     }
 
@@ -3247,7 +3350,7 @@ draw_position_gizmo :: proc(editor: ^Editor, e: ^Entity) {
     //         time = 5)
     // }
 
-    m := &e.transform.global_matrix[0][0]
+    m := &e.world.transforms.world_matrices[e.transform][0][0]
 
     snap := Vector3{0.5, 0.5, 0.5}
 
@@ -3272,9 +3375,9 @@ draw_position_gizmo :: proc(editor: ^Editor, e: ^Entity) {
                 &new_pos[0],
                 &new_euler[0],
                 &new_scale[0])
-            e.transform.local_position = new_pos
-            e.transform.local_rotation = new_euler
-            e.transform.local_scale = new_scale
+            transform_local_position(e)^ = new_pos
+            transform_local_rotation(e)^ = euler_to_quat(new_euler)
+            transform_local_scale(e)^ = new_scale
         case .Global:
 
         }
@@ -3283,11 +3386,11 @@ draw_position_gizmo :: proc(editor: ^Editor, e: ^Entity) {
             activated = true
             switch editor.gizmo_type {
             case .Translation:
-                undo_push_single(&editor.undo, &e.transform.local_position, tag = "GizmoLocalPosition")
+                undo_push_single(&editor.undo, transform_local_position(e), tag = "GizmoLocalPosition")
             case .Rotation:
-                undo_push_single(&editor.undo, &e.transform.local_rotation, tag = "GizmoLocalRotation")
+                undo_push_single(&editor.undo, transform_local_rotation(e), tag = "GizmoLocalRotation")
             case .Scale:
-                undo_push_single(&editor.undo, &e.transform.local_scale, tag = "GizmoLocalScale")
+                undo_push_single(&editor.undo, transform_local_scale(e), tag = "GizmoLocalScale")
             }
         }
     } else {
@@ -153,6 +153,7 @@ engine_draw :: proc(e: ^Engine) {
 
 engine_deinit :: proc(e: ^Engine) {
     destroy_world(e.world)
+    entity_commands_deinit()
 
     physics_deinit(&e.physics)
 
@@ -65,6 +65,16 @@ component_default_copy :: proc(this: rawptr) -> rawptr {
     panic("Copy is not implemented!")
 }
 
+@(private = "file")
+NO_COPY_MESSAGE :: "Component %v does not implement copy. Every component must set a copy proc, use component_shallow_copy if it holds no heap data."
+
+// Clones a component with its copy proc. A bitwise copy would share the heap data of the component
+// and both copies would free it, so a component without a copy proc is a bug.
+clone_component :: proc(component: ^Component, id: typeid) -> ^Component {
+    assert(component.copy != component_default_copy, fmt.tprintf(NO_COPY_MESSAGE, id))
+    return cast(^Component)component->copy()
+}
+
 component_shallow_copy :: proc($T: typeid) -> proc(rawptr) -> rawptr {
     return proc(this: rawptr) -> rawptr {
         this := cast(^T) this
@@ -103,9 +113,6 @@ Children :: [dynamic]EntityHandle
 
 @(LuaExport = {
     Type = {Light},
-    Fields = {
-        transform = "transform",
-    },
 })
 Entity :: struct {
     components: ComponentMap `fmt:"-"`,
@@ -117,9 +124,13 @@ Entity :: struct {
     name: DynamicString `fmt:"s"`,
     flags: EntityFlags,
 
-    transform: TransformComponent `fmt:"-"`,
+    // Index of the entity's transform in the TransformStore of its world, see transform.odin.
+    transform: int `fmt:"-"`,
     parent: EntityHandle,
     children: Children,
+
+    // The prefab this entity was instantiated from, if any.
+    prefab: AssetHandle,
 }
 
 EntityHandle :: distinct UUID
@@ -128,10 +139,13 @@ duplicate_entity :: proc(world: ^World, entity: EntityHandle) -> EntityHandle {
     en := get_object(world, entity)
     new := new_object(world, ds_to_string(en.name))
     new_en := get_object(world, new)
+    // new_object can grow the objects map.
+    en = get_object(world, entity)
 
-    new_en.transform = en.transform
+    set_transform(new_en, get_transform(en))
     new_en.flags = en.flags
     new_en.enabled = en.enabled
+    new_en.prefab = en.prefab
 
     for id, component in en.components {
         copy_component(world, new, entity, id)
@@ -144,8 +158,10 @@ clone_entity :: proc(source: Entity) -> (en: Entity) {
     en.children = clone(source.children)
     en.name.data = clone(source.name.data)
 
+    en.components = {}
     for id, component in source.components {
-        en.components[id] = cast(^Component)component->copy()
+        // Shared components belong to the prefab template, the clone keeps referencing it.
+        en.components[id] = component if component_is_shared(&en, component) else clone_component(component, id)
     }
     return
 }
@@ -159,29 +175,70 @@ copy_component :: proc(w: ^World, handle, target: EntityHandle, id: typeid) {
 
     go := get_object(w, handle)
 
-    target_component := get_component_typeid(w, target, id)
+    // Not through get_component, that would give the target its own copy of a shared component.
+    target_entity := get_object(w, target)
+    target_component := target_entity.components[id] if target_entity != nil else nil
     if target_component == nil {
         log_error(LC.EntitySystem, "Cannot copy component %v from entity %v because it doesn't exist.", id, target)
         return
     }
 
     // go.components[id] = cast(^Component)get_component_constructor(id)()
-    go.components[id] = cast(^Component)target_component->copy()
-    go.components[id].owner = handle
-    go.components[id].world = w
+    if component_is_shared(target_entity, target_component) {
+        share_component(w, go, id, target_component)
+    } else {
+        attach_component(w, go, id, clone_component(target_component, id))
+    }
 
     // go.components[id]->init()
 }
 
+// Attaches an already constructed component to an entity.
+attach_component :: proc(w: ^World, go: ^Entity, id: typeid, component: ^Component) {
+    go.components[id] = component
+    component.owner = go.handle
+    component.world = w
+    track_component(w, id, go.handle, component)
+}
+
+// Makes `go` reference a component owned by another entity, a prefab template, instead of a copy of it.
+// Shared components are never initialized, updated or destroyed through the entities sharing them.
+share_component :: proc(w: ^World, go: ^Entity, id: typeid, component: ^Component) {
+    go.components[id] = component
+    track_component(w, id, go.handle, component)
+}
+
+// True if `component` is referenced by `go` but owned by another entity, see share_component.
+component_is_shared :: proc(go: ^Entity, component: ^Component) -> bool {
+    return component.owner != go.handle
+}
+
+// Components without per entity state can be shared. Anything that gets initialized, updated or
+// debug drawn for its owner needs its own copy.
+component_is_shareable :: proc(component: ^Component) -> bool {
+    return component.init == component_default_init &&
+        component.update == component_default_update &&
+        component.destroy == component_default_destroy &&
+        component.debug_draw == component_default_debug_draw
+}
+
+// Gives `go` its own copy of a shared component, so it can be changed without touching the
+// other entities. Returns the component of `go`, copied or not.
+unshare_component :: proc(w: ^World, go: ^Entity, id: typeid) -> ^Component {
+    component := go.components[id]
+    if component_is_shared(go, component) {
+        component = clone_component(component, id)
+        attach_component(w, go, id, component)
+    }
+    return component
+}
+
 add_component_typeid :: proc(w: ^World, handle: EntityHandle, id: typeid) {
     tracy.Zone()
     assert(id in COMPONENT_INDICES, fmt.tprintf(NOT_REGISTERED_MESSAGE, id))
 
     go := get_object(w, handle)
-
-    go.components[id] = cast(^Component)get_component_constructor(id)()
-    go.components[id].owner = handle
-    go.components[id].world = w
+    attach_component(w, go, id, cast(^Component)get_component_constructor(id)())
 
     // go.components[id]->init()
 }
@@ -191,10 +248,7 @@ add_component_type :: proc(w: ^World, handle: EntityHandle, $C: typeid) {
     assert(C in COMPONENT_INDICES, fmt.tprintf(NOT_REGISTERED_MESSAGE, typeid_of(C)))
 
     go := get_object(w, handle)
-
-    go.components[C] = cast(^Component)get_component_constructor(C)()
-    go.components[C].owner = handle
-    go.components[C].world = w
+    attach_component(w, go, C, cast(^Component)get_component_constructor(C)())
 
     // go.components[C]->init()
 }
@@ -204,18 +258,19 @@ add_component :: proc {
     add_component_typeid,
 }
 
+// The returned component can be written to, shared components are copied first (see unshare_component).
 get_component_type :: proc(w: ^World, handle: EntityHandle, $C: typeid) -> ^C {
     tracy.Zone()
     if !has_component(w, handle, C) do return nil
     go := get_object(w, handle)
-    return cast(^C)go.components[C]
+    return cast(^C)unshare_component(w, go, C)
 }
 
 get_component_typeid :: proc(w: ^World, handle: EntityHandle, id: typeid) -> ^Component {
     tracy.Zone()
     if !has_component(w, handle, id) do return nil
     go := get_object(w, handle)
-    return go.components[id]
+    return unshare_component(w, go, id)
 }
 
 get_component :: proc {
@@ -246,12 +301,16 @@ remove_component_typeid :: proc(w: ^World, handle: EntityHandle, id: typeid) {
     go := get_object(w, handle)
 
     component :=  go.components[id]
-    if component.destroy != nil {
+    shared := component_is_shared(go, component)
+    if !shared && component.destroy != nil {
         component->destroy()
     }
 
+    untrack_component(w, handle, id)
     delete_key(&go.components, id)
-    free(component)
+    if !shared {
+        free(component)
+    }
 }
 
 remove_component :: proc {
@@ -276,6 +335,167 @@ has_component :: proc {
     has_component_typeid,
 }
 
+// All the components of a single type that live in a world. Kept in sync by
+// add/copy/remove_component and delete_object so queries never have to walk
+// every entity in the world.
+ComponentStorage :: struct {
+    components: [dynamic]^Component,
+    // The entity of each component. Not `component.owner`, shared components appear once per entity.
+    owners: [dynamic]EntityHandle,
+    // Position of an entity's component inside `components`, for O(1) removal.
+    indices: map[EntityHandle]int,
+}
+
+@(private = "file")
+track_component :: proc(w: ^World, id: typeid, owner: EntityHandle, component: ^Component) {
+    storage, ok := &w.component_storage[id]
+    if !ok {
+        w.component_storage[id] = {}
+        storage = &w.component_storage[id]
+    }
+
+    // Replacing an existing component of the same type.
+    if index, exists := storage.indices[owner]; exists {
+        storage.components[index] = component
+        return
+    }
+
+    storage.indices[owner] = len(storage.components)
+    append(&storage.components, component)
+    append(&storage.owners, owner)
+}
+
+@(private = "file")
+untrack_component :: proc(w: ^World, handle: EntityHandle, id: typeid) {
+    storage, ok := &w.component_storage[id]
+    if !ok do return
+
+    index, exists := storage.indices[handle]
+    if !exists do return
+
+    last := len(storage.components) - 1
+    if index != last {
+        storage.components[index] = storage.components[last]
+        storage.owners[index] = storage.owners[last]
+        storage.indices[storage.owners[index]] = index
+    }
+    pop(&storage.components)
+    pop(&storage.owners)
+    delete_key(&storage.indices, handle)
+}
+
+@(private = "file")
+destroy_component_storage :: proc(w: ^World) {
+    for _, &storage in w.component_storage {
+        delete(storage.components)
+        delete(storage.owners)
+        delete(storage.indices)
+    }
+    delete(w.component_storage)
+    w.component_storage = {}
+}
+
+// Rebuilds the component storage from scratch, by walking every entity.
+// Only needed when the world's objects were replaced wholesale, like in copy_world.
+world_rebuild_component_storage :: proc(w: ^World) {
+    tracy.Zone()
+    destroy_component_storage(w)
+    for handle, &go in w.objects {
+        for id, component in go.components {
+            track_component(w, id, handle, component)
+        }
+    }
+}
+
+// Returns all the components of type C in the world, in no particular order, and the entity of each one.
+// Use the entities instead of `component.owner`, components shared with a prefab template are owned by the template.
+world_components :: proc(w: ^World, $C: typeid) -> (components: []^C, owners: []EntityHandle) {
+    if storage, ok := &w.component_storage[C]; ok {
+        return transmute([]^C)storage.components[:], storage.owners[:]
+    }
+    return nil, nil
+}
+
+MAX_VIEW_COMPONENTS :: 8
+
+// Iterates over all the entities that have every component in the view.
+// Only the storage of the rarest component is walked, so iterating is O(matches of the rarest component)
+// instead of O(entities). A view of just TransformComponent matches every entity, since they all have one.
+// Usage:
+//     view := world_view(world, DirectionalLight, TransformComponent)
+//     for go in world_view_next(&view) { ... }
+WorldView :: struct {
+    world: ^World,
+    storage: ^ComponentStorage,
+    filter: [MAX_VIEW_COMPONENTS]typeid,
+    filter_count: int,
+    index: int,
+    // Only for views without a stored component (just TransformComponent), those match every entity.
+    entities: []EntityHandle,
+}
+
+world_view :: proc(w: ^World, ids: ..typeid) -> (view: WorldView) {
+    tracy.Zone()
+    assert(len(ids) <= MAX_VIEW_COMPONENTS)
+    view.world = w
+
+    for id in ids {
+        // Every entity has a transform, it's not stored as a regular component.
+        if id == TransformComponent do continue
+
+        storage, ok := &w.component_storage[id]
+        if !ok || len(storage.components) == 0 {
+            // Nobody has this component, so nobody can match the view.
+            view.storage = nil
+            view.filter_count = 0
+            return
+        }
+
+        if view.storage == nil || len(storage.components) < len(view.storage.components) {
+            view.storage = storage
+        }
+        view.filter[view.filter_count] = id
+        view.filter_count += 1
+    }
+
+    if view.filter_count == 0 {
+        keys, err := slice.map_keys(w.objects, context.temp_allocator)
+        assert(err == nil)
+        view.entities = keys
+    }
+    return
+}
+
+world_view_next :: proc(view: ^WorldView) -> (go: ^Entity, ok: bool) {
+    if view.filter_count == 0 {
+        for view.index < len(view.entities) {
+            handle := view.entities[view.index]
+            view.index += 1
+            // The root is not a real entity.
+            if handle == view.world.root do continue
+            if go = get_object(view.world, handle); go != nil {
+                return go, true
+            }
+        }
+        return nil, false
+    }
+    if view.storage == nil do return
+
+    outer: for view.index < len(view.storage.components) {
+        owner := view.storage.owners[view.index]
+        view.index += 1
+
+        go = get_object(view.world, owner)
+        if go == nil do continue
+
+        for id in view.filter[:view.filter_count] {
+            if id not_in go.components do continue outer
+        }
+        return go, true
+    }
+    return nil, false
+}
+
 when USE_EDITOR {
     WorldEditorData :: struct {
         modified: bool,
@@ -306,6 +526,15 @@ Scene :: struct {
         bias: f32,
     },
 
+    component_storage: map[typeid]ComponentStorage,
+    transforms: TransformStore,
+
+    // Shared by the script components of this world, created by the first one that gets initialized.
+    scripts: ScriptVM,
+    // Set by world_init_components. Components added by deferred commands after that are initialized
+    // when they get attached.
+    components_initialized: bool,
+
     using editor_data: WorldEditorData,
 }
 
@@ -318,7 +547,7 @@ create_world :: proc(world: ^World, name: string = "World") {
     world.name = name
     world.objects[world.root] = Entity{
         name = make_ds("Root"),
-        transform = default_transform(),
+        transform = transform_store_add(&world.transforms, world.root),
         world = world,
     }
     world.next_local_id = 1
@@ -331,8 +560,13 @@ destroy_world :: proc(world: ^World) {
         return
     }
     delete(world.name)
+    world_discard_commands(world)
     delete_object(world, world.root)
     delete(world.objects)
+    destroy_component_storage(world)
+    transform_store_destroy(&world.transforms)
+    // After the components, they unref their instances.
+    destroy_script_vm(&world.scripts)
     delete(world.file_path)
 }
 
@@ -349,32 +583,47 @@ copy_world :: proc(source: ^World) -> ^World {
     }
 
     world.local_id_to_uuid = clone(source.local_id_to_uuid)
+    // Entities keep their transform index.
+    world.transforms = transform_store_clone(source.transforms)
+
+    // The shallow copy shares the storage of the source world and points to its components.
+    world.component_storage = {}
+    world_rebuild_component_storage(world)
+
+    // The copy's scripts get their own state when its components are initialized.
+    world.scripts = {}
+    world.components_initialized = false
 
     return world
 }
 
 world_update :: proc(world: ^World, delta: f64, update_components := true) {
     tracy.Zone()
-    update_object :: proc(go: ^Entity, handle: EntityHandle, delta: f64, update_components: bool) {
+    update_object :: proc(go: ^Entity, handle: EntityHandle, delta: f64) {
         tracy.Zone()
-        update_transform(go, &go.transform, delta)
         for child_handle in go.children {
             child := get_object(go.world, child_handle)
-            update_object(child, child_handle, delta, update_components)
+            update_object(child, child_handle, delta)
         }
 
-        if update_components {
-            for id, component in go.components {
-                component->update(delta)
-            }
+        for id, component in go.components do if !component_is_shared(go, component) {
+            component->update(delta)
         }
     }
     if world.objects == nil || len(world.objects) == 0 {
         return
     }
 
-    root := &world.objects[world.root]
-    update_object(root, world.root, delta, update_components)
+    update_transforms(world)
+
+    if update_components {
+        root := &world.objects[world.root]
+        update_object(root, world.root, delta)
+    }
+
+    // Sync point: structural changes recorded during the update are applied now
+    // that nothing is iterating the world anymore.
+    world_flush_commands(world)
 }
 
 world_init_components :: proc(world: ^World) {
@@ -386,13 +635,14 @@ world_init_components :: proc(world: ^World) {
             update_object(child, child_handle)
         }
 
-        for id, component in go.components {
+        for id, component in go.components do if !component_is_shared(go, component) {
             component->init()
         }
     }
 
     root := &world.objects[world.root]
     update_object(root, world.root)
+    world.components_initialized = true
 }
 
 get_object :: proc(world: ^World, handle: EntityHandle) -> ^Entity {
@@ -450,7 +700,7 @@ new_object :: proc(world: ^World, name: string = "New Entity", parent: Maybe(Ent
     go.handle = id
     go.local_id = world.next_local_id
     go.enabled = true
-    go.transform.local_scale = vec3{1, 1, 1}
+    go.transform = transform_store_add(&world.transforms, id)
 
     world.next_local_id += 1
     world.local_id_to_uuid[go.local_id] = go.handle
@@ -476,7 +726,7 @@ new_object_with_uuid :: proc(world: ^World, name: string = "New Entity", handle:
     go.world = world
     go.handle = handle
     go.enabled = true
-    go.transform.local_scale = vec3{1, 1, 1}
+    go.transform = transform_store_add(&world.transforms, handle)
 
     go.local_id = world.next_local_id
     world.next_local_id += 1
@@ -506,11 +756,13 @@ delete_object :: proc(world: ^World, handle: EntityHandle) {
         obj := world.objects[handle]
 
         for id, comp in obj.components {
-            if comp.destroy != nil {
+            if comp.destroy != nil && !component_is_shared(&obj, comp) {
                 comp->destroy()
             }
+            untrack_component(world, handle, id)
         }
 
+        transform_store_remove(world, obj.transform)
         delete_key(&world.objects, handle)
     }
 
@@ -519,14 +771,13 @@ delete_object :: proc(world: ^World, handle: EntityHandle) {
     delete(go.components)
 }
 
-// Scans the entire world and returns the first componment of type C it finds.
+// Returns the first componment of type C in the world.
 // If no such component exists, a nil pointer is returned.
 find_first_component :: proc(world: ^World, $C: typeid) -> ^C {
     tracy.Zone()
-    for obj_handle, &obj in world.objects {
-        if has_component(world, obj_handle, C) {
-            return get_component(world, obj_handle, C)
-        }
+    components, _ := world_components(world, C)
+    if len(components) > 0 {
+        return components[0]
     }
 
     return nil
@@ -636,16 +887,25 @@ deserialize_world :: proc(world: ^World, file: string) -> bool {
                 entity.enabled = enabled
                 entity.flags = flags
 
-                if serialize_begin_table(&s, "Transform") {
-                    if position, ok := serialize_get_field(&s, "LocalPosition", vec3); ok {
-                        entity.transform.local_position = position
-                    }
-                    if rotation, ok := serialize_get_field(&s, "LocalRotation", vec3); ok {
-                        entity.transform.local_rotation = rotation
-                    }
-                    if scale, ok := serialize_get_field(&s, "LocalScale", vec3); ok {
-                        entity.transform.local_scale = scale
+                if prefab_handle, ok := serialize_get_field(&s, "Prefab", u64); ok {
+                    removed := make([dynamic]typeid, context.temp_allocator)
+                    if serialize_begin_table(&s, "RemovedComponents") {
+                        for key in serialize_get_keys(&s) {
+                            if id, found := get_component_typeid_from_name(key); found {
+                                append(&removed, id)
+                            }
+                        }
+                        serialize_end_table(&s)
                     }
+
+                    // Start from the prefab components, the serialized ones are overrides.
+                    prefab_apply(world, entity, AssetHandle(prefab_handle), removed[:])
+                }
+
+                if serialize_begin_table(&s, "Transform") {
+                    transform := get_transform(entity)
+                    serialize_transform(&transform, false, &s)
+                    set_transform(entity, transform)
                     serialize_end_table(&s)
                 }
 
@@ -675,21 +935,42 @@ deserialize_world :: proc(world: ^World, file: string) -> bool {
 
 serialize_entity :: proc(entity: ^Entity, s: ^SerializeContext) {
     serialize_begin_table(s, "Transform")
-        serialize_do_field(s, "LocalPosition", entity.transform.local_position)
-        serialize_do_field(s, "LocalRotation", entity.transform.local_rotation)
-        serialize_do_field(s, "LocalScale", entity.transform.local_scale)
+        transform := get_transform(entity)
+        serialize_transform(&transform, true, s)
     serialize_end_table(s)
 
+    prefab := get_entity_prefab(entity)
+
     serialize_begin_table(s, "Components")
     {
-        i := 0
         for id, component in entity.components {
-            serialize_component(component, id, s)
-            i += 1
+            // Still the data of the prefab template, nothing to store.
+            if component_is_shared(entity, component) do continue
+
+            // Instances only store the fields that differ from their prefab.
+            if prefab != nil {
+                prefab_serialize_overrides(prefab, component, id, s)
+            } else {
+                serialize_component(component, id, s)
+            }
         }
     }
     serialize_end_table(s)
 
+    if prefab != nil {
+        serialize_do_field(s, "Prefab", entity.prefab)
+
+        // Otherwise loading would add them back from the template.
+        removed := prefab_removed_components(prefab, entity, context.temp_allocator)
+        if len(removed) > 0 {
+            serialize_begin_table(s, "RemovedComponents")
+            for id in removed {
+                named := type_info_of(id).variant.(runtime.Type_Info_Named)
+                serialize_do_field(s, named.name, true)
+            }
+            serialize_end_table(s)
+        }
+    }
     serialize_do_field(s, "UUID", entity.handle)
     serialize_do_field(s, "Name", ds_to_string(entity.name))
 
@@ -700,7 +981,8 @@ serialize_entity :: proc(entity: ^Entity, s: ^SerializeContext) {
     serialize_do_field(s, "Parent", entity.parent)
 }
 
-serialize_component :: proc(component: ^Component, id: typeid, s: ^SerializeContext) {
+// Writes the component to the table named after its type, or `key` if given.
+serialize_component :: proc(component: ^Component, id: typeid, s: ^SerializeContext, key := "") {
     ti := type_info_of(id)
     named, ok := ti.variant.(runtime.Type_Info_Named)
     assert(ok)
@@ -711,7 +993,7 @@ serialize_component :: proc(component: ^Component, id: typeid, s: ^SerializeCont
 
     a := any{component, ti.id}
 
-    serialize_begin_table(s, named.name)
+    serialize_begin_table(s, key if key != "" else named.name)
 
     serialize_do_field(s, "Enabled", component.enabled)
 
@@ -726,13 +1008,18 @@ serialize_component :: proc(component: ^Component, id: typeid, s: ^SerializeCont
 
 deserialize_component :: proc(s: ^SerializeContext, name: string, world: ^World, entity: ^Entity) {
     tracy.Zone()
-    enabled: bool
-    serialize_do_field(s, "Enabled", enabled)
-
     if id, ok := get_component_typeid_from_name(name); ok {
-        add_component(world, entity.handle, id)
+        // Prefab instances already have the component, deserialize the overrides on top of it.
+        // Only the overridden fields are stored for them, so every field is optional.
+        if !has_component(world, entity.handle, id) {
+            add_component(world, entity.handle, id)
+        }
         comp := get_component_typeid(world, entity.handle, id)
 
+        if enabled, found := serialize_get_field(s, "Enabled", bool); found {
+            comp.enabled = enabled
+        }
+
         if id in COMPONENT_SERIALIZERS {
             // Component has a serializer
             serializer := COMPONENT_SERIALIZERS[id]
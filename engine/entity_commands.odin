@@ -0,0 +1,279 @@
+package engine
+import "core:sync"
+import "core:strings"
+import "core:slice"
+import tracy "packages:odin-tracy"
+
+// Structural changes (creating/deleting entities, adding/removing components) cannot
+// happen while the world is being iterated, like during world_update. Instead, they
+// get recorded into a command buffer and are applied later, at a sync point, with world_flush_commands.
+//
+// Every thread records into its own buffer so no locking is needed while recording.
+// The buffer list itself is only locked the first time a thread records a command.
+//
+// Scripts record through the LuaEntity and Scene api (scripting_api.odin). Physics contact callbacks run on
+// Jolt's threads during physics_update, the world is flushed again right after the step.
+
+NewEntityCommand :: struct {
+    handle: EntityHandle,
+    name: string,
+    parent: Maybe(EntityHandle),
+}
+
+DeleteEntityCommand :: struct {
+    handle: EntityHandle,
+}
+
+AddComponentCommand :: struct {
+    handle: EntityHandle,
+    id: typeid,
+    component: ^Component,
+}
+
+RemoveComponentCommand :: struct {
+    handle: EntityHandle,
+    id: typeid,
+}
+
+EntityCommand :: struct {
+    world: ^World,
+    variant: union {
+        NewEntityCommand,
+        DeleteEntityCommand,
+        AddComponentCommand,
+        RemoveComponentCommand,
+    },
+}
+
+EntityCommandBuffer :: struct {
+    commands: [dynamic]EntityCommand,
+}
+
+@(private = "file")
+g_command_buffers: struct {
+    mutex: sync.Mutex,
+    buffers: [dynamic]^EntityCommandBuffer,
+}
+
+@(private = "file", thread_local)
+tls_command_buffer: ^EntityCommandBuffer
+
+@(private = "file")
+get_thread_command_buffer :: proc() -> ^EntityCommandBuffer {
+    if tls_command_buffer == nil {
+        tls_command_buffer = new(EntityCommandBuffer)
+
+        if sync.guard(&g_command_buffers.mutex) {
+            append(&g_command_buffers.buffers, tls_command_buffer)
+        }
+    }
+    return tls_command_buffer
+}
+
+// Records the creation of a new entity. The handle is valid immediately and can be
+// used to record more commands, but the entity will only exist after the next flush.
+deferred_new_object :: proc(world: ^World, name: string = "New Entity", parent: Maybe(EntityHandle) = nil) -> EntityHandle {
+    handle := EntityHandle(generate_uuid())
+    append(&get_thread_command_buffer().commands, EntityCommand {
+        world = world,
+        variant = NewEntityCommand {
+            handle = handle,
+            name = strings.clone(name),
+            parent = parent,
+        },
+    })
+    return handle
+}
+
+deferred_delete_object :: proc(world: ^World, handle: EntityHandle) {
+    append(&get_thread_command_buffer().commands, EntityCommand {
+        world = world,
+        variant = DeleteEntityCommand {
+            handle = handle,
+        },
+    })
+}
+
+// The component is constructed right away so the caller can fill it in,
+// it gets attached to the entity on the next flush.
+deferred_add_component_type :: proc(world: ^World, handle: EntityHandle, $C: typeid) -> ^C {
+    assert(C in COMPONENT_INDICES)
+    component := cast(^Component)get_component_constructor(C)()
+    component.owner = handle
+    component.world = world
+
+    append(&get_thread_command_buffer().commands, EntityCommand {
+        world = world,
+        variant = AddComponentCommand {
+            handle = handle,
+            id = C,
+            component = component,
+        },
+    })
+    return cast(^C)component
+}
+
+deferred_add_component_typeid :: proc(world: ^World, handle: EntityHandle, id: typeid) -> ^Component {
+    assert(id in COMPONENT_INDICES)
+    component := cast(^Component)get_component_constructor(id)()
+    component.owner = handle
+    component.world = world
+
+    append(&get_thread_command_buffer().commands, EntityCommand {
+        world = world,
+        variant = AddComponentCommand {
+            handle = handle,
+            id = id,
+            component = component,
+        },
+    })
+    return component
+}
+
+deferred_add_component :: proc {
+    deferred_add_component_type,
+    deferred_add_component_typeid,
+}
+
+deferred_remove_component_type :: proc(world: ^World, handle: EntityHandle, $C: typeid) {
+    deferred_remove_component_typeid(world, handle, C)
+}
+
+deferred_remove_component_typeid :: proc(world: ^World, handle: EntityHandle, id: typeid) {
+    append(&get_thread_command_buffer().commands, EntityCommand {
+        world = world,
+        variant = RemoveComponentCommand {
+            handle = handle,
+            id = id,
+        },
+    })
+}
+
+deferred_remove_component :: proc {
+    deferred_remove_component_type,
+    deferred_remove_component_typeid,
+}
+
+// Applies all the recorded commands that target `world`, in the order they were recorded
+// (per thread). Must be called when no other thread is recording commands for this world.
+world_flush_commands :: proc(world: ^World) {
+    tracy.Zone()
+    // Applying a command can register a new thread buffer, so don't hold the lock while doing it.
+    buffers: []^EntityCommandBuffer
+    if sync.guard(&g_command_buffers.mutex) {
+        buffers = slice.clone(g_command_buffers.buffers[:], context.temp_allocator)
+    }
+
+    for buffer in buffers {
+        // Commands can record other commands (e.g. a component's destroy), so don't cache the length.
+        kept := 0
+        for i := 0; i < len(buffer.commands); i += 1 {
+            command := buffer.commands[i]
+            if command.world != world {
+                buffer.commands[kept] = command
+                kept += 1
+                continue
+            }
+            apply_command(world, command)
+        }
+        resize(&buffer.commands, kept)
+    }
+}
+
+// Drops all the pending commands for `world`, without applying them.
+world_discard_commands :: proc(world: ^World) {
+    // Freeing a command destroys its component, which can record new commands and register a new
+    // thread buffer, so they are only collected under the lock.
+    dropped := make([dynamic]EntityCommand, context.temp_allocator)
+    if sync.guard(&g_command_buffers.mutex) {
+        for buffer in g_command_buffers.buffers {
+            kept := 0
+            for command in buffer.commands {
+                if command.world != world {
+                    buffer.commands[kept] = command
+                    kept += 1
+                    continue
+                }
+                append(&dropped, command)
+            }
+            resize(&buffer.commands, kept)
+        }
+    }
+
+    for command in dropped {
+        free_command(command)
+    }
+}
+
+entity_commands_deinit :: proc() {
+    // Same as world_discard_commands, don't hold the lock while destroying components.
+    buffers: [dynamic]^EntityCommandBuffer
+    if sync.guard(&g_command_buffers.mutex) {
+        buffers = g_command_buffers.buffers
+        g_command_buffers.buffers = {}
+    }
+
+    for buffer in buffers {
+        for command in buffer.commands {
+            free_command(command)
+        }
+        delete(buffer.commands)
+        free(buffer)
+    }
+    delete(buffers)
+}
+
+@(private = "file")
+apply_command :: proc(world: ^World, command: EntityCommand) {
+    switch cmd in command.variant {
+    case NewEntityCommand:
+        parent := cmd.parent
+        if p, ok := parent.?; ok && get_object(world, p) == nil {
+            log_warning(LC.EntitySystem, "Parent %v of deferred entity '%v' no longer exists, using root.", p, cmd.name)
+            parent = nil
+        }
+        new_object_with_uuid(world, cmd.name, cmd.handle, parent)
+        delete(cmd.name)
+    case DeleteEntityCommand:
+        delete_object(world, cmd.handle)
+    case AddComponentCommand:
+        go := get_object(world, cmd.handle)
+        if go == nil {
+            log_warning(LC.EntitySystem, "Cannot add deferred component %v, entity %v doesn't exist.", cmd.id, cmd.handle)
+            destroy_unattached_component(cmd.component)
+            return
+        }
+        if cmd.id in go.components {
+            remove_component(world, cmd.handle, cmd.id)
+        }
+        attach_component(world, go, cmd.id, cmd.component)
+        // Added during play, world_init_components won't get to it.
+        if world.components_initialized {
+            cmd.component->init()
+        }
+    case RemoveComponentCommand:
+        if go := get_object(world, cmd.handle); go != nil && cmd.id in go.components {
+            remove_component(world, cmd.handle, cmd.id)
+        }
+    }
+}
+
+@(private = "file")
+free_command :: proc(command: EntityCommand) {
+    #partial switch cmd in command.variant {
+    case NewEntityCommand:
+        delete(cmd.name)
+    case AddComponentCommand:
+        destroy_unattached_component(cmd.component)
+    }
+}
+
+// A component that was constructed but never attached still owns whatever its constructor or the
+// recording code gave it.
+@(private = "file")
+destroy_unattached_component :: proc(component: ^Component) {
+    if component.destroy != nil {
+        component->destroy()
+    }
+    free(component)
+}
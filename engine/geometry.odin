@@ -0,0 +1,169 @@
+package engine
+import "core:sync"
+import "core:mem"
+import "gpu"
+
+// All mesh geometry lives in a few big device local vertex and index buffers (pages) instead of a
+// buffer pair per mesh. Meshes only hold their ranges in a page, so draws of different meshes
+// in the same page don't need to rebind anything, just a different first index/vertex offset.
+
+// 1M vertices per page.
+GEOMETRY_PAGE_VERTICES :: 1024 * 1024
+GEOMETRY_PAGE_INDEX_SIZE :: 16 * mem.Megabyte
+// Index ranges are kept 4 byte aligned so a page can hold both u16 and u32 indices.
+GEOMETRY_INDEX_ALIGNMENT :: 4
+// Pages are never moved or freed until shutdown, so the render thread can read them while meshes are loading.
+MAX_GEOMETRY_PAGES :: 64
+
+GeometryPage :: struct {
+    // Allocated in vertices.
+    vertices: gpu.BufferArena,
+    // Allocated in bytes.
+    indices: gpu.BufferArena,
+}
+
+GeometryArena :: struct {
+    device: ^gpu.Device,
+    pages: [MAX_GEOMETRY_PAGES]GeometryPage,
+    page_count: int,
+    // Meshes can be loaded from any thread.
+    mutex: sync.Mutex,
+}
+
+MeshGeometry :: struct {
+    page: int,
+    vertices: gpu.BufferRange,
+    indices: gpu.BufferRange,
+    // Picked per mesh, u16 unless there are too many vertices.
+    index_type: gpu.IndexType,
+
+    // Ready to be passed to draw_indexed.
+    first_index: u32,
+    vertex_offset: i32,
+}
+
+geometry_arena_init :: proc(arena: ^GeometryArena, device: ^gpu.Device) {
+    arena.device = device
+}
+
+geometry_arena_deinit :: proc(arena: ^GeometryArena) {
+    for &page in arena.pages[:arena.page_count] {
+        gpu.destroy_buffer_arena(&page.vertices)
+        gpu.destroy_buffer_arena(&page.indices)
+    }
+    arena.page_count = 0
+}
+
+// Finds room for the mesh in one of the pages, creating a new page when they are all full.
+// Meshes bigger than a page get a page of their own.
+geometry_alloc :: proc(
+    arena: ^GeometryArena,
+    vertices: []Vertex,
+    index_bytes: []byte,
+    index_type: gpu.IndexType,
+) -> (geometry: MeshGeometry, ok: bool) {
+    if sync.guard(&arena.mutex) {
+        found := false
+        for &page, i in arena.pages[:arena.page_count] {
+            vertex_range, vertex_ok := gpu.buffer_arena_alloc(&page.vertices, len(vertices))
+            if !vertex_ok do continue
+            index_range, index_ok := gpu.buffer_arena_alloc(&page.indices, len(index_bytes), GEOMETRY_INDEX_ALIGNMENT)
+            if !index_ok {
+                gpu.buffer_arena_free(&page.vertices, vertex_range)
+                continue
+            }
+
+            geometry = {page = i, vertices = vertex_range, indices = index_range}
+            found = true
+            break
+        }
+
+        if !found {
+            if arena.page_count == MAX_GEOMETRY_PAGES {
+                log_error(LC.Renderer, "Out of geometry pages (%v), cannot load any more meshes.", MAX_GEOMETRY_PAGES)
+                return
+            }
+
+            geometry.page = arena.page_count
+            page := &arena.pages[geometry.page]
+            geometry_page_init(
+                arena.device,
+                page,
+                max(GEOMETRY_PAGE_VERTICES, len(vertices)),
+                max(GEOMETRY_PAGE_INDEX_SIZE, mem.align_forward_int(len(index_bytes), GEOMETRY_INDEX_ALIGNMENT)))
+            arena.page_count += 1
+
+            geometry.vertices = gpu.buffer_arena_alloc(&page.vertices, len(vertices)) or_return
+            geometry.indices = gpu.buffer_arena_alloc(&page.indices, len(index_bytes), GEOMETRY_INDEX_ALIGNMENT) or_return
+        }
+
+        page := &arena.pages[geometry.page]
+        gpu.buffer_arena_upload(&page.vertices, geometry.vertices, mem.slice_to_bytes(vertices))
+        gpu.buffer_arena_upload(&page.indices, geometry.indices, index_bytes)
+    }
+
+    geometry.index_type = index_type
+    geometry.first_index = u32(geometry.indices.offset / gpu.index_type_size(index_type))
+    geometry.vertex_offset = i32(geometry.vertices.offset)
+    return geometry, true
+}
+
+geometry_free :: proc(arena: ^GeometryArena, geometry: MeshGeometry) {
+    if sync.guard(&arena.mutex) {
+        if geometry.page >= arena.page_count do return
+        page := &arena.pages[geometry.page]
+        gpu.buffer_arena_free(&page.vertices, geometry.vertices)
+        gpu.buffer_arena_free(&page.indices, geometry.indices)
+    }
+}
+
+// What is currently bound on a command buffer, so draw_mesh only rebinds when it has to.
+GeometryBinding :: struct {
+    page: int,
+    index_type: gpu.IndexType,
+}
+
+NO_GEOMETRY_BINDING :: GeometryBinding{page = -1}
+
+@(private = "file")
+geometry_page_init :: proc(device: ^gpu.Device, page: ^GeometryPage, vertex_count, index_size: int) {
+    page.vertices = gpu.create_buffer_arena(gpu.BufferSpecification {
+        device = device,
+        name = "Geometry Vertex Page",
+        size = vertex_count * size_of(Vertex),
+        usage = {.Vertex},
+        device_local = true,
+    }, size_of(Vertex))
+
+    page.indices = gpu.create_buffer_arena(gpu.BufferSpecification {
+        device = device,
+        name = "Geometry Index Page",
+        size = index_size,
+        usage = {.Index},
+        device_local = true,
+    })
+}
+
+// Draws `count` instances of a LOD of `mesh`, binding its page first if `bound` is a different one.
+// Pages hold both u16 and u32 indices, the index buffer is also rebound when the type changes.
+draw_mesh :: proc(
+    arena: ^GeometryArena,
+    cmd: gpu.CommandBuffer,
+    mesh: Mesh,
+    #any_int lod: int,
+    #any_int count, first_instance: u32,
+    bound: ^GeometryBinding,
+) {
+    geometry := mesh.geometry
+    page := &arena.pages[geometry.page]
+    if geometry.page != bound.page {
+        gpu.bind_buffers(cmd, page.vertices.buffer)
+    }
+    if geometry.page != bound.page || geometry.index_type != bound.index_type {
+        gpu.bind_index_buffer(cmd, page.indices.buffer, geometry.index_type)
+    }
+    bound^ = {geometry.page, geometry.index_type}
+
+    range := mesh.lods[clamp(lod, 0, mesh.lod_count - 1)]
+    gpu.draw_indexed(cmd, range.index_count, count, geometry.first_index + range.first_index, geometry.vertex_offset, first_instance)
+}
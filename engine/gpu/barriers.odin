@@ -0,0 +1,235 @@
+package gpu
+import vk "vendor:vulkan"
+
+// Barriers described by what happens to a resource instead of by stages and access masks. Every
+// Access maps to the stages, memory access and image layout Vulkan wants, so a barrier can be worked
+// out from the state a resource was left in and how it's about to be used. The render graph in the
+// engine keeps a ResourceState per resource and collects the barriers of a pass in a BarrierBatch.
+
+Access :: enum {
+    None,
+    IndirectRead,
+    VertexShaderRead,
+    FragmentShaderRead,
+    ComputeShaderRead,
+    ComputeShaderWrite,
+    ColorAttachmentWrite,
+    DepthAttachmentRead,
+    DepthAttachmentWrite,
+    TransferRead,
+    TransferWrite,
+    HostRead,
+}
+
+AccessFlags :: bit_set[Access]
+
+WRITE_ACCESSES :: AccessFlags{.ComputeShaderWrite, .ColorAttachmentWrite, .DepthAttachmentWrite, .TransferWrite}
+
+ResourceState :: struct {
+    // Whatever wrote the resource last, which the next access has to wait for.
+    written: AccessFlags,
+    // Reads since then, which the next write has to wait for.
+    read: AccessFlags,
+    layout: ImageLayout,
+}
+
+BarrierBatch :: struct {
+    src_stages, dst_stages: vk.PipelineStageFlags,
+    images: [dynamic]vk.ImageMemoryBarrier,
+    buffers: [dynamic]vk.BufferMemoryBarrier,
+}
+
+// Adds the barrier `image` needs before `access`, if any, and moves `state` past it. With `discard`
+// the current contents are thrown away, which is what transient images want on their first use.
+barrier_image :: proc(batch: ^BarrierBatch, image: ^Image, state: ^ResourceState, access: Access, discard := false) {
+    depth := is_depth_format(image.spec.format)
+    layout := access_layout(access, depth)
+    old_layout := ImageLayout.Undefined if discard else state.layout
+
+    transition := old_layout != layout
+    src_stages, src_access, needed := resolve_hazard(state, access, transition)
+    if !needed && !transition {
+        return
+    }
+
+    aspect: vk.ImageAspectFlags = {.COLOR}
+    if depth {
+        aspect = {.DEPTH}
+        #partial switch image.spec.format {
+        case .D32_SFLOAT_S8_UINT, .DEPTH24_STENCIL8:
+            aspect += {.STENCIL}
+        }
+    }
+
+    dst_stages, dst_access := access_info(access)
+    if batch.images == nil {
+        batch.images = make([dynamic]vk.ImageMemoryBarrier, context.temp_allocator)
+    }
+    append(&batch.images, vk.ImageMemoryBarrier {
+        sType = .IMAGE_MEMORY_BARRIER,
+        srcAccessMask = src_access,
+        dstAccessMask = dst_access,
+        oldLayout = image_layout_to_vulkan(old_layout),
+        newLayout = image_layout_to_vulkan(layout),
+        srcQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        dstQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        image = image.handle,
+        subresourceRange = vk.ImageSubresourceRange {
+            aspectMask = aspect,
+            levelCount = vk.REMAINING_MIP_LEVELS,
+            layerCount = vk.REMAINING_ARRAY_LAYERS,
+        },
+    })
+    batch.src_stages += src_stages
+    batch.dst_stages += dst_stages
+
+    state.layout = layout
+    image.spec.layout = layout
+}
+
+// Same as barrier_image, for buffers, which have no layout.
+barrier_buffer :: proc(batch: ^BarrierBatch, buffer: Buffer, state: ^ResourceState, access: Access) {
+    src_stages, src_access, needed := resolve_hazard(state, access)
+    if !needed {
+        return
+    }
+
+    dst_stages, dst_access := access_info(access)
+    if batch.buffers == nil {
+        batch.buffers = make([dynamic]vk.BufferMemoryBarrier, context.temp_allocator)
+    }
+    append(&batch.buffers, vk.BufferMemoryBarrier {
+        sType = .BUFFER_MEMORY_BARRIER,
+        srcAccessMask = src_access,
+        dstAccessMask = dst_access,
+        srcQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        dstQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        buffer = buffer.handle,
+        size = vk.DeviceSize(vk.WHOLE_SIZE),
+    })
+    batch.src_stages += src_stages
+    batch.dst_stages += dst_stages
+}
+
+// Records every barrier in the batch with a single vkCmdPipelineBarrier and empties it.
+// Returns how many barriers there were.
+cmd_flush_barriers :: proc(cmd: CommandBuffer, batch: ^BarrierBatch) -> (count: int) {
+    count = len(batch.images) + len(batch.buffers)
+    if count == 0 {
+        return
+    }
+
+    src_stages := batch.src_stages
+    if src_stages == {} {
+        src_stages = {.TOP_OF_PIPE}
+    }
+    vk.CmdPipelineBarrier(
+        cmd.handle,
+        src_stages, batch.dst_stages, {},
+        0, nil,
+        u32(len(batch.buffers)), raw_data(batch.buffers),
+        u32(len(batch.images)), raw_data(batch.images))
+
+    clear(&batch.images)
+    clear(&batch.buffers)
+    batch.src_stages = {}
+    batch.dst_stages = {}
+    return
+}
+
+// Works out what `access` has to wait for and updates `state` as if it happened. A layout transition
+// writes the image, so it waits for earlier reads like a write would.
+@(private = "file")
+resolve_hazard :: proc(state: ^ResourceState, access: Access, transition := false) -> (src_stages: vk.PipelineStageFlags, src_access: vk.AccessFlags, needed: bool) {
+    if transition {
+        for previous in state.read {
+            stages, _ := access_info(previous)
+            src_stages += stages
+        }
+        if access not_in WRITE_ACCESSES {
+            state.read = {}
+        }
+    }
+
+    if access in WRITE_ACCESSES {
+        // Write after write or after read. Reads only need to be done, their memory has nothing to flush.
+        for previous in state.written {
+            stages, mask := access_info(previous)
+            src_stages += stages
+            src_access += mask
+        }
+        for previous in state.read {
+            stages, _ := access_info(previous)
+            src_stages += stages
+        }
+        needed = state.written != {} || state.read != {}
+        state.written = {access}
+        state.read = {}
+        return
+    }
+
+    // Read after write, once per kind of read.
+    if access not_in state.read {
+        for previous in state.written {
+            stages, mask := access_info(previous)
+            src_stages += stages
+            src_access += mask
+        }
+        needed = state.written != {}
+        state.read += {access}
+    }
+    return
+}
+
+access_info :: proc(access: Access) -> (stages: vk.PipelineStageFlags, mask: vk.AccessFlags) {
+    switch access {
+    case .None:
+        return {.TOP_OF_PIPE}, {}
+    case .IndirectRead:
+        return {.DRAW_INDIRECT}, {.INDIRECT_COMMAND_READ}
+    case .VertexShaderRead:
+        return {.VERTEX_SHADER}, {.SHADER_READ}
+    case .FragmentShaderRead:
+        return {.FRAGMENT_SHADER}, {.SHADER_READ}
+    case .ComputeShaderRead:
+        return {.COMPUTE_SHADER}, {.SHADER_READ}
+    case .ComputeShaderWrite:
+        return {.COMPUTE_SHADER}, {.SHADER_READ, .SHADER_WRITE}
+    case .ColorAttachmentWrite:
+        return {.COLOR_ATTACHMENT_OUTPUT}, {.COLOR_ATTACHMENT_READ, .COLOR_ATTACHMENT_WRITE}
+    case .DepthAttachmentRead:
+        return {.EARLY_FRAGMENT_TESTS, .LATE_FRAGMENT_TESTS}, {.DEPTH_STENCIL_ATTACHMENT_READ}
+    case .DepthAttachmentWrite:
+        return {.EARLY_FRAGMENT_TESTS, .LATE_FRAGMENT_TESTS}, {.DEPTH_STENCIL_ATTACHMENT_READ, .DEPTH_STENCIL_ATTACHMENT_WRITE}
+    case .TransferRead:
+        return {.TRANSFER}, {.TRANSFER_READ}
+    case .TransferWrite:
+        return {.TRANSFER}, {.TRANSFER_WRITE}
+    case .HostRead:
+        return {.HOST}, {.HOST_READ}
+    }
+    unreachable()
+}
+
+// The layout an image has to be in for `access`.
+access_layout :: proc(access: Access, depth: bool) -> ImageLayout {
+    switch access {
+    case .None:
+        return .Undefined
+    case .VertexShaderRead, .FragmentShaderRead, .ComputeShaderRead:
+        return .DepthStencilReadOnlyOptimal if depth else .ShaderReadOnlyOptimal
+    case .ComputeShaderWrite, .IndirectRead, .HostRead:
+        return .General
+    case .ColorAttachmentWrite:
+        return .ColorAttachmentOptimal
+    case .DepthAttachmentRead:
+        return .DepthStencilReadOnlyOptimal
+    case .DepthAttachmentWrite:
+        return .DepthStencilAttachmentOptimal
+    case .TransferRead:
+        return .TransferSrcOptimal
+    case .TransferWrite:
+        return .TransferDstOptimal
+    }
+    unreachable()
+}
@@ -17,6 +17,9 @@ BufferUsage :: enum {
     Vertex,
     Index,
     Uniform,
+    Storage,
+    // Holds draw commands (and their count) for the draw_*_indirect commands.
+    Indirect,
 
     TransferSource,
     TransferDest,
@@ -30,6 +33,10 @@ BufferSpecification :: struct {
     usage: BufferUsageFlags,
     size: int,
     mapped: bool,
+    // Lives in device local memory, not visible to the host. Written with `buffer_upload` through the uploader.
+    device_local: bool,
+    // Mapped and read by the host, prefers cached memory. Call `buffer_invalidate` before reading.
+    readback: bool,
 }
 
 create_buffer :: proc(spec: BufferSpecification) -> (buffer: Buffer) {
@@ -50,6 +57,20 @@ create_buffer :: proc(spec: BufferSpecification) -> (buffer: Buffer) {
     if spec.mapped {
         allocation_info.flags += {.MAPPED}
     }
+    if spec.readback {
+        allocation_info.flags = {.HOST_ACCESS_RANDOM, .MAPPED}
+    }
+
+    families: [2]u32
+    if spec.device_local {
+        assert(!spec.mapped, "Device local buffers cannot be mapped")
+        allocation_info.usage = .AUTO_PREFER_DEVICE
+        allocation_info.flags = {}
+        buffer_create_info.usage += {.TRANSFER_DST}
+
+        buffer_create_info.sharingMode, families, buffer_create_info.queueFamilyIndexCount = device_sharing_mode(spec.device)
+        buffer_create_info.pQueueFamilyIndices = raw_data(families[:])
+    }
 
     check(vma.CreateBuffer(spec.device.allocator, &buffer_create_info, &allocation_info, &buffer.handle, &buffer.allocation, &buffer.alloc_info))
     vma.SetAllocationName(spec.device.allocator, buffer.allocation, spec.name)
@@ -74,12 +95,22 @@ buffer_unmap :: proc(buffer: Buffer)  {
     vma.UnmapMemory(buffer.spec.device.allocator, buffer.allocation)
 }
 
-buffer_upload :: proc(buffer: Buffer, data: []byte) {
+// Makes writes from the device visible to mapped pointers, for memory that isn't host coherent.
+buffer_invalidate :: proc(buffer: Buffer) {
+    vma.InvalidateAllocation(buffer.spec.device.allocator, buffer.allocation, 0, vk.DeviceSize(vk.WHOLE_SIZE))
+}
+
+buffer_upload :: proc(buffer: Buffer, data: []byte, offset := 0) {
+    if buffer.spec.device_local {
+        upload_buffer(buffer, data, offset)
+        return
+    }
+
     ptr: rawptr
     buffer_map(buffer, &ptr)
     defer buffer_unmap(buffer)
 
-    mem.copy(ptr, raw_data(data), len(data))
+    mem.copy(rawptr(uintptr(ptr) + uintptr(offset)), raw_data(data), len(data))
 }
 
 buffer_copy_to_image :: proc(buffer: Buffer, image: Image) {
@@ -119,6 +150,10 @@ buffer_usage_to_vulkan :: proc(usages: BufferUsageFlags) -> (vk_usage: vk.Buffer
             vk_usage += {.VERTEX_BUFFER}
         case .Uniform:
             vk_usage += {.UNIFORM_BUFFER}
+        case .Storage:
+            vk_usage += {.STORAGE_BUFFER}
+        case .Indirect:
+            vk_usage += {.INDIRECT_BUFFER}
         case .TransferSource:
             vk_usage += {.TRANSFER_SRC}
         case .TransferDest:
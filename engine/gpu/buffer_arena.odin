@@ -0,0 +1,77 @@
+package gpu
+import vk "vendor:vulkan"
+import vma "packages:odin-vma"
+
+// One big buffer that gets suballocated. VMA does the bookkeeping through a virtual block,
+// so allocations are just offsets into `buffer`.
+// Offsets and sizes are in `unit` sized elements (bytes by default). A vertex arena with
+// `unit = size_of(Vertex)` hands out offsets that can be used as the vertex offset of a draw directly.
+BufferArena :: struct {
+    buffer: Buffer,
+    block: vma.VirtualBlock,
+
+    unit: int,
+    // In units.
+    capacity: int,
+    used: int,
+}
+
+BufferRange :: struct {
+    allocation: vma.VirtualAllocation,
+    // In units.
+    offset, size: int,
+}
+
+// `spec.size` is the size of the buffer in bytes.
+create_buffer_arena :: proc(spec: BufferSpecification, unit := 1) -> (arena: BufferArena) {
+    assert(unit > 0)
+    arena.unit = unit
+    arena.capacity = spec.size / unit
+    arena.buffer = create_buffer(spec)
+
+    block_info := vma.VirtualBlockCreateInfo {
+        size = vk.DeviceSize(arena.capacity),
+    }
+    check(vma.CreateVirtualBlock(&block_info, &arena.block))
+    return
+}
+
+destroy_buffer_arena :: proc(arena: ^BufferArena) {
+    // Anything still allocated is about to be destroyed with the buffer anyway.
+    vma.ClearVirtualBlock(arena.block)
+    vma.DestroyVirtualBlock(arena.block)
+    destroy_buffer(arena.buffer)
+    arena^ = {}
+}
+
+// Returns false when there is no room left, the caller is expected to try another arena.
+buffer_arena_alloc :: proc(arena: ^BufferArena, #any_int count: int, #any_int alignment := 1) -> (range: BufferRange, ok: bool) {
+    if count <= 0 || count > arena.capacity - arena.used {
+        return
+    }
+
+    alloc_info := vma.VirtualAllocationCreateInfo {
+        size = vk.DeviceSize(count),
+        alignment = vk.DeviceSize(alignment),
+    }
+    offset: vk.DeviceSize
+    if vma.VirtualAllocate(arena.block, &alloc_info, &range.allocation, &offset) != .SUCCESS {
+        return
+    }
+
+    range.offset = int(offset)
+    range.size = count
+    arena.used += count
+    return range, true
+}
+
+buffer_arena_free :: proc(arena: ^BufferArena, range: BufferRange) {
+    if range.size == 0 do return
+    vma.VirtualFree(arena.block, range.allocation)
+    arena.used -= range.size
+}
+
+buffer_arena_upload :: proc(arena: ^BufferArena, range: BufferRange, data: []byte) {
+    assert(len(data) <= range.size * arena.unit, "Upload does not fit in the arena range")
+    buffer_upload(arena.buffer, data, range.offset * arena.unit)
+}
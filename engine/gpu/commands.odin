@@ -5,35 +5,87 @@ import tracy "packages:odin-tracy"
 CommandBuffer :: struct {
     id: UUID,
     handle: vk.CommandBuffer,
+    // The pool this buffer was allocated from.
+    pool: vk.CommandPool,
 
     spec: CommandBufferSpecification,
 }
 
+CommandBufferLevel :: enum {
+    Primary,
+    // Recorded inside a render pass and executed from a primary buffer with `execute_commands`.
+    Secondary,
+}
+
 CommandBufferSpecification :: struct {
     tag: cstring,
     device: Device,
+    level: CommandBufferLevel,
 }
 
 create_command_buffer :: proc(device: Device, spec: CommandBufferSpecification) -> (cmd_buffer: CommandBuffer) {
+    return allocate_command_buffer_raw(device.command_pool, spec)
+}
+
+destroy_command_buffer :: proc(cmd_buffer: CommandBuffer) {
+    cmd_buffer := cmd_buffer
+    vk.FreeCommandBuffers(cmd_buffer.spec.device.handle, cmd_buffer.pool, 1, &cmd_buffer.handle)
+}
+
+// Command pools are not thread safe, so every thread (or job) that records commands
+// in parallel needs its own pool. The device pool is for the main thread only.
+CommandPool :: struct {
+    handle: vk.CommandPool,
+    device: ^Device,
+}
+
+// Transient pools are meant to be reset as a whole every frame with `command_pool_reset`.
+create_command_pool :: proc(device: ^Device, tag: cstring, transient := true) -> (pool: CommandPool) {
+    pool.device = device
+    indices := get_queue_families(device.physical_device, device.surface)
+
+    create_info := vk.CommandPoolCreateInfo {
+        sType = .COMMAND_POOL_CREATE_INFO,
+        flags = {.TRANSIENT} if transient else {.RESET_COMMAND_BUFFER},
+        queueFamilyIndex = cast(u32)indices.graphics_family.(int),
+    }
+
+    check(vk.CreateCommandPool(device.handle, &create_info, nil, &pool.handle))
+    set_handle_name(device, pool.handle, .COMMAND_POOL, tag)
+    return
+}
+
+destroy_command_pool :: proc(pool: CommandPool) {
+    vk.DestroyCommandPool(pool.device.handle, pool.handle, nil)
+}
+
+// Resets every buffer allocated from the pool. None of them can be pending execution.
+command_pool_reset :: proc(pool: CommandPool) {
+    tracy.Zone()
+    check(vk.ResetCommandPool(pool.device.handle, pool.handle, {}))
+}
+
+allocate_command_buffer :: proc(pool: CommandPool, spec: CommandBufferSpecification) -> CommandBuffer {
+    return allocate_command_buffer_raw(pool.handle, spec)
+}
+
+@(private)
+allocate_command_buffer_raw :: proc(pool: vk.CommandPool, spec: CommandBufferSpecification) -> (cmd_buffer: CommandBuffer) {
     cmd_buffer.id = new_id()
     cmd_buffer.spec = spec
+    cmd_buffer.pool = pool
 
     cmd_buffer_create_info := vk.CommandBufferAllocateInfo {
         sType = .COMMAND_BUFFER_ALLOCATE_INFO,
-        commandPool = device.command_pool,
-        level = .PRIMARY,
+        commandPool = pool,
+        level = .SECONDARY if spec.level == .Secondary else .PRIMARY,
         commandBufferCount = 1,
     }
 
-    check(vk.AllocateCommandBuffers(device.handle, &cmd_buffer_create_info, &cmd_buffer.handle))
+    check(vk.AllocateCommandBuffers(spec.device.handle, &cmd_buffer_create_info, &cmd_buffer.handle))
     return
 }
 
-destroy_command_buffer :: proc(cmd_buffer: CommandBuffer) {
-    cmd_buffer := cmd_buffer
-    vk.FreeCommandBuffers(cmd_buffer.spec.device.handle, cmd_buffer.spec.device.command_pool, 1, &cmd_buffer.handle)
-}
-
 create_command_buffers :: proc(device: Device, spec: CommandBufferSpecification, $count: int) -> (cmd_buffers: [count]CommandBuffer) {
     for i in 0..<count {
         cmd_buffers[i] = create_command_buffer(device, spec)
@@ -56,6 +108,36 @@ cmd_begin :: proc(cmd_buffer: CommandBuffer, type: CommandType = .None) {
     vk.BeginCommandBuffer(cmd_buffer.handle, &begin_info)
 }
 
+// Begins a secondary command buffer that will be executed inside `renderpass`.
+// Dynamic state (viewport, scissor) and bound resources are not inherited and must be set again.
+cmd_begin_secondary :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, framebuffer: FrameBuffer, subpass := u32(0)) {
+    assert(cmd_buffer.spec.level == .Secondary)
+    inheritance_info := vk.CommandBufferInheritanceInfo {
+        sType = .COMMAND_BUFFER_INHERITANCE_INFO,
+        renderPass = renderpass.handle,
+        subpass = subpass,
+        framebuffer = framebuffer.handle,
+    }
+
+    begin_info := vk.CommandBufferBeginInfo {
+        sType = .COMMAND_BUFFER_BEGIN_INFO,
+        flags = {.ONE_TIME_SUBMIT, .RENDER_PASS_CONTINUE},
+        pInheritanceInfo = &inheritance_info,
+    }
+    vk.BeginCommandBuffer(cmd_buffer.handle, &begin_info)
+}
+
+// Executes secondary buffers from a primary one. The render pass must have been
+// started with `.SecondaryCommandBuffers` contents.
+execute_commands :: proc(cmd: CommandBuffer, secondaries: ..CommandBuffer) {
+    tracy.Zone()
+    handles := make([]vk.CommandBuffer, len(secondaries), context.temp_allocator)
+    for secondary, i in secondaries {
+        handles[i] = secondary.handle
+    }
+    vk.CmdExecuteCommands(cmd.handle, cast(u32)len(handles), raw_data(handles))
+}
+
 @(deferred_in = cmd_end)
 do_cmd :: proc(cmd_buffer: CommandBuffer, type: CommandType = .None) -> bool {
     cmd_begin(cmd_buffer, type)
@@ -107,9 +189,29 @@ draw :: proc(cmd: CommandBuffer, #any_int vertex_count, instance_count: u32, fir
     vk.CmdDraw(cmd.handle, vertex_count, instance_count, first_vertex, first_instance)
 }
 
-draw_indexed :: proc(cmd: CommandBuffer, #any_int index_count, instance_count: u32, first_index := u32(0), vertex_offset := i32(0), vertex_count := u32(0)) {
+draw_indexed :: proc(cmd: CommandBuffer, #any_int index_count, instance_count: u32, first_index := u32(0), vertex_offset := i32(0), first_instance := u32(0)) {
     tracy.Zone()
-    vk.CmdDrawIndexed(cmd.handle, index_count, instance_count, first_index, vertex_offset, vertex_count)
+    vk.CmdDrawIndexed(cmd.handle, index_count, instance_count, first_index, vertex_offset, first_instance)
+}
+
+IndexType :: enum {
+    U16,
+    U32,
+}
+
+index_type_size :: proc(type: IndexType) -> int {
+    switch type {
+    case .U16:
+        return 2
+    case .U32:
+        return 4
+    }
+    unreachable()
+}
+
+bind_index_buffer :: proc(cmd: CommandBuffer, buffer: Buffer, type: IndexType, offset := 0) {
+    tracy.Zone()
+    vk.CmdBindIndexBuffer(cmd.handle, buffer.handle, vk.DeviceSize(offset), type == .U16 ? .UINT16 : .UINT32)
 }
 
 bind_buffers :: proc(cmd: CommandBuffer, buffers: ..Buffer) {
@@ -134,5 +236,42 @@ bind_resource :: proc(cmd: CommandBuffer, resource: Resource, pipeline: Pipeline
         resource.handle,
     }
 
-    vk.CmdBindDescriptorSets(cmd.handle, .GRAPHICS, pipeline.spec.layout.handle, first_set, 1, raw_data(sets), 0, nil)
+    vk.CmdBindDescriptorSets(cmd.handle, pipeline_bind_point(pipeline), pipeline.spec.layout.handle, first_set, 1, raw_data(sets), 0, nil)
+}
+
+dispatch :: proc(cmd: CommandBuffer, #any_int x: u32, #any_int y: u32 = 1, #any_int z: u32 = 1) {
+    tracy.Zone()
+    vk.CmdDispatch(cmd.handle, x, y, z)
+}
+
+// Draws up to `max_draws` DrawIndexedIndirectCommands from `buffer`, the actual number is read from
+// a u32 in `count_buffer`. Both offsets are in bytes.
+draw_indexed_indirect_count :: proc(
+    cmd: CommandBuffer,
+    buffer: Buffer, #any_int offset: int,
+    count_buffer: Buffer, #any_int count_offset: int,
+    #any_int max_draws: u32,
+) {
+    tracy.Zone()
+    vk.CmdDrawIndexedIndirectCount(
+        cmd.handle,
+        buffer.handle, vk.DeviceSize(offset),
+        count_buffer.handle, vk.DeviceSize(count_offset),
+        max_draws, size_of(vk.DrawIndexedIndirectCommand))
+}
+
+// Sets `size` bytes of `buffer` to `value`, which is repeated every 4 bytes. Has to be outside of a render pass.
+fill_buffer :: proc(cmd: CommandBuffer, buffer: Buffer, #any_int offset, size: int, value := u32(0)) {
+    vk.CmdFillBuffer(cmd.handle, buffer.handle, vk.DeviceSize(offset), vk.DeviceSize(size), value)
 }
+
+// Makes fill_buffer/copy writes visible to compute shaders.
+cmd_transfer_to_compute_barrier :: proc(cmd: CommandBuffer) {
+    barrier := vk.MemoryBarrier {
+        sType = .MEMORY_BARRIER,
+        srcAccessMask = {.TRANSFER_WRITE},
+        dstAccessMask = {.SHADER_READ, .SHADER_WRITE},
+    }
+    vk.CmdPipelineBarrier(cmd.handle, {.TRANSFER}, {.COMPUTE_SHADER}, {}, 1, &barrier, 0, nil, 0, nil)
+}
+
@@ -15,6 +15,8 @@ ResourcePoolSpecification :: struct {
     device: ^Device,
     max_sets: int,
     resource_limits: [dynamic]ResourceLimit,
+    // Required to allocate layouts with bindless resources.
+    update_after_bind: bool,
 }
 
 create_resource_pool :: proc(spec: ResourcePoolSpecification) -> (pool: ResourcePool) {
@@ -37,6 +39,9 @@ create_resource_pool :: proc(spec: ResourcePoolSpecification) -> (pool: Resource
         maxSets       = cast(u32) spec.max_sets,
         flags = {.FREE_DESCRIPTOR_SET},
     }
+    if spec.update_after_bind {
+        pool_info.flags += {.UPDATE_AFTER_BIND}
+    }
 
     check(vk.CreateDescriptorPool(spec.device.handle, &pool_info, nil, &pool.handle))
     return
@@ -96,7 +101,8 @@ allocate_resource :: proc(pool: ResourcePool, layout: ResourceLayout, name: cstr
     return
 }
 
-resource_bind_image :: proc(resource: Resource, image: Image, type: ResourceType, binding := u32(0)) {
+// `array_element` picks the descriptor to write in array bindings.
+resource_bind_image :: proc(resource: Resource, image: Image, type: ResourceType, binding := u32(0), array_element := u32(0)) {
     image_info := vk.DescriptorImageInfo {
         sampler = image.sampler.handle,
         imageView = image.view.handle,
@@ -110,7 +116,7 @@ resource_bind_image :: proc(resource: Resource, image: Image, type: ResourceType
         pImageInfo = &image_info,
         descriptorType = resource_type_to_vulkan(type),
         descriptorCount = 1,
-        dstArrayElement = 0,
+        dstArrayElement = array_element,
     }
 
     vk.UpdateDescriptorSets(image.spec.device.handle, 1, &a, 0, nil)
@@ -193,6 +199,9 @@ ResourceUsage :: struct {
     type: ResourceType,
     count: int,
     stage: ShaderStages,
+    // Descriptors of this binding can be left unwritten and updated while the set is bound,
+    // as long as the GPU doesn't use those particular descriptors. For big arrays indexed in the shader.
+    bindless: bool,
 }
 
 ResourceLayout :: struct {
@@ -202,6 +211,8 @@ ResourceLayout :: struct {
 
 create_resource_layout :: proc(device: Device, usages: ..ResourceUsage) -> (layout: ResourceLayout) {
     bindings := make([dynamic]vk.DescriptorSetLayoutBinding, 0, len(usages), context.temp_allocator)
+    binding_flags := make([dynamic]vk.DescriptorBindingFlags, 0, len(usages), context.temp_allocator)
+    any_bindless := false
     for resource, i in usages {
         a := vk.DescriptorSetLayoutBinding {
             binding = u32(i),
@@ -210,6 +221,19 @@ create_resource_layout :: proc(device: Device, usages: ..ResourceUsage) -> (layo
             stageFlags = shader_stage_to_vulkan(resource.stage),
         }
         append(&bindings, a)
+
+        flags: vk.DescriptorBindingFlags
+        if resource.bindless {
+            flags = {.PARTIALLY_BOUND, .UPDATE_AFTER_BIND}
+            any_bindless = true
+        }
+        append(&binding_flags, flags)
+    }
+
+    flags_info := vk.DescriptorSetLayoutBindingFlagsCreateInfo {
+        sType = .DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        bindingCount = cast(u32) len(binding_flags),
+        pBindingFlags = raw_data(binding_flags),
     }
 
     dslci := vk.DescriptorSetLayoutCreateInfo {
@@ -217,6 +241,10 @@ create_resource_layout :: proc(device: Device, usages: ..ResourceUsage) -> (layo
         bindingCount = cast(u32) len(bindings),
         pBindings = raw_data(bindings),
     }
+    if any_bindless {
+        dslci.pNext = &flags_info
+        dslci.flags = {.UPDATE_AFTER_BIND_POOL}
+    }
 
     check(vk.CreateDescriptorSetLayout(device.handle, &dslci, nil, &layout.handle))
     return
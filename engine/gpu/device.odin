@@ -12,6 +12,10 @@ Device :: struct {
     surface: vk.SurfaceKHR,
     graphics_queue: vk.Queue,
     present_queue: vk.Queue,
+    // A dedicated transfer queue if the device has one, otherwise the graphics queue.
+    transfer_queue: vk.Queue,
+    graphics_family, transfer_family: u32,
+    uploader: ^Uploader,
 
     command_pool: vk.CommandPool,
     properties: vk.PhysicalDeviceProperties,
@@ -19,6 +23,16 @@ Device :: struct {
 
     allocator: vma.Allocator,
     callbacks: ImageCallbacks,
+
+    // Shared by all pipelines, see pipeline_cache.odin.
+    pipeline_cache: vk.PipelineCache,
+    pipeline_stats: PipelineStats,
+
+    // vkCmdDrawIndexedIndirectCount, plus multi draw indirect with a first instance. Optional,
+    // the renderer falls back to recording the draws on the CPU without it.
+    supports_indirect_count: bool,
+    // BC1-7 images. Optional, textures are cooked uncompressed without it.
+    supports_bc_compression: bool,
 }
 
 ImageCreateCallback  :: #type proc(user_data: rawptr, image: ^Image)
@@ -55,7 +69,8 @@ create_device :: proc(instance: Instance, callbacks: ImageCallbacks = {}) -> (de
     return
 }
 
-destroy_device :: proc(#by_ptr device: Device) {
+destroy_device :: proc(device: ^Device) {
+    destroy_pipeline_cache(device)
     vk.DestroyCommandPool(device.handle, device.command_pool, nil)
 
     when VALIDATION {
@@ -123,6 +138,27 @@ device_create_image_view :: proc(
     return
 }
 
+MemoryBudget :: struct {
+    // In bytes, summed over the device local heaps.
+    usage, budget: int,
+}
+
+// How much device local memory the process uses and how much it can use. Without VK_EXT_memory_budget,
+// which isn't enabled, VMA estimates the budget from the heap sizes and tracks the usage itself.
+device_memory_budget :: proc(device: ^Device) -> (budget: MemoryBudget) {
+    properties: ^vk.PhysicalDeviceMemoryProperties
+    vma.GetMemoryProperties(device.allocator, &properties)
+
+    heaps: [vk.MAX_MEMORY_HEAPS]vma.Budget
+    vma.GetHeapBudgets(device.allocator, &heaps[0])
+
+    for heap, i in properties.memoryHeaps[:properties.memoryHeapCount] do if .DEVICE_LOCAL in heap.flags {
+        budget.usage += int(heaps[i].usage)
+        budget.budget += int(heaps[i].budget)
+    }
+    return
+}
+
 @(private)
 device_begin_single_time_command :: proc(device: Device) -> CommandBuffer {
     spec := CommandBufferSpecification {tag = "Single Time Command", device = device}
@@ -143,6 +179,22 @@ device_end_single_time_command :: proc(device: Device, cmd: CommandBuffer) {
         pCommandBuffers    = &cmd.handle,
     }
 
+    // Single time commands can touch resources that are still being uploaded.
+    device := device
+    wait_stage := vk.PipelineStageFlags{.ALL_COMMANDS}
+    semaphore, value, uploading := uploader_submit_wait(&device)
+    timeline_info := vk.TimelineSemaphoreSubmitInfo {
+        sType = .TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        waitSemaphoreValueCount = 1,
+        pWaitSemaphoreValues = &value,
+    }
+    if uploading {
+        submit_info.pNext = &timeline_info
+        submit_info.waitSemaphoreCount = 1
+        submit_info.pWaitSemaphores = &semaphore
+        submit_info.pWaitDstStageMask = &wait_stage
+    }
+
     vk.QueueSubmit(device.graphics_queue, 1, &submit_info, 0)
     vk.QueueWaitIdle(device.graphics_queue)
 
@@ -264,7 +316,7 @@ device_create_logical_device :: proc(device: ^Device) {
         context.temp_allocator,
     )
 
-    for fam in unique_families {
+    for fam in unique_families[:] {
         queue_priority := []f32{1.0}
         append(
             &queue_info,
@@ -277,13 +329,45 @@ device_create_logical_device :: proc(device: ^Device) {
         )
     }
 
+    supported12 := vk.PhysicalDeviceVulkan12Features {
+        sType = .PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    }
+    supported := vk.PhysicalDeviceFeatures2 {
+        sType = .PHYSICAL_DEVICE_FEATURES_2,
+        pNext = &supported12,
+    }
+    vk.GetPhysicalDeviceFeatures2(device.physical_device, &supported)
+
+    device.supports_indirect_count = bool(supported12.drawIndirectCount) &&
+        bool(supported.features.multiDrawIndirect) &&
+        bool(supported.features.drawIndirectFirstInstance)
+    device.supports_bc_compression = bool(supported.features.textureCompressionBC)
+
     device_features := vk.PhysicalDeviceFeatures {
         samplerAnisotropy = true,
         sampleRateShading = true,
+        multiDrawIndirect = b32(device.supports_indirect_count),
+        drawIndirectFirstInstance = b32(device.supports_indirect_count),
+        textureCompressionBC = b32(device.supports_bc_compression),
+    }
+
+    // Timeline semaphores track the uploads on the transfer queue, see `Uploader`.
+    // Descriptor indexing is for bindless resources, see `ResourceUsage.bindless`.
+    // Indirect count is for the GPU driven opaque pass, if it's there.
+    vulkan12_features := vk.PhysicalDeviceVulkan12Features {
+        sType = .PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        timelineSemaphore = true,
+        descriptorIndexing = true,
+        runtimeDescriptorArray = true,
+        descriptorBindingPartiallyBound = true,
+        descriptorBindingSampledImageUpdateAfterBind = true,
+        shaderSampledImageArrayNonUniformIndexing = true,
+        drawIndirectCount = b32(device.supports_indirect_count),
     }
 
     create_info := vk.DeviceCreateInfo {
         sType                   = vk.StructureType.DEVICE_CREATE_INFO,
+        pNext                   = &vulkan12_features,
         pQueueCreateInfos       = raw_data(queue_info),
         queueCreateInfoCount    = cast(u32) len(queue_info),
         pEnabledFeatures        = &device_features,
@@ -306,9 +390,27 @@ device_create_logical_device :: proc(device: ^Device) {
         0,
         &device.present_queue,
     )
+
+    device.graphics_family = cast(u32)indices.graphics_family.(int)
+    device.transfer_family = cast(u32)indices.transfer_family.(int)
+    if device.transfer_family == device.graphics_family {
+        device.transfer_queue = device.graphics_queue
+    } else {
+        vk.GetDeviceQueue(device.handle, device.transfer_family, 0, &device.transfer_queue)
+    }
     return
 }
 
+// Resources written by the transfer queue and read by the graphics queue are shared concurrently
+// between the two families, instead of doing queue ownership transfers.
+@(private)
+device_sharing_mode :: proc(device: ^Device) -> (mode: vk.SharingMode, families: [2]u32, count: u32) {
+    if device.transfer_family == device.graphics_family {
+        return .EXCLUSIVE, {}, 0
+    }
+    return .CONCURRENT, {device.graphics_family, device.transfer_family}, 2
+}
+
 @(private)
 device_create_command_pool :: proc(device: ^Device) {
     indices := get_queue_families(device.physical_device, device.surface)
@@ -398,6 +500,8 @@ Queue_Family_Indices :: struct {
     graphics_family: Maybe(int),
     present_family:  Maybe(int),
     compute_family:  Maybe(int),
+    // Always set once the graphics family is, falls back to it.
+    transfer_family: Maybe(int),
 }
 
 @(private)
@@ -409,13 +513,17 @@ is_queue_family_complete :: proc(using family: Queue_Family_Indices) -> bool {
 }
 
 @(private)
-get_unique_queue_families :: proc(using indices: Queue_Family_Indices) -> [1]u32 {
-    graphics, present, compute := cast(u32)graphics_family.(int), cast(u32)present_family.(int), cast(u32)compute_family.(int)
-    if graphics == present {
-        return {graphics}
+get_unique_queue_families :: proc(using indices: Queue_Family_Indices) -> (families: [dynamic]u32) {
+    families = make([dynamic]u32, 0, 2, context.temp_allocator)
+    graphics, present, transfer := cast(u32)graphics_family.(int), cast(u32)present_family.(int), cast(u32)transfer_family.(int)
+    if graphics != present {
+        log.error("Present and Graphics indices differe, do something")
+    }
+    append(&families, graphics)
+    if transfer != graphics {
+        append(&families, transfer)
     }
-    log.error("Present and Graphics indices differe, do something")
-    return {0}
+    return
 }
 
 @(private)
@@ -452,6 +560,15 @@ get_queue_families :: proc(
             break
         }
     }
+
+    // Prefer a transfer only family, those are usually backed by dedicated copy engines.
+    indices.transfer_family = indices.graphics_family
+    for property, i in properties {
+        if vk.QueueFlag.TRANSFER in property.queueFlags && property.queueFlags & {.GRAPHICS, .COMPUTE} == {} {
+            indices.transfer_family = i
+            break
+        }
+    }
     return
 }
 
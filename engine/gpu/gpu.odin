@@ -76,55 +76,64 @@ get_color_attachment :: proc(fb: FrameBuffer, #any_int index: int) -> Image {
     return fb.color_attachments[index]
 }
 
-read_pixel :: proc(fb: FrameBuffer, x, y: int, attachment := 0) -> (pixel: [4]byte, ok: bool) {
-    assert(attachment < len(fb.color_attachments), "Attachment index is bigger than the amount of attachments in the framebuffer")
-
-    cmd := device_begin_single_time_command(fb.spec.device^)
-
-    image := &fb.color_attachments[attachment]
-
-    if x < 0 || y < 0 || x >= image.spec.width || y >= image.spec.height {
-        ok = false
-        return
-    }
-
-    buffer_spec := BufferSpecification {
-        name = "Read Pixel Temp Buffer",
-        mapped = true,
-        device = fb.spec.device,
-        usage = {.TransferDest},
-        size = image.spec.width * image.spec.height * 4,
-    }
-
-    buffer := create_buffer(buffer_spec)
-    defer destroy_buffer(buffer)
+// Records a copy of a region of a color image into `buffer`, tightly packed rows. The image has to be
+// in TransferSrcOptimal already. The buffer is made visible to the host, so it can be read once the
+// command buffer is done.
+cmd_copy_image_region :: proc(cmd: CommandBuffer, image: ^Image, buffer: Buffer, x, y, width, height: int) {
+    assert(x >= 0 && y >= 0 && x + width <= image.spec.width && y + height <= image.spec.height, "Region is outside of the attachment")
 
     copy := vk.BufferImageCopy {
+        imageOffset = {i32(x), i32(y), 0},
         imageExtent = vk.Extent3D {
-            width = cast(u32) image.spec.width,
-            height = cast(u32) image.spec.height,
+            width = cast(u32) width,
+            height = cast(u32) height,
             depth = 1,
         },
         imageSubresource = vk.ImageSubresourceLayers {
             aspectMask = {.COLOR},
             layerCount = 1,
-        }
+        },
     }
 
-    image_transition_layout(image, .TransferSrcOptimal, old = .ColorAttachmentOptimal)
     vk.CmdCopyImageToBuffer(cmd.handle, image.handle, .TRANSFER_SRC_OPTIMAL, buffer.handle, 1, &copy)
-    device_end_single_time_command(fb.spec.device^, cmd)
 
-    image_transition_layout(image, .ColorAttachmentOptimal)
+    barrier := vk.BufferMemoryBarrier {
+        sType = .BUFFER_MEMORY_BARRIER,
+        srcAccessMask = {.TRANSFER_WRITE},
+        dstAccessMask = {.HOST_READ},
+        srcQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        dstQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+        buffer = buffer.handle,
+        size = vk.DeviceSize(vk.WHOLE_SIZE),
+    }
+    vk.CmdPipelineBarrier(cmd.handle, {.TRANSFER}, {.HOST}, {}, 0, nil, 1, &barrier, 0, nil)
+}
 
-    as_pixels := cast([]byte) (cast([^]byte)buffer.alloc_info.pMappedData)[:buffer_spec.size]
+// Records a copy of every layer of `src` into `dst`, which have the same size and format. They have to be
+// in TransferSrcOptimal and TransferDstOptimal.
+cmd_copy_image :: proc(cmd: CommandBuffer, src, dst: ^Image) {
+    aspect: vk.ImageAspectFlags = {.COLOR}
+    if is_depth_format(src.spec.format) {
+        aspect = {.DEPTH}
+    }
 
-    pos := (y * image.spec.width + x) * 1
-    r := as_pixels[pos + 0]
-    g := as_pixels[pos + 1]
-    b := as_pixels[pos + 2]
-    a := as_pixels[pos + 3]
-    return {r, g, b, a}, true
+    layers := cast(u32) max(src.spec.layer_count, 1)
+    region := vk.ImageCopy {
+        srcSubresource = vk.ImageSubresourceLayers {
+            aspectMask = aspect,
+            layerCount = layers,
+        },
+        dstSubresource = vk.ImageSubresourceLayers {
+            aspectMask = aspect,
+            layerCount = layers,
+        },
+        extent = vk.Extent3D {
+            width = cast(u32) src.spec.width,
+            height = cast(u32) src.spec.height,
+            depth = 1,
+        },
+    }
+    vk.CmdCopyImage(cmd.handle, src.handle, .TRANSFER_SRC_OPTIMAL, dst.handle, .TRANSFER_DST_OPTIMAL, 1, &region)
 }
 
 // This constructor is used to create a framebuffer from an existing image.
@@ -251,7 +260,6 @@ framebuffer_invalidate :: proc(fb: ^FrameBuffer) {
     check(vk.CreateFramebuffer(fb.spec.device.handle, &fb_create_info, nil, &fb.handle))
 }
 
-@(private)
 is_depth_format :: proc(format: ImageFormat) -> bool {
     #partial switch format {
     case .D16_UNORM, .D32_SFLOAT_S8_UINT, .D32_SFLOAT, .DEPTH32_SFLOAT, .DEPTH24_STENCIL8:
@@ -260,6 +268,17 @@ is_depth_format :: proc(format: ImageFormat) -> bool {
     return false
 }
 
+// Bytes per 4x4 block of a block compressed format, 0 for the others.
+format_block_size :: proc(format: ImageFormat) -> int {
+    #partial switch format {
+    case .BC1_UNORM:
+        return 8
+    case .BC3_UNORM, .BC5_UNORM, .BC7_UNORM:
+        return 16
+    }
+    return 0
+}
+
 @(private)
 set_handle_name :: proc(device: ^Device, #any_int handle: u64, type: vk.ObjectType, name: cstring) {
     name_info := vk.DebugUtilsObjectNameInfoEXT {
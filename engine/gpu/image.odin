@@ -2,7 +2,6 @@ package gpu
 import vk "vendor:vulkan"
 import vma "packages:odin-vma"
 import "core:fmt"
-import "core:mem"
 
 Image :: struct {
     id: UUID,
@@ -25,6 +24,8 @@ ImageSpecification :: struct {
     layout, final_layout: ImageLayout,
     sampler: SamplerSpecification,
     layer_count: int,
+    // 0 means 1. The levels get their data with upload_image_mips.
+    mip_levels: int,
 }
 
 create_image :: proc(spec: ImageSpecification) -> (image: Image) {
@@ -35,6 +36,94 @@ create_image :: proc(spec: ImageSpecification) -> (image: Image) {
     image.spec = spec
     image._destroy_handle = true
 
+    families: [2]u32
+    image_create_info := make_image_create_info(spec, &families)
+
+    allocation_create_info := vma.AllocationCreateInfo {
+        usage = .AUTO,
+        flags = {.DEDICATED_MEMORY},
+    }
+
+    check(vma.CreateImage(
+        spec.device.allocator,
+        &image_create_info,
+        &allocation_create_info,
+        &image.handle,
+        &image.allocation,
+        nil))
+
+    image_finish(&image)
+    return
+}
+
+// Memory shared by several images, see create_unbound_image.
+MemoryBlock :: struct {
+    device: ^Device,
+    allocation: vma.Allocation,
+    size: int,
+}
+
+MemoryRequirements :: struct {
+    size, alignment: int,
+    type_bits: u32,
+}
+
+// Creates an image without any memory behind it, for images that share memory with others.
+// It can't be used before bind_image_memory. destroy_image only destroys the image, the memory
+// belongs to the block.
+create_unbound_image :: proc(spec: ImageSpecification) -> (image: Image, requirements: MemoryRequirements) {
+    image.id = new_id()
+    spec := spec
+    spec.samples = spec.samples if spec.samples > 0 else 1
+
+    image.spec = spec
+    image._destroy_handle = true
+
+    families: [2]u32
+    image_create_info := make_image_create_info(spec, &families)
+    check(vk.CreateImage(spec.device.handle, &image_create_info, nil, &image.handle))
+
+    vk_requirements: vk.MemoryRequirements
+    vk.GetImageMemoryRequirements(spec.device.handle, image.handle, &vk_requirements)
+    requirements = MemoryRequirements {
+        size = int(vk_requirements.size),
+        alignment = int(vk_requirements.alignment),
+        type_bits = vk_requirements.memoryTypeBits,
+    }
+    return
+}
+
+allocate_memory_block :: proc(device: ^Device, requirements: MemoryRequirements) -> (block: MemoryBlock) {
+    vk_requirements := vk.MemoryRequirements {
+        size = vk.DeviceSize(requirements.size),
+        alignment = vk.DeviceSize(requirements.alignment),
+        memoryTypeBits = requirements.type_bits,
+    }
+    allocation_create_info := vma.AllocationCreateInfo {
+        usage = .GPU_ONLY,
+        flags = {.DEDICATED_MEMORY},
+    }
+
+    block.device = device
+    block.size = requirements.size
+    check(vma.AllocateMemory(device.allocator, &vk_requirements, &allocation_create_info, &block.allocation, nil))
+    return
+}
+
+free_memory_block :: proc(block: ^MemoryBlock) {
+    if block.allocation == nil do return
+    vma.FreeMemory(block.device.allocator, block.allocation)
+    block^ = {}
+}
+
+// Binds an image made by create_unbound_image to `offset` in `block`, and creates its view.
+bind_image_memory :: proc(image: ^Image, block: MemoryBlock, offset: int) {
+    check(vma.BindImageMemory2(block.device.allocator, block.allocation, vk.DeviceSize(offset), image.handle, nil))
+    image_finish(image)
+}
+
+@(private = "file")
+make_image_create_info :: proc(spec: ImageSpecification, families: ^[2]u32) -> vk.ImageCreateInfo {
     image_create_info := vk.ImageCreateInfo {
         sType = .IMAGE_CREATE_INFO,
         imageType = .D2,
@@ -44,7 +133,7 @@ create_image :: proc(spec: ImageSpecification) -> (image: Image) {
             height = cast(u32) spec.height,
             depth  = 1,
         },
-        mipLevels = 1,
+        mipLevels = cast(u32) max(spec.mip_levels, 1),
         arrayLayers = cast(u32) spec.layer_count if spec.layer_count > 0 else 1,
         samples = samples_to_vulkan(spec.samples),
         tiling = .OPTIMAL,
@@ -53,39 +142,38 @@ create_image :: proc(spec: ImageSpecification) -> (image: Image) {
         initialLayout = image_layout_to_vulkan(spec.layout),
     }
 
-    allocation_create_info := vma.AllocationCreateInfo {
-        usage = .AUTO,
-        flags = {.DEDICATED_MEMORY},
+    // Images with data get filled by the uploader, on the transfer queue.
+    if .TransferDst in spec.usage {
+        image_create_info.sharingMode, families^, image_create_info.queueFamilyIndexCount = device_sharing_mode(spec.device)
+        image_create_info.pQueueFamilyIndices = raw_data(families[:])
     }
+    return image_create_info
+}
 
-    check(vma.CreateImage(
-        spec.device.allocator,
-        &image_create_info,
-        &allocation_create_info,
-        &image.handle,
-        &image.allocation,
-        nil))
+@(private = "file")
+image_finish :: proc(image: ^Image) {
+    spec := image.spec
     image_view_spec := ImageViewSpecification {
         device = spec.device,
         format = spec.format,
         layer_count = spec.layer_count,
         base_layer_index = 0,
+        mip_levels = spec.mip_levels,
     }
 
-    if image_create_info.arrayLayers > 1 {
+    if spec.layer_count > 1 {
         image_view_spec.view_type = .D2_Array
     } else {
         image_view_spec.view_type = .D2
     }
 
-    image.view = create_image_view(image, image_view_spec)
+    image.view = create_image_view(image^, image_view_spec)
 
     image.sampler = create_sampler(spec.device^, spec.sampler)
 
     if spec.device.callbacks.image_create != nil {
-        spec.device.callbacks.image_create(spec.device.callbacks.user_data, &image)
+        spec.device.callbacks.image_create(spec.device.callbacks.user_data, image)
     }
-    return
 }
 
 destroy_image :: proc(image: ^Image) {
@@ -95,6 +183,7 @@ destroy_image :: proc(image: ^Image) {
         if image.spec.device.callbacks.image_destroy != nil {
             image.spec.device.callbacks.image_destroy(image.spec.device.callbacks.user_data, image)
         }
+        // Images bound to a MemoryBlock have no allocation of their own, VMA only destroys the image then.
         vma.DestroyImage(image.spec.device.allocator, image.handle, image.allocation)
     }
 
@@ -102,24 +191,14 @@ destroy_image :: proc(image: ^Image) {
     destroy_sampler(image.spec.device^, image.sampler)
 }
 
+// The copy goes through the uploader and happens on the GPU after the next flush.
 image_set_data :: proc(image: ^Image, data: []byte = {}) {
-    // Create temp buffer
-    spec := BufferSpecification {
-        device = image.spec.device,
-        name = "Staging Buffer",
-        size = image.spec.width * image.spec.height * 4,
-        usage = {.TransferSource},
-        mapped = true,
-    }
-    buffer := create_buffer(spec)
-    defer destroy_buffer(buffer)
-
-    // Do we need to "flush" the copy?
-    mem.copy(buffer.alloc_info.pMappedData, raw_data(data), len(data))
+    upload_image(image, data)
+}
 
-    image_transition_layout(image, .TransferDstOptimal)
-    buffer_copy_to_image(buffer, image^)
-    image_transition_layout(image, .ShaderReadOnlyOptimal)
+// Like image_set_data, but for every mip level. Level `i` starts at `level_offsets[i]` in `data`.
+image_set_mip_data :: proc(image: ^Image, data: []byte, level_offsets: []int) {
+    upload_image_mips(image, data, level_offsets)
 }
 
 @(private)
@@ -149,6 +228,7 @@ ImageViewSpecification :: struct {
     format: ImageFormat,
     base_layer_index: int,
     layer_count: int,
+    mip_levels: int,
 }
 
 create_image_view :: proc(image: Image, spec: ImageViewSpecification) -> (view: ImageView) {
@@ -169,7 +249,7 @@ create_image_view :: proc(image: Image, spec: ImageViewSpecification) -> (view:
         subresourceRange = vk.ImageSubresourceRange {
             aspectMask     = {aspect_mask},
             baseMipLevel   = 0,
-            levelCount     = 1,
+            levelCount     = cast(u32) max(spec.mip_levels, 1),
             baseArrayLayer = cast(u32) spec.base_layer_index,
             layerCount     = cast(u32) spec.layer_count if spec.layer_count > 0 else 1,
         },
@@ -187,6 +267,11 @@ image_transition_layout :: proc(image: ^Image, new_layout: ImageLayout, old: May
     command_buffer := device_begin_single_time_command(image.spec.device^)
     defer device_end_single_time_command(image.spec.device^, command_buffer)
 
+    cmd_transition_image_layout(command_buffer, image, new_layout, old)
+}
+
+// Same as image_transition_layout, but recorded into `command_buffer` instead of waiting for it.
+cmd_transition_image_layout :: proc(command_buffer: CommandBuffer, image: ^Image, new_layout: ImageLayout, old: Maybe(ImageLayout) = nil) {
     old := image.spec.layout if old == nil else old.?
     if old == new_layout {
         return
@@ -203,7 +288,7 @@ image_transition_layout :: proc(image: ^Image, new_layout: ImageLayout, old: May
         subresourceRange = vk.ImageSubresourceRange {
             aspectMask = {.COLOR},
             baseMipLevel = 0,
-            levelCount = 1,
+            levelCount = cast(u32) max(image.spec.mip_levels, 1),
             baseArrayLayer = 0,
             layerCount = 1,
         },
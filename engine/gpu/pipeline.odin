@@ -19,12 +19,19 @@ PipelineSpecification :: struct {
     shader:           Shader,
 }
 import "core:fmt"
+import "core:time"
 
+// Shaders with a compute module get a compute pipeline, which only uses the layout of the spec.
 create_pipeline :: proc(device: ^Device, spec: PipelineSpecification) -> (pipeline: Pipeline, error: PipelineCreationError) {
     pipeline.id = new_id()
     pipeline.device = device
     pipeline.spec = spec
 
+    if spec.shader.compute_module != 0 {
+        create_compute_pipeline(device, &pipeline)
+        return
+    }
+
     vert_stage_create_info := vk.PipelineShaderStageCreateInfo {
         sType = vk.StructureType.PIPELINE_SHADER_STAGE_CREATE_INFO,
         stage = {vk.ShaderStageFlag.VERTEX},
@@ -96,14 +103,43 @@ create_pipeline :: proc(device: ^Device, spec: PipelineSpecification) -> (pipeli
         basePipelineHandle  = 0,
         basePipelineIndex   = -1,
     }
-    check(vk.CreateGraphicsPipelines(device.handle, 0, 1, &pipeline_create_info, nil, &pipeline.handle))
+    start := time.tick_now()
+    check(vk.CreateGraphicsPipelines(device.handle, device.pipeline_cache, 1, &pipeline_create_info, nil, &pipeline.handle))
+    device.pipeline_stats.count += 1
+    device.pipeline_stats.time += time.tick_since(start)
 
     set_handle_name(device, pipeline.handle, .PIPELINE, spec.tag)
     return
 }
 
+@(private = "file")
+create_compute_pipeline :: proc(device: ^Device, pipeline: ^Pipeline) {
+    pipeline_create_info := vk.ComputePipelineCreateInfo {
+        sType = .COMPUTE_PIPELINE_CREATE_INFO,
+        stage = vk.PipelineShaderStageCreateInfo {
+            sType = .PIPELINE_SHADER_STAGE_CREATE_INFO,
+            stage = {.COMPUTE},
+            module = pipeline.spec.shader.compute_module,
+            pName = "main",
+        },
+        layout = pipeline.spec.layout.handle,
+        basePipelineIndex = -1,
+    }
+    start := time.tick_now()
+    check(vk.CreateComputePipelines(device.handle, device.pipeline_cache, 1, &pipeline_create_info, nil, &pipeline.handle))
+    device.pipeline_stats.count += 1
+    device.pipeline_stats.time += time.tick_since(start)
+
+    set_handle_name(device, pipeline.handle, .PIPELINE, pipeline.spec.tag)
+}
+
 pipeline_bind :: proc(cmd: CommandBuffer, pipeline: Pipeline) {
-    vk.CmdBindPipeline(cmd.handle, .GRAPHICS, pipeline.handle)
+    vk.CmdBindPipeline(cmd.handle, pipeline_bind_point(pipeline), pipeline.handle)
+}
+
+@(private)
+pipeline_bind_point :: proc(pipeline: Pipeline) -> vk.PipelineBindPoint {
+    return .COMPUTE if pipeline.spec.shader.compute_module != 0 else .GRAPHICS
 }
 
 PipelineLayout :: struct {
@@ -119,6 +155,8 @@ PipelineLayoutSpecification :: struct {
     // descriptor_set_layout: ...
     layouts: [dynamic]ResourceLayout,
     use_push: bool,
+    // Stages that see the push constants, vertex and fragment when empty.
+    push_stages: ShaderStages,
 }
 
 create_pipeline_layout :: proc(spec: PipelineLayoutSpecification, T: Maybe(int) = {}) -> (layout: PipelineLayout) {
@@ -136,7 +174,7 @@ create_pipeline_layout :: proc(spec: PipelineLayoutSpecification, T: Maybe(int)
         range = vk.PushConstantRange {
             size = u32(t),
             offset = 0,
-            stageFlags = {.VERTEX, .FRAGMENT},
+            stageFlags = shader_stage_to_vulkan(spec.push_stages) if spec.push_stages != {} else {.VERTEX, .FRAGMENT},
         }
     }
 
@@ -234,6 +272,10 @@ VertexElementType :: enum {
     Int4,
     Mat3,
     Mat4,
+    // 16 bit float.
+    Half2,
+    // 16 bit signed normalized, read as floats in [-1, 1].
+    Snorm2,
 }
 
 @(private)
@@ -261,12 +303,20 @@ vertex_element_type_to_vulkan :: proc(type: VertexElementType) -> vk.Format {
         return .R32G32B32_SFLOAT
     case .Mat4:
         return .R32G32B32A32_SFLOAT
+    case .Half2:
+        return .R16G16_SFLOAT
+    case .Snorm2:
+        return .R16G16_SNORM
     }
     unreachable()
 }
 
 // Returns size in bytes of a `VertexElementType`.
 vertex_element_size :: proc(type: VertexElementType) -> int {
+    #partial switch type {
+    case .Half2, .Snorm2:
+        return 2 * vertex_element_count(type)
+    }
     return 4 * vertex_element_count(type)
 }
 
@@ -276,7 +326,7 @@ vertex_element_count :: proc(type: VertexElementType) -> int {
         return 0
     case .Int, .Float:
         return 1
-    case .Int2, .Float2:
+    case .Int2, .Float2, .Half2, .Snorm2:
         return 2
     case .Int3, .Float3:
         return 3
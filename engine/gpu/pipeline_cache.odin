@@ -0,0 +1,132 @@
+package gpu
+import vk "vendor:vulkan"
+import "core:log"
+import "core:mem"
+import "core:time"
+
+// One VkPipelineCache per device, shared by every create_pipeline call. Its contents can be saved
+// and handed back to create_pipeline_cache on the next run, so pipelines that were built before only
+// cost a lookup.
+//
+// The driver validates the blob too, but some drivers are known to crash on data from a different
+// version instead of rejecting it. So the blob is wrapped in a header of our own that has to match
+// the device exactly, otherwise the cache starts out empty.
+
+@(private = "file")
+PIPELINE_CACHE_MAGIC :: u32(0x48435050) // "PPCH"
+@(private = "file")
+PIPELINE_CACHE_VERSION :: 1
+
+@(private = "file")
+PipelineCacheHeader :: struct {
+    magic: u32,
+    version: u32,
+    vendor_id: u32,
+    device_id: u32,
+    driver_version: u32,
+    data_size: u32,
+    cache_uuid: [vk.UUID_SIZE]u8,
+}
+
+PipelineStats :: struct {
+    // Pipelines created since the device was.
+    count: int,
+    // Total time spent in vkCreate*Pipelines.
+    time: time.Duration,
+    // Whether the cache was created from saved data.
+    cache_loaded: bool,
+}
+
+// Creates the device pipeline cache, from data returned by pipeline_cache_data on an earlier run if
+// it's valid for this device. Returns whether that data was used.
+create_pipeline_cache :: proc(device: ^Device, saved_data: []byte = nil) -> (loaded: bool) {
+    initial_data := pipeline_cache_validate(device, saved_data)
+
+    ci := vk.PipelineCacheCreateInfo {
+        sType = .PIPELINE_CACHE_CREATE_INFO,
+        initialDataSize = len(initial_data),
+        pInitialData = raw_data(initial_data),
+    }
+    if vk.CreatePipelineCache(device.handle, &ci, nil, &device.pipeline_cache) != .SUCCESS && len(initial_data) > 0 {
+        log.warn("Driver rejected the saved pipeline cache, starting with an empty one")
+        initial_data = nil
+        ci.initialDataSize = 0
+        ci.pInitialData = nil
+        check(vk.CreatePipelineCache(device.handle, &ci, nil, &device.pipeline_cache))
+    }
+
+    loaded = len(initial_data) > 0
+    device.pipeline_stats.cache_loaded = loaded
+    return
+}
+
+destroy_pipeline_cache :: proc(device: ^Device) {
+    if device.pipeline_cache == 0 do return
+    vk.DestroyPipelineCache(device.handle, device.pipeline_cache, nil)
+    device.pipeline_cache = 0
+}
+
+// Returns the current contents of the cache, ready to be written to disk.
+pipeline_cache_data :: proc(device: ^Device, allocator := context.allocator) -> (data: []byte, ok: bool) {
+    if device.pipeline_cache == 0 do return
+
+    size: int
+    if vk.GetPipelineCacheData(device.handle, device.pipeline_cache, &size, nil) != .SUCCESS || size == 0 {
+        return
+    }
+
+    data = make([]byte, size_of(PipelineCacheHeader) + size, allocator)
+    if vk.GetPipelineCacheData(device.handle, device.pipeline_cache, &size, &data[size_of(PipelineCacheHeader)]) != .SUCCESS {
+        delete(data, allocator)
+        return nil, false
+    }
+
+    header := pipeline_cache_header(device)
+    header.data_size = u32(size)
+    copy(data, mem.ptr_to_bytes(&header))
+    return data[:size_of(PipelineCacheHeader) + size], true
+}
+
+@(private = "file")
+pipeline_cache_header :: proc(device: ^Device) -> PipelineCacheHeader {
+    return PipelineCacheHeader {
+        magic = PIPELINE_CACHE_MAGIC,
+        version = PIPELINE_CACHE_VERSION,
+        vendor_id = device.properties.vendorID,
+        device_id = device.properties.deviceID,
+        driver_version = device.properties.driverVersion,
+        cache_uuid = device.properties.pipelineCacheUUID,
+    }
+}
+
+// Returns the Vulkan part of `saved_data`, or nil if it was saved by a different device or driver.
+@(private = "file")
+pipeline_cache_validate :: proc(device: ^Device, saved_data: []byte) -> []byte {
+    if len(saved_data) < size_of(PipelineCacheHeader) {
+        return nil
+    }
+
+    header := (^PipelineCacheHeader)(raw_data(saved_data))^
+    data := saved_data[size_of(PipelineCacheHeader):]
+    expected := pipeline_cache_header(device)
+    expected.data_size = header.data_size
+
+    if header != expected {
+        log.info("Saved pipeline cache is from a different device or driver, ignoring it")
+        return nil
+    }
+    if int(header.data_size) != len(data) || len(data) < size_of(vk.PipelineCacheHeaderVersionOne) {
+        log.warn("Saved pipeline cache is truncated, ignoring it")
+        return nil
+    }
+
+    // The Vulkan header has to agree as well.
+    vk_header := (^vk.PipelineCacheHeaderVersionOne)(raw_data(data))^
+    if vk_header.headerVersion != .ONE ||
+        vk_header.vendorID != expected.vendor_id ||
+        vk_header.deviceID != expected.device_id ||
+        vk_header.pipelineCacheUUID != expected.cache_uuid {
+        return nil
+    }
+    return data
+}
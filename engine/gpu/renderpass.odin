@@ -191,13 +191,19 @@ create_render_pass :: proc(spec: RenderPassSpecification, is_shadow_map: bool =
     return
 }
 
+RenderPassContents :: enum {
+    Inline,
+    // The pass only executes secondary command buffers, see `execute_commands`.
+    SecondaryCommandBuffers,
+}
+
 @(deferred_in=render_pass_end)
-do_render_pass :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, framebuffer: FrameBuffer) -> bool {
-    render_pass_begin(cmd_buffer, renderpass, framebuffer)
+do_render_pass :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, framebuffer: FrameBuffer, contents := RenderPassContents.Inline) -> bool {
+    render_pass_begin(cmd_buffer, renderpass, framebuffer, contents)
     return true
 }
 
-render_pass_begin :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, framebuffer: FrameBuffer) {
+render_pass_begin :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, framebuffer: FrameBuffer, contents := RenderPassContents.Inline) {
     clear_values := make([dynamic]vk.ClearValue, context.temp_allocator)
     for attachment in renderpass.spec.attachments {
         if is_depth_format(attachment.format) {
@@ -234,10 +240,11 @@ render_pass_begin :: proc(cmd_buffer: CommandBuffer, renderpass: RenderPass, fra
         },
     }
 
-    vk.CmdBeginRenderPass(cmd_buffer.handle, &begin_info, .INLINE)
+    vk_contents := vk.SubpassContents.SECONDARY_COMMAND_BUFFERS if contents == .SecondaryCommandBuffers else .INLINE
+    vk.CmdBeginRenderPass(cmd_buffer.handle, &begin_info, vk_contents)
 }
 
-render_pass_end :: proc(cmd: CommandBuffer, _: RenderPass, _: FrameBuffer) {
+render_pass_end :: proc(cmd: CommandBuffer, _: RenderPass, _: FrameBuffer, _: RenderPassContents) {
     vk.CmdEndRenderPass(cmd.handle)
 }
 
@@ -344,6 +351,7 @@ ImageLayout :: enum {
     TransferDstOptimal,
     PresentSrc,
     AttachmentOptimal,
+    General,
 }
 
 // @(private)
@@ -368,6 +376,8 @@ image_layout_to_vulkan :: proc(layout: ImageLayout, loc := #caller_location) ->
         return .PRESENT_SRC_KHR
     case .AttachmentOptimal:
         return .ATTACHMENT_OPTIMAL
+    case .General:
+        return .GENERAL
     }
     unreachable()
 }
@@ -386,6 +396,12 @@ ImageFormat :: enum {
     DEPTH24_STENCIL8,
     DEPTH32_SFLOAT,
     D32_SFLOAT_S8_UINT,
+
+    // Block compressed, see `format_block_size`.
+    BC1_UNORM,
+    BC3_UNORM,
+    BC5_UNORM,
+    BC7_UNORM,
 }
 
 @(private)
@@ -417,6 +433,14 @@ image_format_to_vulkan :: proc(format: ImageFormat, loc := #caller_location) ->
         return .D32_SFLOAT
     case .D32_SFLOAT_S8_UINT:
         return .D32_SFLOAT_S8_UINT
+    case .BC1_UNORM:
+        return .BC1_RGB_UNORM_BLOCK
+    case .BC3_UNORM:
+        return .BC3_UNORM_BLOCK
+    case .BC5_UNORM:
+        return .BC5_UNORM_BLOCK
+    case .BC7_UNORM:
+        return .BC7_UNORM_BLOCK
     }
     unreachable()
 }
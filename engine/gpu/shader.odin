@@ -7,31 +7,35 @@ Shader :: struct {
 
     vertex_module: vk.ShaderModule,
     fragment_module: vk.ShaderModule,
+    // Compute shaders only have this one, see `create_pipeline`.
+    compute_module: vk.ShaderModule,
 }
 
 ShaderSpecification :: struct {
     vertex_spirv: []byte,
     fragment_spirv: []byte,
+    compute_spirv: []byte,
 }
 
+// Only the stages that have SPIR-V get a module.
 create_shader :: proc(device: ^Device, spec: ShaderSpecification) -> (shader: Shader) {
     shader.device = device
 
-    shader_create_info := vk.ShaderModuleCreateInfo {
-        sType = .SHADER_MODULE_CREATE_INFO,
-        pCode = raw_data(transmute([]u32) spec.vertex_spirv),
-        codeSize = len(spec.vertex_spirv),
-    }
-
-    check(vk.CreateShaderModule(device.handle, &shader_create_info, nil, &shader.vertex_module))
+    create_module :: proc(device: ^Device, spirv: []byte) -> (module: vk.ShaderModule) {
+        if len(spirv) == 0 do return
 
-    shader_create_info = vk.ShaderModuleCreateInfo {
-        sType = .SHADER_MODULE_CREATE_INFO,
-        pCode = raw_data(transmute([]u32) spec.fragment_spirv),
-        codeSize = len(spec.fragment_spirv),
+        shader_create_info := vk.ShaderModuleCreateInfo {
+            sType = .SHADER_MODULE_CREATE_INFO,
+            pCode = raw_data(transmute([]u32) spirv),
+            codeSize = len(spirv),
+        }
+        check(vk.CreateShaderModule(device.handle, &shader_create_info, nil, &module))
+        return
     }
 
-    check(vk.CreateShaderModule(device.handle, &shader_create_info, nil, &shader.fragment_module))
+    shader.vertex_module = create_module(device, spec.vertex_spirv)
+    shader.fragment_module = create_module(device, spec.fragment_spirv)
+    shader.compute_module = create_module(device, spec.compute_spirv)
     return
 }
 
@@ -1,12 +1,65 @@
 package gpu
+import "base:runtime"
+import "core:c"
 import vk "vendor:vulkan"
+import tracy "packages:odin-tracy"
+
+// Every frame writes its timestamps into its own set of queries. A set is read back without waiting
+// once the frame that used it is known to be done, so the results lag a frame behind but collecting
+// them never stalls the CPU. Sets that are still not ready when they get reused are dropped.
+
+MAX_GPU_ZONES :: 32
+
+@(private = "file")
+STATS_FRAMES :: MAX_FRAMES_IN_FLIGHT + 1
+// Frame begin/end, then a begin/end pair per zone.
+@(private = "file")
+QUERIES_PER_FRAME :: 2 + MAX_GPU_ZONES * 2
+
+// Tracy knows the context type by its position in the GpuContextType enum.
+@(private = "file")
+TRACY_GPU_CONTEXT_VULKAN :: 2
+
+GpuZone :: struct {
+    name: string,
+    loc: runtime.Source_Code_Location,
+    depth: int,
+}
+
+GpuZoneTiming :: struct {
+    name: string,
+    depth: int,
+    // In milliseconds.
+    time: f64,
+}
+
+StatsFrame :: struct {
+    zones: [MAX_GPU_ZONES]GpuZone,
+    zone_count: int,
+    // Query offsets (relative to the zone queries) in the order they were written, so nested zones
+    // can be replayed to Tracy in the right order. Even is a begin, odd an end.
+    events: [MAX_GPU_ZONES * 2]u8,
+    event_count: int,
+    // Zones that have been started but not ended yet.
+    open: [MAX_GPU_ZONES]u8,
+    open_count: int,
+    // Recorded but not read back yet.
+    pending: bool,
+}
 
 RenderStats :: struct {
     device: ^Device,
     time_pool: vk.QueryPool,
 
+    // Results of the last frame that was read back.
     time_begin, time_end: u64,
+    zones: [MAX_GPU_ZONES]GpuZoneTiming,
+    zone_count: int,
+
+    frames: [STATS_FRAMES]StatsFrame,
+    frame: int,
 
+    tracy_context_created: bool,
     _time_period: f32,
 }
 
@@ -18,13 +71,18 @@ create_render_stats :: proc(device: ^Device) -> (stats: RenderStats) {
     ci := vk.QueryPoolCreateInfo {
         sType = .QUERY_POOL_CREATE_INFO,
         queryType = .TIMESTAMP,
-        queryCount = 128,
+        queryCount = QUERIES_PER_FRAME * STATS_FRAMES,
     }
 
     check(vk.CreateQueryPool(device.handle, &ci, nil, &stats.time_pool))
     return
 }
 
+destroy_render_stats :: proc(stats: ^RenderStats) {
+    vk.DestroyQueryPool(stats.device.handle, stats.time_pool, nil)
+    stats.time_pool = 0
+}
+
 @(private)
 g_stats: ^RenderStats
 
@@ -32,34 +90,174 @@ set_global_stats :: proc(stats: ^RenderStats) {
     g_stats = stats
 }
 
-@(private)
-stats_reset :: proc(cmd: CommandBuffer) {
-    vk.CmdResetQueryPool(cmd.handle, g_stats.time_pool, 0, 2)
+@(private = "file")
+stats_current_frame :: proc() -> (frame: ^StatsFrame, base: u32) {
+    index := g_stats.frame % STATS_FRAMES
+    return &g_stats.frames[index], u32(index * QUERIES_PER_FRAME)
 }
 
 stats_begin_frame :: proc(cmd: CommandBuffer) {
-    stats_reset(cmd)
+    g_stats.frame += 1
+    frame, base := stats_current_frame()
+    // Whatever this set held last time was never ready, it's gone now.
+    frame^ = {}
 
-    vk.CmdWriteTimestamp(cmd.handle, {.TOP_OF_PIPE}, g_stats.time_pool, 0)
+    vk.CmdResetQueryPool(cmd.handle, g_stats.time_pool, base, QUERIES_PER_FRAME)
+    vk.CmdWriteTimestamp(cmd.handle, {.TOP_OF_PIPE}, g_stats.time_pool, base)
+    frame.pending = true
 }
 
 stats_end_frame :: proc(cmd: CommandBuffer) {
-    vk.CmdWriteTimestamp(cmd.handle, {.BOTTOM_OF_PIPE}, g_stats.time_pool, 1)
+    frame, base := stats_current_frame()
+    // A zone left open would never become available and the whole frame would be dropped.
+    for frame.open_count > 0 {
+        zone_end(cmd)
+    }
+    vk.CmdWriteTimestamp(cmd.handle, {.BOTTOM_OF_PIPE}, g_stats.time_pool, base + 1)
+}
+
+// Times everything recorded into `cmd` until the matching zone_end. Zones can nest, but they
+// have to be recorded on the frame's primary command buffer, outside of render passes.
+// Returns false when the frame already has MAX_GPU_ZONES zones, zone_end still has to be called.
+zone_begin :: proc(cmd: CommandBuffer, name: string, loc := #caller_location) -> bool {
+    frame, base := stats_current_frame()
+    if frame.zone_count == MAX_GPU_ZONES {
+        // Keep the begin/end pairs balanced, the matching end is ignored.
+        frame.open[frame.open_count] = 0xFF
+        frame.open_count += 1
+        return false
+    }
+
+    zone := frame.zone_count
+    frame.zone_count += 1
+    frame.zones[zone] = GpuZone {
+        name = name,
+        loc = loc,
+        depth = frame.open_count,
+    }
+    frame.open[frame.open_count] = u8(zone)
+    frame.open_count += 1
+    frame.events[frame.event_count] = u8(zone * 2)
+    frame.event_count += 1
+
+    vk.CmdWriteTimestamp(cmd.handle, {.TOP_OF_PIPE}, g_stats.time_pool, base + 2 + u32(zone) * 2)
+    return true
+}
+
+// Ends the innermost open zone.
+zone_end :: proc(cmd: CommandBuffer) {
+    frame, base := stats_current_frame()
+    assert(frame.open_count > 0, "zone_end without a zone_begin")
+    frame.open_count -= 1
+    zone := frame.open[frame.open_count]
+    if zone == 0xFF do return
+
+    frame.events[frame.event_count] = zone * 2 + 1
+    frame.event_count += 1
+
+    vk.CmdWriteTimestamp(cmd.handle, {.BOTTOM_OF_PIPE}, g_stats.time_pool, base + 3 + u32(zone) * 2)
 }
 
+@(private = "file")
+_zone_scope_end :: proc(cmd: CommandBuffer, _: string, _: runtime.Source_Code_Location) {
+    zone_end(cmd)
+}
+
+// Scoped version of zone_begin/zone_end, to be used like do_render_pass.
+@(deferred_in = _zone_scope_end)
+do_zone :: proc(cmd: CommandBuffer, name: string, loc := #caller_location) -> bool {
+    zone_begin(cmd, name, loc)
+    return true
+}
+
+// Reads back the frames that finished since the last call. Never waits on the GPU.
 stats_collect :: proc() {
-    results: [2]u64
+    // Oldest first, the current frame was only just submitted.
+    for age := STATS_FRAMES - 1; age > 0; age -= 1 {
+        if g_stats.frame - age <= 0 do continue
+
+        index := (g_stats.frame - age) % STATS_FRAMES
+        frame := &g_stats.frames[index]
+        if !frame.pending do continue
+
+        if stats_read_back(frame, u32(index * QUERIES_PER_FRAME)) {
+            frame.pending = false
+        }
+    }
+}
 
-    vk.GetQueryPoolResults(
+@(private = "file")
+stats_read_back :: proc(frame: ^StatsFrame, base: u32) -> bool {
+    results: [QUERIES_PER_FRAME]u64
+    count := 2 + frame.zone_count * 2
+
+    result := vk.GetQueryPoolResults(
         g_stats.device.handle,
         g_stats.time_pool,
-        0,
-        len(results),
-        size_of(u64) * len(results),
+        base,
+        u32(count),
+        size_of(u64) * count,
         &results,
         size_of(u64),
-        {._64, .WAIT})
+        {._64})
+    if result != .SUCCESS {
+        return false
+    }
 
     g_stats.time_begin = results[0]
     g_stats.time_end   = results[1]
+
+    period := f64(g_stats._time_period)
+    g_stats.zone_count = frame.zone_count
+    for zone, i in frame.zones[:frame.zone_count] {
+        begin, end := results[2 + i * 2], results[3 + i * 2]
+        g_stats.zones[i] = GpuZoneTiming {
+            name = zone.name,
+            depth = zone.depth,
+            time = f64(end - begin) * period * 1e-6,
+        }
+    }
+
+    when tracy.TRACY_ENABLE {
+        stats_emit_tracy_zones(frame, base, results[:count])
+    }
+    return true
+}
+
+// Zones are sent to Tracy once their timestamps are known, instead of when they are recorded.
+@(private = "file")
+stats_emit_tracy_zones :: proc(frame: ^StatsFrame, base: u32, results: []u64) {
+    if !g_stats.tracy_context_created {
+        // NOTE: There is no calibration, Tracy lines the GPU timeline up with the
+        // time this gets called, which is a frame or so late.
+        tracy.___tracy_emit_gpu_new_context_serial({
+            gpuTime = i64(results[0]),
+            period = g_stats._time_period,
+            _context = 0,
+            type = TRACY_GPU_CONTEXT_VULKAN,
+        })
+        name := "Vulkan"
+        tracy.___tracy_emit_gpu_context_name_serial({
+            _context = 0,
+            name = cstring(raw_data(name)),
+            len = u16(len(name)),
+        })
+        g_stats.tracy_context_created = true
+    }
+
+    for event in frame.events[:frame.event_count] {
+        query_id := u16(base + 2 + u32(event))
+        zone := frame.zones[event / 2]
+        if event % 2 == 0 {
+            srcloc := tracy.___tracy_alloc_srcloc_name(
+                u32(zone.loc.line),
+                cstring(raw_data(zone.loc.file_path)), c.size_t(len(zone.loc.file_path)),
+                cstring(raw_data(zone.loc.procedure)), c.size_t(len(zone.loc.procedure)),
+                cstring(raw_data(zone.name)), c.size_t(len(zone.name)))
+            tracy.___tracy_emit_gpu_zone_begin_alloc_serial({srcloc = srcloc, queryId = query_id})
+        } else {
+            tracy.___tracy_emit_gpu_zone_end_serial({queryId = query_id})
+        }
+        tracy.___tracy_emit_gpu_time_serial({gpuTime = i64(results[2 + event]), queryId = query_id})
+    }
 }
@@ -166,13 +166,34 @@ swapchain_get_next_image :: proc(sw: ^Swapchain) -> (image: u32, error: Swapchai
 }
 
 swapchain_cmd_submit :: proc(swapchain: ^Swapchain, cmds: []CommandBuffer) {
-    wait_semaphores: []vk.Semaphore =  {
-        swapchain.image_available_semaphores[swapchain.current_frame],
+    wait_semaphores := make([dynamic]vk.Semaphore, 0, 2, context.temp_allocator)
+    wait_values := make([dynamic]u64, 0, 2, context.temp_allocator)
+    flags := make([dynamic]vk.PipelineStageFlags, 0, 2, context.temp_allocator)
+
+    append(&wait_semaphores, swapchain.image_available_semaphores[swapchain.current_frame])
+    append(&wait_values, 0)
+    append(&flags, vk.PipelineStageFlags{.COLOR_ATTACHMENT_OUTPUT})
+
+    // Anything uploaded this frame has to land before it gets used.
+    if semaphore, value, ok := uploader_submit_wait(swapchain.device); ok {
+        append(&wait_semaphores, semaphore)
+        append(&wait_values, value)
+        append(&flags, vk.PipelineStageFlags{.ALL_COMMANDS})
     }
+
     signal_semaphores: []vk.Semaphore =  {
         swapchain.render_finished_semaphores[swapchain.current_frame],
     }
-    flags := vk.PipelineStageFlags{.COLOR_ATTACHMENT_OUTPUT}
+    signal_values: []u64 = {0}
+
+    // Values for the binary semaphores are ignored.
+    timeline_info := vk.TimelineSemaphoreSubmitInfo {
+        sType = .TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        waitSemaphoreValueCount = u32(len(wait_values)),
+        pWaitSemaphoreValues = raw_data(wait_values),
+        signalSemaphoreValueCount = u32(len(signal_values)),
+        pSignalSemaphoreValues = raw_data(signal_values),
+    }
 
     buffers := make([dynamic]vk.CommandBuffer, 0, len(cmds), context.temp_allocator)
     for cmd in cmds {
@@ -181,9 +202,10 @@ swapchain_cmd_submit :: proc(swapchain: ^Swapchain, cmds: []CommandBuffer) {
 
     submit_info := vk.SubmitInfo {
         sType                = .SUBMIT_INFO,
+        pNext                = &timeline_info,
         waitSemaphoreCount   = u32(len(wait_semaphores)),
         pWaitSemaphores      = raw_data(wait_semaphores),
-        pWaitDstStageMask    = &flags,
+        pWaitDstStageMask    = raw_data(flags),
         commandBufferCount   = u32(len(buffers)),
         pCommandBuffers      = raw_data(buffers),
         signalSemaphoreCount = u32(len(signal_semaphores)),
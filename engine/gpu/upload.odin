@@ -0,0 +1,370 @@
+package gpu
+import vk "vendor:vulkan"
+import "core:mem"
+import "core:sync"
+import tracy "packages:odin-tracy"
+
+// All uploads to device local memory go through the uploader. The data is copied into a persistently
+// mapped staging ring and the copies are recorded into a batch on the transfer queue (a dedicated one if
+// the device has it). Batches get submitted with `uploader_flush` and tracked with a timeline semaphore:
+// graphics submits wait for the last submitted value, and ring space is reclaimed once the GPU reaches
+// the value of the batch that used it. Nothing ever waits for the whole queue to go idle.
+//
+// NOTE(minebill): Without a dedicated family the transfer queue is the graphics queue, so flushing
+// must happen on the thread that submits rendering work.
+
+STAGING_RING_SIZE :: 32 * mem.Megabyte
+STAGING_ALIGNMENT :: 16
+
+UploadBatch :: struct {
+    cmd: vk.CommandBuffer,
+    // The timeline value signaled when the batch finishes.
+    value: u64,
+    // Bytes of the ring used by the batch (including any wasted at the end when wrapping)
+    // and the ring offset right after them.
+    ring_bytes, ring_end: int,
+    // Staging buffers for uploads that were too big for the ring.
+    temp_buffers: [dynamic]Buffer,
+}
+
+Uploader :: struct {
+    device: ^Device,
+    mutex: sync.Mutex,
+
+    ring: Buffer,
+    head, tail, used: int,
+
+    pool: vk.CommandPool,
+    timeline: vk.Semaphore,
+    submitted_value: u64,
+
+    recording: bool,
+    current: UploadBatch,
+    in_flight: [dynamic]UploadBatch,
+    free_cmds: [dynamic]vk.CommandBuffer,
+}
+
+uploader_init :: proc(device: ^Device) {
+    u := new(Uploader)
+    u.device = device
+    device.uploader = u
+
+    u.ring = create_buffer({
+        device = device,
+        name = "Staging Ring",
+        size = STAGING_RING_SIZE,
+        usage = {.TransferSource},
+        mapped = true,
+    })
+
+    pool_info := vk.CommandPoolCreateInfo {
+        sType = .COMMAND_POOL_CREATE_INFO,
+        flags = {.TRANSIENT, .RESET_COMMAND_BUFFER},
+        queueFamilyIndex = device.transfer_family,
+    }
+    check(vk.CreateCommandPool(device.handle, &pool_info, nil, &u.pool))
+    set_handle_name(device, u.pool, .COMMAND_POOL, "Upload Pool")
+
+    timeline_info := vk.SemaphoreTypeCreateInfo {
+        sType = .SEMAPHORE_TYPE_CREATE_INFO,
+        semaphoreType = .TIMELINE,
+        initialValue = 0,
+    }
+    semaphore_info := vk.SemaphoreCreateInfo {
+        sType = .SEMAPHORE_CREATE_INFO,
+        pNext = &timeline_info,
+    }
+    check(vk.CreateSemaphore(device.handle, &semaphore_info, nil, &u.timeline))
+    set_handle_name(device, u.timeline, .SEMAPHORE, "Upload Timeline")
+}
+
+uploader_deinit :: proc(device: ^Device) {
+    u := device.uploader
+    if u == nil do return
+
+    uploader_flush(device)
+    uploader_wait(device, u.submitted_value)
+
+    if sync.guard(&u.mutex) {
+        uploader_retire(u)
+    }
+
+    vk.DestroySemaphore(device.handle, u.timeline, nil)
+    vk.DestroyCommandPool(device.handle, u.pool, nil)
+    destroy_buffer(u.ring)
+    delete(u.in_flight)
+    delete(u.free_cmds)
+    free(u)
+    device.uploader = nil
+}
+
+// Copies `data` into `buffer` at `offset`. The copy happens on the GPU after the next flush.
+upload_buffer :: proc(buffer: Buffer, data: []byte, offset := 0) {
+    tracy.Zone()
+    u := buffer.spec.device.uploader
+    assert(u != nil, "Uploader not initialized")
+    if sync.guard(&u.mutex) {
+        src, src_offset := uploader_stage(u, data)
+
+        region := vk.BufferCopy {
+            srcOffset = vk.DeviceSize(src_offset),
+            dstOffset = vk.DeviceSize(offset),
+            size = vk.DeviceSize(len(data)),
+        }
+        vk.CmdCopyBuffer(u.current.cmd, src, buffer.handle, 1, &region)
+    }
+}
+
+// Replaces the contents of the first mip/layer of `image` and leaves it in the shader read only layout.
+upload_image :: proc(image: ^Image, data: []byte) {
+    upload_image_mips(image, data, {0})
+}
+
+// Replaces the contents of the first `len(level_offsets)` mip levels of `image`, level `i` starting at
+// `level_offsets[i]` in `data`, tightly packed. Block compressed levels are stored block by block.
+upload_image_mips :: proc(image: ^Image, data: []byte, level_offsets: []int) {
+    tracy.Zone()
+    u := image.spec.device.uploader
+    assert(u != nil, "Uploader not initialized")
+    assert(len(level_offsets) <= max(image.spec.mip_levels, 1))
+    if sync.guard(&u.mutex) {
+        src, src_offset := uploader_stage(u, data)
+
+        barrier := vk.ImageMemoryBarrier {
+            sType = .IMAGE_MEMORY_BARRIER,
+            // The whole image is overwritten, so the old contents can be discarded.
+            oldLayout = .UNDEFINED,
+            newLayout = .TRANSFER_DST_OPTIMAL,
+            srcQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+            dstQueueFamilyIndex = vk.QUEUE_FAMILY_IGNORED,
+            dstAccessMask = {.TRANSFER_WRITE},
+            image = image.handle,
+            subresourceRange = {
+                aspectMask = {.COLOR},
+                levelCount = cast(u32) max(image.spec.mip_levels, 1),
+                layerCount = 1,
+            },
+        }
+        vk.CmdPipelineBarrier(u.current.cmd, {.TOP_OF_PIPE}, {.TRANSFER}, {}, 0, nil, 0, nil, 1, &barrier)
+
+        regions := make([]vk.BufferImageCopy, len(level_offsets), context.temp_allocator)
+        for offset, level in level_offsets {
+            regions[level] = vk.BufferImageCopy {
+                bufferOffset = vk.DeviceSize(src_offset + offset),
+                imageSubresource = {
+                    aspectMask = {.COLOR},
+                    mipLevel = cast(u32) level,
+                    layerCount = 1,
+                },
+                imageExtent = {
+                    cast(u32) max(image.spec.width >> uint(level), 1),
+                    cast(u32) max(image.spec.height >> uint(level), 1),
+                    1,
+                },
+            }
+        }
+        vk.CmdCopyBufferToImage(u.current.cmd, src, image.handle, .TRANSFER_DST_OPTIMAL, u32(len(regions)), raw_data(regions))
+
+        // Transfer queues can't name shader stages. Visibility for the graphics queue comes from
+        // the timeline semaphore wait.
+        barrier.oldLayout = .TRANSFER_DST_OPTIMAL
+        barrier.newLayout = .SHADER_READ_ONLY_OPTIMAL
+        barrier.srcAccessMask = {.TRANSFER_WRITE}
+        barrier.dstAccessMask = {}
+        vk.CmdPipelineBarrier(u.current.cmd, {.TRANSFER}, {.BOTTOM_OF_PIPE}, {}, 0, nil, 0, nil, 1, &barrier)
+
+        image.spec.layout = .ShaderReadOnlyOptimal
+    }
+}
+
+// Submits the recorded uploads, if any. Returns the timeline value that will be signaled when they are done.
+uploader_flush :: proc(device: ^Device) -> u64 {
+    u := device.uploader
+    if u == nil do return 0
+    if sync.guard(&u.mutex) {
+        uploader_flush_locked(u)
+        uploader_retire(u)
+    }
+    return u.submitted_value
+}
+
+// Blocks until the GPU reached `value` on the upload timeline.
+uploader_wait :: proc(device: ^Device, value: u64) {
+    u := device.uploader
+    if u == nil || value == 0 do return
+    tracy.Zone()
+
+    value := value
+    wait_info := vk.SemaphoreWaitInfo {
+        sType = .SEMAPHORE_WAIT_INFO,
+        semaphoreCount = 1,
+        pSemaphores = &u.timeline,
+        pValues = &value,
+    }
+    check(vk.WaitSemaphores(device.handle, &wait_info, max(u64)))
+}
+
+// Flushes any pending uploads and returns what a submit on another queue has to wait on to see them.
+@(private)
+uploader_submit_wait :: proc(device: ^Device) -> (semaphore: vk.Semaphore, value: u64, ok: bool) {
+    u := device.uploader
+    if u == nil do return
+    value = uploader_flush(device)
+    return u.timeline, value, value > 0
+}
+
+// Copies `data` to staging memory and makes sure a batch is being recorded.
+@(private = "file")
+uploader_stage :: proc(u: ^Uploader, data: []byte) -> (src: vk.Buffer, offset: int) {
+    size := mem.align_forward_int(len(data), STAGING_ALIGNMENT)
+
+    if size > STAGING_RING_SIZE {
+        uploader_begin(u)
+        temp := create_buffer({
+            device = u.device,
+            name = "Oversized Staging Buffer",
+            size = len(data),
+            usage = {.TransferSource},
+            mapped = true,
+        })
+        mem.copy(temp.alloc_info.pMappedData, raw_data(data), len(data))
+        append(&u.current.temp_buffers, temp)
+        return temp.handle, 0
+    }
+
+    for {
+        if offset, wasted, ok := ring_alloc(u, size); ok {
+            // Begin after allocating, the allocation can flush the current batch.
+            uploader_begin(u)
+            u.current.ring_bytes += size + wasted
+            u.current.ring_end = u.head
+            mem.copy(rawptr(uintptr(u.ring.alloc_info.pMappedData) + uintptr(offset)), raw_data(data), len(data))
+            return u.ring.handle, offset
+        }
+
+        // Out of space. Submit what we have and wait for the oldest batch to free its part of the ring.
+        tracy.ZoneN("Staging Ring Stall")
+        uploader_flush_locked(u)
+        if len(u.in_flight) > 0 {
+            uploader_wait(u.device, u.in_flight[0].value)
+        }
+        uploader_retire(u)
+    }
+}
+
+@(private = "file")
+ring_alloc :: proc(u: ^Uploader, size: int) -> (offset, wasted: int, ok: bool) {
+    if u.used == 0 {
+        u.head, u.tail = 0, 0
+    }
+
+    if u.head >= u.tail && u.used < STAGING_RING_SIZE {
+        if u.head + size <= STAGING_RING_SIZE {
+            offset = u.head
+            u.head += size
+            u.used += size
+            return offset, 0, true
+        }
+        // Doesn't fit at the end, wrap around and waste the rest.
+        if size <= u.tail {
+            wasted = STAGING_RING_SIZE - u.head
+            u.head = size
+            u.used += size + wasted
+            return 0, wasted, true
+        }
+        return
+    }
+
+    if u.head + size <= u.tail {
+        offset = u.head
+        u.head += size
+        u.used += size
+        return offset, 0, true
+    }
+    return
+}
+
+@(private = "file")
+uploader_begin :: proc(u: ^Uploader) {
+    if u.recording do return
+
+    cmd: vk.CommandBuffer
+    if len(u.free_cmds) > 0 {
+        cmd = pop(&u.free_cmds)
+    } else {
+        alloc_info := vk.CommandBufferAllocateInfo {
+            sType = .COMMAND_BUFFER_ALLOCATE_INFO,
+            commandPool = u.pool,
+            level = .PRIMARY,
+            commandBufferCount = 1,
+        }
+        check(vk.AllocateCommandBuffers(u.device.handle, &alloc_info, &cmd))
+    }
+
+    begin_info := vk.CommandBufferBeginInfo {
+        sType = .COMMAND_BUFFER_BEGIN_INFO,
+        flags = {.ONE_TIME_SUBMIT},
+    }
+    check(vk.BeginCommandBuffer(cmd, &begin_info))
+
+    u.current = UploadBatch {
+        cmd = cmd,
+        ring_end = u.head,
+    }
+    u.recording = true
+}
+
+@(private = "file")
+uploader_flush_locked :: proc(u: ^Uploader) {
+    if !u.recording do return
+    tracy.Zone()
+
+    check(vk.EndCommandBuffer(u.current.cmd))
+
+    u.submitted_value += 1
+    u.current.value = u.submitted_value
+
+    timeline_info := vk.TimelineSemaphoreSubmitInfo {
+        sType = .TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        signalSemaphoreValueCount = 1,
+        pSignalSemaphoreValues = &u.current.value,
+    }
+    submit_info := vk.SubmitInfo {
+        sType = .SUBMIT_INFO,
+        pNext = &timeline_info,
+        commandBufferCount = 1,
+        pCommandBuffers = &u.current.cmd,
+        signalSemaphoreCount = 1,
+        pSignalSemaphores = &u.timeline,
+    }
+    check(vk.QueueSubmit(u.device.transfer_queue, 1, &submit_info, 0))
+
+    append(&u.in_flight, u.current)
+    u.current = {}
+    u.recording = false
+}
+
+// Releases the ring space and command buffers of the batches the GPU has finished.
+@(private = "file")
+uploader_retire :: proc(u: ^Uploader) {
+    completed: u64
+    check(vk.GetSemaphoreCounterValue(u.device.handle, u.timeline, &completed))
+
+    done := 0
+    for batch in u.in_flight {
+        if batch.value > completed do break
+
+        for buffer in batch.temp_buffers {
+            destroy_buffer(buffer)
+        }
+        delete(batch.temp_buffers)
+
+        vk.ResetCommandBuffer(batch.cmd, {})
+        append(&u.free_cmds, batch.cmd)
+
+        u.used -= batch.ring_bytes
+        u.tail = batch.ring_end
+        done += 1
+    }
+    remove_range(&u.in_flight, 0, done)
+}
@@ -0,0 +1,359 @@
+package engine
+import "gpu"
+import vk "vendor:vulkan"
+import tracy "packages:odin-tracy"
+
+// GPU driven path for the opaque pass. Instead of culling, sorting and batching the renderers on the
+// CPU, they are all written to a storage buffer and a compute shader (cull.shader) does the frustum
+// culling and LOD selection. For every visible object it writes the instance data and a draw command,
+// and the world pass draws all of them with one vkCmdDrawIndexedIndirectCount per bucket.
+//
+// A bucket is a geometry page and an index type, the only state that can't change in the middle of an
+// indirect draw (materials come with the instances). Objects whose mesh is in the same bucket get a
+// contiguous range of draw commands, the shader appends to it and bumps the bucket's count.
+//
+// The CPU still writes the data of every renderer once a frame, but recording the pass costs the same
+// no matter how many objects there are. Devices without indirect count support use the CPU path.
+
+// Every object gets its own instance, so there can't be more of them than instances.
+MAX_GPU_OBJECTS :: MAX_INSTANCES
+MAX_DRAW_BUCKETS :: MAX_GEOMETRY_PAGES * len(gpu.IndexType)
+
+@(private = "file")
+CULL_GROUP_SIZE :: 64
+
+// Must match `Mesh` in cull.shader (std430).
+GpuMesh :: struct {
+    // First index of the mesh already added in.
+    lods: [MAX_MESH_LODS]MeshLod,
+    vertex_offset: i32,
+    lod_count: u32,
+    // First draw command of the bucket, in the current frame's region.
+    command_base: u32,
+    bucket: u32,
+}
+#assert(size_of(GpuMesh) == 48)
+
+// Must match `Object` in cull.shader (std430).
+GpuObject :: struct {
+    model: mat4,
+    bounds_min: vec3,
+    // Index into the mesh buffer, in the current frame's region.
+    mesh: u32,
+    bounds_max: vec3,
+    material: u32,
+    entity_id: i32,
+    _: [3]i32,
+}
+#assert(size_of(GpuObject) == 112)
+
+GpuCullPushConstants :: struct {
+    planes: [len(FrustumPlane)]vec4,
+    // xyz is the view position, w the projection scale, see `DrawView`.
+    view: vec4,
+    object_base: u32,
+    object_count: u32,
+    instance_base: u32,
+    count_base: u32,
+}
+#assert(size_of(GpuCullPushConstants) <= 128)
+
+GpuDrawBucket :: struct {
+    first_command: int,
+    // Objects with a mesh in this bucket, the most draws it can end up with.
+    capacity: int,
+}
+
+GpuCulling :: struct {
+    // Whether the device can do this at all, otherwise nothing else here is created.
+    supported: bool,
+
+    layout: gpu.ResourceLayout,
+    pool: gpu.ResourcePool,
+    resource: gpu.Resource,
+    shader: AssetHandle,
+
+    // Written by the CPU, one region per frame in flight like the instance buffer.
+    objects: gpu.Buffer,
+    meshes: gpu.Buffer,
+    // Written by the cull shader, also one region per frame.
+    commands: gpu.Buffer,
+    counts: gpu.Buffer,
+
+    // What gpu_culling_prepare wrote for the current frame.
+    object_count: int,
+    instance_base: int,
+    buckets: [MAX_DRAW_BUCKETS]GpuDrawBucket,
+}
+
+gpu_culling_init :: proc(r: ^Renderer3D) -> (ok: bool) {
+    tracy.Zone()
+    if !r.device.supports_indirect_count {
+        log_info(LC.Renderer, "Indirect count draws are not supported, the opaque pass will be recorded on the CPU.")
+        return
+    }
+    c := &r.gpu_culling
+    c.layout = gpu.create_resource_layout(r.device, {
+        tag = "Objects",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Compute},
+    }, {
+        tag = "Meshes",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Compute},
+    }, {
+        tag = "Draw Commands",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Compute},
+    }, {
+        tag = "Draw Counts",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Compute},
+    }, {
+        tag = "Instances",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Compute},
+    })
+
+    c.pool = gpu.create_resource_pool({
+        tag = "GPU Culling Pool",
+        device = &r.device,
+        max_sets = 1,
+        resource_limits = gpu.make_list([]gpu.ResourceLimit{{
+            resource = .StorageBuffer,
+            limit    = 5,
+        }}),
+    })
+
+    alloc_error: gpu.ResourceAllocationError
+    c.resource, alloc_error = gpu.allocate_resource(c.pool, c.layout, "GPU Culling")
+    assert(alloc_error == nil, "Could not allocate the GPU culling set")
+
+    c.objects = gpu.create_buffer({
+        name = "GPU Culling Objects",
+        device = &r.device,
+        size = size_of(GpuObject) * MAX_GPU_OBJECTS * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage},
+        mapped = true,
+    })
+    c.meshes = gpu.create_buffer({
+        name = "GPU Culling Meshes",
+        device = &r.device,
+        size = size_of(GpuMesh) * MAX_GPU_OBJECTS * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage},
+        mapped = true,
+    })
+    c.commands = gpu.create_buffer({
+        name = "GPU Culling Draw Commands",
+        device = &r.device,
+        size = size_of(vk.DrawIndexedIndirectCommand) * MAX_GPU_OBJECTS * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage, .Indirect},
+        device_local = true,
+    })
+    c.counts = gpu.create_buffer({
+        name = "GPU Culling Draw Counts",
+        device = &r.device,
+        size = size_of(u32) * MAX_DRAW_BUCKETS * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage, .Indirect},
+        device_local = true,
+    })
+
+    gpu.resource_bind_buffer(c.resource, c.objects, .StorageBuffer, 0)
+    gpu.resource_bind_buffer(c.resource, c.meshes, .StorageBuffer, 1)
+    gpu.resource_bind_buffer(c.resource, c.commands, .StorageBuffer, 2)
+    gpu.resource_bind_buffer(c.resource, c.counts, .StorageBuffer, 3)
+    gpu.resource_bind_buffer(c.resource, r.global_set.instances.handle, .StorageBuffer, 4)
+
+    pipeline_layout := gpu.create_pipeline_layout({
+        tag = "GPU Culling Pipeline Layout",
+        device = &r.device,
+        layouts = {
+            c.layout,
+        },
+        use_push = true,
+        push_stages = {.Compute},
+    }, size_of(GpuCullPushConstants))
+
+    pipeline_spec := gpu.PipelineSpecification {
+        tag = "GPU Culling Pipeline",
+        layout = pipeline_layout,
+    }
+
+    manager := &EngineInstance.asset_manager
+    id := AssetHandle(generate_uuid())
+    manager.registry[id] = AssetMetadata {
+        path = "assets/shaders/new/cull.shader",
+        type = .Shader,
+        dont_serialize = true,
+    }
+    manager.loaded_assets[id] = new_shader(manager.registry[id].path, pipeline_spec) or_return
+    c.shader = id
+    c.supported = true
+    return true
+}
+
+gpu_culling_deinit :: proc(c: ^GpuCulling) {
+    if !c.supported do return
+    gpu.destroy_buffer(c.objects)
+    gpu.destroy_buffer(c.meshes)
+    gpu.destroy_buffer(c.commands)
+    gpu.destroy_buffer(c.counts)
+    gpu.destroy_resource_pool(&c.pool)
+}
+
+// Writes the objects and meshes of every renderer in the culling BVH for this frame, and reserves
+// an instance for each of them.
+gpu_culling_prepare :: proc(r: ^Renderer3D, scene: ^World) {
+    tracy.Zone()
+    c := &r.gpu_culling
+    c.object_count = 0
+    c.buckets = {}
+
+    items := r.culling_bvh.items[:]
+    if scene == nil || len(items) == 0 {
+        return
+    }
+
+    base, available := instance_buffer_reserve(r, min(len(items), MAX_GPU_OBJECTS))
+    c.instance_base = base
+
+    frame := r.swapchain.current_frame
+    region := frame * MAX_GPU_OBJECTS
+    // These are write combined, so nothing gets read back from them.
+    objects := ([^]GpuObject)(c.objects.alloc_info.pMappedData)[region:]
+    meshes := ([^]GpuMesh)(c.meshes.alloc_info.pMappedData)[region:]
+
+    MeshEntry :: struct {
+        index: u32,
+        bucket: int,
+    }
+    manager := &EngineInstance.asset_manager
+    mesh_entries := make(map[AssetHandle]MeshEntry, allocator = context.temp_allocator)
+    mesh_buckets := make([dynamic]int, context.temp_allocator)
+    materials := make(map[AssetHandle]u32, allocator = context.temp_allocator)
+
+    for item in items[:available] {
+        mr := item.renderer
+        mesh := get_asset(manager, mr.mesh, Mesh)
+        if mesh == nil do continue
+        go := get_object(scene, item.owner)
+        if go == nil do continue
+
+        material, material_found := materials[mr.material]
+        if !material_found {
+            // The CPU path warns about missing materials.
+            asset := get_asset(manager, mr.material, PbrMaterial)
+            if asset == nil do continue
+            material = material_table_material(r, mr.material, asset)
+            materials[mr.material] = material
+        }
+
+        entry, mesh_found := mesh_entries[mr.mesh]
+        if !mesh_found {
+            geometry := mesh.geometry
+            entry = MeshEntry {
+                index = u32(len(mesh_buckets)),
+                bucket = geometry.page * len(gpu.IndexType) + int(geometry.index_type),
+            }
+
+            gpu_mesh := GpuMesh {
+                vertex_offset = geometry.vertex_offset,
+                lod_count = u32(mesh.lod_count),
+                bucket = u32(entry.bucket),
+            }
+            for lod, i in mesh.lods[:mesh.lod_count] {
+                gpu_mesh.lods[i] = MeshLod {
+                    first_index = geometry.first_index + lod.first_index,
+                    index_count = lod.index_count,
+                }
+            }
+            meshes[entry.index] = gpu_mesh
+
+            mesh_entries[mr.mesh] = entry
+            append(&mesh_buckets, entry.bucket)
+        }
+
+        objects[c.object_count] = GpuObject {
+            model = transform_world_matrix(go),
+            bounds_min = item.bounds.min,
+            bounds_max = item.bounds.max,
+            mesh = u32(region) + entry.index,
+            material = material,
+            entity_id = i32(go.local_id),
+        }
+        c.object_count += 1
+        c.buckets[entry.bucket].capacity += 1
+    }
+
+    first_command := region
+    for &bucket in c.buckets {
+        bucket.first_command = first_command
+        first_command += bucket.capacity
+    }
+    for bucket, i in mesh_buckets {
+        meshes[i].command_base = u32(c.buckets[bucket].first_command)
+    }
+}
+
+// Culls the objects written by gpu_culling_prepare. Has to be recorded on the frame's command buffer
+// before the pass that calls gpu_culling_draw, outside of a render pass.
+gpu_culling_dispatch :: proc(r: ^Renderer3D, cmd: gpu.CommandBuffer, camera: RenderCamera) {
+    tracy.Zone()
+    c := &r.gpu_culling
+    if c.object_count == 0 {
+        return
+    }
+
+    frame := r.swapchain.current_frame
+    count_base := frame * MAX_DRAW_BUCKETS
+    gpu.fill_buffer(cmd, c.counts, count_base * size_of(u32), MAX_DRAW_BUCKETS * size_of(u32))
+    gpu.cmd_transfer_to_compute_barrier(cmd)
+
+    shader := get_asset(&EngineInstance.asset_manager, c.shader, Shader)
+    gpu.pipeline_bind(cmd, shader.pipeline)
+    gpu.bind_resource(cmd, c.resource, shader.pipeline)
+
+    view := make_draw_view(camera)
+    push := GpuCullPushConstants {
+        view = vec4{view.position.x, view.position.y, view.position.z, view.projection_scale},
+        object_base = u32(frame * MAX_GPU_OBJECTS),
+        object_count = u32(c.object_count),
+        instance_base = u32(c.instance_base),
+        count_base = u32(count_base),
+    }
+    frustum := frustum_from_matrix(camera.projection * camera.view)
+    for plane, kind in frustum.planes {
+        push.planes[int(kind)] = plane
+    }
+    vk.CmdPushConstants(
+        cmd.handle,
+        shader.pipeline.spec.layout.handle,
+        {.COMPUTE},
+        0, size_of(GpuCullPushConstants), &push)
+
+    gpu.dispatch(cmd, (c.object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE)
+}
+
+// Draws whatever the cull shader let through, with the object pipeline and its sets already bound.
+gpu_culling_draw :: proc(r: ^Renderer3D, cmd: gpu.CommandBuffer) {
+    tracy.Zone()
+    c := &r.gpu_culling
+    count_base := r.swapchain.current_frame * MAX_DRAW_BUCKETS
+
+    for bucket, i in c.buckets do if bucket.capacity > 0 {
+        page := &r.geometry.pages[i / len(gpu.IndexType)]
+        gpu.bind_buffers(cmd, page.vertices.buffer)
+        gpu.bind_index_buffer(cmd, page.indices.buffer, gpu.IndexType(i % len(gpu.IndexType)))
+
+        gpu.draw_indexed_indirect_count(
+            cmd,
+            c.commands, bucket.first_command * size_of(vk.DrawIndexedIndirectCommand),
+            c.counts, (count_base + i) * size_of(u32),
+            bucket.capacity)
+    }
+}
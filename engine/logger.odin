@@ -7,6 +7,7 @@ import "core:time"
 import intr "base:intrinsics"
 import rt "base:runtime"
 import "core:reflect"
+import "core:sync"
 
 when USE_EDITOR {
     LogCategory :: enum {
@@ -49,6 +50,9 @@ RawCategoryLogger :: struct {
     typed_category_logger: rawptr,
 
     log_entries: ^[dynamic]LogEntry,
+    // Worker threads log too, like the shader compile jobs and the file watchers. Held while appending to
+    // log_entries, anything else touching them has to hold it as well, see category_logger_mutex.
+    mutex: sync.Mutex,
 }
 
 CategoryLogger :: struct($T: typeid) where intr.type_is_enum(T) {
@@ -83,6 +87,7 @@ raw_category_logger_proc :: proc(logger_data: rawptr, level: log.Level, text: st
 }
 
 cat_logger_proc :: proc(raw_logger: ^RawCategoryLogger, category: $T, level: log.Level, text: string, options: log.Options, location := #caller_location) {
+    sync.guard(&raw_logger.mutex)
     raw_logger.base_logger.procedure(raw_logger.base_logger.data, level, text, options, location)
 
     name, ok := reflect.enum_name_from_value(category)
@@ -96,6 +101,12 @@ cat_logger_proc :: proc(raw_logger: ^RawCategoryLogger, category: $T, level: log
         location})
 }
 
+// The mutex guarding the log entries of a logger made with create_category_logger.
+category_logger_mutex :: proc(logger: log.Logger) -> ^sync.Mutex {
+    assert(logger.procedure == raw_category_logger_proc)
+    return &(cast(^RawCategoryLogger) logger.data).mutex
+}
+
 @(private = "file")
 log_actual :: proc(category: $T, level: log.Level, text: string, location := #caller_location) where intr.type_is_enum(T) {
     if context.logger.procedure == raw_category_logger_proc {
@@ -0,0 +1,194 @@
+package engine
+import "core:sync"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Bindless materials. Every texture in use gets a slot in one big sampler array and every material
+// a slot in a storage buffer, where it references its textures by slot. Both live in a single set
+// (set 2 of the object pipeline) that is bound once per pass, and every instance carries the index
+// of its material, see `InstanceData`. That way draws with different materials don't need any state
+// changes in between, which is what lets the GPU driven path draw everything in a few indirect draws.
+//
+// Like the instance buffer, the material buffer has one region per frame in flight and the index
+// of a material already points into the current frame's region.
+
+MAX_BINDLESS_TEXTURES :: 4096
+
+// Must match `MaterialData` in object.glsl (std430).
+MaterialData :: struct {
+    albedo_color: Color,
+    metallic: f32,
+    roughness: f32,
+    // Slots in the texture array: albedo, normal, ambient occlusion, emissive, metallic/roughness.
+    textures: [MATERIAL_TEXTURE_COUNT]u32,
+    _: u32,
+}
+#assert(size_of(MaterialData) == 48)
+
+MaterialTable :: struct {
+    layout: gpu.ResourceLayout,
+    pool: gpu.ResourcePool,
+    resource: gpu.Resource,
+
+    // Images can be destroyed from any thread, which frees their slot.
+    texture_mutex: sync.Mutex,
+    texture_slots: map[gpu.UUID]u32,
+    free_texture_slots: [dynamic]u32,
+    texture_count: u32,
+
+    materials: gpu.Buffer,
+    material_slots: map[AssetHandle]u32,
+    material_count: u32,
+    overflow_reported: bool,
+    // What was last written to each slot, per frame region, so unchanged materials are skipped.
+    written: [gpu.MAX_FRAMES_IN_FLIGHT][MAX_MATERIALS]MaterialData,
+    is_written: [gpu.MAX_FRAMES_IN_FLIGHT][MAX_MATERIALS]bool,
+}
+
+material_table_init :: proc(table: ^MaterialTable, device: ^gpu.Device) {
+    tracy.Zone()
+    table.layout = gpu.create_resource_layout(device^, {
+        tag = "Materials",
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Vertex, .Fragment},
+    }, {
+        tag = "Textures",
+        type = .CombinedImageSampler,
+        count = MAX_BINDLESS_TEXTURES,
+        stage = {.Fragment},
+        bindless = true,
+    })
+
+    table.pool = gpu.create_resource_pool({
+        tag = "Material Table Pool",
+        device = device,
+        max_sets = 1,
+        resource_limits = gpu.make_list([]gpu.ResourceLimit{{
+            resource = .StorageBuffer,
+            limit    = 1,
+        }, {
+            resource = .CombinedImageSampler,
+            limit    = MAX_BINDLESS_TEXTURES,
+        }}),
+        update_after_bind = true,
+    })
+
+    alloc_error: gpu.ResourceAllocationError
+    table.resource, alloc_error = gpu.allocate_resource(table.pool, table.layout, "Material Table")
+    assert(alloc_error == nil, "Could not allocate the material table set")
+
+    table.materials = gpu.create_buffer({
+        name = "Material Data",
+        device = device,
+        size = size_of(MaterialData) * MAX_MATERIALS * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage},
+        mapped = true,
+    })
+    gpu.resource_bind_buffer(table.resource, table.materials, .StorageBuffer, 0)
+}
+
+material_table_deinit :: proc(table: ^MaterialTable) {
+    gpu.destroy_buffer(table.materials)
+    gpu.destroy_resource_pool(&table.pool)
+    delete(table.texture_slots)
+    delete(table.free_texture_slots)
+    delete(table.material_slots)
+}
+
+// Returns the slot of `texture` in the texture array, writing it there the first time it's used.
+material_table_texture :: proc(table: ^MaterialTable, texture: ^Texture2D) -> u32 {
+    if sync.guard(&table.texture_mutex) {
+        image := texture.handle
+        if slot, found := table.texture_slots[image.id]; found {
+            return slot
+        }
+
+        slot: u32
+        if len(table.free_texture_slots) > 0 {
+            slot = pop(&table.free_texture_slots)
+        } else if table.texture_count < MAX_BINDLESS_TEXTURES {
+            slot = table.texture_count
+            table.texture_count += 1
+        } else {
+            log_error(LC.Renderer, "Out of bindless texture slots (%v).", MAX_BINDLESS_TEXTURES)
+            return 0
+        }
+
+        gpu.resource_bind_image(table.resource, image, .CombinedImageSampler, 1, slot)
+        table.texture_slots[image.id] = slot
+        return slot
+    }
+    unreachable()
+}
+
+// Called when an image is destroyed. Its slot can be handed out again once the frames that might
+// still sample it are done, which the frame fence already guarantees with MAX_FRAMES_IN_FLIGHT of 1.
+material_table_release_image :: proc(table: ^MaterialTable, image: gpu.UUID) {
+    if sync.guard(&table.texture_mutex) {
+        if slot, found := table.texture_slots[image]; found {
+            delete_key(&table.texture_slots, image)
+            append(&table.free_texture_slots, slot)
+        }
+    }
+}
+
+// Returns the index to push for `material` this frame, updating its entry when it changed.
+// Not thread safe, like the rest of draw list extraction.
+material_table_material :: proc(r: ^Renderer3D, handle: AssetHandle, material: ^PbrMaterial) -> u32 {
+    tracy.Zone()
+    table := &r.material_table
+    manager := &EngineInstance.asset_manager
+
+    slot, found := table.material_slots[handle]
+    if !found {
+        if table.material_count == MAX_MATERIALS {
+            if !table.overflow_reported {
+                log_error(LC.Renderer, "Out of material slots (%v), using the default material.", MAX_MATERIALS)
+                table.overflow_reported = true
+            }
+            if handle == r.default_material do return 0
+            default := get_asset(manager, r.default_material, PbrMaterial)
+            return material_table_material(r, r.default_material, default)
+        }
+        slot = table.material_count
+        table.material_count += 1
+        table.material_slots[handle] = slot
+    }
+
+    get_texture :: proc(manager: ^AssetManager, handle, fallback: AssetHandle) -> ^Texture2D {
+        texture := get_asset(manager, handle, Texture2D)
+        if texture == nil {
+            texture = get_asset(manager, fallback, Texture2D)
+        }
+        return texture
+    }
+
+    // Same order as the texture slots in `MaterialData`.
+    textures := [MATERIAL_TEXTURE_COUNT]^Texture2D {
+        get_texture(manager, material.albedo_texture, r.white_texture),
+        get_texture(manager, material.normal_texture, r.normal_texture),
+        get_texture(manager, material.ambient_occlusion_texture, r.white_texture),
+        get_texture(manager, material.emissive_texture, r.black_texture),
+        get_texture(manager, material.metallic_texture, r.white_texture),
+    }
+
+    data := MaterialData {
+        albedo_color = material.block.albedo_color,
+        metallic = material.block.metallic_factor,
+        roughness = material.block.roughness_factor,
+    }
+    for texture, i in textures {
+        data.textures[i] = material_table_texture(table, texture)
+    }
+
+    frame := r.swapchain.current_frame
+    index := u32(frame * MAX_MATERIALS) + slot
+    if !table.is_written[frame][slot] || table.written[frame][slot] != data {
+        materials := ([^]MaterialData)(table.materials.alloc_info.pMappedData)
+        materials[index] = data
+        table.written[frame][slot] = data
+        table.is_written[frame][slot] = true
+    }
+    return index
+}
@@ -8,15 +8,23 @@ get_quaternion_forward :: proc(rotation: quaternion128) -> Vector3 {
 }
 
 get_vector_forward :: proc(vector: Vector3) -> Vector3 {
-    quat := linalg.quaternion_from_euler_angles(
-        vector.y * math.RAD_PER_DEG,
-        vector.x * math.RAD_PER_DEG,
-        vector.z * math.RAD_PER_DEG,
+    return linalg.quaternion_mul_vector3(euler_to_quat(vector), Vector3{0, 0, 1})
+}
+
+euler_to_quat :: proc(euler_degrees: vec3) -> quat {
+    return linalg.quaternion_from_euler_angles(
+        euler_degrees.y * math.RAD_PER_DEG,
+        euler_degrees.x * math.RAD_PER_DEG,
+        euler_degrees.z * math.RAD_PER_DEG,
         .YXZ)
-    return linalg.quaternion_mul_vector3(quat, Vector3{0, 0, 1})
+}
+
+quat_to_euler :: proc(q: quat) -> vec3 {
+    y, x, z := linalg.euler_angles_from_quaternion(q, .YXZ)
+    return vec3{x, y, z} * math.DEG_PER_RAD
 }
 
 get_forward :: proc {
     get_quaternion_forward,
     get_vector_forward,
-}
\ No newline at end of file
+}
\ No newline at end of file
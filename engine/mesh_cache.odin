@@ -0,0 +1,169 @@
+package engine
+import "core:os"
+import "core:mem"
+import "core:mem/virtual"
+import "core:path/filepath"
+import "core:time"
+import fs "filesystem"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Cooked meshes are written to the project cache folder after a glTF file is imported, so the next load
+// can skip parsing and processing entirely. The file is memory mapped and the vertex/index blobs,
+// which are already in GPU layout, are copied straight into the staging ring.
+//
+// Layout:
+//  | CookedMeshHeader | lods: [lod_count]MeshLod | vertices | indices |
+// Blobs are aligned to COOKED_MESH_ALIGNMENT from the start of the file.
+
+COOKED_MESH_MAGIC :: u32(0x4853454d) // "MESH"
+// Bump when the format or the import pipeline changes, older files get recooked.
+COOKED_MESH_VERSION :: 2
+COOKED_MESH_EXTENSION :: ".mesh"
+@(private = "file")
+COOKED_MESH_ALIGNMENT :: 16
+
+CookedMeshHeader :: struct {
+    magic: u32,
+    version: u32,
+    // Cooked meshes are only valid for the `Vertex` they were written with.
+    vertex_size: u32,
+    index_type: u32,
+    vertex_count: u32,
+    index_count: u32,
+    lod_count: u32,
+    _: u32,
+    bounds: AABB,
+
+    // Offsets from the start of the file.
+    lods_offset: u64,
+    vertices_offset: u64,
+    indices_offset: u64,
+}
+
+CookedMesh :: struct {
+    file: []byte,
+    // Points into `file`, only valid until close_cooked_mesh.
+    data: MeshData,
+}
+
+// Maps the cooked version of `source_path`. Fails if there is none, it's older than the source or it's
+// not a valid cooked mesh for this version of the engine.
+open_cooked_mesh :: proc(source_path: string) -> (mesh: CookedMesh, ok: bool) {
+    tracy.Zone()
+    cooked_path := cooked_asset_path(source_path, COOKED_MESH_EXTENSION)
+
+    if !os.exists(cooked_path) {
+        return
+    }
+    source_info, _ := os.stat(source_path, context.temp_allocator)
+    cooked_info, _ := os.stat(cooked_path, context.temp_allocator)
+    if time.diff(source_info.modification_time, cooked_info.modification_time) < 0 {
+        return
+    }
+
+    file, err := virtual.map_file_from_path(cooked_path, {.Read})
+    if err != .None {
+        log_warning(LC.AssetSystem, "Could not map cooked mesh '%v': %v", cooked_path, err)
+        return
+    }
+    mesh.file = file
+    defer if !ok do close_cooked_mesh(&mesh)
+
+    if len(file) < size_of(CookedMeshHeader) {
+        return
+    }
+    header := (^CookedMeshHeader)(raw_data(file))^
+    if header.magic != COOKED_MESH_MAGIC ||
+        header.version != COOKED_MESH_VERSION ||
+        header.vertex_size != size_of(Vertex) ||
+        header.index_type > u32(max(gpu.IndexType)) ||
+        header.lod_count == 0 || header.lod_count > MAX_MESH_LODS {
+        return
+    }
+
+    index_type := gpu.IndexType(header.index_type)
+    lods_size := u64(header.lod_count) * size_of(MeshLod)
+    vertices_size := u64(header.vertex_count) * size_of(Vertex)
+    indices_size := u64(header.index_count) * u64(gpu.index_type_size(index_type))
+    if header.lods_offset + lods_size > u64(len(file)) ||
+        header.vertices_offset + vertices_size > u64(len(file)) ||
+        header.indices_offset + indices_size > u64(len(file)) {
+        log_warning(LC.AssetSystem, "Cooked mesh '%v' is truncated, it will be recooked.", cooked_path)
+        return
+    }
+
+    // The draws index with these, a range past the index buffer reads garbage.
+    lods := mem.slice_ptr((^MeshLod)(&file[header.lods_offset]), int(header.lod_count))
+    for lod, i in lods {
+        if u64(lod.first_index) + u64(lod.index_count) > u64(header.index_count) {
+            log_warning(LC.AssetSystem, "Cooked mesh '%v' has an invalid LOD %v, it will be recooked.", cooked_path, i)
+            return
+        }
+    }
+
+    mesh.data = MeshData {
+        vertices = mem.slice_ptr((^Vertex)(&file[header.vertices_offset]), int(header.vertex_count)),
+        index_data = file[header.indices_offset:][:indices_size],
+        index_type = index_type,
+        index_count = int(header.index_count),
+        lods = lods,
+        bounds = header.bounds,
+    }
+    return mesh, true
+}
+
+close_cooked_mesh :: proc(mesh: ^CookedMesh) {
+    if mesh.file != nil {
+        virtual.release(raw_data(mesh.file), uint(len(mesh.file)))
+    }
+    mesh^ = {}
+}
+
+write_cooked_mesh :: proc(source_path: string, data: MeshData) -> bool {
+    tracy.Zone()
+    cooked_path := cooked_asset_path(source_path, COOKED_MESH_EXTENSION)
+    fs.make_directory_recursive(filepath.dir(cooked_path, context.temp_allocator))
+
+    header := CookedMeshHeader {
+        magic = COOKED_MESH_MAGIC,
+        version = COOKED_MESH_VERSION,
+        vertex_size = size_of(Vertex),
+        index_type = u32(data.index_type),
+        vertex_count = u32(len(data.vertices)),
+        index_count = u32(data.index_count),
+        lod_count = u32(len(data.lods)),
+        bounds = data.bounds,
+    }
+
+    vertex_bytes := mem.slice_to_bytes(data.vertices)
+    lods_bytes := mem.slice_to_bytes(data.lods)
+
+    header.lods_offset = u64(mem.align_forward_int(size_of(CookedMeshHeader), COOKED_MESH_ALIGNMENT))
+    header.vertices_offset = u64(mem.align_forward_int(int(header.lods_offset) + len(lods_bytes), COOKED_MESH_ALIGNMENT))
+    header.indices_offset = u64(mem.align_forward_int(int(header.vertices_offset) + len(vertex_bytes), COOKED_MESH_ALIGNMENT))
+
+    file := make([]byte, int(header.indices_offset) + len(data.index_data), context.temp_allocator)
+    copy(file, mem.ptr_to_bytes(&header))
+    copy(file[header.lods_offset:], lods_bytes)
+    copy(file[header.vertices_offset:], vertex_bytes)
+    copy(file[header.indices_offset:], data.index_data)
+
+    if !os.write_entire_file(cooked_path, file) {
+        log_warning(LC.AssetSystem, "Could not write cooked mesh to '%v'", cooked_path)
+        return false
+    }
+    return true
+}
+
+// Cooked assets mirror the source layout inside the cache folder. Paths inside the project are made relative to it.
+cooked_asset_path :: proc(source_path, extension: string) -> string {
+    project := EditorInstance.active_project
+    path := source_path
+    if filepath.is_abs(path) {
+        if rel, err := filepath.rel(project.root, path, context.temp_allocator); err == .None {
+            path = rel
+        }
+    }
+    return concat(make_tpath(project_get_cache_folder(project, context.temp_allocator), path), extension, allocator = context.temp_allocator)
+}
@@ -0,0 +1,586 @@
+package engine
+import "core:math"
+import "core:math/linalg"
+import "core:slice"
+import "core:mem"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Import time mesh processing. Meshes go through these before they are uploaded:
+//  1. optimize_vertex_cache: reorders triangles so vertices get reused while they are still in the post transform cache.
+//  2. optimize_overdraw: reorders clusters of triangles so the ones facing outwards are drawn first,
+//     without undoing most of the cache optimisation.
+//  3. simplify_mesh: generates the LODs, which share the vertices of LOD 0.
+//  4. optimize_vertex_fetch: reorders (and drops unused) vertices in the order the index buffer uses them.
+// Vertices are quantised with `pack_vertex`.
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+VERTEX_CACHE_SIZE :: 32
+@(private = "file")
+CACHE_DECAY_POWER :: 1.5
+@(private = "file")
+LAST_TRIANGLE_SCORE :: 0.75
+@(private = "file")
+VALENCE_BOOST_SCALE :: 2.0
+@(private = "file")
+VALENCE_BOOST_POWER :: 0.5
+
+// Size of the FIFO cache simulated to find the cluster boundaries for the overdraw pass.
+@(private = "file")
+OVERDRAW_CACHE_SIZE :: 16
+
+// Every LOD aims for this fraction of the triangles of the previous one.
+@(private = "file")
+LOD_TRIANGLE_RATIO :: 0.5
+// Largest error a LOD may have, relative to the size of the mesh.
+@(private = "file")
+LOD_MAX_ERROR :: 0.05
+// Meshes this small are not worth simplifying.
+@(private = "file")
+LOD_MIN_TRIANGLES :: 32
+
+@(private = "file")
+vertex_cache_score :: proc(cache_position, remaining: int) -> f32 {
+    if remaining == 0 {
+        return -1
+    }
+
+    score := f32(0)
+    if cache_position >= 0 {
+        if cache_position < 3 {
+            // The vertices of the last triangle get a fixed score, so the next triangle doesn't
+            // just depend on whichever one of them happens to be first.
+            score = LAST_TRIANGLE_SCORE
+        } else {
+            scale := 1.0 / f32(VERTEX_CACHE_SIZE - 3)
+            score = math.pow(1 - f32(cache_position - 3) * scale, CACHE_DECAY_POWER)
+        }
+    }
+
+    // Boost vertices with few triangles left, so lone triangles don't get left behind.
+    score += VALENCE_BOOST_SCALE * math.pow(f32(remaining), -VALENCE_BOOST_POWER)
+    return score
+}
+
+optimize_vertex_cache :: proc(indices: []u32, vertex_count: int) {
+    tracy.Zone()
+    triangle_count := len(indices) / 3
+    if triangle_count == 0 {
+        return
+    }
+
+    context.allocator = context.temp_allocator
+
+    // The triangles of every vertex, packed in one array.
+    remaining := make([]int, vertex_count)
+    for index in indices {
+        remaining[index] += 1
+    }
+    offsets := make([]int, vertex_count + 1)
+    for v in 0..<vertex_count {
+        offsets[v + 1] = offsets[v] + remaining[v]
+    }
+    adjacency := make([]int, len(indices))
+    cursor := slice.clone(offsets[:vertex_count])
+    for index, i in indices {
+        adjacency[cursor[index]] = i / 3
+        cursor[index] += 1
+    }
+
+    cache_position := make([]int, vertex_count)
+    vertex_score := make([]f32, vertex_count)
+    for v in 0..<vertex_count {
+        cache_position[v] = -1
+        vertex_score[v] = vertex_cache_score(-1, remaining[v])
+    }
+
+    triangle_score :: proc(indices: []u32, vertex_score: []f32, t: int) -> f32 {
+        return vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]]
+    }
+
+    emitted := make([]bool, triangle_count)
+    output := make([]u32, len(indices))
+
+    best, best_score := 0, f32(-1)
+    for t in 0..<triangle_count {
+        if score := triangle_score(indices, vertex_score, t); score > best_score {
+            best, best_score = t, score
+        }
+    }
+
+    cache, new_cache: [VERTEX_CACHE_SIZE + 3]u32
+    cache_len := 0
+    next_unemitted := 0
+    for out in 0..<triangle_count {
+        if best < 0 {
+            // Nothing in the cache has triangles left, continue with the first triangle that wasn't emitted.
+            for emitted[next_unemitted] {
+                next_unemitted += 1
+            }
+            best = next_unemitted
+        }
+
+        emitted[best] = true
+        triangle := indices[best * 3:][:3]
+        copy(output[out * 3:], triangle)
+
+        // The triangle's vertices move to the front of the cache, everything else gets pushed back.
+        n := 0
+        for v in triangle {
+            new_cache[n] = v
+            n += 1
+            remaining[v] -= 1
+        }
+        for v in cache[:cache_len] {
+            if v != triangle[0] && v != triangle[1] && v != triangle[2] {
+                new_cache[n] = v
+                n += 1
+            }
+        }
+        for v in new_cache[min(n, VERTEX_CACHE_SIZE):n] {
+            cache_position[v] = -1
+            vertex_score[v] = vertex_cache_score(-1, remaining[v])
+        }
+
+        cache_len = min(n, VERTEX_CACHE_SIZE)
+        cache = new_cache
+        for v, i in cache[:cache_len] {
+            cache_position[v] = i
+            vertex_score[v] = vertex_cache_score(i, remaining[v])
+        }
+
+        // Only triangles that use a cached vertex can have changed score.
+        best, best_score = -1, -1
+        for v in cache[:cache_len] {
+            for t in adjacency[offsets[v]:offsets[v + 1]] {
+                if emitted[t] do continue
+                if score := triangle_score(indices, vertex_score, t); score > best_score {
+                    best, best_score = t, score
+                }
+            }
+        }
+    }
+
+    copy(indices, output)
+}
+
+// Expects cache optimised indices. The triangles are split into clusters where a simulated cache goes cold
+// (all three vertices miss), so moving whole clusters around costs almost nothing in cache efficiency.
+// The clusters are then sorted so the ones facing away from the center of the mesh come first,
+// which makes them likely to occlude the rest.
+optimize_overdraw :: proc(indices: []u32, vertices: []Vertex) {
+    tracy.Zone()
+    triangle_count := len(indices) / 3
+    if triangle_count == 0 {
+        return
+    }
+
+    context.allocator = context.temp_allocator
+
+    Cluster :: struct {
+        first, count: int,
+        sort_key: f32,
+    }
+
+    clusters := make([dynamic]Cluster)
+    cache_time := make([]int, len(vertices))
+    for &t in cache_time {
+        t = -OVERDRAW_CACHE_SIZE - 1
+    }
+
+    time := 0
+    for t in 0..<triangle_count {
+        misses := 0
+        for index in indices[t * 3:][:3] {
+            if time - cache_time[index] > OVERDRAW_CACHE_SIZE {
+                cache_time[index] = time
+                time += 1
+                misses += 1
+            }
+        }
+
+        if t == 0 || misses == 3 {
+            append(&clusters, Cluster{first = t})
+        }
+        clusters[len(clusters) - 1].count += 1
+    }
+
+    if len(clusters) < 2 {
+        return
+    }
+
+    mesh_center: vec3
+    for v in vertices {
+        mesh_center += v.position
+    }
+    mesh_center /= f32(len(vertices))
+
+    for &cluster in clusters {
+        center: vec3
+        normal: vec3
+        area: f32
+        for t in cluster.first..<cluster.first + cluster.count {
+            a := vertices[indices[t * 3]].position
+            b := vertices[indices[t * 3 + 1]].position
+            c := vertices[indices[t * 3 + 2]].position
+
+            // Area weighted, the length of the cross product is twice the triangle area.
+            n := linalg.cross(b - a, c - a)
+            triangle_area := linalg.length(n)
+            center += (a + b + c) / 3 * triangle_area
+            normal += n
+            area += triangle_area
+        }
+
+        if area > 0 {
+            center /= area
+        }
+        if length := linalg.length(normal); length > 0 {
+            normal /= length
+        }
+        cluster.sort_key = linalg.dot(center - mesh_center, normal)
+    }
+
+    slice.stable_sort_by(clusters[:], proc(a, b: Cluster) -> bool {
+        return a.sort_key > b.sort_key
+    })
+
+    sorted := make([]u32, len(indices))
+    offset := 0
+    for cluster in clusters {
+        copy(sorted[offset:], indices[cluster.first * 3:][:cluster.count * 3])
+        offset += cluster.count * 3
+    }
+    copy(indices, sorted)
+}
+
+// Reorders the vertices in the order they are first referenced and remaps the indices.
+// Unreferenced vertices are dropped, returns the new vertex count.
+optimize_vertex_fetch :: proc(vertices: []$T, indices: []u32) -> int {
+    tracy.Zone()
+    remap := make([]u32, len(vertices), context.temp_allocator)
+    slice.fill(remap, max(u32))
+    reordered := make([]T, len(vertices), context.temp_allocator)
+
+    count := 0
+    for &index in indices {
+        if remap[index] == max(u32) {
+            remap[index] = u32(count)
+            reordered[count] = vertices[index]
+            count += 1
+        }
+        index = remap[index]
+    }
+
+    copy(vertices, reordered[:count])
+    return count
+}
+
+// Octahedral encoding of a unit vector, stored as snorm16. Decoded with `oct_decode` in common.glsl.
+oct_encode :: proc(n: vec3) -> [2]i16 {
+    l1 := abs(n.x) + abs(n.y) + abs(n.z)
+    if l1 == 0 {
+        return {0, 32767}
+    }
+
+    n := n / l1
+    p := n.xy
+    if n.z < 0 {
+        p = {
+            (1 - abs(n.y)) * (n.x >= 0 ? 1 : -1),
+            (1 - abs(n.x)) * (n.y >= 0 ? 1 : -1),
+        }
+    }
+    return {
+        i16(math.round(clamp(p.x, -1, 1) * 32767)),
+        i16(math.round(clamp(p.y, -1, 1) * 32767)),
+    }
+}
+
+pack_vertex :: proc(position, normal, tangent: vec3, uv: vec2) -> Vertex {
+    return {
+        position = position,
+        normal = oct_encode(normal),
+        tangent = oct_encode(tangent),
+        uv = {f16(uv.x), f16(uv.y)},
+    }
+}
+
+// Runs all the optimisations on a freshly imported mesh and generates its LODs. The LODs are stored one
+// after the other in the index data. Only the vertices that are still used are returned and the indices
+// are u16 when they fit, u32 otherwise. Everything is in the temp allocator, bounds are left to the caller.
+process_mesh :: proc(vertices: []Vertex, indices: []u32) -> (mesh: MeshData) {
+    tracy.Zone()
+    optimize_vertex_cache(indices, len(vertices))
+    optimize_overdraw(indices, vertices)
+
+    all_indices := make([dynamic]u32, 0, len(indices) * 2, context.temp_allocator)
+    lods := make([dynamic]MeshLod, 0, MAX_MESH_LODS, context.temp_allocator)
+    append(&all_indices, ..indices)
+    append(&lods, MeshLod{first_index = 0, index_count = u32(len(indices))})
+
+    bounds := EMPTY_AABB
+    for v in vertices {
+        aabb_add_point(&bounds, v.position)
+    }
+    max_error := linalg.length(bounds.max - bounds.min) * LOD_MAX_ERROR
+
+    source := indices
+    for len(lods) < MAX_MESH_LODS {
+        target := int(f32(len(source) / 3) * LOD_TRIANGLE_RATIO)
+        if target < LOD_MIN_TRIANGLES {
+            break
+        }
+
+        lod, _ := simplify_mesh(source, vertices, target, max_error, context.temp_allocator)
+        // Stop when the simplifier runs out of things it's allowed to collapse.
+        if len(lod) > len(source) * 3 / 4 {
+            break
+        }
+        optimize_vertex_cache(lod, len(vertices))
+
+        append(&lods, MeshLod{first_index = u32(len(all_indices)), index_count = u32(len(lod))})
+        append(&all_indices, ..lod)
+        source = lod
+    }
+
+    mesh.vertices = vertices[:optimize_vertex_fetch(vertices, all_indices[:])]
+    mesh.index_count = len(all_indices)
+    mesh.lods = lods[:]
+
+    if len(mesh.vertices) <= int(max(u16)) + 1 {
+        small := make([]u16, len(all_indices), context.temp_allocator)
+        for index, i in all_indices {
+            small[i] = u16(index)
+        }
+        mesh.index_data, mesh.index_type = mem.slice_to_bytes(small), .U16
+    } else {
+        mesh.index_data, mesh.index_type = mem.slice_to_bytes(all_indices[:]), .U32
+    }
+    return
+}
+
+@(private = "file")
+Quadric :: struct {
+    a00, a01, a02, a11, a12, a22: f32,
+    b0, b1, b2: f32,
+    c: f32,
+}
+
+@(private = "file")
+quadric_from_plane :: proc(n: vec3, d: f32) -> Quadric {
+    return {
+        a00 = n.x * n.x, a01 = n.x * n.y, a02 = n.x * n.z,
+        a11 = n.y * n.y, a12 = n.y * n.z,
+        a22 = n.z * n.z,
+        b0 = n.x * d, b1 = n.y * d, b2 = n.z * d,
+        c = d * d,
+    }
+}
+
+@(private = "file")
+quadric_add :: proc(a: ^Quadric, b: Quadric) {
+    a.a00 += b.a00; a.a01 += b.a01; a.a02 += b.a02
+    a.a11 += b.a11; a.a12 += b.a12
+    a.a22 += b.a22
+    a.b0 += b.b0; a.b1 += b.b1; a.b2 += b.b2
+    a.c += b.c
+}
+
+// Sum of the squared distances from `p` to the planes in the quadric.
+@(private = "file")
+quadric_error :: proc(q: Quadric, p: vec3) -> f32 {
+    x, y, z := p.x, p.y, p.z
+    r := q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+        2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+        2 * (q.b0 * x + q.b1 * y + q.b2 * z) +
+        q.c
+    return abs(r)
+}
+
+// Quadric error edge collapse (Garland & Heckbert). Returns the indices of a mesh with around `target_triangles`
+// triangles that uses the same vertices: a vertex only ever collapses onto one of its neighbours, so no new
+// vertices are needed. Vertices on borders and attribute seams (several vertices at the same position)
+// never move, which keeps the silhouette and the UV layout intact.
+// `error` is the largest error of the collapses that were made, as a distance.
+simplify_mesh :: proc(
+    indices: []u32,
+    vertices: []Vertex,
+    target_triangles: int,
+    max_error: f32,
+    allocator := context.allocator,
+) -> (result: []u32, error: f32) {
+    tracy.Zone()
+    result_allocator := allocator
+    context.allocator = context.temp_allocator
+
+    locked := make([]bool, len(vertices))
+
+    // Seams.
+    vertices_at := make(map[vec3]int)
+    for v in vertices {
+        vertices_at[v.position] += 1
+    }
+    for v, i in vertices {
+        if vertices_at[v.position] > 1 {
+            locked[i] = true
+        }
+    }
+
+    // Borders, edges with only one triangle.
+    edge_count := make(map[[2]u32]int)
+    for t in 0..<len(indices) / 3 {
+        tri := indices[t * 3:][:3]
+        for e in 0..<3 {
+            a, b := tri[e], tri[(e + 1) % 3]
+            edge_count[{min(a, b), max(a, b)}] += 1
+        }
+    }
+    for edge, count in edge_count {
+        if count == 1 {
+            locked[edge[0]] = true
+            locked[edge[1]] = true
+        }
+    }
+
+    quadrics := make([]Quadric, len(vertices))
+    for t in 0..<len(indices) / 3 {
+        a := vertices[indices[t * 3]].position
+        b := vertices[indices[t * 3 + 1]].position
+        c := vertices[indices[t * 3 + 2]].position
+        n := linalg.cross(b - a, c - a)
+        length := linalg.length(n)
+        if length == 0 do continue
+        n /= length
+
+        q := quadric_from_plane(n, -linalg.dot(n, a))
+        for index in indices[t * 3:][:3] {
+            quadric_add(&quadrics[index], q)
+        }
+    }
+
+    Collapse :: struct {
+        from, to: u32,
+        cost: f32,
+    }
+
+    // Whether moving `from` onto `to` flips any of the triangles around `from`.
+    flips :: proc(current: []u32, vertices: []Vertex, triangles: []int, from, to: u32) -> bool {
+        target := vertices[to].position
+        for t in triangles {
+            tri := current[t * 3:][:3]
+            if tri[0] == to || tri[1] == to || tri[2] == to {
+                // Becomes degenerate and gets removed.
+                continue
+            }
+
+            before, after: [3]vec3
+            for index, i in tri {
+                before[i] = vertices[index].position
+                after[i] = index == from ? target : before[i]
+            }
+            n0 := linalg.cross(before[1] - before[0], before[2] - before[0])
+            n1 := linalg.cross(after[1] - after[0], after[2] - after[0])
+            if linalg.dot(n0, n1) <= 0 {
+                return true
+            }
+        }
+        return false
+    }
+
+    max_cost := max_error * max_error
+    current := slice.clone(indices)
+    touched := make([]bool, len(vertices))
+    for len(current) / 3 > target_triangles {
+        triangle_count := len(current) / 3
+
+        // The triangles around every vertex, packed in one array.
+        offsets := make([]int, len(vertices) + 1)
+        for index in current {
+            offsets[index + 1] += 1
+        }
+        for v in 0..<len(vertices) {
+            offsets[v + 1] += offsets[v]
+        }
+        adjacency := make([]int, len(current))
+        cursor := slice.clone(offsets[:len(vertices)])
+        for index, i in current {
+            adjacency[cursor[index]] = i / 3
+            cursor[index] += 1
+        }
+
+        collapses := make([dynamic]Collapse, 0, len(current) * 2)
+        for t in 0..<triangle_count {
+            tri := current[t * 3:][:3]
+            for e in 0..<3 {
+                a, b := tri[e], tri[(e + 1) % 3]
+                if !locked[a] {
+                    q := quadrics[a]
+                    quadric_add(&q, quadrics[b])
+                    append(&collapses, Collapse{a, b, quadric_error(q, vertices[b].position)})
+                }
+                if !locked[b] {
+                    q := quadrics[b]
+                    quadric_add(&q, quadrics[a])
+                    append(&collapses, Collapse{b, a, quadric_error(q, vertices[a].position)})
+                }
+            }
+        }
+        slice.sort_by(collapses[:], proc(a, b: Collapse) -> bool {
+            return a.cost < b.cost
+        })
+
+        // An interior collapse removes two triangles. Collapses in the same pass can't share any
+        // triangles, otherwise the flip tests would be wrong.
+        wanted := (triangle_count - target_triangles + 1) / 2
+        collapsed := 0
+        slice.fill(touched, false)
+        for c in collapses {
+            if c.cost > max_cost || collapsed >= wanted {
+                break
+            }
+            if touched[c.from] || touched[c.to] {
+                continue
+            }
+
+            triangles := adjacency[offsets[c.from]:offsets[c.from + 1]]
+            if flips(current, vertices, triangles, c.from, c.to) {
+                continue
+            }
+
+            for t in triangles {
+                for index in current[t * 3:][:3] {
+                    touched[index] = true
+                }
+            }
+            quadric_add(&quadrics[c.to], quadrics[c.from])
+            for t in triangles {
+                for &index in current[t * 3:][:3] {
+                    if index == c.from {
+                        index = c.to
+                    }
+                }
+            }
+            error = max(error, c.cost)
+            collapsed += 1
+        }
+
+        if collapsed == 0 {
+            break
+        }
+
+        // Drop the triangles that became degenerate.
+        kept := 0
+        for t in 0..<triangle_count {
+            a, b, c := current[t * 3], current[t * 3 + 1], current[t * 3 + 2]
+            if a == b || b == c || a == c {
+                continue
+            }
+            current[kept * 3], current[kept * 3 + 1], current[kept * 3 + 2] = a, b, c
+            kept += 1
+        }
+        current = current[:kept * 3]
+    }
+
+    return slice.clone(current, result_allocator), math.sqrt(error)
+}
@@ -5,20 +5,36 @@ import "core:strings"
 import gltf "vendor:cgltf"
 import gl "vendor:OpenGL"
 import stbi "vendor:stb/image"
-import "core:math/linalg"
 import "gpu"
-import "core:mem"
+import tracy "packages:odin-tracy"
 
 WHITE_TEXTURE :: #load("../assets/textures/white_texture.png")
 BLACK_TEXTURE :: #load("../assets/textures/black_texture.png")
 NORMAL_MAP :: #load("../assets/textures/default_normal_map.png")
 
+// 24 bytes, built with `pack_vertex`. Normals and tangents are octahedral encoded.
+// Must match `mesh_vertex_layout`.
 Vertex :: struct {
     position:   vec3,
-    normal:     vec3,
-    tangent:    vec3,
-    uv:         vec2,
-    color:      vec3,
+    normal:     [2]i16,
+    tangent:    [2]i16,
+    uv:         [2]f16,
+}
+
+mesh_vertex_layout :: proc() -> gpu.VertexAttributeLayout {
+    return gpu.vertex_layout({
+        name = "Position",
+        type = .Float3,
+    }, {
+        name = "Normal",
+        type = .Snorm2,
+    }, {
+        name = "Tangent",
+        type = .Snorm2,
+    }, {
+        name = "UV",
+        type = .Half2,
+    })
 }
 
 @(asset)
@@ -45,10 +61,17 @@ Mesh :: struct {
     // vertex_buffer:  u32,
     // index_buffer:   u32,
     // vertex_array:   u32,
-    vertex_buffer: gpu.Buffer,
-    index_buffer: gpu.Buffer,
+    // Ranges in the renderer's geometry arena.
+    geometry: MeshGeometry,
 
+    // Index count of LOD 0.
     num_indices:    i32,
+    // Ranges in the index data, LOD 0 is the full detail mesh.
+    lods: [MAX_MESH_LODS]MeshLod,
+    lod_count: int,
+
+    // Object space bounds, used for culling.
+    bounds: AABB,
 }
 
 is_mesh_valid :: proc(mesh: Mesh) -> bool {
@@ -56,6 +79,9 @@ is_mesh_valid :: proc(mesh: Mesh) -> bool {
 }
 
 mesh_deinit :: proc(mesh: ^Mesh) {
+    if is_mesh_valid(mesh^) {
+        geometry_free(&Renderer3DInstance.geometry, mesh.geometry)
+    }
     delete(mesh.name)
 }
 
@@ -68,8 +94,53 @@ new_mesh_from_file :: proc(file: string) -> ^Mesh {
     return mesh
 }
 
+// CPU side mesh data, ready to be uploaded. Either freshly imported from a glTF file
+// or pointing straight into a memory mapped cooked mesh, see mesh_cache.odin.
+MeshData :: struct {
+    vertices: []Vertex,
+    index_data: []byte,
+    index_type: gpu.IndexType,
+    // Of all the LODs together.
+    index_count: int,
+    lods: []MeshLod,
+    bounds: AABB,
+}
+
+MAX_MESH_LODS :: 4
+
+MeshLod :: struct {
+    // Relative to the first index of the mesh.
+    first_index: u32,
+    index_count: u32,
+}
+
+// Loads the cooked version of the mesh when it's up to date, otherwise imports the glTF file and cooks it.
 load_mesh_from_gltf_file :: proc(path: string) -> (mesh: Mesh, ok: bool) {
-    gltf_data := os.read_entire_file(path) or_return
+    tracy.Zone()
+    if cooked, found := open_cooked_mesh(path); found {
+        defer close_cooked_mesh(&cooked)
+        return mesh_from_data(cooked.data)
+    }
+
+    data := import_gltf_mesh(path) or_return
+    write_cooked_mesh(path, data)
+    return mesh_from_data(data)
+}
+
+mesh_from_data :: proc(data: MeshData) -> (mesh: Mesh, ok: bool) {
+    assert(len(data.lods) > 0 && len(data.lods) <= MAX_MESH_LODS)
+    mesh.geometry = geometry_alloc(&Renderer3DInstance.geometry, data.vertices, data.index_data, data.index_type) or_return
+    mesh.lod_count = copy(mesh.lods[:], data.lods)
+    mesh.num_indices = i32(data.lods[0].index_count)
+    mesh.bounds = data.bounds
+    return mesh, true
+}
+
+// Parses the glTF file and runs it through the import pipeline, see `process_mesh`.
+// All the primitives of the first node are merged into one mesh. Everything is in the temp allocator.
+import_gltf_mesh :: proc(path: string) -> (mesh: MeshData, ok: bool) {
+    tracy.Zone()
+    gltf_data := os.read_entire_file(path, context.temp_allocator) or_return
 
     if len(gltf_data) <= 0 {
         log.errorf("Empty data provided to model loader. Cannot continue.")
@@ -80,6 +151,7 @@ load_mesh_from_gltf_file :: proc(path: string) -> (mesh: Mesh, ok: bool) {
 
     data, res := gltf.parse(options, raw_data(gltf_data), len(gltf_data))
     (res == .success) or_return
+    defer gltf.free(data)
 
     res = gltf.load_buffers(options, data, cstr(path))
     (res == .success) or_return
@@ -89,6 +161,10 @@ load_mesh_from_gltf_file :: proc(path: string) -> (mesh: Mesh, ok: bool) {
 
     node := s.nodes[0]
 
+    vertices := make([dynamic]Vertex, context.temp_allocator)
+    indices := make([dynamic]u32, context.temp_allocator)
+    mesh.bounds = EMPTY_AABB
+
     for primitive in node.mesh.primitives {
         get_buffer_data :: proc(attributes: []gltf.attribute, index: u32, $T: typeid) -> []T {
             accessor := attributes[index].data
@@ -115,84 +191,35 @@ load_mesh_from_gltf_file :: proc(path: string) -> (mesh: Mesh, ok: bool) {
 
         tangent_data := get_buffer_data(primitive.attributes, 3, f32)
 
-        vertices := make([]Vertex, len(position_data) / 3, context.temp_allocator)
+        base := u32(len(vertices))
 
         vi := 0
         ti := 0
         tangent_idx := 0
-        for i := 0; i < len(vertices) - 0; i += 1 {
-            vertices[i] = Vertex {
+        for _ in 0..<len(position_data) / 3 {
+            vertex := pack_vertex(
                 position = {position_data[vi], position_data[vi + 1], position_data[vi + 2]},
                 normal = {normal_data[vi], normal_data[vi + 1], normal_data[vi + 2]},
                 tangent = {tangent_data[tangent_idx], tangent_data[tangent_idx + 1], tangent_data[tangent_idx + 2]},
                 uv = {tex_data[ti], tex_data[ti + 1]},
-                color = {1, 1, 1},
-            }
-            // vertices[i].pos += node.translation
+            )
+            append(&vertices, vertex)
+            aabb_add_point(&mesh.bounds, vertex.position)
             vi += 3
             ti += 2
             tangent_idx += 4
         }
 
+        // Indices can be stored as u8, u16 or u32, let cgltf deal with it.
         accessor := primitive.indices
-        data := accessor.buffer_view.buffer.data
-        offset := accessor.buffer_view.offset
-
-        indices_raw := cast([^]u16)(uintptr(data) + uintptr(offset))
-        count := accessor.count
-        indices := indices_raw[:count]
-
-        mesh.num_indices = i32(len(indices))
-
-        vertex_buffer_spec := gpu.BufferSpecification {
-            device = &Renderer3DInstance.device,
-            name = "Mesh Vertex Buffer",
-            size = size_of(Vertex) * len(vertices),
-            usage = {.Vertex},
-        }
-
-        mesh.vertex_buffer = gpu.create_buffer(vertex_buffer_spec)
-        gpu.buffer_upload(mesh.vertex_buffer, mem.slice_to_bytes(vertices))
-
-        index_buffer_spec := gpu.BufferSpecification {
-            name = "Mesh Index Buffer",
-            device = &Renderer3DInstance.device,
-            size = size_of(u16) * len(indices),
-            usage = {.Index},
+        for i in 0..<accessor.count {
+            append(&indices, base + u32(gltf.accessor_read_index(accessor, i)))
         }
-
-        mesh.index_buffer = gpu.create_buffer(index_buffer_spec)
-        gpu.buffer_upload(mesh.index_buffer, mem.slice_to_bytes(indices))
-        // gl.CreateBuffers(1, &model.vertex_buffer)
-        // gl.NamedBufferStorage(model.vertex_buffer, size_of(Vertex) * len(vertices), raw_data(vertices), gl.DYNAMIC_STORAGE_BIT)
-
-        // gl.CreateBuffers(1, &model.index_buffer)
-        // gl.NamedBufferStorage(model.index_buffer, size_of(u16) * len(indices), raw_data(indices), gl.DYNAMIC_STORAGE_BIT)
-
-        // gl.CreateVertexArrays(1, &model.vertex_array)
-
-        // vao := model.vertex_array
-        // gl.VertexArrayVertexBuffer(vao, 0, model.vertex_buffer, 0, size_of(Vertex))
-        // gl.VertexArrayElementBuffer(vao, model.index_buffer)
-
-        // gl.EnableVertexArrayAttrib(vao, 0)
-        // gl.EnableVertexArrayAttrib(vao, 1)
-        // gl.EnableVertexArrayAttrib(vao, 2)
-        // gl.EnableVertexArrayAttrib(vao, 3)
-        // gl.EnableVertexArrayAttrib(vao, 4)
-
-        // gl.VertexArrayAttribFormat(vao, 0, 3, gl.FLOAT, false, u32(offset_of(Vertex, position)))
-        // gl.VertexArrayAttribFormat(vao, 1, 3, gl.FLOAT, false, u32(offset_of(Vertex, normal)))
-        // gl.VertexArrayAttribFormat(vao, 2, 3, gl.FLOAT, false, u32(offset_of(Vertex, tangent)))
-        // gl.VertexArrayAttribFormat(vao, 3, 2, gl.FLOAT, false, u32(offset_of(Vertex, uv)))
-        // gl.VertexArrayAttribFormat(vao, 4, 3, gl.FLOAT, false, u32(offset_of(Vertex, color)))
-
-        // gl.VertexArrayAttribBinding(vao, 0, 0)
-        // gl.VertexArrayAttribBinding(vao, 1, 0)
-        // gl.VertexArrayAttribBinding(vao, 2, 0)
-        // gl.VertexArrayAttribBinding(vao, 3, 0)
-        // gl.VertexArrayAttribBinding(vao, 4, 0)
     }
+
+    bounds := mesh.bounds
+    mesh = process_mesh(vertices[:], indices[:])
+    mesh.bounds = bounds
     ok = true
     return
 }
@@ -208,26 +235,20 @@ PbrMaterial :: struct {
     metallic_texture:          AssetHandle `asset:"Texture2D"`,
     emissive_texture:          AssetHandle `asset:"Texture2D"`,
 
-    block: UniformBuffer(struct {
-        albedo_color:     Color,
-        metallic_factor:  f32 `range:"0.0, 1.0"`,
-        roughness_factor: f32 `range:"0.0, 1.0"`,
-    }),
+    // Copied into the material table when it changes, see `material_table_material`.
+    block: PbrMaterialBlock,
+}
+
+PbrMaterialBlock :: struct {
+    albedo_color:     Color,
+    metallic_factor:  f32 `range:"0.0, 1.0"`,
+    roughness_factor: f32 `range:"0.0, 1.0"`,
 }
 
 @(constructor=PbrMaterial)
 new_pbr_material :: proc() -> ^Asset {
     material := new(PbrMaterial)
     material.type = .PbrMaterial
-
-    // TODO(minebill): Hacky solution, this doesn't belong here.
-    object_shader := get_asset(&EngineInstance.asset_manager, Renderer3DInstance.object_shader, Shader)
-
-    material.block = create_uniform_buffer(
-        &Renderer3DInstance.device,
-        type_of(material.block.data),
-        "PBR Material")
-
     return material
 }
 
@@ -382,13 +403,11 @@ scene_load_from_file :: proc(w: ^World, file: string) {
                 ti += 2
                 tangent_idx += 4
             }
-            go.transform.local_position = node.translation
+            transform_local_position(go)^ = node.translation
 
             r := node.rotation
-            qr := quaternion(w = r.w, x = r.x, y = r.y, z = r.z)
-            x, y, z := linalg.euler_angles_xyz_from_quaternion(qr)
-            go.transform.local_rotation = vec3{x, y, z}
-            go.transform.local_scale = node.scale
+            transform_local_rotation(go)^ = quaternion(w = r.w, x = r.x, y = r.y, z = r.z)
+            transform_local_scale(go)^ = node.scale
 
             accessor := primitive.indices
             data := accessor.buffer_view.buffer.data
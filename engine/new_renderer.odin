@@ -11,10 +11,31 @@ import "packages:odin-imgui/imgui_impl_glfw"
 import imgui "packages:odin-imgui"
 import "base:runtime"
 import "core:fmt"
+import "core:sync"
+import "core:hash"
+import "core:slice"
+import "core:thread"
+import "core:os"
+import "core:path/filepath"
+import fs "filesystem"
 import tracy "packages:odin-tracy"
 
 Renderer3DInstance: ^Renderer3D
 SHADOW_CASCADES :: 4
+// Shadow casters are drawn this many LODs coarser than in the main view.
+SHADOW_LOD_BIAS :: 1
+MAX_MATERIALS :: 256
+
+// One secondary command buffer per shadow cascade, one per cached cascade, plus one for the world pass.
+RECORDING_SLOTS :: SHADOW_CASCADES * 2 + 1
+SHADOW_CACHE_RECORDING_SLOT :: SHADOW_CASCADES
+WORLD_RECORDING_SLOT :: SHADOW_CASCADES * 2
+
+// Every slot has its own command pools, so the jobs recording into them never have to synchronize.
+RecordingSlot :: struct {
+    pools: [gpu.MAX_FRAMES_IN_FLIGHT]gpu.CommandPool,
+    cmds: [gpu.MAX_FRAMES_IN_FLIGHT]gpu.CommandBuffer,
+}
 
 Renderer3D :: struct {
     instance: gpu.Instance,
@@ -24,11 +45,19 @@ Renderer3D :: struct {
 
     image_index: u32,
     command_buffers: [3]gpu.CommandBuffer,
+    recording_slots: [RECORDING_SLOTS]RecordingSlot,
+    // Records the shadow cascades while the main thread records the world pass.
+    job_pool: thread.Pool,
+
+    // Vertex and index data of every mesh, see `geometry_alloc`.
+    geometry: GeometryArena,
 
     // grug developer logic
     global_set: GlobalSet,
     scene_set: SceneSet,
-    object_set: ObjectSet,
+    // Set 2 of the object pipeline, every material and its textures.
+    material_table: MaterialTable,
+    texture_streamer: TextureStreamer,
 
     shadow_renderpass: gpu.RenderPass,
     world_renderpass: gpu.RenderPass,
@@ -42,7 +71,16 @@ Renderer3D :: struct {
 
     depth_image: gpu.Image,
     shadow_framebuffers: [SHADOW_CASCADES]gpu.FrameBuffer,
-    world_framebuffers: [3]gpu.FrameBuffer,
+    // Static shadow casters, see shadow_cache.odin.
+    shadow_cache: ShadowCache,
+    // Resolved color of the world pass, what the editor shows.
+    world_color: gpu.Image,
+
+    // The passes of a frame, see r3d_setup_render_graph.
+    render_graph: RenderGraph,
+    culling_pass, shadow_cache_pass, shadow_composite_pass: RGPass,
+    world_pass, picking_readback_pass: RGPass,
+    picking_id: RGImage,
 
     global_pool: gpu.ResourcePool,
     pool_allocator: gpu.FrameAllocator,
@@ -53,8 +91,6 @@ Renderer3D :: struct {
 
     // scene_uniform_usage: gpu.ResourceUsage,
 
-    material_pool: gpu.ResourcePool,
-
     // Probably shouldn't be here.
     imgui_renderpass: gpu.RenderPass,
     object_picking: ObjectPicking,
@@ -65,11 +101,23 @@ Renderer3D :: struct {
 
     visualization_options: VisualizationOptions,
 
+    culling_bvh: CullingBVH,
+    cull_stats: CullStats,
+    // Cull and draw the opaque pass on the GPU when it's supported, see gpu_culling.odin.
+    gpu_culling: GpuCulling,
+    gpu_driven: bool,
+
     white_texture, normal_texture, black_texture: AssetHandle,
     primitive_cube: AssetHandle,
     default_material: AssetHandle,
 }
 
+CullStats :: struct {
+    total: int,
+    visible: int,
+    shadow_visible: [SHADOW_CASCADES]int,
+}
+
 tex :: proc(image: gpu.Image) -> imgui.TextureID {
     return transmute(imgui.TextureID) Renderer3DInstance._editor_images[image.id]
 }
@@ -114,8 +162,15 @@ r3d_setup :: proc(r: ^Renderer3D) {
             if image.id in m._editor_images {
                 imgui_impl_vulkan.RemoveTexture(m._editor_images[image.id])
             }
+            material_table_release_image(&m.material_table, image.id)
         },
     })
+    {
+        saved_data, _ := os.read_entire_file(pipeline_cache_path(), context.temp_allocator)
+        gpu.create_pipeline_cache(&r.device, saved_data)
+    }
+    gpu.uploader_init(&r.device)
+    geometry_arena_init(&r.geometry, &r.device)
     r.stats = gpu.create_render_stats(&r.device)
     gpu.set_global_stats(&r.stats)
 
@@ -128,30 +183,27 @@ r3d_setup :: proc(r: ^Renderer3D) {
         }, {
             resource = .CombinedImageSampler,
             limit    = 5,
+        }, {
+            resource = .StorageBuffer,
+            limit    = 1,
         }}),
     }
     r.global_pool = gpu.create_resource_pool(pool_spec)
 
-    pool_spec = gpu.ResourcePoolSpecification {
-        device = &r.device,
-        max_sets = 20,
-        resource_limits = gpu.make_list([]gpu.ResourceLimit{{
-            resource = .UniformBuffer,
-            limit    = 30,
-        }}),
-    }
-    r.material_pool = gpu.create_resource_pool(pool_spec)
-
     r.pool_allocator = gpu.create_frame_allocator({device = &r.device, frames = gpu.MAX_FRAMES_IN_FLIGHT})
 
     r.global_set = build_global_set(r)
     r.scene_set = build_scene_set(r)
-    r.object_set = build_object_set(r)
+    material_table_init(&r.material_table, &r.device)
+    texture_streamer_init(&r.texture_streamer)
 }
 
 r3d_init :: proc(r: ^Renderer3D) {
+    precompile_engine_shaders()
     r3d_setup_renderpasses(r)
+    r.gpu_driven = gpu_culling_init(r)
     object_picking_init(&r.object_picking, &r.device)
+    r3d_setup_render_graph(r)
     create_default_resources(r)
 
     swapchain_spec := gpu.SwapchainSpecification {
@@ -169,24 +221,89 @@ r3d_init :: proc(r: ^Renderer3D) {
 
     object_shader := get_asset(&EngineInstance.asset_manager, r.object_shader, Shader)
 
-    // r.object_set.material = create_uniform_buffer(&r.device,
-    //     r.global_pool,
-    //     object_shader.pipeline_spec.layout.spec.layouts["object"],
-    //     LightData,
-    //     "View Data")
-
     cmd_spec := gpu.CommandBufferSpecification {
         tag = "Swapchain Command Buffer",
         device = r.device,
     }
     r.command_buffers = gpu.create_command_buffers(r.device, cmd_spec, 3)
 
+    for &slot in r.recording_slots {
+        for frame in 0..<gpu.MAX_FRAMES_IN_FLIGHT {
+            slot.pools[frame] = gpu.create_command_pool(&r.device, "Recording Slot Pool")
+            slot.cmds[frame] = gpu.allocate_command_buffer(slot.pools[frame], {
+                tag = "Recording Slot Command Buffer",
+                device = r.device,
+                level = .Secondary,
+            })
+        }
+    }
+
+    thread.pool_init(&r.job_pool, context.allocator, SHADOW_CASCADES)
+    thread.pool_start(&r.job_pool)
+
     dbg_init(g_dbg_context, r.world_renderpass)
+
+    stats := r.device.pipeline_stats
+    log_info(LC.Renderer, "Created %v pipelines in %v (pipeline cache %v)",
+        stats.count, stats.time, "loaded" if stats.cache_loaded else "empty")
+}
+
+// Compiles all the engine shaders in parallel, so loading them one by one only reads the shader cache.
+@(private = "file")
+precompile_engine_shaders :: proc() {
+    ENGINE_SHADERS_FOLDER :: "assets/shaders/new"
+    handle, err := os.open(ENGINE_SHADERS_FOLDER)
+    if err != os.ERROR_NONE {
+        return
+    }
+    defer os.close(handle)
+    files, _ := os.read_dir(handle, -1, context.temp_allocator)
+
+    paths := make([dynamic]string, 0, len(files), context.temp_allocator)
+    for file in files {
+        if !file.is_dir && filepath.ext(file.name) == ".shader" {
+            // Same form as the paths the shaders get loaded with.
+            append(&paths, fmt.tprintf("%v/%v", ENGINE_SHADERS_FOLDER, file.name))
+        }
+    }
+    shader_precompile(paths[:])
+}
+
+@(private = "file")
+pipeline_cache_path :: proc() -> string {
+    return make_tpath(project_get_cache_folder(EditorInstance.active_project, context.temp_allocator), "pipelines.cache")
 }
 
 r3d_deinit :: proc(r: ^Renderer3D) {
     gpu.device_wait(r.device)
+    thread.pool_join(&r.job_pool)
+    thread.pool_destroy(&r.job_pool)
+    for slot in r.recording_slots {
+        for pool in slot.pools {
+            gpu.destroy_command_pool(pool)
+        }
+    }
     object_picking_deinit(&r.object_picking)
+    render_graph_deinit(&r.render_graph)
+    shadow_cache_deinit(&r.shadow_cache)
+    texture_streamer_deinit(&r.texture_streamer)
+    gpu.destroy_image(&r.world_color)
+    bvh_destroy(&r.culling_bvh)
+    gpu_culling_deinit(&r.gpu_culling)
+    gpu.destroy_buffer(r.global_set.instances.handle)
+    geometry_arena_deinit(&r.geometry)
+    gpu.destroy_render_stats(&r.stats)
+
+    if data, ok := gpu.pipeline_cache_data(&r.device, context.temp_allocator); ok {
+        path := pipeline_cache_path()
+        fs.make_directory_recursive(filepath.dir(path, context.temp_allocator))
+        if !os.write_entire_file(path, data) {
+            log_warning(LC.Renderer, "Could not save the pipeline cache to '%v'", path)
+        }
+    }
+    gpu.destroy_pipeline_cache(&r.device)
+    gpu.uploader_deinit(&r.device)
+    material_table_deinit(&r.material_table)
 }
 
 RPacket :: struct {
@@ -216,45 +333,258 @@ r3d_draw_frame :: proc(r: ^Renderer3D, packet: RPacket, cmd: gpu.CommandBuffer)
 
     gpu.bind_resource(cmd, r.global_set.resource, object_shader.pipeline)
 
-    mesh_components := make([dynamic]^MeshRenderer, allocator = context.temp_allocator)
+    r.global_set.instances.count = 0
+
+    bvh_clear(&r.culling_bvh)
+    // Changes whenever a static shadow caster is added, removed, moved or given another mesh.
+    static_hash: u64
     m: {
         if packet.scene == nil {
             break m
         }
         tracy.ZoneN("Mesh Collection")
-        for handle, &go in packet.scene.objects do if go.enabled && has_component(packet.scene, handle, MeshRenderer) {
-            mr := get_component(packet.scene, handle, MeshRenderer)
-            if is_asset_handle_valid(&EngineInstance.asset_manager, mr.mesh) {
-                append(&mesh_components, mr)
+        renderers, owners := world_components(packet.scene, MeshRenderer)
+        for mr, i in renderers {
+            go := get_object(packet.scene, owners[i])
+            if go == nil || !go.enabled do continue
+            if !is_asset_handle_valid(&EngineInstance.asset_manager, mr.mesh) do continue
+
+            mesh := get_asset(&EngineInstance.asset_manager, mr.mesh, Mesh)
+            if mesh == nil do continue
+            bvh_add(&r.culling_bvh, aabb_transform(mesh.bounds, transform_world_matrix(go)), mr, go.handle)
+
+            if .Static in go.flags {
+                static_caster := struct {
+                    mesh: AssetHandle,
+                    model: mat4,
+                } {mr.mesh, transform_world_matrix(go)}
+                static_hash = hash.fnv64a(mem.ptr_to_bytes(&static_caster), static_hash)
             }
         }
     }
+    bvh_build(&r.culling_bvh)
+
+    mesh_components := make([dynamic]CullItem, allocator = context.temp_allocator)
+    camera_frustum := frustum_from_matrix(packet.camera.projection * packet.camera.view)
+    bvh_cull(&r.culling_bvh, camera_frustum, &mesh_components)
+
+    r.cull_stats.total = len(r.culling_bvh.items)
+    r.cull_stats.visible = len(mesh_components)
+
+    // Before extraction, so the materials pick up this frame's images.
+    texture_streamer_gather(&r.texture_streamer, packet.scene, mesh_components[:], packet.camera, f32(packet.size.y))
+    texture_streamer_update(&r.texture_streamer, &r.device)
+
+    // The GPU driven path skips the draw list, the CPU cull above is still needed for object picking.
+    gpu_driven := r.gpu_driven && r.gpu_culling.supported
+    opaque_list: DrawList
+    if gpu_driven {
+        gpu_culling_prepare(r, packet.scene)
+    } else {
+        opaque_list = make_draw_list(.Opaque, len(mesh_components))
+        draw_list_extract(r, &opaque_list, packet.scene, mesh_components[:], make_draw_view(packet.camera))
+        draw_list_sort(&opaque_list)
+    }
+
+    cascades := prepare_shadow_cascades(r, &packet, static_hash)
+    r.scene_set.light_data.shadow_split_distances = cascades.distances
+
+    depth_shader := get_asset(&EngineInstance.asset_manager, r.depth_shader, Shader)
+    assert(depth_shader != nil)
 
-    splits := do_depth_pass(r, &packet, cmd, mesh_components[:])
-    r.scene_set.light_data.shadow_split_distances = splits
+    // The cascades get recorded on the job pool, into secondary buffers, while this thread records the world pass.
+    frame := r.swapchain.current_frame
+    wait_group: sync.Wait_Group
+    jobs: [SHADOW_CASCADES]ShadowCascadeJob
+    for split in 0..<SHADOW_CASCADES {
+        jobs[split] = ShadowCascadeJob {
+            r = r,
+            packet = &packet,
+            cascades = &cascades,
+            split = split,
+            pipeline = depth_shader.pipeline,
+            cmd = r.recording_slots[split].cmds[frame],
+            cache_cmd = r.recording_slots[SHADOW_CACHE_RECORDING_SLOT + split].cmds[frame],
+            wait_group = &wait_group,
+        }
+        sync.wait_group_add(&wait_group, 1)
+        thread.pool_add_task(&r.job_pool, context.allocator, shadow_cascade_job, &jobs[split], split)
+    }
 
-    size := EngineInstance.screen_size
-    if gpu.do_render_pass(cmd, r.world_renderpass, r.world_framebuffers[0]) {
+    world_cmd := r.recording_slots[WORLD_RECORDING_SLOT].cmds[frame]
+    {
         tracy.ZoneN("World Pass")
-        gpu.set_viewport(cmd, {size.x, -size.y})
-        gpu.set_scissor(cmd, 0, 0, u32(size.x), u32(size.y))
+        gpu.cmd_begin_secondary(world_cmd, r.world_renderpass, render_graph_pass(&r.render_graph, r.world_pass).framebuffer)
+
+        size := EngineInstance.screen_size
+        gpu.set_viewport(world_cmd, {size.x, -size.y})
+        gpu.set_scissor(world_cmd, 0, 0, u32(size.x), u32(size.y))
 
-        render_scene(r, &packet, cmd, mesh_components[:])
+        render_scene(r, &packet, world_cmd, nil if gpu_driven else &opaque_list)
 
-        gpu.bind_resource(cmd, r.global_set.resource, g_dbg_context.pipeline)
+        gpu.bind_resource(world_cmd, r.global_set.resource, g_dbg_context.pipeline)
         // NOTE(minebill): Is this the correct place for this?
-        dbg_render(g_dbg_context, cmd, EngineInstance.delta)
+        dbg_render(g_dbg_context, world_cmd, EngineInstance.delta)
 
         {
             grid_shader := get_asset(&EngineInstance.asset_manager, r.grid_shader, Shader)
-            gpu.bind_resource(cmd, r.global_set.resource, grid_shader.pipeline)
-            gpu.bind_resource(cmd, r.scene_set.resource, grid_shader.pipeline, 1)
-            gpu.pipeline_bind(cmd, grid_shader.pipeline)
-            gpu.draw(cmd, 6, 1)
+            gpu.bind_resource(world_cmd, r.global_set.resource, grid_shader.pipeline)
+            gpu.bind_resource(world_cmd, r.scene_set.resource, grid_shader.pipeline, 1)
+            gpu.pipeline_bind(world_cmd, grid_shader.pipeline)
+            gpu.draw(world_cmd, 6, 1)
         }
+        gpu.cmd_end(world_cmd, {})
     }
 
-    object_picking_render(&r.object_picking, packet, cmd, mesh_components[:])
+    {
+        tracy.ZoneN("Wait For Shadow Jobs")
+        sync.wait_group_wait(&wait_group)
+    }
+
+    // The CPU fallback of object picking works off what was rendered, even when the picking pass isn't.
+    r.object_picking.camera = packet.camera
+    r.object_picking.scene = packet.scene
+
+    render_graph_pass(&r.render_graph, r.culling_pass).enabled = gpu_driven
+    render_graph_pass(&r.render_graph, r.shadow_composite_pass).enabled = cascades.cached
+    render_graph_pass(&r.render_graph, r.shadow_cache_pass).enabled = cascades.cached && slice.any_of(cascades.redraw[:], true)
+    // Without a request nothing needs the picking pass, and the graph culls it.
+    render_graph_pass(&r.render_graph, r.picking_readback_pass).side_effects = r.object_picking.state == .Requested
+
+    frame_context := FrameContext {
+        r = r,
+        packet = &packet,
+        cascades = &cascades,
+        jobs = &jobs,
+        world_cmd = world_cmd,
+        mesh_components = mesh_components[:],
+    }
+    render_graph_execute(&r.render_graph, cmd, &frame_context)
+}
+
+// What the passes of the render graph need to record a frame, see r3d_draw_frame.
+@(private = "file")
+FrameContext :: struct {
+    r: ^Renderer3D,
+    packet: ^RPacket,
+    cascades: ^ShadowCascades,
+    jobs: ^[SHADOW_CASCADES]ShadowCascadeJob,
+    world_cmd: gpu.CommandBuffer,
+    mesh_components: []CullItem,
+}
+
+// Declares the passes of a frame. The shadow map and the resolved world color outlive the frame, the
+// multisampled world attachments and the picking attachments only live in their passes, so the picking
+// pass reuses the memory of the world attachments.
+@(private = "file")
+r3d_setup_render_graph :: proc(r: ^Renderer3D) {
+    g := &r.render_graph
+    render_graph_init(g, &r.device)
+    r3d_create_world_color(r, {100, 100})
+
+    shadow_map := render_graph_import_image(g, "Shadow Map", &r.depth_image)
+    shadow_cache := render_graph_import_image(g, "Shadow Cache", &r.shadow_cache.image)
+    world_color := render_graph_import_image(g, "World Color", &r.world_color, final_access = .FragmentShaderRead)
+    world_msaa_color := render_graph_create_image(g, "World MSAA Color", {
+        format = .R8G8B8A8_SRGB,
+        usage = {.Transient, .ColorAttachment},
+        samples = 8,
+    })
+    world_depth := render_graph_create_image(g, "World Depth", {
+        format = .D32_SFLOAT_S8_UINT,
+        usage = {.Transient, .DepthStencilAttachment},
+        samples = 8,
+    })
+    r.picking_id = render_graph_create_image(g, "Object Picking ID", {
+        format = .RED_SIGNED,
+        usage = {.ColorAttachment, .TransferSrc},
+    })
+    picking_depth := render_graph_create_image(g, "Object Picking Depth", {
+        format = .D32_SFLOAT_S8_UINT,
+        usage = {.Transient, .DepthStencilAttachment},
+    })
+
+    draw_commands := render_graph_import_buffer(g, "Draw Commands", &r.gpu_culling.commands)
+    draw_counts := render_graph_import_buffer(g, "Draw Counts", &r.gpu_culling.counts)
+    instances := render_graph_import_buffer(g, "Instances", &r.global_set.instances.handle)
+
+    r.culling_pass = render_graph_add_pass(g, "Culling", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        gpu_culling_dispatch(ctx.r, cmd, ctx.packet.camera)
+    })
+    render_graph_use_buffer(g, r.culling_pass, draw_commands, .ComputeShaderWrite)
+    render_graph_use_buffer(g, r.culling_pass, draw_counts, .ComputeShaderWrite)
+    render_graph_use_buffer(g, r.culling_pass, instances, .ComputeShaderWrite)
+
+    // Static casters of the cascades that need a redraw, into the cache. Copied into the shadow map below.
+    r.shadow_cache_pass = render_graph_add_pass(g, "Shadow Cache", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        for split in 0..<SHADOW_CASCADES do if ctx.cascades.redraw[split] {
+            if gpu.do_render_pass(cmd, ctx.r.shadow_renderpass, ctx.r.shadow_cache.framebuffers[split], .SecondaryCommandBuffers) {
+                gpu.execute_commands(cmd, ctx.jobs[split].cache_cmd)
+            }
+        }
+    })
+    render_graph_use_image(g, r.shadow_cache_pass, shadow_cache, .DepthAttachmentWrite)
+
+    r.shadow_composite_pass = render_graph_add_pass(g, "Shadow Composite", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        gpu.cmd_copy_image(cmd, &ctx.r.shadow_cache.image, &ctx.r.depth_image)
+    })
+    render_graph_use_image(g, r.shadow_composite_pass, shadow_cache, .TransferRead)
+    render_graph_use_image(g, r.shadow_composite_pass, shadow_map, .TransferWrite)
+
+    // Every cascade is its own render pass, on a view of one layer of the shadow map.
+    // The shadow casters read instances written on the host, not the ones the culling pass writes.
+    shadows := render_graph_add_pass(g, "Shadows", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        // On top of the static casters when they come from the cache.
+        renderpass := ctx.r.shadow_cache.load_renderpass if ctx.cascades.cached else ctx.r.shadow_renderpass
+        for split in 0..<SHADOW_CASCADES {
+            if gpu.do_render_pass(cmd, renderpass, ctx.r.shadow_framebuffers[split], .SecondaryCommandBuffers) {
+                gpu.execute_commands(cmd, ctx.jobs[split].cmd)
+            }
+        }
+    })
+    render_graph_use_image(g, shadows, shadow_map, .DepthAttachmentWrite)
+
+    r.world_pass = render_graph_add_pass(g, "World", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        gpu.execute_commands(cmd, ctx.world_cmd)
+    }, r.world_renderpass, .SecondaryCommandBuffers)
+    render_graph_attachments(g, r.world_pass, world_msaa_color, world_color, world_depth)
+    render_graph_use_image(g, r.world_pass, shadow_map, .FragmentShaderRead)
+    render_graph_use_buffer(g, r.world_pass, draw_commands, .IndirectRead)
+    render_graph_use_buffer(g, r.world_pass, draw_counts, .IndirectRead)
+    render_graph_use_buffer(g, r.world_pass, instances, .VertexShaderRead)
+
+    picking := render_graph_add_pass(g, "Object Picking", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        object_picking_render(&ctx.r.object_picking, ctx.packet^, cmd, ctx.mesh_components)
+    }, r.object_picking.renderpass)
+    render_graph_attachments(g, picking, r.picking_id, picking_depth)
+
+    r.picking_readback_pass = render_graph_add_pass(g, "Object Picking Readback", proc(cmd: gpu.CommandBuffer, user_data: rawptr) {
+        ctx := cast(^FrameContext) user_data
+        r := ctx.r
+        object_picking_record_readback(&r.object_picking, cmd, r.swapchain.current_frame, render_graph_image(&r.render_graph, r.picking_id))
+    })
+    render_graph_use_image(g, r.picking_readback_pass, r.picking_id, .TransferRead)
+
+    render_graph_compile(g, 100, 100)
+}
+
+@(private = "file")
+r3d_create_world_color :: proc(r: ^Renderer3D, size: vec2) {
+    r.world_color = gpu.create_image({
+        tag = "World Color",
+        device = &r.device,
+        width = int(size.x),
+        height = int(size.y),
+        format = .R8G8B8A8_SRGB,
+        usage = {.ColorAttachment, .Sampled},
+        final_layout = .ShaderReadOnlyOptimal,
+    })
 }
 
 r3d_begin_frame :: proc(r: ^Renderer3D) -> (cmd: gpu.CommandBuffer, ok: bool) {
@@ -271,6 +601,13 @@ r3d_begin_frame :: proc(r: ^Renderer3D) -> (cmd: gpu.CommandBuffer, ok: bool) {
     }
 
     gpu.frame_allocator_reset(&r.pool_allocator)
+    // swapchain_get_next_image waited on this frame's fence, so whatever it recorded last time is done.
+    object_picking_resolve(&r.object_picking, r.swapchain.current_frame)
+    // Get the uploads recorded since the last frame going while this one is recorded.
+    gpu.uploader_flush(&r.device)
+    for slot in r.recording_slots {
+        gpu.command_pool_reset(slot.pools[r.swapchain.current_frame])
+    }
 
     cmd = r.command_buffers[r.image_index]
     gpu.reset(cmd)
@@ -295,11 +632,10 @@ r3d_on_resize :: proc(r: ^Renderer3D, size: vec2) {
     log_info(LC.Renderer, "New renderer size is: %v", size)
     gpu.device_wait(r.device)
 
-    for i in 0..<len(r.world_framebuffers) {
-        gpu.framebuffer_resize(&r.world_framebuffers[i], size)
-    }
-
+    gpu.destroy_image(&r.world_color)
+    r3d_create_world_color(r, size)
     object_picking_resize(&r.object_picking, size)
+    render_graph_compile(&r.render_graph, int(size.x), int(size.y))
 }
 
 r3d_resize_swapchain :: proc(r: ^Renderer3D, size: vec2) {
@@ -308,22 +644,18 @@ r3d_resize_swapchain :: proc(r: ^Renderer3D, size: vec2) {
     // gpu.swapchain_resize(&r.swapchain, size)
 }
 
+// Draws `draw_list`, or what the GPU culling let through when it's nil.
 @(private = "file")
-render_scene :: proc(r: ^Renderer3D, packet: ^RPacket, cmd: gpu.CommandBuffer, mesh_components: []^MeshRenderer) {
+render_scene :: proc(r: ^Renderer3D, packet: ^RPacket, cmd: gpu.CommandBuffer, draw_list: ^DrawList) {
     tracy.Zone()
-    asset_manager := &EngineInstance.asset_manager
     if packet.scene == nil {
         return
     }
 
-    for handle, &go in packet.scene.objects do if go.enabled && has_component(packet.scene, handle, DirectionalLight) {
-        dir_light := get_component(packet.scene, handle, DirectionalLight)
-        rot := go.transform.local_rotation
-        dir_light_quat := linalg.quaternion_from_euler_angles(
-            rot.y * math.RAD_PER_DEG,
-            rot.x * math.RAD_PER_DEG,
-            rot.z * math.RAD_PER_DEG,
-            .YXZ)
+    light_view := world_view(packet.scene, DirectionalLight, TransformComponent)
+    for go in world_view_next(&light_view) do if go.enabled {
+        dir_light := get_component(packet.scene, go.handle, DirectionalLight)
+        dir_light_quat := transform_local_rotation(go)^
         dir := linalg.quaternion_mul_vector3(dir_light_quat, vec3{0, 0, 1})
 
         light_data := &r.scene_set.light_data
@@ -370,232 +702,241 @@ render_scene :: proc(r: ^Renderer3D, packet: ^RPacket, cmd: gpu.CommandBuffer, m
     gpu.pipeline_bind(cmd, object_shader.pipeline)
     gpu.bind_resource(cmd, r.global_set.resource, object_shader.pipeline, 0)
     gpu.bind_resource(cmd, r.scene_set.resource, object_shader.pipeline, 1)
+    gpu.bind_resource(cmd, r.material_table.resource, object_shader.pipeline, 2)
 
-    for mr in mesh_components {
-        tracy.ZoneN("Draw Mesh")
-        mesh := get_asset(asset_manager, mr.mesh, Mesh)
-        if mesh == nil do continue
-
-        go := get_object(packet.scene, mr.owner)
+    if draw_list == nil {
+        gpu_culling_draw(r, cmd)
+        return
+    }
 
-        material := get_asset(&EngineInstance.asset_manager, mr.material, PbrMaterial)
-        fmt.assertf(material != nil, "Cannot have <nil> material. A default one should have been assigned.")
+    // The draw list is sorted by material then mesh, so identical draws end up next to each other
+    // and can be instanced. Materials come with the instances and meshes share the geometry pages,
+    // so the vertex/index buffers are about the only state that ever changes.
+    batches := draw_list_build_batches(r, draw_list)
 
-        // gpu.frame_allocator_alloc(&r.pool_allocator, )
-        {
-            tracy.ZoneN("Object set allocation")
-            manager := &EngineInstance.asset_manager
+    bound := NO_GEOMETRY_BINDING
+    for batch in batches {
+        tracy.ZoneN("Draw Mesh")
+        draw_mesh(&r.geometry, cmd, batch.mesh^, batch.lod, batch.count, batch.first_instance, &bound)
+    }
+}
 
-            object_set := build_object_set(r)
-            albedo := get_asset(manager, material.albedo_texture, Texture2D)
-            if albedo == nil {
-                albedo = get_asset(manager, Renderer3DInstance.white_texture, Texture2D)
-            }
+ShadowCascades :: struct {
+    distances: [SHADOW_CASCADES]f32,
+    light_spaces: [SHADOW_CASCADES]mat4,
+    has_light: bool,
+    // Static casters are drawn into the shadow cache, only for the cascades that need a redraw.
+    cached: bool,
+    redraw: [SHADOW_CASCADES]bool,
+}
 
-            normal := get_asset(manager, material.normal_texture, Texture2D)
-            if normal == nil {
-                normal = get_asset(manager, Renderer3DInstance.normal_texture, Texture2D)
-            }
+// Computes the split distances and light space matrices of the shadow cascades. This writes to shared
+// renderer state (uniforms, debug draws), so it runs on the main thread before any cascade is recorded.
+// `static_hash` changes whenever a static caster does, see r3d_draw_frame.
+prepare_shadow_cascades :: proc(r: ^Renderer3D, packet: ^RPacket, static_hash: u64) -> (cascades: ShadowCascades) {
+    tracy.Zone()
+    cache := &r.shadow_cache
+    cascades.cached = cache.enabled
+    scene := packet.scene
+    if scene == nil {
+        cache.valid = {}
+        return
+    }
 
-            ao := get_asset(manager, material.ambient_occlusion_texture, Texture2D)
-            if ao == nil {
-                ao = get_asset(manager, Renderer3DInstance.white_texture, Texture2D)
-            }
+    for split in 0..<SHADOW_CASCADES {
+        light_view := world_view(scene, DirectionalLight)
+        for go in world_view_next(&light_view) do if go.enabled {
+            dir_light := get_component(scene, go.handle, DirectionalLight)
+            z := get_split_depth(split + 1, SHADOW_CASCADES, packet.camera.near, packet.camera.far, dir_light.shadow.correction)
+            cascades.distances[split] = z
+        }
+    }
 
-            emissive := get_asset(manager, material.emissive_texture, Texture2D)
-            if emissive == nil {
-                emissive = get_asset(manager, Renderer3DInstance.black_texture, Texture2D)
-            }
+    light_direction: vec3
+    for split in 0..<SHADOW_CASCADES {
+        light_view := world_view(scene, DirectionalLight, TransformComponent)
+        for go in world_view_next(&light_view) do if go.enabled {
+            dir_light := get_component(scene, go.handle, DirectionalLight)
+            dir_light_quat := transform_local_rotation(go)^
+            dir := linalg.quaternion_mul_vector3(dir_light_quat, vec3{0, 0, 1})
+            near := packet.camera.near
+
+            z := cascades.distances[split]
+
+            proj := linalg.matrix4_perspective_f32(
+                math.to_radians(f32(50)),
+                f32(packet.size.x) / f32(packet.size.y),
+                // distances[split], packet.camera.far if split < SHADOW_CASCADES else distances[split + 1])
+                near, z * packet.camera.far)
+                // distances[split - 1] if split > 0 else near, z)
+
+            corners := get_frustum_corners_world_space(
+                proj,
+                packet.camera.view)
+
+            cascade_view, cascade_projection: mat4
+            cascade_view, cascade_projection, cascades.redraw[split] = shadow_cache_fit_cascade(cache, split, corners, dir, static_hash)
+            light_direction = dir
+
+            if .ShadowCascadeBoxes in r.visualization_options {
+                light_corners := get_frustum_corners_world_space(cascade_projection, cascade_view)
+                center := vec3{}
+                for corner in light_corners {
+                    center += corner.xyz
+                }
 
-            metallic_roughness := get_asset(manager, material.metallic_texture, Texture2D)
-            if metallic_roughness == nil {
-                metallic_roughness = get_asset(manager, Renderer3DInstance.white_texture, Texture2D)
+                r := f32(split) / f32(dir_light.shadow.splits)
+                color := Color{r, r, r, 1.0}
+                switch split {
+                case 0:
+                    color = COLOR_RED
+                case 1:
+                    color = COLOR_BLUE
+                case 2:
+                    color = COLOR_GREEN
+                case 3:
+                    color = COLOR_YELLOW
+                }
+                dbg_draw_line(g_dbg_context, light_corners[0].xyz + center, light_corners[1].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[2].xyz + center, light_corners[3].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[4].xyz + center, light_corners[5].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[6].xyz + center, light_corners[7].xyz + center, 2.0, color)
+
+                dbg_draw_line(g_dbg_context, light_corners[0].xyz + center, light_corners[2].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[2].xyz + center, light_corners[6].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[6].xyz + center, light_corners[4].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[4].xyz + center, light_corners[0].xyz + center, 2.0, color)
+
+                dbg_draw_line(g_dbg_context, light_corners[1].xyz + center, light_corners[3].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[3].xyz + center, light_corners[7].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[7].xyz + center, light_corners[5].xyz + center, 2.0, color)
+                dbg_draw_line(g_dbg_context, light_corners[5].xyz + center, light_corners[1].xyz + center, 2.0, color)
             }
 
-            object_set.material = material^
-            // @note This is where we could use shader reflection i guess?
-            gpu.resource_bind_buffer(object_set.resource, object_set.material.block.handle, .UniformBuffer, 0)
-            gpu.resource_bind_image(object_set.resource, albedo.handle, .CombinedImageSampler, 1)
-            gpu.resource_bind_image(object_set.resource, normal.handle, .CombinedImageSampler, 2)
-            gpu.resource_bind_image(object_set.resource, ao.handle, .CombinedImageSampler, 3)
-            gpu.resource_bind_image(object_set.resource, emissive.handle, .CombinedImageSampler, 4)
-            gpu.resource_bind_image(object_set.resource, metallic_roughness.handle, .CombinedImageSampler, 5)
-
-            uniform_buffer_flush(&object_set.material.block)
-            gpu.bind_resource(cmd, object_set.resource, object_shader.pipeline, 2)
+            light_data := &r.scene_set.light_data
+            light_space := cascade_projection * cascade_view
+            light_data.directional.light_space_matrix[split] = light_space
+            cascades.light_spaces[split] = light_space
+            cascades.has_light = true
         }
+    }
 
-        mat := go.transform.global_matrix
-        push := PushConstants {
-            model = mat,
-            local_entity_id = go.local_id,
+    // Only now, every cascade has to be compared against what the cache was drawn with.
+    cache.light_direction = light_direction
+    cache.static_hash = static_hash
+    if !cascades.has_light {
+        cache.valid = {}
+    }
+    if cache.enabled {
+        for redraw in cascades.redraw do if redraw {
+            cache.redraws += 1
         }
-        vk.CmdPushConstants(
-            cmd.handle,
-            object_shader.pipeline.spec.layout.handle,
-            {.VERTEX, .FRAGMENT},
-            0, size_of(PushConstants), &push)
-
-        gpu.bind_buffers(cmd, mesh.vertex_buffer)
-        gpu.bind_buffers(cmd, mesh.index_buffer)
-        gpu.draw_indexed(cmd, mesh.num_indices, 1, 0)
     }
+    return
 }
 
-do_depth_pass :: proc(r: ^Renderer3D, packet: ^RPacket, cmd: gpu.CommandBuffer, mesh_components: []^MeshRenderer) -> (distances: [4]f32) {
-    scene := packet.scene
-    if scene == nil {
+// Records the casters of one cascade into `cmd`, a secondary buffer that runs inside the shadow render pass.
+// Safe to call from a job: it only reads the scene, the culling BVH and assets that were loaded during mesh collection.
+record_shadow_cascade :: proc(
+    r: ^Renderer3D,
+    packet: ^RPacket,
+    cascades: ^ShadowCascades,
+    split: int,
+    pipeline: gpu.Pipeline,
+    cmd: gpu.CommandBuffer,
+    casters_kind: ShadowCasters,
+) {
+    tracy.Zone()
+    size := vec2{SHADOW_MAP_RES, SHADOW_MAP_RES}
+    gpu.set_viewport(cmd, {size.x, -size.y})
+    gpu.set_scissor(cmd, 0, 0, u32(size.x), u32(size.y))
+
+    if packet.scene == nil || !cascades.has_light {
         return
     }
-    view_data := &r.global_set.uniform_buffer
 
-    for split in 0..<SHADOW_CASCADES {
-        for handle, &go in scene.objects do if go.enabled && has_component(scene, handle, DirectionalLight) {
-            dir_light := get_component(scene, handle, DirectionalLight)
-            z := get_split_depth(split + 1, SHADOW_CASCADES, packet.camera.near, packet.camera.far, dir_light.shadow.correction)
-            distances[split] = z
+    gpu.pipeline_bind(cmd, pipeline)
+    gpu.bind_resource(cmd, r.global_set.resource, pipeline, 0)
+
+    light_space := cascades.light_spaces[split]
+
+    // Casters in front of or behind the cascade can still shadow it, so only cull on the sides.
+    casters := make([dynamic]CullItem, context.temp_allocator)
+    bvh_cull(&r.culling_bvh, frustum_from_matrix(light_space, {.Near, .Far}), &casters)
+    if casters_kind != .All {
+        kept := 0
+        for caster in casters {
+            go := get_object(packet.scene, caster.owner)
+            if go != nil && (.Static in go.flags) == (casters_kind == .Static) {
+                casters[kept] = caster
+                kept += 1
+            }
         }
+        resize(&casters, kept)
     }
+    r.cull_stats.shadow_visible[split] += len(casters)
 
-    for split in 0..<SHADOW_CASCADES {
-        if gpu.do_render_pass(cmd, r.shadow_renderpass, r.shadow_framebuffers[split]) {
-            size := vec2{SHADOW_MAP_RES, SHADOW_MAP_RES}
-            gpu.set_viewport(cmd, {size.x, -size.y})
-            gpu.set_scissor(cmd, 0, 0, u32(size.x), u32(size.y))
-
-
-            depth_shader := get_asset(&EngineInstance.asset_manager, r.depth_shader, Shader)
-            assert(depth_shader != nil)
-
-            gpu.pipeline_bind(cmd, depth_shader.pipeline)
-            // gpu.bind_resource(cmd, r.scene_set.resource, object_shader.pipeline, 1)
-
-            // Depth Pass, for lighting
-            {
-                for handle, &go in scene.objects do if go.enabled && has_component(scene, handle, DirectionalLight) {
-                    dir_light := get_component(scene, handle, DirectionalLight)
-                    rot := go.transform.local_rotation
-                    dir_light_quat := linalg.quaternion_from_euler_angles(
-                        rot.y * math.RAD_PER_DEG,
-                        rot.x * math.RAD_PER_DEG,
-                        rot.z * math.RAD_PER_DEG,
-                        .YXZ)
-                    dir := linalg.quaternion_mul_vector3(dir_light_quat, vec3{0, 0, 1})
-                    near := packet.camera.near
-
-                    z := distances[split]
-
-                    proj := linalg.matrix4_perspective_f32(
-                        math.to_radians(f32(50)),
-                        f32(packet.size.x) / f32(packet.size.y),
-                        // distances[split], packet.camera.far if split < SHADOW_CASCADES else distances[split + 1])
-                        near, z * packet.camera.far)
-                        // distances[split - 1] if split > 0 else near, z)
-
-                    corners := get_frustum_corners_world_space(
-                        proj,
-                        packet.camera.view)
-
-                    center := vec3{}
-                    for corner in corners {
-                        center += corner.xyz
-                    }
-
-                    center /= len(corners)
-
-                    view_data.view = linalg.matrix4_look_at_f32(center + dir, center, vec3{0, 1, 0})
-
-                    min_f :: min(f32)
-                    max_f :: max(f32)
-
-                    min, max := vec3{max_f, max_f, max_f}, vec3{min_f, min_f, min_f}
-
-                    for corner in corners {
-                        hm := (view_data.view * corner).xyz
-                        if hm.x < min.x do min.x = hm.x
-                        if hm.y < min.y do min.y = hm.y
-                        if hm.z < min.z do min.z = hm.z
-                        if hm.x > max.x do max.x = hm.x
-                        if hm.y > max.y do max.y = hm.y
-                        if hm.z > max.z do max.z = hm.z
-                    }
-
-                    view_data.projection = linalg.matrix_ortho3d_f32(
-                        left = min.x,
-                        right = max.x,
-                        bottom = min.y,
-                        top = max.y,
-                        near = min.z * 10,
-                        far = max.z / 10)
-
-                        // dbg_draw_sphere(g_dbg_context, center, color = COLOR_PEACH)
-
-                    if .ShadowCascadeBoxes in r.visualization_options {
-                        light_corners := get_frustum_corners_world_space(view_data.projection, view_data.view)
-                        center := vec3{}
-                        for corner in light_corners {
-                            center += corner.xyz
-                        }
-
-                        r := f32(split) / f32(dir_light.shadow.splits)
-                        color := Color{r, r, r, 1.0}
-                        switch split {
-                        case 0:
-                            color = COLOR_RED
-                        case 1:
-                            color = COLOR_BLUE
-                        case 2:
-                            color = COLOR_GREEN
-                        case 3:
-                            color = COLOR_YELLOW
-                        }
-                        dbg_draw_line(g_dbg_context, light_corners[0].xyz + center, light_corners[1].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[2].xyz + center, light_corners[3].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[4].xyz + center, light_corners[5].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[6].xyz + center, light_corners[7].xyz + center, 2.0, color)
-
-                        dbg_draw_line(g_dbg_context, light_corners[0].xyz + center, light_corners[2].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[2].xyz + center, light_corners[6].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[6].xyz + center, light_corners[4].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[4].xyz + center, light_corners[0].xyz + center, 2.0, color)
-
-                        dbg_draw_line(g_dbg_context, light_corners[1].xyz + center, light_corners[3].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[3].xyz + center, light_corners[7].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[7].xyz + center, light_corners[5].xyz + center, 2.0, color)
-                        dbg_draw_line(g_dbg_context, light_corners[5].xyz + center, light_corners[1].xyz + center, 2.0, color)
-                    }
-
-                    light_data := &r.scene_set.light_data
-                    light_space := view_data.projection * view_data.view
-                    light_data.directional.light_space_matrix[split] = light_space
-
-                    for mr in mesh_components {
-                        mesh := get_asset(&EngineInstance.asset_manager, mr.mesh, Mesh)
-                        if mesh == nil do continue
-
-                        go := get_object(scene, mr.owner)
-
-                        mat := go.transform.global_matrix
-                        push := DepthPassPushConstants {
-                            model = mat,
-                            light_space = light_space,
-                        }
-
-                        vk.CmdPushConstants(
-                            cmd.handle,
-                            depth_shader.pipeline.spec.layout.handle,
-                            {.VERTEX, .FRAGMENT},
-                            0, size_of(DepthPassPushConstants), &push)
-
-                        gpu.bind_buffers(cmd, mesh.vertex_buffer)
-                        gpu.bind_buffers(cmd, mesh.index_buffer)
-                        gpu.draw_indexed(cmd, mesh.num_indices, 1, 0)
-                    }
-                }
-            }
-        }
+    push := DepthPassPushConstants {
+        light_space = light_space,
     }
-    return
+    vk.CmdPushConstants(
+        cmd.handle,
+        pipeline.spec.layout.handle,
+        {.VERTEX, .FRAGMENT},
+        0, size_of(DepthPassPushConstants), &push)
+
+    // LODs come from the cascade, not the camera. Cached static casters are only redrawn when the cascade
+    // changes, with the camera they would keep whatever LOD it had back then.
+    view := make_draw_view(packet.camera, SHADOW_LOD_BIAS)
+    view.ortho_extent = r.shadow_cache.extents[split]
+
+    // Materials don't matter for depth, so the shadow list only sorts (and instances) by mesh.
+    shadow_list := make_draw_list(.Shadow, len(casters))
+    draw_list_extract(r, &shadow_list, packet.scene, casters[:], view)
+    draw_list_sort(&shadow_list)
+
+    bound := NO_GEOMETRY_BINDING
+    for batch in draw_list_build_batches(r, &shadow_list) {
+        draw_mesh(&r.geometry, cmd, batch.mesh^, batch.lod, batch.count, batch.first_instance, &bound)
+    }
+}
+
+@(private = "file")
+ShadowCascadeJob :: struct {
+    r: ^Renderer3D,
+    packet: ^RPacket,
+    cascades: ^ShadowCascades,
+    split: int,
+    pipeline: gpu.Pipeline,
+    cmd: gpu.CommandBuffer,
+    // Static casters, when the cascade has to be redrawn in the shadow cache.
+    cache_cmd: gpu.CommandBuffer,
+    wait_group: ^sync.Wait_Group,
+}
+
+@(private = "file")
+shadow_cascade_job :: proc(task: thread.Task) {
+    job := cast(^ShadowCascadeJob)task.data
+    defer sync.wait_group_done(job.wait_group)
+    defer free_all(context.temp_allocator)
+
+    r := job.r
+    r.cull_stats.shadow_visible[job.split] = 0
+    if !job.cascades.cached {
+        gpu.cmd_begin_secondary(job.cmd, r.shadow_renderpass, r.shadow_framebuffers[job.split])
+        record_shadow_cascade(r, job.packet, job.cascades, job.split, job.pipeline, job.cmd, .All)
+        gpu.cmd_end(job.cmd, {})
+        return
+    }
+
+    if job.cascades.redraw[job.split] {
+        gpu.cmd_begin_secondary(job.cache_cmd, r.shadow_renderpass, r.shadow_cache.framebuffers[job.split])
+        record_shadow_cascade(r, job.packet, job.cascades, job.split, job.pipeline, job.cache_cmd, .Static)
+        gpu.cmd_end(job.cache_cmd, {})
+    }
+    gpu.cmd_begin_secondary(job.cmd, r.shadow_cache.load_renderpass, r.shadow_framebuffers[job.split])
+    record_shadow_cascade(r, job.packet, job.cascades, job.split, job.pipeline, job.cmd, .Dynamic)
+    gpu.cmd_end(job.cmd, {})
 }
 
 UniformBuffer :: struct($T: typeid) {
@@ -636,22 +977,7 @@ uniform_buffer_flush :: proc(ubo: ^UniformBuffer($T)) {
 
 @(private = "file")
 r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
-    vertex_layout := gpu.vertex_layout({
-        name = "Position",
-        type = .Float3,
-    }, {
-        name = "Normal",
-        type = .Float3,
-    }, {
-        name = "Tangent",
-        type = .Float3,
-    }, {
-        name = "UV",
-        type = .Float2,
-    }, {
-        name = "Color",
-        type = .Float3,
-    })
+    vertex_layout := mesh_vertex_layout()
 
     // ==============================
     // === Dear ImGui Render Pass ===
@@ -709,7 +1035,8 @@ r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
                     load_op      = .Clear,
                     store_op     = .Store,
                     samples      = 1,
-                    final_layout = .DepthStencilReadOnlyOptimal,
+                    // The render graph moves it to read only for the world pass.
+                    final_layout = .DepthStencilAttachmentOptimal,
                     clear_depth  = 1.0,
                 },
             },
@@ -728,6 +1055,7 @@ r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
             tag = "Depth Pipeline Layout",
             device = &r.device,
             layouts = {
+                r.global_set.layout,
             },
             use_push = true,
         }
@@ -766,39 +1094,15 @@ r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
             height = SHADOW_MAP_RES,
             layer_count = SHADOW_CASCADES,
             format = renderpass_spec.attachments[0].format,
-            usage = {.DepthStencilAttachment, .Sampled},
+            // The shadow cache gets copied into it.
+            usage = {.DepthStencilAttachment, .Sampled, .TransferDst},
             sampler = {},
             layout = .Undefined,
             final_layout = .DepthStencilReadOnlyOptimal,
         }
         r.depth_image = gpu.create_image(depth_image_spec)
-
-        for i in 0..<SHADOW_CASCADES {
-
-            spec := gpu.FrameBufferSpecification {
-                device = &r.device,
-                width = SHADOW_MAP_RES,
-                height = SHADOW_MAP_RES,
-                renderpass = r.shadow_renderpass,
-            }
-            // Create view
-            image_view_spec := gpu.ImageViewSpecification {
-                device = &r.device,
-                format = depth_image_spec.format,
-                view_type = .D2_Array,
-                base_layer_index = i,
-                layer_count = 1,
-            }
-            view := gpu.create_image_view(r.depth_image, image_view_spec)
-
-            // NOTE(minebill): The framebuffer only really cares about the view, so we
-            // just create a dumb struct here with just a view.
-            image := gpu.Image {
-                view = view,
-            }
-
-            r.shadow_framebuffers[i] = gpu.create_framebuffer_from_images(spec, []gpu.Image {image})
-        }
+        r.shadow_framebuffers = create_cascade_framebuffers(r, r.depth_image)
+        shadow_cache_init(&r.shadow_cache, r)
     }
 
     // =========================
@@ -860,34 +1164,8 @@ r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
             },
         }
 
+        // The framebuffer belongs to the render graph, see r3d_setup_render_graph.
         r.world_renderpass = gpu.create_render_pass(renderpass_spec)
-        for i in 0..<len(r.world_framebuffers) {
-            fb_spec := gpu.FrameBufferSpecification {
-                device = &r.device,
-                width = 100, height = 100,
-                samples = 8,
-                renderpass = r.world_renderpass,
-                attachments = {
-                    {
-                        format = .R8G8B8A8_SRGB,
-                        usage = {.Transient, .ColorAttachment},
-                        samples = 8,
-                    },
-                    {
-                        format = .R8G8B8A8_SRGB,
-                        usage = {.ColorAttachment, .Sampled},
-                        samples = 1,
-                    },
-                    {
-                        format = .D32_SFLOAT_S8_UINT,
-                        usage = {.Transient, .DepthStencilAttachment},
-                        samples = 8,
-                    }
-                },
-            }
-
-            r.world_framebuffers[i] = gpu.create_framebuffer(fb_spec)
-        }
 
         pipeline_layout_spec := gpu.PipelineLayoutSpecification {
             tag = "Object Pipeline Layout",
@@ -895,7 +1173,7 @@ r3d_setup_renderpasses :: proc(r: ^Renderer3D) -> (ok: bool) {
             layouts = {
                 r.global_set.layout,
                 r.scene_set.layout,
-                r.object_set.layout,
+                r.material_table.layout,
             },
             use_push = true,
         }
@@ -1109,7 +1387,7 @@ initialize_imgui_for_vulkan :: proc(r: ^Renderer3D) {
         Device = s.device.handle,
         QueueFamily = u32(0), // TODO: This is wrong. It just happens to line up for now.
         Queue = s.device.graphics_queue,
-        PipelineCache = 0, // NOTE(minebill): We don't use pipeline caches right now.
+        PipelineCache = s.device.pipeline_cache,
         DescriptorPool = imgui_descriptor_pool,
         Subpass = 0,
         MinImageCount = 2,
@@ -1169,6 +1447,15 @@ Texture :: struct {
 })
 Texture2D :: struct {
     using texture_base: Texture,
+    // Set for textures loaded from a cooked file, see texture_streamer.odin.
+    stream: ^StreamedTexture,
+}
+
+// Only streamed textures give their image back for now, the streamer knows when no frame uses it anymore.
+destroy_texture2d :: proc(texture: ^Texture2D) {
+    if texture.stream != nil {
+        texture_streamer_remove(&Renderer3DInstance.texture_streamer, texture)
+    }
 }
 
 create_texture2d :: proc(spec: TextureSpecification, data: []byte = {}, tag: cstring = "") -> (texture: Texture2D) {
@@ -1199,6 +1486,44 @@ create_texture2d :: proc(spec: TextureSpecification, data: []byte = {}, tag: cst
     return
 }
 
+// Creates a texture with the mip levels of `data` from `first_mip` on, in whatever format it was cooked to.
+// The spec keeps the full size.
+create_texture2d_from_data :: proc(data: TextureData, first_mip := 0, tag: cstring = "") -> (texture: Texture2D) {
+    texture.spec = TextureSpecification {
+        width = data.width,
+        height = data.height,
+        samples = 1,
+        anisotropy = 4,
+        filter = .Linear,
+        pixel_type = .Unsigned,
+    }
+
+    image_spec := gpu.ImageSpecification {
+        tag = tag,
+        device = &Renderer3DInstance.device,
+        width = max(data.width >> uint(first_mip), 1),
+        height = max(data.height >> uint(first_mip), 1),
+        samples = 1,
+        usage = {.Sampled, .TransferDst},
+        format = data.format,
+        final_layout = .ShaderReadOnlyOptimal,
+        mip_levels = len(data.levels) - first_mip,
+        sampler = {
+            wrap = .Repeat,
+        }
+    }
+
+    levels := data.levels[first_mip:]
+    level_offsets := make([]int, len(levels), context.temp_allocator)
+    for level, i in levels {
+        level_offsets[i] = int(level.offset - levels[0].offset)
+    }
+
+    texture.handle = gpu.create_image(image_spec)
+    gpu.image_set_mip_data(&texture.handle, data.data[levels[0].offset:], level_offsets)
+    return
+}
+
 new_texture2d :: proc(spec: TextureSpecification, data: []byte = {}, tag: cstring = "") -> (texture: ^Texture2D) {
     texture = new(Texture2D)
     texture^ = create_texture2d(spec, data, tag)
@@ -1229,6 +1554,10 @@ build_global_set :: proc(r: ^Renderer3D) -> (set: GlobalSet) {
         type = .UniformBuffer,
         count = 1,
         stage = {.Vertex, .Fragment},
+    }, {
+        type = .StorageBuffer,
+        count = 1,
+        stage = {.Vertex},
     })
 
     alloc_error: gpu.ResourceAllocationError
@@ -1243,6 +1572,15 @@ build_global_set :: proc(r: ^Renderer3D) -> (set: GlobalSet) {
 
     set.global_data = create_uniform_buffer(&r.device, GlobalData, "Global Shader Data")
     gpu.resource_bind_buffer(set.resource, set.global_data.handle, .UniformBuffer, 2)
+
+    set.instances.handle = gpu.create_buffer({
+        name = "Instance Data",
+        device = &r.device,
+        size = size_of(InstanceData) * MAX_INSTANCES * gpu.MAX_FRAMES_IN_FLIGHT,
+        usage = {.Storage},
+        mapped = true,
+    })
+    gpu.resource_bind_buffer(set.resource, set.instances.handle, .StorageBuffer, 3)
     return
 }
 
@@ -1274,58 +1612,6 @@ build_scene_set :: proc(r: ^Renderer3D) -> (set: SceneSet) {
     return
 }
 
-// @note We could generate this at runtime by reflecting on shaders
-// and looking at what kind of resources they use at set = 2, which is the "object set".
-// This way, since we allocate these per-frame, each shader can trivially have it's own unique
-// set bound to it.
-build_object_set :: proc(r: ^Renderer3D) -> (set: ObjectSet) {
-    tracy.Zone()
-    set.layout = gpu.create_resource_layout(r.device, {
-        tag = "Material",
-        type = .UniformBuffer,
-        count = 1,
-        stage = {.Vertex, .Fragment},
-    }, {
-        tag = "Albedo Map",
-        type = .CombinedImageSampler,
-        count = 1,
-        stage ={.Fragment},
-    }, {
-        tag = "Normal Map",
-        type = .CombinedImageSampler,
-        count = 1,
-        stage ={.Fragment},
-    }, {
-        tag = "Ambient Occlusion Map",
-        type = .CombinedImageSampler,
-        count = 1,
-        stage ={.Fragment},
-    }, {
-        tag = "Emissive Map",
-        type = .CombinedImageSampler,
-        count = 1,
-        stage ={.Fragment},
-    }, {
-        tag = "Metallic Roughness Map",
-        type = .CombinedImageSampler,
-        count = 1,
-        stage ={.Fragment},
-    })
-
-    alloc_error: gpu.ResourceAllocationError
-    // set.resource, alloc_error = gpu.allocate_resource(pool, set.layout)
-    // fmt.assertf(alloc_error == nil, "Error allocating resource for global set: %v", alloc_error)
-    set.resource, alloc_error = gpu.frame_allocator_alloc(&r.pool_allocator, set.layout)
-    fmt.assertf(alloc_error == nil, "Error allocating resource for object set: %v", alloc_error)
-
-    // set.view_data = create_uniform_buffer(&r.device, ViewData, "Scene View Data")
-    // gpu.resource_bind_buffer(set.resource, set.view_data.handle, .UniformBuffer)
-
-    // set.light_data = create_uniform_buffer(&r.device, LightData, "Scene Light Data")
-    // gpu.resource_bind_buffer(set.resource, set.light_data.handle, .UniformBuffer)
-    return
-}
-
 get_frustum_corners_world_space :: proc(proj, view: mat4) -> (corners: [8]vec4) {
     inv := linalg.inverse(proj * view)
 
@@ -1,12 +1,46 @@
 package engine
 import "gpu"
+import "core:math/linalg"
 import tracy "packages:odin-tracy"
 import vk "vendor:vulkan"
 
+// Picking is asynchronous: a request is recorded as a small copy at the end of the next frame and
+// resolved once that frame's fence has been waited on, so a click never stalls the GPU.
+
+// Size of the region around the cursor that gets read back. The object closest to the cursor wins,
+// so small objects don't need pixel perfect clicks.
+PICK_REGION_SIZE :: 5
+
+ObjectPickState :: enum {
+    Idle,
+    // Waiting for the next frame to record the copy.
+    Requested,
+    // Copy recorded, waiting for the frame to finish.
+    Recorded,
+    Ready,
+}
+
 ObjectPicking :: struct {
     renderpass: gpu.RenderPass,
     shader: AssetHandle,
-    framebuffer: gpu.FrameBuffer,
+    // The attachments belong to the render graph, see r3d_setup_render_graph.
+    width, height: int,
+
+    readback_buffers: [gpu.MAX_FRAMES_IN_FLIGHT]gpu.Buffer,
+    state: ObjectPickState,
+    x, y: int,
+    // The part of the framebuffer that was copied (x, y, width, height).
+    region: [4]int,
+    frame: int,
+    // Local id of the picked object, 0 for nothing.
+    result: int,
+
+    // Pick by casting a ray against the bounds in the culling BVH instead of reading back the ID buffer.
+    // Less precise, but it doesn't depend on the picking pass.
+    cpu_fallback: bool,
+    // What the picking pass was last rendered with, for the CPU fallback.
+    camera: RenderCamera,
+    scene: ^World,
 }
 
 ObjectPickingPushConstants :: struct {
@@ -25,7 +59,8 @@ object_picking_init :: proc(this: ^ObjectPicking, device: ^gpu.Device) -> bool {
                 load_op = .Clear,
                 final_layout = .ColorAttachmentOptimal,
                 samples = 1,
-                clear_color = Vector4{1, 1, 1, 1},
+                // Local ids start from 1, 0 means nothing was hit.
+                clear_color = Vector4{0, 0, 0, 0},
             },
             {
                 tag          = "Object Picking Depth",
@@ -52,36 +87,25 @@ object_picking_init :: proc(this: ^ObjectPicking, device: ^gpu.Device) -> bool {
     }
 
     this.renderpass = gpu.create_render_pass(renderpass_spec)
+    this.width, this.height = 100, 100
 
-    fb_spec := gpu.FrameBufferSpecification {
-        device = device,
-        width = 100,
-        height = 100,
-        samples = 1,
-        renderpass = this.renderpass,
-        attachments = {
-            {
-                format = .RED_SIGNED,
-                usage = {.ColorAttachment, .Sampled, .TransferSrc},
-                samples = 1,
-            },
-            {
-                format = .D32_SFLOAT_S8_UINT,
-                usage = {.Transient, .DepthStencilAttachment},
-                samples = 1,
-            }
-        }
+    for &buffer in this.readback_buffers {
+        buffer = gpu.create_buffer(gpu.BufferSpecification {
+            device = device,
+            name = "Object Picking Readback",
+            usage = {.TransferDest},
+            size = PICK_REGION_SIZE * PICK_REGION_SIZE * size_of(i32),
+            readback = true,
+        })
     }
 
-    this.framebuffer = gpu.create_framebuffer(fb_spec)
-
     pipeline_layout_spec := gpu.PipelineLayoutSpecification {
         tag = "Object Picking PL",
         device = device,
         layouts = {
             Renderer3DInstance.global_set.layout,
             Renderer3DInstance.scene_set.layout,
-            Renderer3DInstance.object_set.layout,
+            Renderer3DInstance.material_table.layout,
         },
         use_push = true,
     }
@@ -95,23 +119,7 @@ object_picking_init :: proc(this: ^ObjectPicking, device: ^gpu.Device) -> bool {
     // config.multisample_info.sampleShadingEnable = true
     // config.rasterization_info.cullMode = {.FRONT}
 
-    // @note This should be moved out of here.
-    vertex_layout := gpu.vertex_layout({
-        name = "Position",
-        type = .Float3,
-    }, {
-        name = "Normal", // not needed for this pass
-        type = .Float3,
-    }, {
-        name = "Tangent", // not needed for this pass
-        type = .Float3,
-    }, {
-        name = "UV", // not needed for this pass
-        type = .Float2,
-    }, {
-        name = "Color", // not needed for this pass
-        type = .Float3,
-    })
+    vertex_layout := mesh_vertex_layout()
     pipeline_spec := gpu.PipelineSpecification {
         tag = "Object Pipeline",
         layout = pipeline_layout,
@@ -133,43 +141,146 @@ object_picking_init :: proc(this: ^ObjectPicking, device: ^gpu.Device) -> bool {
 }
 
 object_picking_deinit :: proc(this: ^ObjectPicking) {
-    gpu.destroy_framebuffer(&this.framebuffer)
+    for buffer in this.readback_buffers {
+        gpu.destroy_buffer(buffer)
+    }
 }
 
-object_picking_render :: proc(this: ^ObjectPicking, packet: RPacket, cmd: gpu.CommandBuffer, mesh_components: []^MeshRenderer) {
-    if gpu.do_render_pass(cmd, this.renderpass, this.framebuffer) {
-        tracy.ZoneN("Object Picking")
+// Asks for the object under (x, y), in framebuffer pixels. The result shows up in object_picking_poll
+// a frame or two later. A new request replaces one that is still in flight.
+object_picking_request :: proc(r: ^Renderer3D, x, y: int) {
+    this := &r.object_picking
+    if this.cpu_fallback {
+        this.result = object_picking_raycast(r, x, y)
+        this.state = .Ready
+        return
+    }
 
-        shader := get_asset(&EngineInstance.asset_manager, this.shader, Shader)
-        gpu.pipeline_bind(cmd, shader.pipeline)
+    this.x, this.y = x, y
+    this.state = .Requested
+}
 
-        for mr in mesh_components {
-            tracy.ZoneN("Draw Mesh")
-            mesh := get_asset(&EngineInstance.asset_manager, mr.mesh, Mesh)
-            if mesh == nil do continue
+// Returns the local id of the picked object (0 for nothing) once a request has been resolved.
+object_picking_poll :: proc(this: ^ObjectPicking) -> (local_id: int, ok: bool) {
+    if this.state != .Ready {
+        return
+    }
+    this.state = .Idle
+    return this.result, true
+}
 
-            go := get_object(packet.scene, mr.owner)
+// Records the copy for a pending request, after the picking pass. `ids` has to be in TransferSrcOptimal.
+object_picking_record_readback :: proc(this: ^ObjectPicking, cmd: gpu.CommandBuffer, frame: int, ids: ^gpu.Image) {
+    if this.state != .Requested {
+        return
+    }
+    tracy.Zone()
 
-            mat := go.transform.global_matrix
-            // draw_elements(gl.TRIANGLES, mesh.num_indices, gl.UNSIGNED_SHORT)
-            push := ObjectPickingPushConstants {
-                model = mat,
-                object_id = go.local_id,
+    width, height := ids.spec.width, ids.spec.height
+    if this.x < 0 || this.y < 0 || this.x >= width || this.y >= height {
+        this.result = 0
+        this.state = .Ready
+        return
+    }
+
+    half :: PICK_REGION_SIZE / 2
+    x0, y0 := max(this.x - half, 0), max(this.y - half, 0)
+    x1, y1 := min(this.x + half + 1, width), min(this.y + half + 1, height)
+    this.region = {x0, y0, x1 - x0, y1 - y0}
+
+    gpu.cmd_copy_image_region(cmd, ids, this.readback_buffers[frame], x0, y0, x1 - x0, y1 - y0)
+    this.frame = frame
+    this.state = .Recorded
+}
+
+// Called once the fence of `frame` has been waited on, which means the copy recorded in it is done.
+object_picking_resolve :: proc(this: ^ObjectPicking, frame: int) {
+    if this.state != .Recorded || this.frame != frame {
+        return
+    }
+    tracy.Zone()
+
+    buffer := this.readback_buffers[frame]
+    gpu.buffer_invalidate(buffer)
+
+    rx, ry, rw, rh := this.region[0], this.region[1], this.region[2], this.region[3]
+    ids := ([^]i32)(buffer.alloc_info.pMappedData)[:rw * rh]
+
+    this.result = 0
+    closest := max(int)
+    for py in 0..<rh {
+        for px in 0..<rw {
+            id := ids[py * rw + px]
+            if id == 0 do continue
+
+            dx, dy := rx + px - this.x, ry + py - this.y
+            if distance := dx * dx + dy * dy; distance < closest {
+                closest = distance
+                this.result = int(id)
             }
+        }
+    }
+    this.state = .Ready
+}
 
-            vk.CmdPushConstants(
-                cmd.handle,
-                shader.pipeline.spec.layout.handle,
-                {.VERTEX, .FRAGMENT},
-                0, size_of(PushConstants), &push)
+@(private = "file")
+object_picking_raycast :: proc(r: ^Renderer3D, x, y: int) -> int {
+    this := &r.object_picking
+    width, height := f32(this.width), f32(this.height)
+    if this.scene == nil || width == 0 || height == 0 {
+        return 0
+    }
+
+    // Any point that projects onto the pixel lies on the ray from the camera.
+    ndc := vec2{(f32(x) + 0.5) / width * 2 - 1, (f32(y) + 0.5) / height * 2 - 1}
+    inverse := linalg.inverse(this.camera.projection * this.camera.view)
+    point := inverse * vec4{ndc.x, ndc.y, 0.5, 1}
+    origin := this.camera.position
+    direction := linalg.normalize(point.xyz / point.w - origin)
+
+    item, _, hit := bvh_raycast(&r.culling_bvh, origin, direction)
+    if !hit {
+        return 0
+    }
+    go := get_object(this.scene, item.owner)
+    if go == nil {
+        return 0
+    }
+    return go.local_id
+}
 
-            gpu.bind_buffers(cmd, mesh.vertex_buffer)
-            gpu.bind_buffers(cmd, mesh.index_buffer)
-            gpu.draw_indexed(cmd, mesh.num_indices, 1, 0)
+// Records the picking pass, inside the render pass begun by the render graph.
+object_picking_render :: proc(this: ^ObjectPicking, packet: RPacket, cmd: gpu.CommandBuffer, mesh_components: []CullItem) {
+    tracy.ZoneN("Object Picking")
+
+    shader := get_asset(&EngineInstance.asset_manager, this.shader, Shader)
+    gpu.pipeline_bind(cmd, shader.pipeline)
+
+    bound := NO_GEOMETRY_BINDING
+    for item in mesh_components {
+        tracy.ZoneN("Draw Mesh")
+        mesh := get_asset(&EngineInstance.asset_manager, item.renderer.mesh, Mesh)
+        if mesh == nil do continue
+
+        go := get_object(packet.scene, item.owner)
+
+        mat := transform_world_matrix(go)
+        // draw_elements(gl.TRIANGLES, mesh.num_indices, gl.UNSIGNED_SHORT)
+        push := ObjectPickingPushConstants {
+            model = mat,
+            object_id = go.local_id,
         }
+
+        vk.CmdPushConstants(
+            cmd.handle,
+            shader.pipeline.spec.layout.handle,
+            {.VERTEX, .FRAGMENT},
+            0, size_of(ObjectPickingPushConstants), &push)
+
+        draw_mesh(&Renderer3DInstance.geometry, cmd, mesh^, 0, 1, 0, &bound)
     }
 }
 
 object_picking_resize :: proc(this: ^ObjectPicking, size: Vector2) {
-    gpu.framebuffer_resize(&this.framebuffer, size)
+    this.width, this.height = int(size.x), int(size.y)
 }
\ No newline at end of file
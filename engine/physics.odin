@@ -89,6 +89,8 @@ physics_init :: proc(physics: ^Physics) {
         physics.object_layer_pair_filter)
 
     // CAN BE CALLED FROM A DIFFERENT THREAD
+    // The contact callbacks run while the main thread waits in physics_update, so they may read the world,
+    // but any structural change has to be recorded with the deferred_* procs (see entity_commands.odin).
     physics.contact_listener.OnContactAdded = proc "c" (body1, body2: jolt.Body, manifold: jolt.ContactManifold, settings: ^jolt.ContactSettings) {
         context = EngineInstance.ctx
 
@@ -100,6 +102,10 @@ physics_init :: proc(physics: ^Physics) {
 
         entity_a := get_entity(EngineInstance.world, handle_a)
         entity_b := get_entity(EngineInstance.world, handle_b)
+        // Deleted by a command that hasn't reached the body yet.
+        if entity_a == nil || entity_b == nil {
+            return
+        }
         log_debug(LC.PhysicsSystem, "Collision started between '{}' and '{}'", ds_to_string(entity_a.name), ds_to_string(entity_b.name))
     }
 
@@ -122,6 +128,9 @@ physics_init :: proc(physics: ^Physics) {
 
         entity_a := get_entity(EngineInstance.world, handle_a)
         entity_b := get_entity(EngineInstance.world, handle_b)
+        if entity_a == nil || entity_b == nil {
+            return
+        }
         log_debug(LC.PhysicsSystem, "Collision ended between '{}' and '{}'", ds_to_string(entity_a.name), ds_to_string(entity_b.name))
     }
 
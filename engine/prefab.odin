@@ -0,0 +1,263 @@
+package engine
+import "base:runtime"
+import "core:path/filepath"
+import "core:slice"
+import "core:strings"
+import tracy "packages:odin-tracy"
+
+// A prefab is a template entity that can be instantiated many times. Instances keep a
+// handle to the prefab and reference the template components that have no per entity state
+// (see component_is_shareable) instead of copying them. A shared component is copied the first time
+// it's written to, through get_component. Only the fields that differ from the template get serialized
+// with the scene, along with the template components the instance removed.
+//
+// NOTE(minebill): Only single entity prefabs for now, children are not part of the template.
+@(asset = {
+    ImportFormats = ".prefab",
+})
+Prefab :: struct {
+    using base: Asset,
+
+    name: string,
+
+    // The template lives in its own world so that the regular component procs work on it.
+    // Its components are never initialized or updated.
+    world: World,
+    template: EntityHandle,
+}
+
+@(importer=Prefab)
+import_prefab :: proc(metadata: AssetMetadata) -> (asset: ^Asset, error: AssetImportError) {
+    prefab := new(Prefab)
+    prefab.type = .Prefab
+
+    path := filepath.join({EditorInstance.active_project.root, metadata.path}, context.temp_allocator)
+    if !deserialize_prefab(prefab, path) {
+        free(prefab)
+        return nil, GenericMessageError {
+            message = "Failed to read prefab file",
+        }
+    }
+    return prefab, nil
+}
+
+deserialize_prefab :: proc(prefab: ^Prefab, file: string) -> bool {
+    tracy.Zone()
+    s: SerializeContext
+    serialize_init_file(&s, file)
+    defer serialize_deinit(&s)
+
+    if !serialize_begin_table(&s, "Prefab") {
+        return false
+    }
+    defer serialize_end_table(&s)
+
+    name, _ := serialize_get_field(&s, "Name", string)
+    prefab.name = name
+
+    // The world owns its name, destroy_world frees it.
+    create_world(&prefab.world, strings.clone(name))
+    prefab.template = new_object(&prefab.world, name)
+    template := get_object(&prefab.world, prefab.template)
+
+    if serialize_begin_table(&s, "Transform") {
+        transform := get_transform(template)
+        serialize_transform(&transform, false, &s)
+        set_transform(template, transform)
+        serialize_end_table(&s)
+    }
+
+    if serialize_begin_table(&s, "Components") {
+        for key in serialize_get_keys(&s) {
+            serialize_begin_table(&s, key)
+            deserialize_component(&s, key, &prefab.world, template)
+            serialize_end_table(&s)
+        }
+        serialize_end_table(&s)
+    }
+    return true
+}
+
+// Saves an entity as a prefab file.
+save_entity_as_prefab :: proc(world: ^World, handle: EntityHandle, file: string) {
+    entity := get_object(world, handle)
+    if entity == nil do return
+
+    s: SerializeContext
+    serialize_init(&s)
+    defer serialize_deinit(&s)
+
+    serialize_begin_table(&s, "Prefab")
+    {
+        serialize_do_field(&s, "Name", ds_to_string(entity.name))
+
+        serialize_begin_table(&s, "Transform")
+            transform := get_transform(entity)
+            serialize_transform(&transform, true, &s)
+        serialize_end_table(&s)
+
+        serialize_begin_table(&s, "Components")
+        for id, component in entity.components {
+            serialize_component(component, id, &s)
+        }
+        serialize_end_table(&s)
+    }
+    serialize_end_table(&s)
+
+    serialize_dump(&s, file)
+}
+
+destroy_prefab :: proc(prefab: ^Prefab) {
+    destroy_world(&prefab.world)
+    delete(prefab.name)
+    prefab.name = ""
+}
+
+get_entity_prefab :: proc(entity: ^Entity) -> ^Prefab {
+    if entity.prefab == 0 {
+        return nil
+    }
+    return get_asset(&EngineInstance.asset_manager, entity.prefab, Prefab)
+}
+
+prefab_get_template :: proc(prefab: ^Prefab) -> ^Entity {
+    return get_object(&prefab.world, prefab.template)
+}
+
+// Makes `entity` an instance of the prefab, by giving it every template component it doesn't have yet,
+// except the `removed` ones. Does not touch the transform of the entity.
+prefab_apply :: proc(world: ^World, entity: ^Entity, handle: AssetHandle, removed: []typeid = nil) {
+    tracy.Zone()
+    prefab := get_asset(&EngineInstance.asset_manager, handle, Prefab)
+    if prefab == nil {
+        log_error(LC.EntitySystem, "Entity '%v' references invalid prefab %v", ds_to_string(entity.name), handle)
+        return
+    }
+    entity.prefab = handle
+
+    template := prefab_get_template(prefab)
+    for id, component in template.components {
+        if id in entity.components || slice.contains(removed, id) do continue
+        add_template_component(world, entity, id, component)
+    }
+}
+
+prefab_instantiate :: proc(world: ^World, handle: AssetHandle, parent: Maybe(EntityHandle) = nil) -> EntityHandle {
+    tracy.Zone()
+    prefab := get_asset(&EngineInstance.asset_manager, handle, Prefab)
+    if prefab == nil {
+        log_error(LC.EntitySystem, "Cannot instantiate invalid prefab %v", handle)
+        return 0
+    }
+
+    return instantiate_from_template(world, prefab, handle, parent)
+}
+
+// Spawns `count` instances of the prefab. All the world storage is grown once up front,
+// instead of for every instance. Shareable components are only referenced, not copied.
+prefab_instantiate_many :: proc(
+    world: ^World,
+    handle: AssetHandle,
+    count: int,
+    parent: Maybe(EntityHandle) = nil,
+    allocator := context.allocator,
+) -> []EntityHandle {
+    tracy.Zone()
+    prefab := get_asset(&EngineInstance.asset_manager, handle, Prefab)
+    if prefab == nil {
+        log_error(LC.EntitySystem, "Cannot instantiate invalid prefab %v", handle)
+        return nil
+    }
+    template := prefab_get_template(prefab)
+
+    reserve(&world.objects, len(world.objects) + count)
+    reserve(&world.local_id_to_uuid, len(world.local_id_to_uuid) + count)
+    transform_store_reserve(&world.transforms, len(world.transforms.entities) + count)
+    for id in template.components {
+        storage, ok := &world.component_storage[id]
+        if !ok {
+            world.component_storage[id] = {}
+            storage = &world.component_storage[id]
+        }
+        reserve(&storage.components, len(storage.components) + count)
+        reserve(&storage.owners, len(storage.owners) + count)
+        reserve(&storage.indices, len(storage.indices) + count)
+    }
+
+    parent_entity := get_object(world, parent.? or_else world.root)
+    if parent_entity != nil {
+        reserve(&parent_entity.children, len(parent_entity.children) + count)
+    }
+
+    handles := make([]EntityHandle, count, allocator)
+    for i in 0..<count {
+        handles[i] = instantiate_from_template(world, prefab, handle, parent)
+    }
+    return handles
+}
+
+// Serializes the fields of `component` that differ from the template, nested tables included.
+// Nothing is written when it matches the template.
+prefab_serialize_overrides :: proc(prefab: ^Prefab, component: ^Component, id: typeid, s: ^SerializeContext) {
+    template := prefab_get_template(prefab)
+    template_component, ok := template.components[id]
+    if !ok {
+        serialize_component(component, id, s)
+        return
+    }
+
+    // Compared through the serializers, that's what would be stored. The raw structs can't be
+    // compared, maps, strings and runtime handles differ even when the data doesn't.
+    TEMPLATE_KEY :: "PrefabTemplate"
+    named := type_info_of(id).variant.(runtime.Type_Info_Named)
+    serialize_component(template_component, id, s, TEMPLATE_KEY)
+    serialize_component(component, id, s)
+    serialize_strip_equal_fields(s, named.name, TEMPLATE_KEY)
+}
+
+// Gives every instance of the prefab in `world` its own copy of the components it shares with the
+// template, and turns them into regular entities. Must be called before the prefab is destroyed.
+prefab_detach_instances :: proc(world: ^World, handle: AssetHandle) {
+    tracy.Zone()
+    for _, &entity in world.objects do if entity.prefab == handle {
+        for id in entity.components {
+            unshare_component(world, &entity, id)
+        }
+        entity.prefab = 0
+    }
+}
+
+// The template components `entity` doesn't have anymore.
+prefab_removed_components :: proc(prefab: ^Prefab, entity: ^Entity, allocator := context.allocator) -> []typeid {
+    removed := make([dynamic]typeid, allocator)
+    template := prefab_get_template(prefab)
+    for id in template.components do if id not_in entity.components {
+        append(&removed, id)
+    }
+    return removed[:]
+}
+
+@(private = "file")
+instantiate_from_template :: proc(world: ^World, prefab: ^Prefab, handle: AssetHandle, parent: Maybe(EntityHandle)) -> EntityHandle {
+    template := prefab_get_template(prefab)
+
+    instance_handle := new_object(world, prefab.name, parent)
+    instance := get_object(world, instance_handle)
+    instance.prefab = handle
+    instance.flags = template.flags
+    set_transform(instance, get_transform(template))
+
+    for id, component in template.components {
+        add_template_component(world, instance, id, component)
+    }
+    return instance_handle
+}
+
+@(private = "file")
+add_template_component :: proc(world: ^World, entity: ^Entity, id: typeid, component: ^Component) {
+    if component_is_shareable(component) {
+        share_component(world, entity, id, component)
+    } else {
+        attach_component(world, entity, id, clone_component(component, id))
+    }
+}
@@ -0,0 +1,389 @@
+package engine
+import "core:mem"
+import "core:slice"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// The passes of a frame, declared once along with the images and buffers they read and write.
+// From that the graph works out
+// - the barriers and layout transitions in front of every pass, recorded as one vkCmdPipelineBarrier,
+// - which passes can be skipped because nothing uses what they write,
+// - where transient images live. A transient image is only used by a range of passes and its contents
+//   don't survive the frame, so images whose ranges don't overlap share the same memory.
+//
+// Passes and resources are declared at setup. render_graph_compile creates the transient images and
+// the framebuffers, again whenever the size changes, and render_graph_execute records the passes.
+
+RGImage :: distinct int
+RGBuffer :: distinct int
+RGPass :: distinct int
+
+RenderGraphPassProc :: #type proc(cmd: gpu.CommandBuffer, user_data: rawptr)
+
+RenderGraphUse :: struct {
+    resource: int,
+    access: gpu.Access,
+}
+
+RenderGraphImage :: struct {
+    name: cstring,
+    // Imported images belong to someone else and keep their state between frames. Transient ones are
+    // created by render_graph_compile and start every frame with undefined contents.
+    imported: ^gpu.Image,
+    transient: gpu.Image,
+    spec: gpu.ImageSpecification,
+    state: gpu.ResourceState,
+    // How the image gets used after the graph, e.g. sampled by the editor. Imported images with one are
+    // the outputs of the graph, the passes that lead to them are the ones that don't get culled.
+    final_access: gpu.Access,
+    // Passes that use it, in declaration order, and where it lives in the transient memory.
+    first_pass, last_pass: int,
+    offset, size: int,
+}
+
+RenderGraphBuffer :: struct {
+    name: cstring,
+    buffer: ^gpu.Buffer,
+    state: gpu.ResourceState,
+}
+
+RenderGraphPass :: struct {
+    name: string,
+    images: [dynamic]RenderGraphUse,
+    buffers: [dynamic]RenderGraphUse,
+    // When set, `record` runs inside this render pass, on a framebuffer made of `attachments`.
+    renderpass: gpu.RenderPass,
+    contents: gpu.RenderPassContents,
+    attachments: [dynamic]RGImage,
+    framebuffer: gpu.FrameBuffer,
+    record: RenderGraphPassProc,
+    // Disabled passes are skipped, along with the passes that only they needed.
+    enabled: bool,
+    // Keeps the pass even when nothing reads what it writes, e.g. when it reads something back.
+    side_effects: bool,
+}
+
+RenderGraphStats :: struct {
+    passes, culled_passes: int,
+    barriers: int,
+    // Size of the transient memory, and what the transient images would take up without sharing it.
+    transient_size, unaliased_size: int,
+}
+
+RenderGraph :: struct {
+    device: ^gpu.Device,
+    passes: [dynamic]RenderGraphPass,
+    images: [dynamic]RenderGraphImage,
+    buffers: [dynamic]RenderGraphBuffer,
+    transient_memory: gpu.MemoryBlock,
+    // Size of the transient images that don't have one.
+    width, height: int,
+    stats: RenderGraphStats,
+}
+
+render_graph_init :: proc(g: ^RenderGraph, device: ^gpu.Device) {
+    g.device = device
+}
+
+render_graph_deinit :: proc(g: ^RenderGraph) {
+    render_graph_release(g)
+    for &pass in g.passes {
+        delete(pass.images)
+        delete(pass.buffers)
+        delete(pass.attachments)
+    }
+    delete(g.passes)
+    delete(g.images)
+    delete(g.buffers)
+}
+
+// Transient images without a size get the size of the graph.
+render_graph_create_image :: proc(g: ^RenderGraph, name: cstring, spec: gpu.ImageSpecification) -> RGImage {
+    spec := spec
+    spec.tag = name
+    spec.device = g.device
+    append(&g.images, RenderGraphImage {
+        name = name,
+        spec = spec,
+    })
+    return RGImage(len(g.images) - 1)
+}
+
+// `image` has to stay where it is, it can be recreated as long as render_graph_compile is called after.
+render_graph_import_image :: proc(g: ^RenderGraph, name: cstring, image: ^gpu.Image, final_access := gpu.Access.None) -> RGImage {
+    append(&g.images, RenderGraphImage {
+        name = name,
+        imported = image,
+        final_access = final_access,
+    })
+    return RGImage(len(g.images) - 1)
+}
+
+render_graph_import_buffer :: proc(g: ^RenderGraph, name: cstring, buffer: ^gpu.Buffer) -> RGBuffer {
+    append(&g.buffers, RenderGraphBuffer {
+        name = name,
+        buffer = buffer,
+    })
+    return RGBuffer(len(g.buffers) - 1)
+}
+
+// Passes run in the order they are added. The pass name is also the name of its GPU zone.
+render_graph_add_pass :: proc(
+    g: ^RenderGraph,
+    name: string,
+    record: RenderGraphPassProc,
+    renderpass := gpu.RenderPass{},
+    contents := gpu.RenderPassContents.Inline,
+) -> RGPass {
+    append(&g.passes, RenderGraphPass {
+        name = name,
+        record = record,
+        renderpass = renderpass,
+        contents = contents,
+        enabled = true,
+    })
+    return RGPass(len(g.passes) - 1)
+}
+
+// The framebuffer attachments of a pass, in the order of its render pass. They are written by the pass.
+render_graph_attachments :: proc(g: ^RenderGraph, pass: RGPass, attachments: ..RGImage) {
+    p := &g.passes[pass]
+    for attachment in attachments {
+        append(&p.attachments, attachment)
+        depth := gpu.is_depth_format(render_graph_image_spec(g, attachment).format)
+        render_graph_use_image(g, pass, attachment, .DepthAttachmentWrite if depth else .ColorAttachmentWrite)
+    }
+}
+
+render_graph_use_image :: proc(g: ^RenderGraph, pass: RGPass, image: RGImage, access: gpu.Access) {
+    append(&g.passes[pass].images, RenderGraphUse{int(image), access})
+}
+
+render_graph_use_buffer :: proc(g: ^RenderGraph, pass: RGPass, buffer: RGBuffer, access: gpu.Access) {
+    append(&g.passes[pass].buffers, RenderGraphUse{int(buffer), access})
+}
+
+render_graph_pass :: proc(g: ^RenderGraph, pass: RGPass) -> ^RenderGraphPass {
+    return &g.passes[pass]
+}
+
+render_graph_image :: proc(g: ^RenderGraph, image: RGImage) -> ^gpu.Image {
+    rg_image := &g.images[image]
+    return rg_image.imported if rg_image.imported != nil else &rg_image.transient
+}
+
+// (Re)creates the transient images and the framebuffers, for a graph of `width` by `height`.
+// The GPU can't be using any of them.
+render_graph_compile :: proc(g: ^RenderGraph, width, height: int) {
+    tracy.Zone()
+    render_graph_release(g)
+    g.width, g.height = width, height
+
+    for &image in g.images {
+        image.first_pass, image.last_pass = -1, -1
+        if image.imported != nil {
+            image.state = {layout = image.imported.spec.layout}
+        }
+    }
+    for pass, p in g.passes {
+        for use in pass.images {
+            image := &g.images[use.resource]
+            if image.first_pass < 0 do image.first_pass = p
+            image.last_pass = p
+        }
+    }
+
+    Transient :: struct {
+        index: int,
+        requirements: gpu.MemoryRequirements,
+    }
+    transients := make([dynamic]Transient, context.temp_allocator)
+    block := gpu.MemoryRequirements {
+        alignment = 1,
+        type_bits = max(u32),
+    }
+    g.stats.unaliased_size = 0
+    for &image, i in g.images do if image.imported == nil {
+        spec := image.spec
+        if spec.width == 0 || spec.height == 0 {
+            spec.width, spec.height = width, height
+        }
+
+        requirements: gpu.MemoryRequirements
+        image.transient, requirements = gpu.create_unbound_image(spec)
+        image.size = requirements.size
+        append(&transients, Transient{i, requirements})
+
+        block.alignment = max(block.alignment, requirements.alignment)
+        block.type_bits &= requirements.type_bits
+        g.stats.unaliased_size += requirements.size
+    }
+
+    // Biggest first, each at the lowest offset that doesn't overlap an image that is used at the same time.
+    slice.sort_by(transients[:], proc(a, b: Transient) -> bool {
+        return a.requirements.size > b.requirements.size
+    })
+    // Sorted by offset, so a single walk finds the first gap.
+    placed := make([dynamic]int, context.temp_allocator)
+    for transient in transients {
+        image := &g.images[transient.index]
+        offset := 0
+        for other_index in placed {
+            other := &g.images[other_index]
+            if image.first_pass > other.last_pass || other.first_pass > image.last_pass do continue
+            if offset + image.size <= other.offset || other.offset + other.size <= offset do continue
+            offset = mem.align_forward_int(other.offset + other.size, transient.requirements.alignment)
+        }
+        image.offset = offset
+        block.size = max(block.size, offset + image.size)
+
+        at := len(placed)
+        for other_index, i in placed {
+            if g.images[other_index].offset > offset {
+                at = i
+                break
+            }
+        }
+        inject_at(&placed, at, transient.index)
+    }
+
+    if len(transients) > 0 {
+        if block.type_bits == 0 {
+            log_error(LC.Renderer, "Transient images of the render graph have no memory type in common.")
+        }
+        g.transient_memory = gpu.allocate_memory_block(g.device, block)
+        for transient in transients {
+            image := &g.images[transient.index]
+            gpu.bind_image_memory(&image.transient, g.transient_memory, image.offset)
+        }
+    }
+    g.stats.transient_size = block.size
+
+    for &pass in g.passes do if pass.renderpass.handle != 0 {
+        images := make([]gpu.Image, len(pass.attachments), context.temp_allocator)
+        for attachment, i in pass.attachments {
+            images[i] = render_graph_image(g, attachment)^
+        }
+        pass.framebuffer = gpu.create_framebuffer_from_images({
+            device = g.device,
+            renderpass = pass.renderpass,
+            width = images[0].spec.width,
+            height = images[0].spec.height,
+        }, images)
+    }
+}
+
+// Records the passes that are needed this frame. `user_data` is handed to every record proc.
+render_graph_execute :: proc(g: ^RenderGraph, cmd: gpu.CommandBuffer, user_data: rawptr) {
+    tracy.Zone()
+    live := render_graph_cull(g)
+
+    // Buffers are written by the host between frames, which the submit already makes visible.
+    for &buffer in g.buffers {
+        buffer.state = {}
+    }
+    for &image in g.images do if image.imported == nil {
+        image.state = {}
+    }
+
+    g.stats.passes = len(g.passes)
+    g.stats.culled_passes = 0
+    g.stats.barriers = 0
+    batch: gpu.BarrierBatch
+    for &pass, p in g.passes {
+        if !live[p] {
+            g.stats.culled_passes += 1
+            continue
+        }
+
+        for use in pass.images {
+            image := &g.images[use.resource]
+            discard := false
+            if image.imported == nil && image.state == {} {
+                // First use this frame. Whatever had this memory before has to be done with it.
+                discard = true
+                for &other in g.images {
+                    if other.imported != nil || &other == image || other.last_pass >= p do continue
+                    if image.offset + image.size <= other.offset || other.offset + other.size <= image.offset do continue
+                    image.state.written += other.state.written
+                    image.state.read += other.state.read
+                }
+            }
+            gpu.barrier_image(&batch, render_graph_image(g, RGImage(use.resource)), &image.state, use.access, discard)
+        }
+        for use in pass.buffers {
+            buffer := &g.buffers[use.resource]
+            gpu.barrier_buffer(&batch, buffer.buffer^, &buffer.state, use.access)
+        }
+
+        if gpu.do_zone(cmd, pass.name) {
+            g.stats.barriers += gpu.cmd_flush_barriers(cmd, &batch)
+            if pass.renderpass.handle != 0 {
+                if gpu.do_render_pass(cmd, pass.renderpass, pass.framebuffer, pass.contents) {
+                    pass.record(cmd, user_data)
+                }
+            } else {
+                pass.record(cmd, user_data)
+            }
+        }
+    }
+
+    for &image, i in g.images do if image.final_access != .None {
+        gpu.barrier_image(&batch, render_graph_image(g, RGImage(i)), &image.state, image.final_access)
+    }
+    g.stats.barriers += gpu.cmd_flush_barriers(cmd, &batch)
+}
+
+// Walks the passes backwards. A pass is needed when it's enabled and it has side effects or writes
+// something that a later needed pass reads, or that is an output of the graph.
+@(private = "file")
+render_graph_cull :: proc(g: ^RenderGraph) -> (live: []bool) {
+    live = make([]bool, len(g.passes), context.temp_allocator)
+    needed_images := make([]bool, len(g.images), context.temp_allocator)
+    needed_buffers := make([]bool, len(g.buffers), context.temp_allocator)
+    for image, i in g.images {
+        needed_images[i] = image.imported != nil && image.final_access != .None
+    }
+
+    #reverse for pass, p in g.passes {
+        if !pass.enabled do continue
+
+        keep := pass.side_effects
+        for use in pass.images {
+            keep ||= use.access in gpu.WRITE_ACCESSES && needed_images[use.resource]
+        }
+        for use in pass.buffers {
+            keep ||= use.access in gpu.WRITE_ACCESSES && needed_buffers[use.resource]
+        }
+        if !keep do continue
+
+        live[p] = true
+        for use in pass.images do if use.access not_in gpu.WRITE_ACCESSES {
+            needed_images[use.resource] = true
+        }
+        for use in pass.buffers do if use.access not_in gpu.WRITE_ACCESSES {
+            needed_buffers[use.resource] = true
+        }
+    }
+    return
+}
+
+@(private = "file")
+render_graph_image_spec :: proc(g: ^RenderGraph, image: RGImage) -> gpu.ImageSpecification {
+    rg_image := &g.images[image]
+    return rg_image.imported.spec if rg_image.imported != nil else rg_image.spec
+}
+
+@(private = "file")
+render_graph_release :: proc(g: ^RenderGraph) {
+    for &pass in g.passes do if pass.framebuffer.handle != 0 {
+        gpu.destroy_framebuffer(&pass.framebuffer)
+        delete(pass.framebuffer.color_attachments)
+        pass.framebuffer = {}
+    }
+    for &image in g.images do if image.imported == nil && image.transient.handle != 0 {
+        gpu.destroy_image(&image.transient)
+        image.transient = {}
+    }
+    gpu.free_memory_block(&g.transient_memory)
+}
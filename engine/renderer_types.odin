@@ -16,11 +16,41 @@ PushConstants :: struct {
 #assert(size_of(PushConstants) <= 128)
 
 DepthPassPushConstants :: struct {
-    model: mat4,
     light_space: mat4,
 }
 #assert(size_of(DepthPassPushConstants) <= 128)
 
+// Per-draw data, read by the vertex shaders with gl_InstanceIndex. Must match `InstanceData` in global.glsl (std430).
+InstanceData :: struct {
+    model: mat4,
+    entity_id: i32,
+    // Index into the material buffer, see `material_table_material`. Unused by depth only passes.
+    material: u32,
+    _: [2]i32,
+}
+#assert(size_of(InstanceData) == 80)
+
+MAX_INSTANCES :: 16 * 1024
+
+// A single storage buffer split in one region per frame in flight, so the descriptor never has to change.
+InstanceBuffer :: struct {
+    handle: gpu.Buffer,
+    // Number of instances written to the current frame's region.
+    count: int,
+    overflow_reported: bool,
+}
+
+// A run of identical draws, drawn with a single instanced draw call.
+InstanceBatch :: struct {
+    mesh: ^Mesh,
+    mesh_handle: AssetHandle,
+    lod: u8,
+    // Index into `DrawList.materials`. Unused for depth only passes.
+    material: u32,
+    first_instance: u32,
+    count: u32,
+}
+
 GlobalUniform :: struct {
     projection: mat4,
     view: mat4,
@@ -100,6 +130,7 @@ GlobalSet :: struct {
     global_data: UniformBuffer(GlobalData),
     uniform_buffer: UniformBuffer(GlobalUniform),
     debug_options: UniformBuffer(ShaderVisualizationOptions),
+    instances: InstanceBuffer,
 }
 
 SceneSet :: struct {
@@ -112,16 +143,7 @@ SceneSet :: struct {
     shadow_map: gpu.Image,
 }
 
-ObjectSet :: struct {
-    resource: gpu.Resource,
-    layout: gpu.ResourceLayout,
-    // pool: gpu.ResourcePool,
-
-    material: PbrMaterial,
-
-    albedo_image: gpu.Image,
-    normal_image: gpu.Image,
-}
+MATERIAL_TEXTURE_COUNT :: 5
 
 ShaderVisualizationOptions :: struct {
     shadow_cascade_boxes: b32,
@@ -141,4 +163,4 @@ visualization_options_to_shader :: proc(options: VisualizationOptions) -> (s: Sh
     if .ShadowCascadeBoxes in options do s.shadow_cascade_boxes = true
     if .ShadowCascadeColors in options do s.shadow_cascade_colors = true
     return
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -257,22 +257,7 @@ world_renderer_init :: proc(renderer: ^WorldRenderer) {
     // (In the Editor)
     // Display the [Post-Process Renderpass] Output in the Viewport window.
 
-    vertex_layout := gpu.vertex_layout({
-        name = "Position",
-        type = .Float3,
-    }, {
-        name = "Normal",
-        type = .Float3,
-    }, {
-        name = "Tangent",
-        type = .Float3,
-    }, {
-        name = "UV",
-        type = .Float2,
-    }, {
-        name = "Color",
-        type = .Float3,
-    })
+    vertex_layout := mesh_vertex_layout()
 
     // ================
     // DEPTH RENDERPASS
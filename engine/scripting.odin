@@ -56,6 +56,8 @@ ScriptType :: UUID
 ScriptVTable :: struct {
     object: i64,
     instance_table: i64,
+    // {__index = object}, shared by every instance table of the script.
+    metatable: i64,
 
     on_init: i64,
     on_update: i64,
@@ -131,17 +133,64 @@ create_scripting_engine :: proc() -> (engine: ScriptingEngine) {
     return
 }
 
-create_script_instance :: proc(script: ^LuaScript) -> (state: ScriptInstance) {
+// Every script instance of a world runs in the world's ScriptVM, instead of each one getting a lua state
+// of its own with the standard libraries, the exported api and its script loaded again. A script is
+// loaded once per VM, the first time an instance needs it, and every instance is just a table whose
+// metatable falls back to the script's class table. Scripts only run from world_update on the main thread,
+// so that is also one state per thread.
+//
+// Since the class table is shared, anything a script keeps in it or in top level locals is shared by all
+// of its instances. Per instance state belongs in `self`.
+ScriptVM :: struct {
+    state: ^lua.State,
+    // By script asset. Scripts that failed to load are in here too, with a zero `object`, so they aren't
+    // loaded again for every instance.
+    classes: map[AssetHandle]ScriptVTable,
+}
+
+destroy_script_vm :: proc(vm: ^ScriptVM) {
+    if vm.state != nil {
+        lua.close(vm.state)
+    }
+    delete(vm.classes)
+    vm^ = {}
+}
+
+// An instance of `script` in `vm`, creating the state and loading the script if needed. The instance
+// table is created by the component, when it's initialized.
+create_script_instance :: proc(vm: ^ScriptVM, handle: AssetHandle, script: ^LuaScript) -> (instance: ScriptInstance) {
     if script == nil {
         return {}
     }
 
-    log_debug(LC.ScriptingEngine, "Creating new script instance")
-    state.state = luaL.newstate()
-    L := state.state
+    if vm.state == nil {
+        log_debug(LC.ScriptingEngine, "Creating script VM")
+        vm.state = luaL.newstate()
+        luaL.openlibs(vm.state)
+        mani.init(vm.state, &mani.global_state)
+    }
 
-    type := generate_uuid()
-    luaL.openlibs(L)
+    class, ok := vm.classes[handle]
+    if !ok {
+        class = load_script_class(vm.state, script)
+        vm.classes[handle] = class
+    }
+    if class.object == 0 {
+        return {}
+    }
+
+    instance.vtable = class
+    instance.state = vm.state
+    instance.type = ScriptType(handle)
+    return
+}
+
+@(private = "file")
+load_script_class :: proc(L: ^lua.State, script: ^LuaScript) -> (class: ScriptVTable) {
+    log_debug(LC.ScriptingEngine, "Loading script class")
+    // The state is shared by the whole world, nothing can be left behind when loading fails.
+    top := lua.gettop(L)
+    defer lua.settop(L, top)
 
     b := cstring(&script.bytecode[0])
 
@@ -159,25 +208,28 @@ create_script_instance :: proc(script: ^LuaScript) -> (state: ScriptInstance) {
         log_error(LC.ScriptingEngine, "Script did not return a global table.")
         return
     }
-    state.object = i64(luaL.ref(L, lua.REGISTRYINDEX))
-    lua.rawgeti(L, lua.REGISTRYINDEX, state.object)
 
     lua.getfield(L, -1, "on_init")
     if !lua.isfunction(L, -1) {
         log_error(LC.ScriptingEngine, "on_init is not a function")
         return
     }
-
-    state.on_init = i64(luaL.ref(L, lua.REGISTRYINDEX))
-
-    lua.getfield(L, -1, "on_update")
+    lua.getfield(L, -2, "on_update")
     if !lua.isfunction(L, -1) {
         log_error(LC.ScriptingEngine, "on_update is not a function")
         return
     }
-    state.on_update = i64(luaL.ref(L, lua.REGISTRYINDEX))
 
-    mani.init(L, &mani.global_state)
+    // Stack: class, on_init, on_update
+    class.on_update = i64(luaL.ref(L, lua.REGISTRYINDEX))
+    class.on_init = i64(luaL.ref(L, lua.REGISTRYINDEX))
+
+    lua.newtable(L)
+    lua.pushvalue(L, -2)
+    lua.setfield(L, -2, "__index")
+    class.metatable = i64(luaL.ref(L, lua.REGISTRYINDEX))
+
+    class.object = i64(luaL.ref(L, lua.REGISTRYINDEX))
     return
 }
 
@@ -56,7 +56,7 @@ lua_entity_set_position :: proc(le: LuaEntity, position: vec3) {
     go := get_object(le.world, EntityHandle(le.entity))
     if go == nil do return
 
-    go.transform.local_position = position
+    transform_local_position(go)^ = position
 }
 
 //!Gets the local position of the entity.
@@ -70,7 +70,7 @@ lua_entity_get_position :: proc(le: LuaEntity) -> vec3 {
     go := get_object(le.world, EntityHandle(le.entity))
     if go == nil do return vec3{}
 
-    return go.transform.local_position
+    return transform_local_position(go)^
 }
 
 @(LuaExport = {
@@ -81,7 +81,7 @@ lua_entity_get_forward :: proc(le: LuaEntity) -> vec3 {
     go := get_object(le.world, EntityHandle(le.entity))
     if go == nil do return vec3{}
 
-    return get_forward(go.transform.local_rotation)
+    return get_forward(transform_local_rotation(go)^)
 }
 
 //!Gets the global position of the entity.
@@ -95,7 +95,7 @@ lua_entity_get_global_position :: proc(le: LuaEntity) -> vec3 {
     go := get_object(le.world, EntityHandle(le.entity))
     if go == nil do return vec3{}
 
-    return go.transform.position
+    return transform_world_position(go)
 }
 
 @(LuaExport = {
@@ -106,7 +106,7 @@ lua_entity_translate :: proc(le: LuaEntity, offset: vec3) {
     go := get_object(le.world, EntityHandle(le.entity))
     if go == nil do return
 
-    go.transform.local_position += offset
+    transform_local_position(go)^ += offset
 }
 
 @(LuaExport = {
@@ -130,6 +130,60 @@ lua_entity_is_active :: proc(le: LuaEntity) -> bool {
     return go.enabled
 }
 
+// Scripts run while world_update iterates the world, so the structural changes below are recorded and
+// applied at the end of the update, see entity_commands.odin.
+
+//!Deletes the entity, along with its children, at the end of the frame.
+@(LuaExport = {
+    Name = "destroy",
+    MethodOf = LuaEntity,
+})
+lua_entity_destroy :: proc(le: LuaEntity) {
+    deferred_delete_object(le.world, EntityHandle(le.entity))
+}
+
+//!Creates a child entity. It is added to the world at the end of the frame, but the returned
+//!entity can already be used to add components.
+@(LuaExport = {
+    Name = "create_child",
+    MethodOf = LuaEntity,
+})
+lua_entity_create_child :: proc(le: LuaEntity, name: string) -> LuaEntity {
+    handle := deferred_new_object(le.world, name, EntityHandle(le.entity))
+    return LuaEntity{world = le.world, entity = u64(handle)}
+}
+
+//!Adds the component named `component`, like "MeshRenderer", at the end of the frame.
+//!An existing component of the same type is replaced.
+@(LuaExport = {
+    Name = "add_component",
+    MethodOf = LuaEntity,
+})
+lua_entity_add_component :: proc(le: LuaEntity, component: string) -> bool {
+    id, ok := get_component_typeid_from_name(component)
+    if !ok {
+        log_error(LC.UserScript, "Unknown component '%v'", component)
+        return false
+    }
+    deferred_add_component(le.world, EntityHandle(le.entity), id)
+    return true
+}
+
+//!Removes the component named `component` at the end of the frame.
+@(LuaExport = {
+    Name = "remove_component",
+    MethodOf = LuaEntity,
+})
+lua_entity_remove_component :: proc(le: LuaEntity, component: string) -> bool {
+    id, ok := get_component_typeid_from_name(component)
+    if !ok {
+        log_error(LC.UserScript, "Unknown component '%v'", component)
+        return false
+    }
+    deferred_remove_component(le.world, EntityHandle(le.entity), id)
+    return true
+}
+
 @(LuaExport)
 lua_entity_to_string :: proc(le: LuaEntity) -> string {
     go := get_object(le.world, EntityHandle(le.entity))
@@ -184,6 +238,17 @@ api_find_entity_by_name :: proc(name: string) -> LuaEntity {
     return {}
 }
 
+//!Creates an entity at the root of the scene. It is added at the end of the frame, but the returned
+//!entity can already be used to add components.
+@(LuaExport = {
+    Module = "Scene",
+    Name = "create_entity",
+})
+api_create_entity :: proc(name: string) -> LuaEntity {
+    world := EngineInstance.world
+    return LuaEntity{world = world, entity = u64(deferred_new_object(world, name))}
+}
+
 //!Returns whether the `key` is being pressed. This will keep returning true
 //!while the key is being pressed.
 @(LuaExport = {
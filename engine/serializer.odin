@@ -750,10 +750,70 @@ end
 return tableToLuaStringWithTableName
 `
 
+LUA_STRIP_EQUAL :: `
+local function strip(t, base)
+    for key, value in pairs(t) do
+        local other = base[key]
+        if type(value) == "table" and type(other) == "table" then
+            strip(value, other)
+            if next(value) == nil then t[key] = nil end
+        elseif value == other then
+            t[key] = nil
+        end
+    end
+end
+
+return strip
+`
+
+// Removes the fields of the table `name` that have the same value in the table `base`, recursing into
+// nested tables. Both are fields of the current table. `base` is removed afterwards, and so is `name`
+// when none of its fields are left.
+serialize_strip_equal_fields :: proc(s: ^SerializeContext, name, base: string) {
+    assert(s.mode == .Serialize, "Cannot strip fields in Deserialize mode.")
+    L := s.L
+    name := strings.clone_to_cstring(name, context.temp_allocator)
+    base := strings.clone_to_cstring(base, context.temp_allocator)
+
+    if luaL.dostring(L, LUA_STRIP_EQUAL) != lua.OK {
+        log.error("Error loading strip function")
+        return
+    }
+
+    lua.getfield(L, -2, name)
+    lua.getfield(L, -3, base)
+    if lua.pcall(L, 2, 0, 0) != lua.OK {
+        log.errorf("Error calling strip: %v", lua.tostring(L, -1))
+        lua.pop(L, 1)
+        return
+    }
+
+    lua.pushnil(L)
+    lua.setfield(L, -2, base)
+
+    lua.getfield(L, -1, name)
+    lua.pushnil(L)
+    if lua.next(L, -2) == 0 {
+        lua.pop(L, 1)
+        lua.pushnil(L)
+        lua.setfield(L, -2, name)
+    } else {
+        // The key and value next pushed, and the table.
+        lua.pop(L, 3)
+    }
+}
+
 serialize_dump_to_file :: serialize_dump
 
 // Converts the config into a string and writes it to the file located at `output`.
 serialize_dump :: proc(s: ^SerializeContext, output: string) {
+    data, ok := serialize_dump_to_string(s, context.temp_allocator)
+    if !ok do return
+    os.write_entire_file(output, transmute([]byte)data)
+}
+
+// Converts the config into a string. Keys are sorted, so equal configs give equal strings.
+serialize_dump_to_string :: proc(s: ^SerializeContext, allocator := context.allocator) -> (data: string, ok: bool) {
     assert(s.table_count == 0, "Did not close all the tables")
     L := s.L
 
@@ -770,6 +830,7 @@ serialize_dump :: proc(s: ^SerializeContext, output: string) {
         return
     }
 
-    data := transmute([]byte)lua.tostring(L, -1)
-    os.write_entire_file(output, data)
+    data = strings.clone(lua.tostring(L, -1), allocator)
+    lua.pop(L, 1)
+    return data, true
 }
@@ -8,15 +8,17 @@ import "core:path/slashpath"
 import "base:runtime"
 import "core:strings"
 import "shaderc"
-import fs "filesystem"
 import gl "vendor:OpenGL"
 import spvc "spirv-cross"
-import "core:time"
+import "core:slice"
+import "core:thread"
 import "gpu"
+import tracy "packages:odin-tracy"
 
 ShaderKind :: enum {
     Vertex,
     Fragment,
+    Compute,
 }
 
 @(asset)
@@ -30,101 +32,39 @@ Shader :: struct {
     vertex, fragment: string,
 }
 
-@(private="file")
-_check_shader_cache :: proc(path: string) -> (bytecode: []byte, ok: bool) {
-    when ODIN_OS == .Windows {
-        // @note This is stupid, raise an issue about this on Odin discord/repo?
-        cwd := os.get_current_directory(context.temp_allocator)
-    } else {
-        cwd := os.get_current_directory()
-    }
-
-    cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".bin", allocator = context.temp_allocator)
-    source_path := make_tpath(cwd, path)
-    source_info, _ := os.stat(source_path)
-
-    cache_info, _ := os.stat(cache_path)
-    if time.diff(source_info.modification_time, cache_info.modification_time) < 0 {
-        return {}, false
-    }
-    // if source_info.modification_time
-    return os.read_entire_file(cache_path)
-}
-
-@(private = "file")
-read_shader_cache :: proc(path: string) -> (vertex, fragment: []byte, ok: bool) {
-    when ODIN_OS == .Windows {
-        // @note This is stupid, raise an issue about this on Odin discord/repo?
-        cwd := os.get_current_directory(context.temp_allocator)
-    } else {
-        cwd := os.get_current_directory()
+load_shader_stage :: proc(path: string, source: string, shader_kind: ShaderKind, force_compile := false, report_errors := true) -> (bytecode: []byte, ok: bool) {
+    tracy.Zone()
+    // Preprocessing is cheap next to compiling, and it's the only way to know what the includes
+    // currently contain.
+    include_ctx := ShaderIncludeContext {
+        ctx = context,
+        includes = make([dynamic]string, context.temp_allocator),
     }
+    preprocessed := preprocess_shader_source(path, source, shader_kind, &include_ctx, report_errors) or_return
+    shader_track_includes(path, shader_kind, include_ctx.includes[:])
 
-    vertex_cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".vbin", allocator = context.temp_allocator)
-    fragment_cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".fbin", allocator = context.temp_allocator)
-
-    source_path := make_tpath(cwd, path)
-    source_info, _ := os.stat(source_path)
-
-    cache_info, _ := os.stat(vertex_cache_path)
-    if time.diff(source_info.modification_time, cache_info.modification_time) < 0 {
-        return
+    key := shader_cache_key(preprocessed, shader_kind, fmt.tprint(shader_stage_defines(shader_kind)))
+    if !force_compile {
+        if cached, found := shader_cache_read(key); found {
+            return cached, true
+        }
     }
 
-    vertex = os.read_entire_file(vertex_cache_path) or_return
-    fragment = os.read_entire_file(fragment_cache_path) or_return
-    log_debug(LC.Engine, "%v %v ", len(vertex), len(fragment))
-    ok = true
-    return
-}
-
-@(private = "file")
-write_shader_cache :: proc(vertex, fragment: []byte, path: string) {
-    vertex_cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".vbin", allocator = context.temp_allocator)
-    fs.make_directory_recursive(filepath.dir(vertex_cache_path, context.temp_allocator))
-    fragment_cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".fbin", allocator = context.temp_allocator)
-    fs.make_directory_recursive(filepath.dir(fragment_cache_path, context.temp_allocator))
-
-    log_debug(LC.Engine, "Writing shader caches to %v and %v", vertex_cache_path, fragment_cache_path)
-    os.write_entire_file(vertex_cache_path, vertex)
-    os.write_entire_file(fragment_cache_path, fragment)
-}
-
-load_shader_stage :: proc(path: string, source: string, shader_kind: ShaderKind, force_compile := false) -> (bytecode: []byte, ok: bool) {
-    // cache, found := check_shader_cache(path)
-    // if found && !force_compile {
-    //     log_debug(LC.Engine, "CACHE FOUND")
-    //     bytecode, ok = cache, true
-    // } else {
-    //     log_debug(LC.Engine, "CACHE NOT FOUND - COMPILING")
-    //     cache_path := concat(make_tpath(project_get_cache_folder(EditorInstance.active_project), path), ".bin", allocator = context.temp_allocator)
-    //     if !os.write_entire_file(cache_path, bytecode) {
-    //         log_error(LC.Engine, "Could not write shader cache for '%v' of type '%v'", path, shader_kind)
-    //     }
-    // }
-
-    bytecode, ok = compile_shader_source(path, source, shader_kind)
-    return
+    bytecode = compile_shader_source(path, source, shader_kind, report_errors) or_return
+    shader_cache_write(key, bytecode)
+    return bytecode, true
 }
 
 shader_load_from_file :: proc(path: string, pipeline_spec: Maybe(gpu.PipelineSpecification) = {}, force_compile := false) -> (shader: Shader, ok: bool) {
-    vertex, fragment, found := read_shader_cache(path)
+    shader_source := os.read_entire_file(path, context.temp_allocator) or_return
+    vertex_src, fragment_src, compute_src := split_shader(string(shader_source), context.temp_allocator)
 
-    if !found || force_compile {
-        log_debug(LC.Engine, "CACHE NOT FOUND - COMPILING")
-        shader_source := os.read_entire_file(path) or_return
-        vertex_src, fragment_src := split_shader(string(shader_source))
-
-        vertex   = load_shader_stage(path, vertex_src, .Vertex, force_compile) or_return
-        fragment = load_shader_stage(path, fragment_src, .Fragment, force_compile) or_return
-        log_debug(LC.Engine, "%v %v ", len(vertex), len(fragment))
-
-        write_shader_cache(vertex, fragment, path)
-    }
-
-    shader_spec := gpu.ShaderSpecification {
-        vertex_spirv = vertex,
-        fragment_spirv = fragment,
+    shader_spec: gpu.ShaderSpecification
+    if compute_src != "" {
+        shader_spec.compute_spirv = load_shader_stage(path, compute_src, .Compute, force_compile) or_return
+    } else {
+        shader_spec.vertex_spirv = load_shader_stage(path, vertex_src, .Vertex, force_compile) or_return
+        shader_spec.fragment_spirv = load_shader_stage(path, fragment_src, .Fragment, force_compile) or_return
     }
     shader.shader = gpu.create_shader(&Renderer3DInstance.device, shader_spec)
 
@@ -148,15 +88,62 @@ new_shader :: proc(path: string, pipeline_spec: Maybe(gpu.PipelineSpecification)
 
 shader_reload :: proc(shader: ^Shader, path: string) {
     log_debug(LC.AssetSystem, "Shader reload requested")
-    new_shader, ok := shader_load_from_file(path, shader.pipeline_spec, true)
+    // The cache is keyed on the contents, an edited shader can't hit a stale entry.
+    new_shader, ok := shader_load_from_file(path, shader.pipeline_spec)
     if ok {
         shader^ = new_shader
     }
 }
 
+// Compiles every stage of `paths` on a thread pool, so loading the shaders afterwards only has to
+// read the cache. Anything that fails is left for the load to compile again and report.
+shader_precompile :: proc(paths: []string) {
+    tracy.Zone()
+    ShaderStageJob :: struct {
+        path, source: string,
+        kind: ShaderKind,
+        logger: log.Logger,
+    }
+
+    jobs := make([dynamic]ShaderStageJob, 0, len(paths) * len(ShaderKind), context.temp_allocator)
+    for path in paths {
+        data, ok := os.read_entire_file(path, context.temp_allocator)
+        if !ok do continue
+
+        vertex, fragment, compute := split_shader(string(data), context.temp_allocator)
+        if compute != "" {
+            append(&jobs, ShaderStageJob{path = path, source = compute, kind = .Compute, logger = context.logger})
+            continue
+        }
+        append(&jobs,
+            ShaderStageJob{path = path, source = vertex, kind = .Vertex, logger = context.logger},
+            ShaderStageJob{path = path, source = fragment, kind = .Fragment, logger = context.logger})
+    }
+    if len(jobs) == 0 do return
+
+    pool: thread.Pool
+    thread.pool_init(&pool, context.allocator, clamp(os.processor_core_count() - 1, 1, len(jobs)))
+    defer thread.pool_destroy(&pool)
+
+    for &job, i in jobs {
+        thread.pool_add_task(&pool, context.allocator, proc(task: thread.Task) {
+            job := cast(^ShaderStageJob) task.data
+            context.logger = job.logger
+            tracy.ZoneN("Shader Stage Job")
+
+            bytecode, ok := load_shader_stage(job.path, job.source, job.kind, report_errors = false)
+            if ok do delete(bytecode)
+            free_all(context.temp_allocator)
+        }, &job, i)
+    }
+
+    thread.pool_start(&pool)
+    thread.pool_finish(&pool)
+}
+
 // Editor-Only
-compile_shader_source :: proc(file: string, source: string, shader_kind: ShaderKind) -> (bytecode: []byte, ok: bool) {
-    bytecode = compile_to_spirv_vulkan(transmute([]byte) source, shader_kind, file) or_return
+compile_shader_source :: proc(file: string, source: string, shader_kind: ShaderKind, report_errors := true) -> (bytecode: []byte, ok: bool) {
+    bytecode = compile_to_spirv_vulkan(transmute([]byte) source, shader_kind, file, report_errors) or_return
 
     log_info(LC.Engine, "Shader Reflection for %v:", file)
     if !reflect_shader(bytecode, file, shader_kind) {
@@ -166,42 +153,107 @@ compile_shader_source :: proc(file: string, source: string, shader_kind: ShaderK
     return bytecode, true
 }
 
-compile_to_spirv_vulkan :: proc(source: []byte, shader_kind: ShaderKind, name: string) -> (bytecode: []byte, ok: bool) {
-    shader_kind_to_shaderc :: proc(kind: ShaderKind) -> shaderc.ShaderKind {
-        switch kind {
-        case .Vertex: return .glsl_vertex_shader
-        case .Fragment: return .glsl_fragment_shader
-        }
-        unreachable()
+@(private = "file")
+ShaderDefine :: struct {
+    name, value: string,
+}
+
+// Part of the cache key.
+@(private = "file")
+shader_stage_defines :: proc(kind: ShaderKind) -> [2]ShaderDefine {
+    switch kind {
+    case .Vertex:   return {{"EDITOR", ""}, {"Vertex", "main"}}
+    case .Fragment: return {{"EDITOR", ""}, {"Fragment", "main"}}
+    case .Compute:  return {{"EDITOR", ""}, {"Compute", "main"}}
     }
-    compiler := shaderc.compiler_initialize()
-    if compiler == nil {
-        log.errorf("Failed to initialize shader compiler for Vulkan.")
-        return
+    unreachable()
+}
+
+@(private = "file")
+shader_kind_to_shaderc :: proc(kind: ShaderKind) -> shaderc.ShaderKind {
+    switch kind {
+    case .Vertex: return .glsl_vertex_shader
+    case .Fragment: return .glsl_fragment_shader
+    case .Compute: return .glsl_compute_shader
     }
+    unreachable()
+}
 
+// The same options are used for preprocessing and compiling, so the cache key matches what gets compiled.
+// Changing them requires bumping SHADER_CACHE_VERSION.
+@(private = "file")
+vulkan_compile_options :: proc(shader_kind: ShaderKind, include_ctx: ^ShaderIncludeContext) -> ^shaderc.CompileOptions {
     options := shaderc.compile_options_initialize()
     shaderc.compile_options_set_target_env(options, .vulkan, .vulkan_1_3)
     shaderc.compile_options_set_optimization_level(options, .performance)
 
-    def_name: cstring = "EDITOR"
-    shaderc.compile_options_add_macro_definition(options, def_name, len(def_name), nil, 0)
-
-    if shader_kind == .Vertex {
-        name :: "Vertex"
-        value :: "main"
-        shaderc.compile_options_add_macro_definition(options, name, len(name), value, len(value))
-    } else {
-        name :: "Fragment"
-        value :: "main"
-        shaderc.compile_options_add_macro_definition(options, name, len(name), value, len(value))
+    for define in shader_stage_defines(shader_kind) {
+        shaderc.compile_options_add_macro_definition(options,
+            cstring(raw_data(define.name)), len(define.name),
+            cstring(raw_data(define.value)), len(define.value))
     }
 
-    ctx := context
-    shaderc.compile_options_set_include_callbacks(options, include_resolve, include_result_release, &ctx)
+    shaderc.compile_options_set_include_callbacks(options, include_resolve, include_result_release, include_ctx)
     shaderc.compile_options_set_source_language(options, .glsl)
     shaderc.compile_options_set_vulkan_rules_relaxed(options, true)
     shaderc.compile_options_set_generate_debug_info(options)
+    return options
+}
+
+// Returns the source with all includes and macros expanded, allocated with the temp allocator.
+@(private = "file")
+preprocess_shader_source :: proc(
+    name, source: string,
+    shader_kind: ShaderKind,
+    include_ctx: ^ShaderIncludeContext,
+    report_errors := true,
+) -> (preprocessed: string, ok: bool) {
+    tracy.Zone()
+    compiler := shaderc.compiler_initialize()
+    if compiler == nil {
+        log.errorf("Failed to initialize shader compiler for Vulkan.")
+        return
+    }
+    defer shaderc.compiler_release(compiler)
+
+    options := vulkan_compile_options(shader_kind, include_ctx)
+    defer shaderc.compile_options_release(options)
+
+    result := shaderc.compile_into_preprocessed_text(
+        compiler,
+        cstring(raw_data(source)),
+        len(source),
+        shader_kind_to_shaderc(shader_kind),
+        cstr(name), "main", options)
+    defer shaderc.result_release(result)
+
+    if status := shaderc.result_get_compilation_status(result); status != .success {
+        if report_errors {
+            log.errorf("Error preprocessing shader '%v': %v", name, status)
+            log.errorf("\t%v", shaderc.result_get_error_message(result))
+        }
+        return
+    }
+
+    text := shaderc.result_get_bytes(result)[:shaderc.result_get_length(result)]
+    return strings.clone(string(text), context.temp_allocator), true
+}
+
+compile_to_spirv_vulkan :: proc(source: []byte, shader_kind: ShaderKind, name: string, report_errors := true) -> (bytecode: []byte, ok: bool) {
+    tracy.Zone()
+    compiler := shaderc.compiler_initialize()
+    if compiler == nil {
+        log.errorf("Failed to initialize shader compiler for Vulkan.")
+        return
+    }
+    defer shaderc.compiler_release(compiler)
+
+    include_ctx := ShaderIncludeContext {
+        ctx = context,
+        includes = make([dynamic]string, context.temp_allocator),
+    }
+    options := vulkan_compile_options(shader_kind, &include_ctx)
+    defer shaderc.compile_options_release(options)
 
     result := shaderc.compile_into_spv(
         compiler,
@@ -209,9 +261,11 @@ compile_to_spirv_vulkan :: proc(source: []byte, shader_kind: ShaderKind, name: s
         len(source),
         shader_kind_to_shaderc(shader_kind),
         cstr(name), "main", options)
+    defer shaderc.result_release(result)
 
     status := shaderc.result_get_compilation_status(result)
     if status != .success {
+        if !report_errors do return
         errors := shaderc.result_get_num_errors(result)
         warnings := shaderc.result_get_num_warnings(result)
         editor_push_notification(EditorInstance, "Shader compilation failed. Check the console for more info.", .Error)
@@ -221,7 +275,8 @@ compile_to_spirv_vulkan :: proc(source: []byte, shader_kind: ShaderKind, name: s
         return
     }
 
-    bytecode = shaderc.result_get_bytes(result)[:shaderc.result_get_length(result)]
+    // The result owns the bytes.
+    bytecode = slice.clone(shaderc.result_get_bytes(result)[:shaderc.result_get_length(result)])
     ok = true
     return
 }
@@ -231,6 +286,7 @@ compile_to_spirv_opengl :: proc(source: []byte, shader_kind: ShaderKind, name: s
         switch kind {
         case .Vertex: return .glsl_vertex_shader
         case .Fragment: return .glsl_fragment_shader
+        case .Compute: return .glsl_compute_shader
         }
         unreachable()
     }
@@ -249,8 +305,11 @@ compile_to_spirv_opengl :: proc(source: []byte, shader_kind: ShaderKind, name: s
     shaderc.compile_options_set_generate_debug_info(options)
     shaderc.compile_options_set_optimization_level(options, .performance)
 
-    ctx := context
-    shaderc.compile_options_set_include_callbacks(options, include_resolve, include_result_release, &ctx)
+    include_ctx := ShaderIncludeContext {
+        ctx = context,
+        includes = make([dynamic]string, context.temp_allocator),
+    }
+    shaderc.compile_options_set_include_callbacks(options, include_resolve, include_result_release, &include_ctx)
 
     result := shaderc.compile_into_spv(
         compiler, 
@@ -354,6 +413,13 @@ reflect_shader :: proc(spirv_bytecode: []byte, name: string, stage: ShaderKind)
     return true
 }
 
+@(private = "file")
+ShaderIncludeContext :: struct {
+    ctx: runtime.Context,
+    // Every file that got included, relative to the working directory. Uses `ctx`'s temp allocator.
+    includes: [dynamic]string,
+}
+
 @(private = "file")
 include_resolve :: proc "c" (
     user_data: rawptr,
@@ -362,12 +428,15 @@ include_resolve :: proc "c" (
     requesting_source: cstring,
     include_depth: c.size_t,
 ) -> ^shaderc.IncludeResult {
-    context = (cast(^runtime.Context)user_data)^
+    include_ctx := cast(^ShaderIncludeContext)user_data
+    context = include_ctx.ctx
     result := new(shaderc.IncludeResult)
 
     switch type {
     case .relative:
         project_path := filepath.join({"assets", "shaders", string(requested_source)}, context.temp_allocator)
+        tracked_path, _ := filepath.to_slash(project_path, context.temp_allocator)
+        append(&include_ctx.includes, tracked_path)
         full_path, found := filepath.abs(project_path, context.temp_allocator)
         assert(found)
 
@@ -389,15 +458,25 @@ include_resolve :: proc "c" (
 }
 
 @(private = "file")
-include_result_release :: proc "c" (user_data: rawptr, include_result: ^shaderc.IncludeResult) {}
+include_result_release :: proc "c" (user_data: rawptr, include_result: ^shaderc.IncludeResult) {
+    context = (cast(^ShaderIncludeContext)user_data).ctx
+    // A failed include points content at a literal.
+    if include_result.source != "" {
+        delete(include_result.content)
+    }
+    free(include_result)
+}
 
-// Splits a *.shader file into GLSL vertex and GLSL fragment source.
+// Splits a *.shader file into GLSL vertex and GLSL fragment source. Files with a compute section
+// are compute shaders, `compute` is empty for everything else.
 @(private = "file")
-split_shader :: proc(source: string, allocator := context.allocator) -> (vertex: string, fragment: string) {
-    common_sb, vertex_sb, fragment_sb: strings.Builder
+split_shader :: proc(source: string, allocator := context.allocator) -> (vertex: string, fragment: string, compute: string) {
+    common_sb, vertex_sb, fragment_sb, compute_sb: strings.Builder
     strings.builder_init(&common_sb, allocator = context.temp_allocator)
     strings.builder_init(&vertex_sb, allocator = context.temp_allocator)
     strings.builder_init(&fragment_sb, allocator = context.temp_allocator)
+    strings.builder_init(&compute_sb, allocator = context.temp_allocator)
+    has_compute := false
 
     sb: ^strings.Builder = &common_sb
 
@@ -416,6 +495,9 @@ split_shader :: proc(source: string, allocator := context.allocator) -> (vertex:
                     sb = &vertex_sb
                 } else if type == "fragment" {
                     sb = &fragment_sb
+                } else if type == "compute" {
+                    sb = &compute_sb
+                    has_compute = true
                 }
             } else {
                 strings.write_string(sb, line)
@@ -433,5 +515,8 @@ split_shader :: proc(source: string, allocator := context.allocator) -> (vertex:
 
     vertex = strings.concatenate({common_source, vertex_source})
     fragment = strings.concatenate({common_source, fragment_source})
+    if has_compute {
+        compute = strings.concatenate({common_source, strings.to_string(compute_sb)})
+    }
     return
 }
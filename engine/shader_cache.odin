@@ -0,0 +1,117 @@
+package engine
+import "core:fmt"
+import "core:hash"
+import "core:os"
+import "core:path/filepath"
+import "core:slice"
+import "core:strings"
+import "core:sync"
+import fs "filesystem"
+import tracy "packages:odin-tracy"
+
+// Compiled SPIR-V is cached in the project cache folder under a hash of everything that goes into
+// the compiler: the preprocessed stage source, which has every #include expanded, the macro
+// definitions and SHADER_CACHE_VERSION. An edit to any included file changes the hash, so there is
+// nothing to invalidate and no timestamps to compare.
+
+// Bump when the compile options change, they are not part of the hash.
+SHADER_CACHE_VERSION :: 1
+@(private = "file")
+SHADER_CACHE_FOLDER :: "shaders"
+
+// Files included by each shader, so hot reload knows which shaders to rebuild when one of them changes.
+// Paths are relative to the working directory and use forward slashes, like asset paths.
+// Tracked per stage, stages include different files and get compiled on different threads.
+@(private = "file")
+g_shader_includes: struct {
+    mutex: sync.Mutex,
+    // Included file -> shader stages that include it.
+    dependents: map[string][dynamic]ShaderStageRef,
+}
+
+@(private = "file")
+ShaderStageRef :: struct {
+    shader: string,
+    kind: ShaderKind,
+}
+
+@(private = "file")
+SPIRV_MAGIC :: u32(0x07230203)
+
+shader_cache_key :: proc(preprocessed: string, kind: ShaderKind, defines: string) -> u64 {
+    h := hash.fnv64a(transmute([]byte) preprocessed)
+    h = hash.fnv64a(transmute([]byte) defines, h)
+    header := [2]u64{SHADER_CACHE_VERSION, u64(kind)}
+    return hash.fnv64a(([^]byte)(&header)[:size_of(header)], h)
+}
+
+// Anything that doesn't look like SPIR-V is treated as a miss, it gets compiled and overwritten.
+shader_cache_read :: proc(key: u64, allocator := context.allocator) -> (bytecode: []byte, ok: bool) {
+    bytecode = os.read_entire_file(shader_cache_path(key), allocator) or_return
+    if len(bytecode) < 5 * size_of(u32) || len(bytecode) % size_of(u32) != 0 ||
+        (cast(^u32)raw_data(bytecode))^ != SPIRV_MAGIC {
+        log_warning(LC.Engine, "Ignoring invalid shader cache entry '%v'", shader_cache_path(key))
+        delete(bytecode, allocator)
+        return nil, false
+    }
+    return bytecode, true
+}
+
+shader_cache_write :: proc(key: u64, bytecode: []byte) {
+    path := shader_cache_path(key)
+    fs.make_directory_recursive(filepath.dir(path, context.temp_allocator))
+    if !os.write_entire_file(path, bytecode) {
+        log_warning(LC.Engine, "Could not write shader cache to '%v'", path)
+    }
+}
+
+// Replaces the includes recorded for the `kind` stage of `shader`.
+shader_track_includes :: proc(shader: string, kind: ShaderKind, includes: []string) {
+    if sync.guard(&g_shader_includes.mutex) {
+        for _, &dependents in g_shader_includes.dependents {
+            for i := 0; i < len(dependents); {
+                if dependents[i].shader == shader && dependents[i].kind == kind {
+                    delete(dependents[i].shader)
+                    unordered_remove(&dependents, i)
+                } else {
+                    i += 1
+                }
+            }
+        }
+
+        for include in includes {
+            dependents, found := &g_shader_includes.dependents[include]
+            if !found {
+                g_shader_includes.dependents[strings.clone(include)] = {}
+                dependents = &g_shader_includes.dependents[include]
+            }
+            if !slice.contains(dependents[:], ShaderStageRef{shader, kind}) {
+                append(dependents, ShaderStageRef{strings.clone(shader), kind})
+            }
+        }
+    }
+}
+
+// Returns the shaders that include `file`, directly or not.
+shader_dependents :: proc(file: string, allocator := context.allocator) -> []string {
+    tracy.Zone()
+    result := make([dynamic]string, allocator)
+    if sync.guard(&g_shader_includes.mutex) {
+        if dependents, found := g_shader_includes.dependents[file]; found {
+            for dependent in dependents {
+                if !slice.contains(result[:], dependent.shader) {
+                    append(&result, strings.clone(dependent.shader, allocator))
+                }
+            }
+        }
+    }
+    return result[:]
+}
+
+@(private = "file")
+shader_cache_path :: proc(key: u64) -> string {
+    return make_tpath(
+        project_get_cache_folder(EditorInstance.active_project, context.temp_allocator),
+        SHADER_CACHE_FOLDER,
+        fmt.tprintf("%016x.spv", key))
+}
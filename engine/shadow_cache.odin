@@ -0,0 +1,178 @@
+package engine
+import "core:math"
+import "core:math/linalg"
+import "gpu"
+
+// Cached shadow cascades. Most shadow casters and the sun never move, so the cascades are drawn in two
+// parts. Static casters (entities flagged .Static) go into a cached copy of the cascades that is only
+// redrawn when a cascade moves, the light turns or a static caster changes. Every frame that copy is
+// copied into the shadow map and the dynamic casters are drawn on top.
+//
+// For the copy to stay valid, a cascade can't follow the camera exactly. It covers the bounding sphere
+// of its part of the view frustum plus a margin, so its size doesn't change when the camera turns, and
+// it only moves once the sphere leaves the margin. Its center is snapped to shadow map texels, so shadow
+// edges don't shimmer when it does.
+
+// How far the camera can move, as a fraction of the cascade radius, before the cascade follows.
+SHADOW_CACHE_MARGIN :: 0.2
+// Casters up to this many cascade extents towards the light still end up in the shadow map.
+SHADOW_DEPTH_RANGE :: 10
+// Cosine of the angle the light can turn before the cache is redrawn.
+SHADOW_CACHE_DIRECTION_EPSILON :: 0.99999
+
+ShadowCasters :: enum {
+    All,
+    Static,
+    Dynamic,
+}
+
+ShadowCache :: struct {
+    // The static casters of every cascade.
+    image: gpu.Image,
+    framebuffers: [SHADOW_CASCADES]gpu.FrameBuffer,
+    // The shadow render pass, except that it keeps what the copy put in the shadow map.
+    load_renderpass: gpu.RenderPass,
+
+    enabled: bool,
+    valid: [SHADOW_CASCADES]bool,
+    // What the cached cascades were drawn with. Centers are in light space.
+    centers: [SHADOW_CASCADES]vec3,
+    extents: [SHADOW_CASCADES]f32,
+    light_direction: vec3,
+    static_hash: u64,
+    // Cascades redrawn since startup, for the stats.
+    redraws: int,
+}
+
+shadow_cache_init :: proc(cache: ^ShadowCache, r: ^Renderer3D) {
+    cache.load_renderpass = gpu.create_render_pass({
+        tag = "Shadow Load Pass",
+        device = &r.device,
+        attachments = {
+            {
+                tag            = "Depth",
+                format         = .D32_SFLOAT,
+                load_op        = .Load,
+                store_op       = .Store,
+                samples        = 1,
+                initial_layout = .DepthStencilAttachmentOptimal,
+                final_layout   = .DepthStencilAttachmentOptimal,
+            },
+        },
+        subpasses = {
+            {
+                depth_stencil_attachment = gpu.RenderPassAttachmentRef {
+                    attachment = 0, layout = .DepthStencilAttachmentOptimal,
+                },
+            }
+        }
+    }, true)
+
+    cache.image = gpu.create_image({
+        tag = "Shadow Cache",
+        device = &r.device,
+        width = SHADOW_MAP_RES,
+        height = SHADOW_MAP_RES,
+        layer_count = SHADOW_CASCADES,
+        format = .D32_SFLOAT,
+        usage = {.DepthStencilAttachment, .TransferSrc},
+        final_layout = .TransferSrcOptimal,
+    })
+    cache.framebuffers = create_cascade_framebuffers(r, cache.image)
+    cache.enabled = true
+}
+
+shadow_cache_deinit :: proc(cache: ^ShadowCache) {
+    for &framebuffer in cache.framebuffers {
+        gpu.destroy_framebuffer(&framebuffer)
+    }
+    gpu.destroy_image(&cache.image)
+}
+
+// One framebuffer per cascade, on a view of its layer of `image`.
+create_cascade_framebuffers :: proc(r: ^Renderer3D, image: gpu.Image) -> (framebuffers: [SHADOW_CASCADES]gpu.FrameBuffer) {
+    for i in 0..<SHADOW_CASCADES {
+        view := gpu.create_image_view(image, {
+            device = &r.device,
+            format = image.spec.format,
+            view_type = .D2_Array,
+            base_layer_index = i,
+            layer_count = 1,
+        })
+
+        // NOTE(minebill): The framebuffer only really cares about the view, so we
+        // just create a dumb struct here with just a view.
+        layer := gpu.Image {
+            view = view,
+        }
+
+        framebuffers[i] = gpu.create_framebuffer_from_images({
+            device = &r.device,
+            width = SHADOW_MAP_RES,
+            height = SHADOW_MAP_RES,
+            renderpass = r.shadow_renderpass,
+        }, []gpu.Image {layer})
+    }
+    return
+}
+
+// Returns the light view and projection of a cascade that covers `corners`, and whether its static
+// casters have to be redrawn. Without the cache the cascade follows the camera, one texel at a time.
+shadow_cache_fit_cascade :: proc(
+    cache: ^ShadowCache,
+    split: int,
+    corners: [8]vec4,
+    direction: vec3,
+    static_hash: u64,
+) -> (view, projection: mat4, redraw: bool) {
+    center := vec3{}
+    for corner in corners {
+        center += corner.xyz
+    }
+    center /= len(corners)
+
+    radius: f32
+    for corner in corners {
+        radius = max(radius, linalg.length(corner.xyz - center))
+    }
+    // Rounded up, so floating point noise doesn't resize the cascade.
+    radius = math.ceil(radius * 16) / 16
+    margin := radius * SHADOW_CACHE_MARGIN if cache.enabled else 0
+    extent := radius + margin
+
+    up := vec3{0, 1, 0}
+    if abs(linalg.dot(direction, up)) > 0.99 {
+        up = vec3{0, 0, 1}
+    }
+    view = linalg.matrix4_look_at_f32(direction, vec3{}, up)
+
+    texel := 2 * extent / SHADOW_MAP_RES
+    light_center := (view * vec4{center.x, center.y, center.z, 1}).xyz
+    light_center.x = math.floor(light_center.x / texel) * texel
+    light_center.y = math.floor(light_center.y / texel) * texel
+    light_center.z = math.floor(light_center.z / texel) * texel
+
+    redraw = !cache.valid[split] ||
+        cache.extents[split] != extent ||
+        cache.static_hash != static_hash ||
+        linalg.dot(cache.light_direction, direction) < SHADOW_CACHE_DIRECTION_EPSILON
+    if !redraw {
+        offset := linalg.abs(light_center - cache.centers[split])
+        redraw = offset.x > margin || offset.y > margin || offset.z > margin
+    }
+    if redraw {
+        cache.centers[split] = light_center
+        cache.extents[split] = extent
+        cache.valid[split] = cache.enabled
+    }
+
+    c := cache.centers[split]
+    projection = linalg.matrix_ortho3d_f32(
+        left = c.x - extent,
+        right = c.x + extent,
+        bottom = c.y - extent,
+        top = c.y + extent,
+        near = -c.z - extent * SHADOW_DEPTH_RANGE,
+        far = -c.z + extent)
+    return
+}
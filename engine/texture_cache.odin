@@ -0,0 +1,161 @@
+package engine
+import "core:os"
+import "core:mem"
+import "core:mem/virtual"
+import "core:path/filepath"
+import "core:time"
+import fs "filesystem"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Cooked textures are written to the project cache folder after an image is imported, with their whole
+// mip chain already block compressed (see texture_processing.odin). The next load maps the file and copies
+// the levels straight into the staging ring, there is nothing left to decode.
+//
+// The layout follows KTX2, minus the data format descriptor and the key/value data:
+//  | CookedTextureHeader | levels: [level_count]TextureLevel | level data, largest level first |
+// Level offsets are relative to `data_offset`, which is aligned to COOKED_TEXTURE_ALIGNMENT.
+
+COOKED_TEXTURE_MAGIC :: u32(0x32584554) // "TEX2"
+// Bump when the format, the encoders or gpu.ImageFormat change, older files get recooked.
+COOKED_TEXTURE_VERSION :: 1
+COOKED_TEXTURE_EXTENSION :: ".ktex"
+@(private = "file")
+COOKED_TEXTURE_ALIGNMENT :: 16
+// Anything bigger in a cooked file is garbage, no device supports it.
+@(private = "file")
+MAX_COOKED_TEXTURE_SIZE :: 16384
+
+CookedTextureHeader :: struct {
+    magic: u32,
+    version: u32,
+    // A gpu.ImageFormat.
+    format: u32,
+    width: u32,
+    height: u32,
+    level_count: u32,
+
+    // Offsets from the start of the file.
+    levels_offset: u64,
+    data_offset: u64,
+}
+
+CookedTexture :: struct {
+    file: []byte,
+    // Points into `file`, only valid until close_cooked_texture.
+    data: TextureData,
+}
+
+// Maps the cooked version of `source_path`. Fails if there is none, it's older than the source or it's
+// not a valid cooked texture for this version of the engine.
+open_cooked_texture :: proc(source_path: string) -> (texture: CookedTexture, ok: bool) {
+    tracy.Zone()
+    cooked_path := cooked_asset_path(source_path, COOKED_TEXTURE_EXTENSION)
+
+    if !os.exists(cooked_path) {
+        return
+    }
+    source_info, _ := os.stat(source_path, context.temp_allocator)
+    cooked_info, _ := os.stat(cooked_path, context.temp_allocator)
+    if time.diff(source_info.modification_time, cooked_info.modification_time) < 0 {
+        return
+    }
+
+    file, err := virtual.map_file_from_path(cooked_path, {.Read})
+    if err != .None {
+        log_warning(LC.AssetSystem, "Could not map cooked texture '%v': %v", cooked_path, err)
+        return
+    }
+    texture.file = file
+    defer if !ok do close_cooked_texture(&texture)
+
+    if len(file) < size_of(CookedTextureHeader) {
+        return
+    }
+    header := (^CookedTextureHeader)(raw_data(file))^
+    if header.magic != COOKED_TEXTURE_MAGIC ||
+        header.version != COOKED_TEXTURE_VERSION ||
+        header.format > u32(max(gpu.ImageFormat)) ||
+        header.width == 0 || header.height == 0 ||
+        header.level_count == 0 {
+        return
+    }
+
+    levels_size := u64(header.level_count) * size_of(TextureLevel)
+    if header.levels_offset + levels_size > u64(len(file)) || header.data_offset > u64(len(file)) {
+        log_warning(LC.AssetSystem, "Cooked texture '%v' is truncated, it will be recooked.", cooked_path)
+        return
+    }
+
+    // Cooking always writes the full chain.
+    if header.width > MAX_COOKED_TEXTURE_SIZE || header.height > MAX_COOKED_TEXTURE_SIZE ||
+        int(header.level_count) != texture_mip_count(int(header.width), int(header.height)) {
+        log_warning(LC.AssetSystem, "Cooked texture '%v' has an invalid size, it will be recooked.", cooked_path)
+        return
+    }
+
+    format := gpu.ImageFormat(header.format)
+    levels := mem.slice_ptr((^TextureLevel)(&file[header.levels_offset]), int(header.level_count))
+    data := file[header.data_offset:]
+    for level, i in levels {
+        // The size has to match exactly, the upload copies `size` bytes into a level of that extent.
+        w := max(int(header.width) >> uint(i), 1)
+        h := max(int(header.height) >> uint(i), 1)
+        if level.size != u64(texture_level_size(format, w, h)) {
+            log_warning(LC.AssetSystem, "Cooked texture '%v' has an invalid level %v, it will be recooked.", cooked_path, i)
+            return
+        }
+        if level.offset + level.size > u64(len(data)) {
+            log_warning(LC.AssetSystem, "Cooked texture '%v' is truncated, it will be recooked.", cooked_path)
+            return
+        }
+    }
+
+    texture.data = TextureData {
+        format = format,
+        width = int(header.width),
+        height = int(header.height),
+        levels = levels,
+        data = data,
+    }
+    return texture, true
+}
+
+close_cooked_texture :: proc(texture: ^CookedTexture) {
+    if texture.file != nil {
+        virtual.release(raw_data(texture.file), uint(len(texture.file)))
+    }
+    texture^ = {}
+}
+
+write_cooked_texture :: proc(source_path: string, data: TextureData) -> bool {
+    tracy.Zone()
+    cooked_path := cooked_asset_path(source_path, COOKED_TEXTURE_EXTENSION)
+    fs.make_directory_recursive(filepath.dir(cooked_path, context.temp_allocator))
+
+    header := CookedTextureHeader {
+        magic = COOKED_TEXTURE_MAGIC,
+        version = COOKED_TEXTURE_VERSION,
+        format = u32(data.format),
+        width = u32(data.width),
+        height = u32(data.height),
+        level_count = u32(len(data.levels)),
+    }
+
+    levels_bytes := mem.slice_to_bytes(data.levels)
+
+    header.levels_offset = u64(mem.align_forward_int(size_of(CookedTextureHeader), COOKED_TEXTURE_ALIGNMENT))
+    header.data_offset = u64(mem.align_forward_int(int(header.levels_offset) + len(levels_bytes), COOKED_TEXTURE_ALIGNMENT))
+
+    file := make([]byte, int(header.data_offset) + len(data.data))
+    defer delete(file)
+    copy(file, mem.ptr_to_bytes(&header))
+    copy(file[header.levels_offset:], levels_bytes)
+    copy(file[header.data_offset:], data.data)
+
+    if !os.write_entire_file(cooked_path, file) {
+        log_warning(LC.AssetSystem, "Could not write cooked texture to '%v'", cooked_path)
+        return false
+    }
+    return true
+}
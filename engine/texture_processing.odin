@@ -0,0 +1,486 @@
+package engine
+import "core:math"
+import "core:math/linalg"
+import "core:mem"
+import "core:path/filepath"
+import "core:strings"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Import time texture processing. Textures are cooked once (see texture_cache.odin) and uploaded as is:
+//  1. generate_mip: builds the mip chain with a box filter. Normal maps are renormalized at every level,
+//     otherwise they get shorter, and the surface flatter, in the distance.
+//  2. encode_level: block compresses every level on the CPU, in the format `choose_texture_format` picks.
+//     Normal maps go to BC5, which only keeps X and Y (shaders rebuild Z, see `sample_material_normal`),
+//     textures with alpha to BC7 or BC3 and everything else to BC1.
+// Devices without BC support get the mip chain as RGBA8.
+//
+// The BC7 encoder only uses mode 6 (one subset, RGBA endpoints), which is simple and already looks a lot
+// better than BC3 at the same size. The BC1 and BC7 endpoints start on the principal axis of the block
+// and get one least squares refinement, BC4 (the alpha of BC3 and both channels of BC5) uses the range.
+
+// Mode 6 BC7 takes a while longer to encode than BC3.
+TEXTURE_COOK_BC7 :: #config(TEXTURE_COOK_BC7, true)
+
+// Fraction of texels that have to decode to unit vectors for a texture to be treated as a normal map.
+@(private = "file")
+NORMAL_MAP_THRESHOLD :: 0.95
+@(private = "file")
+NORMAL_MAP_TOLERANCE :: 0.1
+
+// Like the level index of a KTX2 file. Offsets are relative to `TextureData.data`.
+TextureLevel :: struct {
+    offset: u64,
+    size: u64,
+}
+
+// CPU side texture data, ready to be uploaded. Either freshly cooked or pointing straight into a memory
+// mapped cooked texture. The first level is the full size one.
+TextureData :: struct {
+    format: gpu.ImageFormat,
+    width, height: int,
+    levels: []TextureLevel,
+    data: []byte,
+}
+
+// Builds the mip chain of `texels` and encodes every level. The result is allocated with `allocator`,
+// see destroy_texture_data.
+cook_texture :: proc(
+    texels: [][4]u8,
+    width, height: int,
+    normal_map: bool,
+    compress: bool,
+    allocator := context.allocator,
+) -> (data: TextureData) {
+    tracy.Zone()
+    data.format = choose_texture_format(texels, normal_map, compress)
+    data.width = width
+    data.height = height
+
+    level_count := texture_mip_count(width, height)
+    data.levels = make([]TextureLevel, level_count, allocator)
+
+    size: u64
+    for &level, i in data.levels {
+        level.offset = size
+        level.size = u64(texture_level_size(data.format, max(width >> uint(i), 1), max(height >> uint(i), 1)))
+        size += level.size
+    }
+    data.data = make([]byte, size, allocator)
+
+    current := texels
+    w, h := width, height
+    for level, i in data.levels {
+        encode_level(data.format, current, w, h, data.data[int(level.offset):][:int(level.size)])
+        if i == level_count - 1 do break
+
+        next_w, next_h := max(w / 2, 1), max(h / 2, 1)
+        next := make([][4]u8, next_w * next_h)
+        generate_mip(current, w, h, next, normal_map)
+        if raw_data(current) != raw_data(texels) {
+            delete(current)
+        }
+        current, w, h = next, next_w, next_h
+    }
+    if raw_data(current) != raw_data(texels) {
+        delete(current)
+    }
+    return
+}
+
+destroy_texture_data :: proc(data: ^TextureData, allocator := context.allocator) {
+    delete(data.levels, allocator)
+    delete(data.data, allocator)
+    data^ = {}
+}
+
+// Levels in a full mip chain, down to 1x1.
+texture_mip_count :: proc(width, height: int) -> int {
+    return 1 + int(math.floor(math.log2(f32(max(width, height)))))
+}
+
+texture_level_size :: proc(format: gpu.ImageFormat, width, height: int) -> int {
+    if block_size := gpu.format_block_size(format); block_size > 0 {
+        return ((width + 3) / 4) * ((height + 3) / 4) * block_size
+    }
+    return width * height * 4
+}
+
+// There are no per texture import settings yet, so normal maps are recognised by their name or by almost
+// all of their texels decoding to unit vectors that point out of the surface.
+texture_is_normal_map :: proc(path: string, texels: [][4]u8) -> bool {
+    name := strings.to_lower(filepath.stem(path), context.temp_allocator)
+    if strings.contains(name, "normal") do return true
+    if len(texels) == 0 do return false
+
+    unit_texels := 0
+    for t in texels {
+        n := vec3{f32(t.r), f32(t.g), f32(t.b)} / 127.5 - 1
+        if n.z > 0 && abs(linalg.length(n) - 1) < NORMAL_MAP_TOLERANCE {
+            unit_texels += 1
+        }
+    }
+    return f32(unit_texels) >= f32(len(texels)) * NORMAL_MAP_THRESHOLD
+}
+
+choose_texture_format :: proc(texels: [][4]u8, normal_map, compress: bool) -> gpu.ImageFormat {
+    if !compress do return .R8G8B8A8_UNORM
+    if normal_map do return .BC5_UNORM
+    for t in texels do if t.a < 255 {
+        return .BC7_UNORM if TEXTURE_COOK_BC7 else .BC3_UNORM
+    }
+    return .BC1_UNORM
+}
+
+// Every texel of `dst` is the average of the 2x2 texels of `src` under it. The engine samples every
+// texture as UNORM, so the average is taken on the stored values.
+@(private = "file")
+generate_mip :: proc(src: [][4]u8, width, height: int, dst: [][4]u8, normal_map: bool) {
+    tracy.Zone()
+    dst_width, dst_height := max(width / 2, 1), max(height / 2, 1)
+    for y in 0..<dst_height do for x in 0..<dst_width {
+        x0, x1 := min(x * 2, width - 1), min(x * 2 + 1, width - 1)
+        y0, y1 := min(y * 2, height - 1), min(y * 2 + 1, height - 1)
+
+        sum: vec4
+        for t in ([4][4]u8{src[y0 * width + x0], src[y0 * width + x1], src[y1 * width + x0], src[y1 * width + x1]}) {
+            sum += texel_to_vec4(t)
+        }
+        average := sum / 4
+
+        if normal_map {
+            n := average.xyz / 127.5 - 1
+            if length := linalg.length(n); length > 0 {
+                n /= length
+            }
+            n = (n + 1) * 127.5
+            average = {n.x, n.y, n.z, average.a}
+        }
+        dst[y * dst_width + x] = vec4_to_texel(average)
+    }
+}
+
+@(private = "file")
+encode_level :: proc(format: gpu.ImageFormat, texels: [][4]u8, width, height: int, out: []byte) {
+    tracy.Zone()
+    block_size := gpu.format_block_size(format)
+    if block_size == 0 {
+        copy(out, mem.slice_to_bytes(texels))
+        return
+    }
+
+    blocks_x, blocks_y := (width + 3) / 4, (height + 3) / 4
+    for by in 0..<blocks_y do for bx in 0..<blocks_x {
+        // Blocks that hang over the edge repeat the last row/column, the extra texels are never sampled.
+        block: [16]vec4
+        for &texel, i in block {
+            x := min(bx * 4 + i % 4, width - 1)
+            y := min(by * 4 + i / 4, height - 1)
+            texel = texel_to_vec4(texels[y * width + x])
+        }
+
+        dst := out[(by * blocks_x + bx) * block_size:][:block_size]
+        #partial switch format {
+        case .BC1_UNORM:
+            encode_bc1(block, dst)
+        case .BC3_UNORM:
+            alpha: [16]f32
+            for texel, i in block do alpha[i] = texel.a
+            encode_bc4(alpha, dst[:8])
+            encode_bc1(block, dst[8:])
+        case .BC5_UNORM:
+            red, green: [16]f32
+            for texel, i in block {
+                red[i], green[i] = texel.r, texel.g
+            }
+            encode_bc4(red, dst[:8])
+            encode_bc4(green, dst[8:])
+        case .BC7_UNORM:
+            encode_bc7(block, dst)
+        case:
+            unreachable()
+        }
+    }
+}
+
+// 4 colour mode BC1, the only mode BC3 understands.
+@(private = "file")
+encode_bc1 :: proc(block: [16]vec4, out: []byte) {
+    BC1_WEIGHTS := [4]f32{0, 1, 1.0 / 3.0, 2.0 / 3.0}
+
+    points := block
+    for &p in points do p.a = 0
+
+    a, b := fit_line(points[:])
+    best_error := max(f32)
+    c0, c1: u16
+    indices: [16]u32
+    for iteration in 0..<2 {
+        try_c0, try_c1 := pack_565(a), pack_565(b)
+        p0, p1 := unpack_565(try_c0), unpack_565(try_c1)
+        palette := [4]vec4{p0, p1, (p0 * 2 + p1) / 3, (p0 + p1 * 2) / 3}
+
+        error: f32
+        try_indices: [16]u32
+        weights: [16]f32
+        for p, i in points {
+            index, e := nearest_color(palette[:], p)
+            try_indices[i] = index
+            weights[i] = BC1_WEIGHTS[index]
+            error += e
+        }
+        if error < best_error {
+            best_error = error
+            c0, c1, indices = try_c0, try_c1, try_indices
+        }
+        if iteration == 0 {
+            refine_line(points[:], weights[:], &a, &b)
+        }
+    }
+
+    // c0 <= c1 would select the 3 colour mode. Swapping the endpoints swaps index 0 with 1 and 2 with 3.
+    if c0 < c1 {
+        c0, c1 = c1, c0
+        for &index in indices do index ~= 1
+    } else if c0 == c1 {
+        indices = {}
+    }
+
+    bits: u32
+    for index, i in indices {
+        bits |= index << uint(2 * i)
+    }
+    out[0], out[1] = u8(c0), u8(c0 >> 8)
+    out[2], out[3] = u8(c1), u8(c1 >> 8)
+    for i in 0..<4 do out[4 + i] = u8(bits >> uint(8 * i))
+}
+
+// One channel, in the 8 value mode.
+@(private = "file")
+encode_bc4 :: proc(values: [16]f32, out: []byte) {
+    lo, hi := values[0], values[0]
+    for v in values {
+        lo, hi = min(lo, v), max(hi, v)
+    }
+    a0, a1 := u8(math.round(hi)), u8(math.round(lo))
+    out[0], out[1] = a0, a1
+
+    bits: u64
+    if a0 > a1 {
+        palette: [8]f32
+        palette[0], palette[1] = f32(a0), f32(a1)
+        for i in 1..=6 {
+            palette[i + 1] = (f32(7 - i) * f32(a0) + f32(i) * f32(a1)) / 7
+        }
+        for v, i in values {
+            best, best_error := 0, max(f32)
+            for p, j in palette do if abs(p - v) < best_error {
+                best, best_error = j, abs(p - v)
+            }
+            bits |= u64(best) << uint(3 * i)
+        }
+    }
+    for i in 0..<6 do out[2 + i] = u8(bits >> uint(8 * i))
+}
+
+// Mode 6: one subset, 7 bit RGBA endpoints with a shared lowest bit each and 4 bit indices.
+@(private = "file")
+encode_bc7 :: proc(block: [16]vec4, out: []byte) {
+    BC7_WEIGHTS := [16]u32{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64}
+
+    a, b := fit_line(block[:])
+    best_error := max(f32)
+    e0, e1: [4]u32
+    p0, p1: u32
+    indices: [16]u32
+    for iteration in 0..<2 {
+        try_e0, try_p0 := quantize_bc7_endpoint(a)
+        try_e1, try_p1 := quantize_bc7_endpoint(b)
+
+        q0, q1: [4]u32
+        for c in 0..<4 {
+            q0[c] = try_e0[c] << 1 | try_p0
+            q1[c] = try_e1[c] << 1 | try_p1
+        }
+        palette: [16]vec4
+        for w, i in BC7_WEIGHTS do for c in 0..<4 {
+            palette[i][c] = f32(((64 - w) * q0[c] + w * q1[c] + 32) >> 6)
+        }
+
+        error: f32
+        try_indices: [16]u32
+        weights: [16]f32
+        for p, i in block {
+            index, e := nearest_color(palette[:], p)
+            try_indices[i] = index
+            weights[i] = f32(BC7_WEIGHTS[index]) / 64
+            error += e
+        }
+        if error < best_error {
+            best_error = error
+            e0, e1, p0, p1, indices = try_e0, try_e1, try_p0, try_p1, try_indices
+        }
+        if iteration == 0 {
+            refine_line(block[:], weights[:], &a, &b)
+        }
+    }
+
+    // The index of the first texel is stored without its top bit, which has to be 0.
+    if indices[0] >= 8 {
+        e0, e1 = e1, e0
+        p0, p1 = p1, p0
+        for &index in indices do index = 15 - index
+    }
+
+    bits := u128(1) << 6
+    shift := uint(7)
+    write :: proc(bits: ^u128, shift: ^uint, value: u32, count: uint) {
+        bits^ |= u128(value) << shift^
+        shift^ += count
+    }
+    for c in 0..<4 {
+        write(&bits, &shift, e0[c], 7)
+        write(&bits, &shift, e1[c], 7)
+    }
+    write(&bits, &shift, p0, 1)
+    write(&bits, &shift, p1, 1)
+    write(&bits, &shift, indices[0], 3)
+    for i in 1..<16 {
+        write(&bits, &shift, indices[i], 4)
+    }
+    assert(shift == 128)
+    for i in 0..<16 do out[i] = u8(bits >> uint(8 * i))
+}
+
+// The line through `points` that fits them best (their principal axis), clipped to the points.
+@(private = "file")
+fit_line :: proc(points: []vec4) -> (a, b: vec4) {
+    mean, lo, hi: vec4
+    lo, hi = points[0], points[0]
+    for p in points {
+        mean += p
+        for c in 0..<4 {
+            lo[c], hi[c] = min(lo[c], p[c]), max(hi[c], p[c])
+        }
+    }
+    mean /= f32(len(points))
+
+    covariance: [4][4]f32
+    for p in points {
+        d := p - mean
+        for i in 0..<4 do for j in 0..<4 {
+            covariance[i][j] += d[i] * d[j]
+        }
+    }
+
+    // Power iteration, starting from the diagonal of the bounding box.
+    axis := hi - lo
+    if linalg.dot(axis, axis) == 0 {
+        return mean, mean
+    }
+    for _ in 0..<8 {
+        next: vec4
+        for i in 0..<4 do for j in 0..<4 {
+            next[i] += covariance[i][j] * axis[j]
+        }
+        largest := max(abs(next.x), abs(next.y), abs(next.z), abs(next.w))
+        if largest == 0 do break
+        axis = next / largest
+    }
+
+    t_min, t_max := max(f32), min(f32)
+    for p in points {
+        t := linalg.dot(p - mean, axis)
+        t_min, t_max = min(t_min, t), max(t_max, t)
+    }
+    length2 := linalg.dot(axis, axis)
+    a = clamp_color(mean + axis * (t_min / length2))
+    b = clamp_color(mean + axis * (t_max / length2))
+    return
+}
+
+// Least squares endpoints for the points, given the weight of `b` in the colour each one got.
+@(private = "file")
+refine_line :: proc(points: []vec4, weights: []f32, a, b: ^vec4) {
+    aa, bb, ab: f32
+    ax, bx: vec4
+    for p, i in points {
+        beta := weights[i]
+        alpha := 1 - beta
+        aa += alpha * alpha
+        bb += beta * beta
+        ab += alpha * beta
+        ax += p * alpha
+        bx += p * beta
+    }
+
+    determinant := aa * bb - ab * ab
+    if abs(determinant) < 1e-6 do return
+    a^ = clamp_color((ax * bb - bx * ab) / determinant)
+    b^ = clamp_color((bx * aa - ax * ab) / determinant)
+}
+
+@(private = "file")
+nearest_color :: proc(palette: []vec4, color: vec4) -> (index: u32, error: f32) {
+    error = max(f32)
+    for p, i in palette {
+        d := p - color
+        if e := linalg.dot(d, d); e < error {
+            index, error = u32(i), e
+        }
+    }
+    return
+}
+
+// Picks the lowest bit that gets the endpoint closest to `color`.
+@(private = "file")
+quantize_bc7_endpoint :: proc(color: vec4) -> (endpoint: [4]u32, p: u32) {
+    best_error := max(f32)
+    for try_p in u32(0)..=1 {
+        try_endpoint: [4]u32
+        error: f32
+        for c in 0..<4 {
+            try_endpoint[c] = u32(clamp(math.round((color[c] - f32(try_p)) / 2), 0, 127))
+            d := f32(try_endpoint[c] << 1 | try_p) - color[c]
+            error += d * d
+        }
+        if error < best_error {
+            best_error = error
+            endpoint, p = try_endpoint, try_p
+        }
+    }
+    return
+}
+
+@(private = "file")
+pack_565 :: proc(color: vec4) -> u16 {
+    r := u16(math.round(color.r * 31 / 255))
+    g := u16(math.round(color.g * 63 / 255))
+    b := u16(math.round(color.b * 31 / 255))
+    return r << 11 | g << 5 | b
+}
+
+@(private = "file")
+unpack_565 :: proc(color: u16) -> vec4 {
+    r, g, b := (color >> 11) & 31, (color >> 5) & 63, color & 31
+    return {f32(r << 3 | r >> 2), f32(g << 2 | g >> 4), f32(b << 3 | b >> 2), 0}
+}
+
+@(private = "file")
+clamp_color :: proc(color: vec4) -> (clamped: vec4) {
+    for c in 0..<4 {
+        clamped[c] = clamp(color[c], 0, 255)
+    }
+    return
+}
+
+@(private = "file")
+texel_to_vec4 :: proc(t: [4]u8) -> vec4 {
+    return {f32(t.r), f32(t.g), f32(t.b), f32(t.a)}
+}
+
+@(private = "file")
+vec4_to_texel :: proc(v: vec4) -> [4]u8 {
+    v := clamp_color(v)
+    return {u8(v.r + 0.5), u8(v.g + 0.5), u8(v.b + 0.5), u8(v.a + 0.5)}
+}
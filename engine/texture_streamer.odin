@@ -0,0 +1,318 @@
+package engine
+import "core:math"
+import "core:math/linalg"
+import "core:mem"
+import "core:slice"
+import "gpu"
+import tracy "packages:odin-tracy"
+
+// Texture streaming. Cooked textures (see texture_cache.odin) keep their file mapped and start out with only
+// their smallest levels resident. Every frame the renderers that survived culling ask for the levels their
+// textures need, from how much of the screen they cover, and the streamer moves textures towards that within
+// a budget shared by all of them:
+//  - Textures missing the most levels get them first, as long as they fit and the frame's upload limit
+//    isn't reached.
+//  - To make room, textures with levels nobody asked for this frame lose them, least recently used first.
+//  - While still over budget, the biggest textures lose their top level, even if they are in use.
+// The budget is the configured one or whatever the device local heaps have left for textures, from VMA's
+// heap budgets, whichever is smaller.
+//
+// An image can't gain or lose levels, so changing them creates a new image with just the resident levels,
+// fills it from the mapped file and retires the old one. Retired images are destroyed once the frames that
+// might still sample them are done. The material table gives the new image a slot the next time the
+// material is extracted.
+
+// Levels up to this size are always resident, so textures never show up blank.
+STREAMING_MIN_RESIDENT_SIZE :: 64
+// Per frame, so turning the camera doesn't stall a frame on the staging ring.
+STREAMING_UPLOAD_LIMIT :: 16 * mem.Megabyte
+DEFAULT_TEXTURE_BUDGET :: 512 * mem.Megabyte
+
+StreamedTexture :: struct {
+    texture: ^Texture2D,
+    cooked: CookedTexture,
+    // Finest resident level.
+    resident_mip: int,
+    // Finest level that is always resident.
+    min_mip: int,
+    // Finest level a visible renderer asked for this frame.
+    wanted_mip: int,
+    // Frame a visible renderer last used it.
+    last_used: u64,
+}
+
+TextureStreamerStats :: struct {
+    textures: int,
+    resident_bytes: int,
+    // What resident_bytes would be with every level of every texture resident.
+    full_bytes: int,
+    budget: int,
+    // Levels that visible renderers asked for but didn't get.
+    missing_mips: int,
+    // This frame.
+    uploaded_bytes, evicted_bytes: int,
+}
+
+TextureStreamer :: struct {
+    // Without streaming every texture gets all of its levels, regardless of the budget.
+    enabled: bool,
+    // In bytes, for all streamed textures together.
+    budget: int,
+
+    textures: [dynamic]^StreamedTexture,
+    retired: [dynamic]RetiredImage,
+    frame: u64,
+    stats: TextureStreamerStats,
+}
+
+@(private = "file")
+RetiredImage :: struct {
+    image: gpu.Image,
+    frame: u64,
+}
+
+texture_streamer_init :: proc(s: ^TextureStreamer) {
+    s.enabled = true
+    s.budget = DEFAULT_TEXTURE_BUDGET
+}
+
+texture_streamer_deinit :: proc(s: ^TextureStreamer) {
+    for &retired in s.retired {
+        gpu.destroy_image(&retired.image)
+    }
+    for t in s.textures {
+        close_cooked_texture(&t.cooked)
+        t.texture.stream = nil
+        free(t)
+    }
+    delete(s.retired)
+    delete(s.textures)
+}
+
+// A texture with just the levels up to STREAMING_MIN_RESIDENT_SIZE. It takes ownership of `cooked`, and
+// streams once it's added with texture_streamer_add.
+create_streamed_texture2d :: proc(cooked: CookedTexture) -> (texture: Texture2D) {
+    stream := new(StreamedTexture)
+    stream.cooked = cooked
+
+    data := cooked.data
+    for stream.min_mip < len(data.levels) - 1 &&
+        max(data.width, data.height) >> uint(stream.min_mip) > STREAMING_MIN_RESIDENT_SIZE {
+        stream.min_mip += 1
+    }
+    stream.resident_mip = stream.min_mip
+    stream.wanted_mip = stream.min_mip
+
+    texture = create_texture2d_from_data(data, stream.min_mip)
+    texture.stream = stream
+    return
+}
+
+// Called once the texture has its final address.
+texture_streamer_add :: proc(s: ^TextureStreamer, texture: ^Texture2D) {
+    texture.stream.texture = texture
+    append(&s.textures, texture.stream)
+}
+
+// Stops streaming `texture` before it goes away. Its image is retired like any other, since frames in flight
+// might still sample it, and the cooked file is closed.
+texture_streamer_remove :: proc(s: ^TextureStreamer, texture: ^Texture2D) {
+    t := texture.stream
+    if t == nil do return
+
+    if index, found := slice.linear_search(s.textures[:], t); found {
+        unordered_remove(&s.textures, index)
+    }
+    append(&s.retired, RetiredImage{texture.handle, s.frame})
+    texture.handle = {}
+
+    close_cooked_texture(&t.cooked)
+    texture.stream = nil
+    free(t)
+}
+
+// Asks for the levels the textures of `renderers` need. The level comes from the screen size of the mesh
+// bounds, assuming the UVs of a mesh span its textures once.
+texture_streamer_gather :: proc(s: ^TextureStreamer, scene: ^World, renderers: []CullItem, camera: RenderCamera, screen_height: f32) {
+    tracy.Zone()
+    manager := &EngineInstance.asset_manager
+    view := make_draw_view(camera)
+
+    for item in renderers {
+        mr := item.renderer
+        mesh := get_asset(manager, mr.mesh, Mesh)
+        if mesh == nil do continue
+        go := get_object(scene, item.owner)
+        if go == nil do continue
+        material := get_asset(manager, mr.material, PbrMaterial)
+        if material == nil do continue
+
+        bounds := aabb_transform(mesh.bounds, transform_world_matrix(go))
+        center := aabb_center(bounds)
+        radius := linalg.length(bounds.max - center)
+        distance := linalg.length(center - view.position)
+
+        // Pixels covered by the bounding sphere, across.
+        pixels := max(f32)
+        if distance > radius {
+            pixels = radius * view.projection_scale / distance * screen_height
+        }
+
+        handles := [?]AssetHandle {
+            material.albedo_texture,
+            material.normal_texture,
+            material.ambient_occlusion_texture,
+            material.emissive_texture,
+            material.metallic_texture,
+        }
+        for handle in handles {
+            texture := get_asset(manager, handle, Texture2D)
+            if texture == nil || texture.stream == nil do continue
+
+            t := texture.stream
+            size := f32(max(texture.spec.width, texture.spec.height))
+            mip := 0
+            if pixels < size {
+                mip = int(math.floor(math.log2(size / max(pixels, 1))))
+            }
+            t.wanted_mip = min(t.wanted_mip, mip)
+            t.last_used = s.frame
+        }
+    }
+}
+
+// Adds and evicts levels for what was gathered this frame. Must run after the frame fence was waited on.
+texture_streamer_update :: proc(s: ^TextureStreamer, device: ^gpu.Device) {
+    tracy.Zone()
+    for i := 0; i < len(s.retired); {
+        if s.frame >= s.retired[i].frame + gpu.MAX_FRAMES_IN_FLIGHT {
+            gpu.destroy_image(&s.retired[i].image)
+            unordered_remove(&s.retired, i)
+        } else {
+            i += 1
+        }
+    }
+
+    s.stats = {textures = len(s.textures)}
+    for t in s.textures {
+        if !s.enabled {
+            t.wanted_mip = 0
+        }
+        s.stats.resident_bytes += resident_size(t, t.resident_mip)
+        s.stats.full_bytes += resident_size(t, 0)
+    }
+
+    // Everything else that lives in device local memory stays where it is, the textures get what's left.
+    memory := gpu.device_memory_budget(device)
+    s.stats.budget = min(s.budget, memory.budget - (memory.usage - s.stats.resident_bytes))
+    if !s.enabled {
+        s.stats.budget = max(int)
+    }
+
+    wanting := make([dynamic]^StreamedTexture, context.temp_allocator)
+    for t in s.textures do if t.wanted_mip < t.resident_mip {
+        append(&wanting, t)
+    }
+    slice.sort_by(wanting[:], proc(a, b: ^StreamedTexture) -> bool {
+        return a.resident_mip - a.wanted_mip > b.resident_mip - b.wanted_mip
+    })
+
+    for t in wanting {
+        // The new image gets all of its levels uploaded, not just the new ones. A frame always gets at
+        // least one texture a level further, or the biggest ones would never make it.
+        mip := t.wanted_mip
+        for mip < t.resident_mip && s.stats.uploaded_bytes > 0 &&
+            s.stats.uploaded_bytes + resident_size(t, mip) > STREAMING_UPLOAD_LIMIT {
+            mip += 1
+        }
+        if mip == t.resident_mip do break
+
+        needed := resident_size(t, mip) - resident_size(t, t.resident_mip)
+        if over := s.stats.resident_bytes + needed - s.stats.budget; over > 0 {
+            evict_unused(s, over, t)
+        }
+        for mip < t.resident_mip && s.stats.resident_bytes + resident_size(t, mip) - resident_size(t, t.resident_mip) > s.stats.budget {
+            mip += 1
+        }
+        if mip < t.resident_mip {
+            set_resident_mip(s, t, mip)
+        }
+    }
+
+    if s.stats.resident_bytes > s.stats.budget {
+        evict_unused(s, s.stats.resident_bytes - s.stats.budget, nil)
+    }
+    for s.stats.resident_bytes > s.stats.budget {
+        biggest: ^StreamedTexture
+        for t in s.textures do if t.resident_mip < t.min_mip {
+            if biggest == nil || level_size(t, t.resident_mip) > level_size(biggest, biggest.resident_mip) {
+                biggest = t
+            }
+        }
+        if biggest == nil do break
+        set_resident_mip(s, biggest, biggest.resident_mip + 1)
+    }
+
+    for t in s.textures {
+        s.stats.missing_mips += max(t.resident_mip - t.wanted_mip, 0)
+        t.wanted_mip = t.min_mip
+    }
+    s.frame += 1
+}
+
+// Drops the levels nobody asked for this frame, least recently used textures first, until `bytes` are freed.
+@(private = "file")
+evict_unused :: proc(s: ^TextureStreamer, bytes: int, keep: ^StreamedTexture) {
+    candidates := make([dynamic]^StreamedTexture, context.temp_allocator)
+    for t in s.textures do if t != keep && t.resident_mip < t.wanted_mip {
+        append(&candidates, t)
+    }
+    slice.sort_by(candidates[:], proc(a, b: ^StreamedTexture) -> bool {
+        if a.last_used != b.last_used {
+            return a.last_used < b.last_used
+        }
+        return a.wanted_mip - a.resident_mip > b.wanted_mip - b.resident_mip
+    })
+
+    freed := 0
+    for t in candidates {
+        if freed >= bytes do break
+        size := resident_size(t, t.resident_mip)
+        mip := t.resident_mip
+        for mip < t.wanted_mip && freed + size - resident_size(t, mip) < bytes {
+            mip += 1
+        }
+        freed += size - resident_size(t, mip)
+        set_resident_mip(s, t, mip)
+    }
+}
+
+@(private = "file")
+set_resident_mip :: proc(s: ^TextureStreamer, t: ^StreamedTexture, mip: int) {
+    tracy.Zone()
+    old_size := resident_size(t, t.resident_mip)
+    new_size := resident_size(t, mip)
+
+    append(&s.retired, RetiredImage{t.texture.handle, s.frame})
+    t.texture.handle = create_texture2d_from_data(t.cooked.data, mip).handle
+    t.resident_mip = mip
+
+    s.stats.resident_bytes += new_size - old_size
+    s.stats.uploaded_bytes += new_size
+    if new_size < old_size {
+        s.stats.evicted_bytes += old_size - new_size
+    }
+}
+
+// Of the levels from `mip` on.
+@(private = "file")
+resident_size :: proc(t: ^StreamedTexture, mip: int) -> int {
+    levels := t.cooked.data.levels
+    last := levels[len(levels) - 1]
+    return int(last.offset + last.size - levels[mip].offset)
+}
+
+@(private = "file")
+level_size :: proc(t: ^StreamedTexture, mip: int) -> int {
+    return int(t.cooked.data.levels[mip].size)
+}
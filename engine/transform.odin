@@ -0,0 +1,184 @@
+package engine
+import "core:math/linalg"
+import tracy "packages:odin-tracy"
+
+// Special case component, every entity has a transform. The transforms of a world live in its
+// TransformStore, this is the local part of a single one, used to copy and serialize them.
+@(component)
+TransformComponent :: struct {
+    local_position: vec3,
+    local_rotation: quat,
+    local_scale: vec3,
+}
+
+// The transforms of a world, as a struct of arrays indexed by `Entity.transform`. Every field has
+// its own array, so update_transforms walks packed positions, rotations and scales.
+//
+// Rotations are stored as quaternions, Euler angles are only a view for the editor.
+TransformStore :: struct {
+    local_positions: [dynamic]vec3,
+    local_rotations: [dynamic]quat,
+    local_scales: [dynamic]vec3,
+    // Written by update_transforms, from the local values and the parent's world matrix.
+    world_matrices: [dynamic]mat4,
+    // The entity of each transform, to fix up its index when another one is moved into its slot.
+    entities: [dynamic]EntityHandle,
+}
+
+// Adds an identity transform for `entity` and returns its index.
+transform_store_add :: proc(store: ^TransformStore, entity: EntityHandle) -> int {
+    append(&store.local_positions, vec3{})
+    append(&store.local_rotations, 1)
+    append(&store.local_scales, vec3{1, 1, 1})
+    append(&store.world_matrices, mat4(1))
+    append(&store.entities, entity)
+    return len(store.entities) - 1
+}
+
+// Removes the transform of a deleted entity. The last transform is moved into its slot.
+transform_store_remove :: proc(world: ^World, index: int) {
+    store := &world.transforms
+    last := len(store.entities) - 1
+    if index != last {
+        store.local_positions[index] = store.local_positions[last]
+        store.local_rotations[index] = store.local_rotations[last]
+        store.local_scales[index] = store.local_scales[last]
+        store.world_matrices[index] = store.world_matrices[last]
+        store.entities[index] = store.entities[last]
+
+        if moved := get_object(world, store.entities[index]); moved != nil {
+            moved.transform = index
+        }
+    }
+    pop(&store.local_positions)
+    pop(&store.local_rotations)
+    pop(&store.local_scales)
+    pop(&store.world_matrices)
+    pop(&store.entities)
+}
+
+transform_store_reserve :: proc(store: ^TransformStore, count: int) {
+    reserve(&store.local_positions, count)
+    reserve(&store.local_rotations, count)
+    reserve(&store.local_scales, count)
+    reserve(&store.world_matrices, count)
+    reserve(&store.entities, count)
+}
+
+transform_store_clone :: proc(store: TransformStore) -> TransformStore {
+    return {
+        local_positions = clone(store.local_positions),
+        local_rotations = clone(store.local_rotations),
+        local_scales = clone(store.local_scales),
+        world_matrices = clone(store.world_matrices),
+        entities = clone(store.entities),
+    }
+}
+
+transform_store_destroy :: proc(store: ^TransformStore) {
+    delete(store.local_positions)
+    delete(store.local_rotations)
+    delete(store.local_scales)
+    delete(store.world_matrices)
+    delete(store.entities)
+    store^ = {}
+}
+
+// The returned pointers point into the store of the entity's world and are only valid until
+// the next entity is created or deleted.
+transform_local_position :: proc(go: ^Entity) -> ^vec3 {
+    return &go.world.transforms.local_positions[go.transform]
+}
+
+transform_local_rotation :: proc(go: ^Entity) -> ^quat {
+    return &go.world.transforms.local_rotations[go.transform]
+}
+
+transform_local_scale :: proc(go: ^Entity) -> ^vec3 {
+    return &go.world.transforms.local_scales[go.transform]
+}
+
+// The world matrix as of the last update_transforms.
+transform_world_matrix :: proc(go: ^Entity) -> mat4 {
+    return go.world.transforms.world_matrices[go.transform]
+}
+
+// The world position as of the last update_transforms.
+transform_world_position :: proc(go: ^Entity) -> vec3 {
+    return go.world.transforms.world_matrices[go.transform][3].xyz
+}
+
+get_transform :: proc(go: ^Entity) -> TransformComponent {
+    store := &go.world.transforms
+    return {
+        local_position = store.local_positions[go.transform],
+        local_rotation = store.local_rotations[go.transform],
+        local_scale = store.local_scales[go.transform],
+    }
+}
+
+set_transform :: proc(go: ^Entity, transform: TransformComponent) {
+    store := &go.world.transforms
+    store.local_positions[go.transform] = transform.local_position
+    store.local_rotations[go.transform] = transform.local_rotation
+    store.local_scales[go.transform] = transform.local_scale
+}
+
+set_global_position :: proc(go: ^Entity, pos: vec3) {
+    parent := get_object(go.world, go.parent)
+    if parent == nil {
+        transform_local_position(go)^ = pos
+    } else {
+        // This assumes that the parents global position is correct
+        transform_local_position(go)^ = pos - transform_world_position(parent)
+    }
+}
+
+// Computes the world matrix of every transform in the world.
+update_transforms :: proc(world: ^World) {
+    tracy.Zone()
+    store := &world.transforms
+
+    // The local matrices don't depend on each other, a flat pass over the arrays.
+    locals := make([]mat4, len(store.entities), context.temp_allocator)
+    for i in 0..<len(locals) {
+        locals[i] = linalg.matrix4_from_trs(store.local_positions[i], store.local_rotations[i], store.local_scales[i])
+    }
+
+    // Then down the hierarchy, parents before their children.
+    update_world_matrix :: proc(world: ^World, locals: []mat4, handle: EntityHandle, parent: mat4) {
+        go := get_object(world, handle)
+        if go == nil do return
+
+        m := parent * locals[go.transform]
+        world.transforms.world_matrices[go.transform] = m
+        for child in go.children {
+            update_world_matrix(world, locals, child, m)
+        }
+    }
+    update_world_matrix(world, locals, world.root, mat4(1))
+}
+
+@(serializer=TransformComponent)
+serialize_transform :: proc(this: rawptr, serialize: bool, s: ^SerializeContext) {
+    this := cast(^TransformComponent)this
+    if serialize {
+        serialize_do_field(s, "LocalPosition", this.local_position)
+        // x, y, z, w.
+        serialize_do_field(s, "LocalOrientation", transmute(vec4)this.local_rotation)
+        serialize_do_field(s, "LocalScale", this.local_scale)
+    } else {
+        if position, ok := serialize_get_field(s, "LocalPosition", vec3); ok {
+            this.local_position = position
+        }
+        if orientation, ok := serialize_get_field(s, "LocalOrientation", vec4); ok {
+            this.local_rotation = transmute(quat)orientation
+        } else if euler, ok := serialize_get_field(s, "LocalRotation", vec3); ok {
+            // Files from before rotations were stored as quaternions.
+            this.local_rotation = euler_to_quat(euler)
+        }
+        if scale, ok := serialize_get_field(s, "LocalScale", vec3); ok {
+            this.local_scale = scale
+        }
+    }
+}